@@ -0,0 +1,130 @@
+/*
+ * AutoGainControl.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Fixed-point automatic gain control for the 8 kHz mic path, run on whole frames just before encoding.
+ * The gain is computed once per frame from the block RMS (and limited by the block peak so it cannot clip), then
+ * smoothed with a fast attack / slow release envelope and ramped linearly across the frame. Frames below the noise
+ * gate threshold freeze the gain, so background noise is never pumped up between words, and are attenuated.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+class AutoGainControl {
+public:
+  static const int32_t UNITY = 1 << 12;                 // gains are Q12
+
+  AutoGainControl() { reset(); }
+
+  void reset() {
+    _gain       = UNITY;
+    _gateGain   = UNITY;
+    _gateOpen   = false;
+    _clipped    = 0;
+    _clipFrames = 0;
+  }
+
+  // Target speech RMS, gain limits (Q12) and the gate threshold (RMS below which a frame counts as noise)
+  void setTarget(int32_t rms)                 { _target = rms; }
+  void setGainRange(int32_t minQ12, int32_t maxQ12) { _minGain = minQ12; _maxGain = maxQ12; }
+  void setGateThreshold(int32_t rms)          { _gateThreshold = rms; }
+
+  void process(int16_t* pcm, size_t n) {
+    if (n == 0) return;
+    int64_t energy = 0;
+    int32_t peak   = 0;
+    for (size_t i = 0; i < n; ++i) {
+      int32_t s = pcm[i];
+      energy += s * s;
+      if (s < 0) s = -s;
+      if (s > peak) peak = s;
+    }
+    int32_t rms = isqrt((uint32_t)(energy / (int64_t)n));
+
+    int32_t start     = _gain;
+    int32_t startGate = _gateGain;
+    _gateOpen = rms >= _gateThreshold;
+    if (_gateOpen) {
+      int32_t want = (int32_t)(((int64_t)_target << 12) / (rms > 0 ? rms : 1));
+      if (peak > 0) {
+        int32_t limit = (int32_t)(((int64_t)32767 << 12) / peak);
+        if (want > limit) want = limit;
+      }
+      if (want < _minGain) want = _minGain;
+      if (want > _maxGain) want = _maxGain;
+      _gain += smooth(want - _gain, n, want < _gain ? ATTACK_MS : RELEASE_MS);
+      _gateGain += smooth(UNITY - _gateGain, n, ATTACK_MS);
+    } else {
+      _gateGain += smooth(GATE_FLOOR - _gateGain, n, GATE_RELEASE_MS);
+    }
+
+    // ramp gain * gate up from the previous frame's value; a cut applies to the whole frame, since the peak that
+    // caused it may be anywhere in it
+    int32_t from = (int32_t)(((int64_t)start * startGate) >> 12);
+    int32_t to   = (int32_t)(((int64_t)_gain * _gateGain) >> 12);
+    if (to < from) from = to;
+    int32_t step = (to - from) / (int32_t)n;
+    int32_t g    = from;
+    bool clippedFrame = false;
+    for (size_t i = 0; i < n; ++i) {
+      g += step;
+      int32_t v = (pcm[i] * g + (1 << 11)) >> 12;
+      if (v > 32767 || v < -32768) {
+        v = v > 0 ? 32767 : -32768;
+        _clipped++;
+        clippedFrame = true;
+      }
+      pcm[i] = (int16_t)v;
+    }
+    if (clippedFrame) _clipFrames++;
+  }
+
+  // Telemetry
+  int32_t  gainQ12() const        { return _gain; }
+  float    gainDb() const         { return 20.0f * log10f((float)_gain / UNITY); }
+  bool     gateOpen() const       { return _gateOpen; }
+  uint32_t clippedSamples() const { return _clipped; }
+  uint32_t clippedFrames() const  { return _clipFrames; }
+
+private:
+  static const int32_t  GATE_FLOOR      = UNITY / 8;   // -18 dB while the gate is closed
+  static const uint32_t ATTACK_MS       = 10;
+  static const uint32_t RELEASE_MS      = 800;
+  static const uint32_t GATE_RELEASE_MS = 150;
+
+  int32_t  _target        = 3000;         // about -21 dBFS
+  int32_t  _minGain       = UNITY / 4;    // -12 dB
+  int32_t  _maxGain       = UNITY * 16;   // +24 dB
+  int32_t  _gateThreshold = 120;          // about -49 dBFS
+  int32_t  _gain;
+  int32_t  _gateGain;
+  bool     _gateOpen;
+  uint32_t _clipped;
+  uint32_t _clipFrames;
+
+  // One-pole step towards the target: delta * frameMs / tauMs, clamped to a full step, so the time constants stay
+  // the same in ms for any ptime
+  static int32_t smooth(int32_t delta, size_t n, uint32_t tauMs) {
+    uint32_t frameMs = (uint32_t)(n / 8);          // 8 samples per ms
+    if (frameMs >= tauMs) return delta;
+    return (int32_t)(((int64_t)delta * frameMs) / tauMs);
+  }
+
+  static int32_t isqrt(uint32_t v) {
+    uint32_t r = 0, bit = 1u << 30;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+      if (v >= r + bit) {
+        v -= r + bit;
+        r = (r >> 1) + bit;
+      } else {
+        r >>= 1;
+      }
+      bit >>= 2;
+    }
+    return (int32_t)r;
+  }
+};
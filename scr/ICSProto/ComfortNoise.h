@@ -0,0 +1,68 @@
+/*
+ * ComfortNoise.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * RFC 3389 comfort noise, level only (no spectral parameters).
+ * The level byte is the noise power in -dBov, 0 dBov being a full-scale 16-bit signal. The receiver plays white
+ * noise at that level, gently low-passed so it sounds like room noise rather than hiss, and ramps to a new level
+ * instead of stepping.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+class ComfortNoise {
+public:
+  static const uint8_t SILENT_LEVEL = 127;
+
+  ComfortNoise() { reset(); }
+
+  void reset() {
+    _seed   = 0x1234567u;
+    _lp     = 0;
+    _amp    = 0;
+    _target = 0;
+  }
+
+  // Level byte for a block of PCM, from its mean power
+  static uint8_t levelOf(uint64_t energy, size_t n) {
+    if (n == 0 || energy == 0) return SILENT_LEVEL;
+    float ms = (float)energy / (float)n;
+    float dbov = 10.0f * log10f(ms / (32767.0f * 32767.0f));
+    int level = (int)lrintf(-dbov);
+    if (level < 0)   level = 0;
+    if (level > 127) level = 127;
+    return (uint8_t)level;
+  }
+
+  // Received CN level; the generator fades to it over the next frame
+  void setLevel(uint8_t levelDbov) {
+    float rms = 32767.0f * powf(10.0f, -(float)(levelDbov & 0x7F) / 20.0f);
+    // the low-passed generator below has an RMS of a third of full scale at unity amplitude
+    float amp = rms * 3.0f;
+    _target = amp > 98301.0f ? 98301 : (int32_t)amp;
+  }
+
+  void generate(int16_t* out, size_t n) {
+    int32_t step = n ? (_target - _amp) / (int32_t)n : 0;
+    for (size_t i = 0; i < n; ++i) {
+      _amp += step;
+      _seed = _seed * 1664525u + 1013904223u;                       // LCG, top 16 bits as uniform noise
+      int32_t white = (int16_t)(_seed >> 16);
+      _lp += (white - _lp) >> 1;                                    // one-pole low-pass, keeps 1/3 of the power
+      int32_t v = (int32_t)(((int64_t)_lp * _amp) >> 15);
+      if (v >  32767) v =  32767;
+      if (v < -32768) v = -32768;
+      out[i] = (int16_t)v;
+    }
+    _amp = _target;
+  }
+
+private:
+  uint32_t _seed;
+  int32_t  _lp;
+  int32_t  _amp;
+  int32_t  _target;
+};
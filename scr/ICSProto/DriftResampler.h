@@ -0,0 +1,113 @@
+/*
+ * DriftResampler.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Clock drift compensation for playback. The sender's sample clock and our I2S clock differ by some ppm, so over a
+ * long call the jitter buffer would slowly run dry or overflow. Decoded PCM goes through a small FIFO and is read
+ * back at a rate of 1 + ppm * 1e-6 input samples per output sample (Q24 phase, linear interpolation). steer() is a
+ * PI loop on the smoothed buffer fill error that sets that ppm, so the buffer holds its target depth: the
+ * proportional part reacts to short term offsets, the integral learns the actual clock drift. At most +-1000 ppm
+ * (under 2 cents of pitch), which is inaudible, and no samples are ever dropped or repeated.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class DriftResampler {
+public:
+  static const size_t CAPACITY = 1024;            // power of two, room for a 60 ms frame on top of a block
+
+  DriftResampler() { reset(); }
+
+  void reset() {
+    _write     = 0;
+    _read      = 0;
+    _frac      = 0;
+    _ppm       = 0;
+    _integral  = 0.0f;
+    _error     = 0.0f;
+    _haveError = false;
+    setStep(0);
+  }
+
+  // Decoded input; returns false (and drops the frame) if it does not fit
+  bool push(const int16_t* pcm, size_t n) {
+    if (available() + n > CAPACITY) return false;
+    for (size_t i = 0; i < n; ++i) _buf[(_write + i) & MASK] = pcm[i];
+    _write += n;
+    return true;
+  }
+
+  // Input samples not yet consumed
+  size_t available() const { return _write - _read; }
+
+  // True if n output samples can be produced without running out of input
+  bool canProduce(size_t n) const {
+    uint64_t needed = (((uint64_t)n * _step + _frac) >> FRAC_BITS) + 2;
+    return available() >= needed;
+  }
+
+  void produce(int16_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      int32_t a = _buf[_read & MASK];
+      int32_t b = _buf[(_read + 1) & MASK];
+      out[i] = (int16_t)(a + (int32_t)(((int64_t)(b - a) * _frac) >> FRAC_BITS));
+      _frac += _step;
+      _read += _frac >> FRAC_BITS;
+      _frac &= FRAC_MASK;
+    }
+  }
+
+  // Control loop, called once per output block of 'blockSamples' with the fill error (buffered - target, samples)
+  void steer(int32_t errorSamples, size_t blockSamples) {
+    float dt = (float)blockSamples / 8000.0f;
+    if (!_haveError) {
+      _error = (float)errorSamples;
+      _haveError = true;
+    }
+    _error += (errorSamples - _error) * (dt / SMOOTH_S);     // arrivals come in whole frames, average them out
+    // conditional integration: a large error is a set point step (the jitter buffer target moved a frame), which
+    // the proportional part works off; integrating it would wind the learned drift far past the real one
+    if (_error < INTEGRATE_WINDOW && _error > -INTEGRATE_WINDOW) _integral += KI * _error * dt;
+    if (_integral >  MAX_PPM) _integral =  MAX_PPM;
+    if (_integral < -MAX_PPM) _integral = -MAX_PPM;
+    float ppm = KP * _error + _integral;
+    if (ppm >  MAX_PPM) ppm =  MAX_PPM;
+    if (ppm < -MAX_PPM) ppm = -MAX_PPM;
+    setStep((int32_t)ppm);
+  }
+
+  // Restarts the error average (after a re-prime) but keeps the learned drift
+  void holdSteering() { _haveError = false; }
+
+  // Current correction: positive means input is consumed faster than it is played
+  int32_t ppm() const        { return _ppm; }
+  int32_t driftPpm() const   { return (int32_t)_integral; }
+
+private:
+  static const size_t   MASK      = CAPACITY - 1;
+  static const uint32_t FRAC_BITS = 24;
+  static const uint32_t FRAC_MASK = (1u << FRAC_BITS) - 1;
+  static constexpr float KP       = 5.0f;        // ppm per sample of error
+  static constexpr float KI       = 0.08f;       // ppm per sample-second, about 0.8 damping with KP
+  static constexpr float SMOOTH_S = 2.0f;        // error averaging time constant
+  static constexpr float MAX_PPM  = 1000.0f;
+  static constexpr float INTEGRATE_WINDOW = 80.0f;   // samples, half a 20 ms frame
+
+  int16_t  _buf[CAPACITY];
+  size_t   _write;
+  size_t   _read;
+  uint32_t _frac;
+  uint32_t _step;
+  int32_t  _ppm;
+  float    _integral;
+  float    _error;
+  bool     _haveError;
+
+  void setStep(int32_t ppm) {
+    _ppm  = ppm;
+    _step = (uint32_t)((1 << FRAC_BITS) + (((int64_t)ppm << FRAC_BITS) / 1000000));
+  }
+};
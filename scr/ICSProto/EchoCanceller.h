@@ -0,0 +1,217 @@
+/*
+ * EchoCanceller.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Acoustic echo canceller for full-duplex intercom at 8 kHz.
+ * The playback path hands every frame it plays to pushFarEnd(); the capture path runs process() on each conditioned
+ * mic frame before encoding. The bulk delay between the two I2S ports (DMA queues, speaker to mic) is estimated by
+ * cross-correlating 1 kHz magnitude envelopes of both signals, and a 256-tap (32 ms) NLMS filter models the echo
+ * path behind it. A Geigel detector freezes adaptation during double talk. Float on purpose: the ESP32 FPU does a
+ * single-cycle multiply-add, so the filter costs about 4 M MAC/s.
+ * pushFarEnd() (or reserveFarEnd()/commitFarEnd() to fill the queue slot in place) runs in the playout task and only
+ * touches an SPSC queue; everything else belongs to the capture task.
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "SPSCQueue.h"
+
+class EchoCanceller {
+public:
+  static const size_t TAPS      = 256;      // 32 ms echo tail after the bulk delay
+  static const size_t MAX_FRAME = 480;
+  static const size_t REF_BLOCK = 160;      // reference block size, 20 ms
+
+  EchoCanceller() { reset(); }
+
+  void reset() {
+    memset(_far, 0, sizeof(_far));
+    memset(_w, 0, sizeof(_w));
+    memset(_farEnv, 0, sizeof(_farEnv));
+    memset(_nearEnv, 0, sizeof(_nearEnv));
+    _farWritten = 0;
+    _envPos     = 0;
+    _envFilled  = 0;
+    _delay      = DEFAULT_DELAY;
+    _hangover   = 0;
+  }
+
+  // Playback task: every block that goes to the speaker
+  void pushFarEnd(const int16_t* pcm, size_t n) {
+    while (n > 0) {
+      RefBlock block;
+      block.n = n < REF_BLOCK ? n : REF_BLOCK;
+      memcpy(block.pcm, pcm, block.n * sizeof(int16_t));
+      if (!_refQueue.push(block)) _refDropped++;
+      pcm += block.n;
+      n   -= block.n;
+    }
+  }
+
+  // Playback task, zero copy: a REF_BLOCK slot to render the next speaker block into, or nullptr if the capture task
+  // has fallen behind (counted as a drop). Hand it over with commitFarEnd() once it has been played.
+  int16_t* reserveFarEnd() {
+    RefBlock* block = _refQueue.reserve();
+    if (!block) {
+      _refDropped++;
+      return nullptr;
+    }
+    block->n = REF_BLOCK;
+    return block->pcm;
+  }
+  void commitFarEnd() { _refQueue.commit(); }
+
+  // Capture task: removes the echo from one mic frame in place
+  void process(int16_t* nearEnd, size_t n) {
+    if (n > MAX_FRAME) n = MAX_FRAME;
+    drainReference();
+    uint32_t written = _farWritten;
+    trackEnvelopes(nearEnd, n, written);
+
+    // reference window: far samples played 'delay' before this frame, plus TAPS - 1 of filter history
+    uint32_t start = written - _delay - n - (TAPS - 1);
+    float farMax = 0.0f;
+    for (size_t i = 0; i < n + TAPS - 1; ++i) {
+      float v = _far[(start + i) & FAR_MASK];
+      _x[i] = v;
+      if (fabsf(v) > farMax) farMax = fabsf(v);
+    }
+    bool farActive = farMax > SILENCE;
+
+    float energy = EPS;
+    for (size_t k = 0; k < TAPS; ++k) energy += _x[k] * _x[k];
+
+    for (size_t i = 0; i < n; ++i) {
+      const float* x = _x + i;               // x[0] oldest .. x[TAPS - 1] aligned with nearEnd[i]
+      float d = nearEnd[i];
+
+      float y = 0.0f;
+      for (size_t k = 0; k < TAPS; ++k) y += _w[k] * x[k];
+      float e = d - y;
+
+      // Geigel: near end louder than half the far-end peak means someone is talking here
+      if (farActive && fabsf(d) > 0.5f * farMax) _hangover = HANGOVER;
+      if (_hangover > 0) {
+        _hangover--;
+      } else if (farActive) {
+        float g = MU * e / energy;
+        for (size_t k = 0; k < TAPS; ++k) _w[k] += g * x[k];
+      }
+
+      if (i + 1 < n) {
+        energy += x[TAPS] * x[TAPS] - x[0] * x[0];
+        if (energy < EPS) energy = EPS;
+      }
+
+      if (e >  32767.0f) e =  32767.0f;
+      if (e < -32768.0f) e = -32768.0f;
+      nearEnd[i] = (int16_t)lrintf(e);
+    }
+  }
+
+  // Current bulk delay estimate in samples
+  uint32_t delaySamples() const { return _delay; }
+  // Reference blocks lost because the capture task fell behind
+  uint32_t referenceDropped() const { return _refDropped; }
+
+private:
+  static const size_t   FAR_SIZE      = 4096;       // 512 ms of reference history
+  static const uint32_t FAR_MASK      = FAR_SIZE - 1;
+  static const uint32_t DEFAULT_DELAY = 320;        // 40 ms until the first estimate
+  static const size_t   ENV_DECIM     = 8;          // 8 kHz -> 1 kHz envelopes
+  static const size_t   ENV_LEN       = 1024;       // about 1 s of envelope per estimate
+  static const size_t   MAX_LAG       = 400;        // bulk delays up to 400 ms
+  static const uint32_t DELAY_MARGIN  = 16;         // keep 2 ms of early echo inside the filter
+  static const uint16_t HANGOVER      = 240;        // 30 ms adaptation freeze after double talk
+  static constexpr float MU      = 0.3f;
+  static constexpr float EPS     = 1.0e4f;
+  static constexpr float SILENCE = 64.0f;
+
+  struct RefBlock {
+    uint16_t n;
+    int16_t  pcm[REF_BLOCK];
+  };
+
+  SPSCQueue<RefBlock, 8> _refQueue;              // 160 ms of playout ahead of the capture task
+  volatile uint32_t      _refDropped = 0;
+  int16_t  _far[FAR_SIZE];
+  uint32_t _farWritten;
+  float    _w[TAPS];
+  float    _x[MAX_FRAME + TAPS];
+  uint32_t _delay;
+  uint16_t _hangover;
+
+  float    _farEnv[ENV_LEN];
+  float    _nearEnv[ENV_LEN];
+  size_t   _envPos;
+  size_t   _envFilled;
+
+  // Copies straight out of the queue slots into the history ring
+  void drainReference() {
+    const RefBlock* block;
+    while ((block = _refQueue.front()) != nullptr) {
+      for (size_t i = 0; i < block->n; ++i) _far[(_farWritten + i) & FAR_MASK] = block->pcm[i];
+      _farWritten += block->n;
+      _refQueue.release();
+    }
+  }
+
+  // Pairs the raw mic frame with the far samples written just before it (zero delay), so the lag found is the delay
+  void trackEnvelopes(const int16_t* nearEnd, size_t n, uint32_t written) {
+    uint32_t farStart = written - n;
+    for (size_t j = 0; j + ENV_DECIM <= n; j += ENV_DECIM) {
+      float f = 0.0f, m = 0.0f;
+      for (size_t k = 0; k < ENV_DECIM; ++k) {
+        f += fabsf((float)_far[(farStart + j + k) & FAR_MASK]);
+        m += fabsf((float)nearEnd[j + k]);
+      }
+      _farEnv[_envPos]  = f;
+      _nearEnv[_envPos] = m;
+      if (++_envPos == ENV_LEN) {
+        _envPos = 0;
+        estimateDelay();
+      }
+    }
+  }
+
+  // Normalised cross-correlation of mean-removed envelopes; the near envelope lags the far one by the echo delay
+  void estimateDelay() {
+    float farMean = 0.0f, nearMean = 0.0f;
+    for (size_t i = 0; i < ENV_LEN; ++i) {
+      farMean  += _farEnv[i];
+      nearMean += _nearEnv[i];
+    }
+    farMean  /= ENV_LEN;
+    nearMean /= ENV_LEN;
+    if (farMean < SILENCE * ENV_DECIM) return;      // nothing played, nothing to learn
+
+    float  bestScore = 0.0f;
+    size_t bestLag   = 0;
+    for (size_t lag = 0; lag < MAX_LAG; ++lag) {
+      float corr = 0.0f, ef = 0.0f, en = 0.0f;
+      for (size_t i = lag; i < ENV_LEN; ++i) {
+        float f = _farEnv[i - lag] - farMean;
+        float m = _nearEnv[i] - nearMean;
+        corr += f * m;
+        ef   += f * f;
+        en   += m * m;
+      }
+      if (ef <= 0.0f || en <= 0.0f) continue;
+      float score = corr / sqrtf(ef * en);
+      if (score > bestScore) {
+        bestScore = score;
+        bestLag   = lag;
+      }
+    }
+    if (bestScore < 0.4f) return;                   // no clear echo, keep the current estimate
+
+    uint32_t delay = bestLag * ENV_DECIM;
+    delay = delay > DELAY_MARGIN ? delay - DELAY_MARGIN : 0;
+    if (delay > _delay + ENV_DECIM || delay + ENV_DECIM < _delay) {
+      _delay = delay;
+      memset(_w, 0, sizeof(_w));                    // echo path moved, re-converge
+    }
+  }
+};
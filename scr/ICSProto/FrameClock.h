@@ -0,0 +1,99 @@
+/*
+ * FrameClock.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Frame pacing for the audio tasks. On the device the clock is the I2S DMA itself: each port is set up with one DMA
+ * buffer per 20 ms frame, so the blocking read or write in update() returns once per buffer completion and the task
+ * sleeps in between, with no polling and no tick-granular delays. FrameClock adds no wait of its own there; the
+ * pipeline calls onWake() when the I2S call returns and onIdle() just before it blocks again, which gives the wake
+ * period, its jitter and the share of each frame spent working.
+ * On the host there is no DMA, so wait() stands in for it: it sleeps until the next frame boundary of a steady timer
+ * and then counts a wake, which lets the same pipeline run at real time in offline tests.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+class FrameClock {
+public:
+  explicit FrameClock(uint32_t frameUs = 20000) : _frameUs(frameUs) { reset(); }
+
+  void reset() {
+    _frames    = 0;
+    _late      = 0;
+    _maxJitter = 0;
+    _maxBusy   = 0;
+    _busyTotal = 0;
+    _lastWake  = 0;
+#ifndef ARDUINO
+    _next = std::chrono::steady_clock::now();
+#endif
+  }
+
+  // The frame's I2S buffer completed and the task is running again
+  void onWake() {
+    uint32_t now = nowUs();
+    if (_frames > 0) {
+      uint32_t period = now - _lastWake;
+      uint32_t jitter = period > _frameUs ? period - _frameUs : _frameUs - period;
+      if (jitter > _maxJitter) _maxJitter = jitter;
+      if (jitter > _frameUs / 2) _late++;         // a frame was missed or two completions arrived together
+    }
+    _lastWake = now;
+    _frames++;
+  }
+
+  // The frame is done and the task is about to block on I2S again
+  void onIdle() {
+    if (_frames == 0) return;
+    uint32_t busy = nowUs() - _lastWake;
+    if (busy > _maxBusy) _maxBusy = busy;
+    _busyTotal += busy;
+  }
+
+#ifndef ARDUINO
+  // Host stand-in for the DMA completion: sleeps until the next frame boundary, then wakes
+  void wait() {
+    _next += std::chrono::microseconds(_frameUs);
+    std::this_thread::sleep_until(_next);
+    onWake();
+  }
+#endif
+
+  // Telemetry, safe to poll from another task (the load is approximate there)
+  uint32_t frames() const      { return _frames; }
+  uint32_t lateWakes() const   { return _late; }
+  uint32_t maxJitterUs() const { return _maxJitter; }
+  uint32_t maxBusyUs() const   { return _maxBusy; }
+  uint32_t loadPercent() const {
+    return _frames ? (uint32_t)(_busyTotal * 100 / ((uint64_t)_frames * _frameUs)) : 0;
+  }
+
+private:
+  uint32_t _frameUs;
+  volatile uint32_t _frames;
+  volatile uint32_t _late;
+  volatile uint32_t _maxJitter;
+  volatile uint32_t _maxBusy;
+  uint64_t _busyTotal;
+  uint32_t _lastWake;
+#ifndef ARDUINO
+  std::chrono::steady_clock::time_point _next;
+#endif
+
+  static inline uint32_t nowUs() {
+#ifdef ARDUINO
+    return (uint32_t)micros();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+};
@@ -0,0 +1,100 @@
+/*
+ * G711.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Block oriented G.711 mu-law and A-law kernels, bit exact with the classic Sun g711.c reference (the original
+ * 16-bit mu-law encoder, the 13-bit revision of the A-law one).
+ * Decoding is a single lookup in a 256 entry table and encoding uses a 256 entry segment (exponent) table shared by
+ * both laws, all generated at compile time. Whole frames are processed per call in a plain loop without virtual calls,
+ * so the compiler can unroll it.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+struct G711Tables {
+  int16_t ulawToPcm[256];
+  int16_t alawToPcm[256];
+  uint8_t segment[256];       // exponent, indexed by (biased magnitude >> 7) for mu-law, (magnitude >> 4) for A-law
+
+  constexpr G711Tables() : ulawToPcm(), alawToPcm(), segment() {
+    for (int i = 0; i < 256; ++i) {
+      int u = ~i & 0xFF;
+      int t = (((u & 0x0F) << 3) + BIAS) << ((u & 0x70) >> 4);
+      ulawToPcm[i] = (int16_t)((u & 0x80) ? (BIAS - t) : (t - BIAS));
+    }
+    for (int i = 0; i < 256; ++i) {
+      int a   = i ^ 0x55;
+      int t   = (a & 0x0F) << 4;
+      int seg = (a & 0x70) >> 4;
+      if (seg == 0) t += 8;
+      else          t = (t + 0x108) << (seg - 1);
+      alawToPcm[i] = (int16_t)((a & 0x80) ? t : -t);
+    }
+    for (int i = 0; i < 256; ++i) {
+      int seg = 0;
+      for (int v = i >> 1; v; v >>= 1) ++seg;
+      segment[i] = (uint8_t)seg;
+    }
+  }
+
+  static constexpr int BIAS = 0x84;
+  static constexpr int CLIP = 32635;
+};
+
+static constexpr G711Tables G711_TABLES{};
+
+class G711 {
+public:
+  // The law a session negotiated: PCMU (payload type 0) or PCMA (payload type 8)
+  enum Law : uint8_t { ULAW, ALAW };
+
+  static inline int16_t ulawToLinear(uint8_t u) { return G711_TABLES.ulawToPcm[u]; }
+  static inline int16_t alawToLinear(uint8_t a) { return G711_TABLES.alawToPcm[a]; }
+  static inline int16_t toLinear(Law law, uint8_t c) { return law == ALAW ? alawToLinear(c) : ulawToLinear(c); }
+
+  static inline uint8_t linearToUlaw(int16_t pcm) {
+    int32_t  v    = pcm;
+    uint8_t  sign = 0;
+    if (v < 0) { v = -v; sign = 0x80; }
+    if (v > G711Tables::CLIP) v = G711Tables::CLIP;
+    v += G711Tables::BIAS;
+    uint8_t exponent = G711_TABLES.segment[(v >> 7) & 0xFF];
+    uint8_t mantissa = (v >> (exponent + 3)) & 0x0F;
+    return ~(sign | (exponent << 4) | mantissa);
+  }
+
+  static inline uint8_t linearToAlaw(int16_t pcm) {
+    int32_t v    = pcm >> 3;                  // A-law works on 13 bits
+    uint8_t mask = 0xD5;
+    if (v < 0) { v = -v - 1; mask = 0x55; }
+    uint8_t exponent = G711_TABLES.segment[(v >> 4) & 0xFF];
+    uint8_t mantissa = (v >> (exponent ? exponent : 1)) & 0x0F;
+    return (uint8_t)(((exponent << 4) | mantissa) ^ mask);
+  }
+
+  static void ulawDecode(const uint8_t* in, int16_t* out, size_t n) {
+    const int16_t* table = G711_TABLES.ulawToPcm;
+    for (size_t i = 0; i < n; ++i) out[i] = table[in[i]];
+  }
+
+  static void ulawEncode(const int16_t* in, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = linearToUlaw(in[i]);
+  }
+
+  static void alawDecode(const uint8_t* in, int16_t* out, size_t n) {
+    const int16_t* table = G711_TABLES.alawToPcm;
+    for (size_t i = 0; i < n; ++i) out[i] = table[in[i]];
+  }
+
+  static void alawEncode(const int16_t* in, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = linearToAlaw(in[i]);
+  }
+
+  // One branch per block, the loops themselves stay law specific
+  static void encode(Law law, const int16_t* in, uint8_t* out, size_t n) {
+    if (law == ALAW) alawEncode(in, out, n);
+    else             ulawEncode(in, out, n);
+  }
+};
@@ -0,0 +1,75 @@
+/*
+ * HalfBandDecimator.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Fixed-point 2:1 polyphase half-band decimator (16 kHz -> 8 kHz for the mic path).
+ * 47-tap Kaiser (beta 5) half-band low-pass, as quantised to Q15: flat within 0.02 dB up to 3.4 kHz and at least
+ * 54.9 dB down from 4.6 kHz (63 dB from 5 kHz), so sibilants no longer alias into the voice band.
+ * Every other tap of a half-band filter is zero and the rest are symmetric, so the odd input phase only needs the
+ * 12 unique coefficients (pre-added pairs) and the even phase is a pure delay onto the 0.5 centre tap:
+ * 12 multiplies per output sample instead of 47.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Unique odd-offset coefficients (Q15), outermost pair last; the centre tap is HalfBandDecimator::CENTER_COEF
+static constexpr int16_t HALFBAND_COEFS[12] = {
+  10389, -3347, 1875, -1207, 813, -553, 371, -241, 149, -85, 43, -17
+};
+
+class HalfBandDecimator {
+public:
+  HalfBandDecimator() { reset(); }
+
+  void reset() {
+    for (size_t i = 0; i < 2 * ODD_TAPS; ++i) _odd[i] = 0;
+    for (size_t i = 0; i < CENTER_DELAY; ++i) _even[i] = 0;
+    _oddPos  = 0;
+    _evenPos = 0;
+  }
+
+  // Takes one input pair (x[2j], x[2j+1]) and returns one output sample
+  inline int16_t process(int16_t even, int16_t odd) {
+    // odd phase history, mirrored so the window is always contiguous
+    _odd[_oddPos] = odd;
+    _odd[_oddPos + ODD_TAPS] = odd;
+    const int16_t* w = _odd + _oddPos + 1;          // w[0] oldest .. w[23] newest
+    if (++_oddPos == ODD_TAPS) _oddPos = 0;
+
+    // even phase only feeds the centre tap, delayed to line up with it
+    int16_t center = _even[_evenPos];
+    _even[_evenPos] = even;
+    if (++_evenPos == CENTER_DELAY) _evenPos = 0;
+
+    int32_t acc = (int32_t)CENTER_COEF * center + (1 << 14);
+    for (size_t k = 0; k < ODD_TAPS / 2; ++k) {
+      acc += (int32_t)HALFBAND_COEFS[k] * ((int32_t)w[ODD_TAPS / 2 + k] + w[ODD_TAPS / 2 - 1 - k]);
+    }
+    acc >>= 15;
+    if (acc >  32767) acc =  32767;
+    if (acc < -32768) acc = -32768;
+    return (int16_t)acc;
+  }
+
+  // Block form for an even number of input samples; returns n / 2 outputs
+  size_t process(const int16_t* in, size_t n, int16_t* out) {
+    size_t produced = 0;
+    for (size_t i = 0; i + 1 < n; i += 2) out[produced++] = process(in[i], in[i + 1]);
+    return produced;
+  }
+
+  // Group delay in input samples
+  static constexpr size_t delay() { return 23; }
+
+private:
+  static const size_t  ODD_TAPS     = 24;   // non-zero taps outside the centre
+  static const size_t  CENTER_DELAY = 11;   // (47 - 1) / 4, in input pairs
+  static const int16_t CENTER_COEF  = 16388;
+
+  int16_t _odd[2 * ODD_TAPS];
+  int16_t _even[CENTER_DELAY];
+  size_t  _oddPos;
+  size_t  _evenPos;
+};
@@ -1,8 +1,13 @@
 #include <Arduino.h>
+#include <Preferences.h>
 #include "SimpleSIPClient.h" 
 #include "RTPInput.h"
 #include "RTPOutput.h"
 #include "UserInput.h"
+#include "RTCPSession.h"
+#include "EchoCanceller.h"
+#include "SPSCQueue.h"
+#include "FrameClock.h"
 
 // Wi-Fi credentials (used inside SimpleSIPClient::begin)
 const char* WIFI_SSID     = "Good's Wifi 2.4";
@@ -17,6 +22,7 @@ const uint16_t LOCAL_SIP_PORT        = 5060;
 
 // RTP media ports and I2S pins
 const uint16_t RTP_RECV_PORT   = 5004;  // for conference audio receive
+const uint8_t  RTP_PTIME_MS    = 20;    // packet time we offer; the packetizer uses what the answer asks for
 const int PIN_WS_OUT   = 33;
 const int PIN_BCK_OUT  = 12;
 const int PIN_DATA_OUT = 22;
@@ -33,14 +39,256 @@ unsigned long lastSipTick   = 0;
 const unsigned long SIP_MS  = 100;
 bool callLaunched           = false;
 bool rtpStarted             = false;
+bool mediaSend              = true;       // false when the call was negotiated recvonly or inactive
+bool mediaRecv              = true;       // false when it was negotiated sendonly or inactive
+uint32_t mediaVersion       = 0;          // of the session the pipelines run with
+IPAddress mediaIp;                        // where they send it
+uint16_t mediaPort          = 0;
+uint8_t mediaPt             = 0;          // and in which codec, ptime and with or without comfort noise
+G711::Law mediaLaw          = G711::ULAW;
+uint8_t mediaPtime          = 0;
+bool mediaCn                = false;
 uint16_t baseExt            = 7000;
 uint8_t groups              = 2;
 
 SimpleSIPClient sipClient(WIFI_SSID, WIFI_PASSWORD, SIP_USER, SIP_PASS, SIP_SERVER, SIP_PORT, LOCAL_SIP_PORT);
 RTPOutput       rtpOut(WIFI_SSID, WIFI_PASSWORD);
 RTPInput        rtpIn(WIFI_SSID, WIFI_PASSWORD);
+RTCPSession     rtcp;
+EchoCanceller   aec;
 UserInput       userInput(PIN_VOL_UP, PIN_VOL_DOWN, PIN_MUTE, PIN_GROUP);
 float lastAmpGain = 0.0f;
+bool  lastMuted   = true;
+
+// Mic DC calibration, kept in NVS so the DC blocker starts converged after a reboot
+Preferences   prefs;
+const unsigned long DC_SAVE_MS = 30000;      // save once the blocker has settled in a call
+unsigned long rtpStartMs       = 0;
+bool          dcSaved          = false;
+
+// Task layout: capture (AEC, noise suppression, encode) has core 1 to itself; playout shares core 0 with the Wi-Fi
+// stack above the low-priority SIP/control task. Both audio tasks sleep in their blocking I2S call and are woken by
+// the DMA once per 20 ms frame; the frame clocks only measure that wake-up.
+const BaseType_t  CAPTURE_CORE  = 1;
+const BaseType_t  PLAYOUT_CORE  = 0;
+const BaseType_t  CONTROL_CORE  = 0;
+const UBaseType_t CAPTURE_PRIO  = 5;
+const UBaseType_t PLAYOUT_PRIO  = 6;
+const UBaseType_t CONTROL_PRIO  = 1;
+const uint32_t    AUDIO_STACK   = 4096;
+const uint32_t    CONTROL_STACK = 8192;
+const unsigned long CONTROL_MS  = 20;
+const unsigned long CLOCK_LOG_MS = 10000;
+FrameClock    captureClock(RTP_PTIME_MS * 1000);
+FrameClock    playoutClock(RTP_PTIME_MS * 1000);
+unsigned long lastClockLog = 0;
+
+// The tasks share no state apart from read-only clock telemetry: everything crossing between them goes through a
+// single-producer/single-consumer queue
+struct ControlMsg {
+  enum Type : uint8_t { Volume, Mute, ReportDcOffset, Retarget, Codec, Receive } type;
+  float value;
+  uint32_t ip;          // Retarget: the new media address and port
+  uint16_t port;
+  uint8_t payloadType;  // Codec: payload type, G.711 law, ptime and comfort noise on or off
+  uint8_t law;
+  uint8_t ptime;
+  bool cn;
+};
+struct StatusMsg {
+  enum Type : uint8_t { DcOffset } type;
+  int32_t value;
+};
+SPSCQueue<ControlMsg, 8> toCapture;     // control -> capture
+SPSCQueue<ControlMsg, 8> toPlayout;     // control -> playout
+SPSCQueue<StatusMsg, 4>  fromCapture;   // capture -> control
+
+static void captureTask(void* pv) {
+  ControlMsg msg;
+  for (;;) {
+    while (toCapture.pop(msg)) {
+      if (msg.type == ControlMsg::Mute) rtpIn.setMuted(msg.value != 0.0f);
+      if (msg.type == ControlMsg::ReportDcOffset) fromCapture.push(StatusMsg{StatusMsg::DcOffset, rtpIn.dcOffset()});
+      if (msg.type == ControlMsg::Retarget) rtpIn.retarget(IPAddress(msg.ip), msg.port);
+      if (msg.type == ControlMsg::Codec) {
+        rtpIn.setCodec(msg.payloadType, (G711::Law)msg.law);
+        rtpIn.setPtime(msg.ptime);
+        rtpIn.setDtxEnabled(msg.cn);
+      }
+    }
+    rtpIn.update();     // Drives Mic Input to RTP, one frame per DMA completion
+  }
+}
+
+static void playoutTask(void* pv) {
+  ControlMsg msg;
+  for (;;) {
+    while (toPlayout.pop(msg)) {
+      if (msg.type == ControlMsg::Volume) rtpOut.setAmpGain(msg.value);
+      if (msg.type == ControlMsg::Codec) rtpOut.setCodec(msg.payloadType, (G711::Law)msg.law);
+      if (msg.type == ControlMsg::Receive) rtpOut.setReceiving(msg.value != 0.0f);
+    }
+    rtpOut.update();    // Drives RTP to Amp Output, one frame per DMA completion
+  }
+}
+
+static void startMedia() {
+  // Media goes where the SDP answer says, which need not be the SIP server (e.g. a separate media server)
+  const Sdp::Session& media = sipClient.mediaSession();
+  mediaVersion = sipClient.mediaVersion();
+  if (!mediaIp.fromString(media.address)) mediaIp.fromString(SIP_SERVER);
+  mediaPort = media.port;
+  G711::Law law = media.codec == Sdp::CODEC_PCMA ? G711::ALAW : G711::ULAW;
+  mediaSend  = Sdp::Sends(media.direction);
+  mediaRecv  = Sdp::Receives(media.direction);
+  mediaPt    = media.payloadType;
+  mediaLaw   = law;
+  mediaPtime = media.ptime;
+  mediaCn    = media.cnPayloadType == RTPPacketizer::CN_PAYLOAD_TYPE;
+  Serial.printf("Starting RTP to %s:%u, PT %u, ptime %u ms\n", mediaIp.toString().c_str(), media.port,
+                media.payloadType, media.ptime);
+
+  // Transmitt pipeline
+  if (!rtpIn.setPtime(media.ptime)) rtpIn.setPtime(RTP_PTIME_MS);
+  rtpIn.setCodec(media.payloadType, law);
+  rtpIn.setDtxEnabled(mediaCn);                 // CN only if the peer takes it
+  prefs.begin("ics", true);
+  if (prefs.isKey("dcOffset")) {
+    rtpIn.seedDcOffset(prefs.getInt("dcOffset"));
+  }
+  prefs.end();
+  if (!rtpIn.begin(mediaIp, media.port, PIN_WS_IN, PIN_BCK_IN, PIN_DATA_IN)) {
+    Serial.println("RTPInput init failed");
+    while (true) delay(100);
+  }
+  Serial.println("RTPInput ready");
+
+    // Recive pipeline
+  rtpOut.setCodec(media.payloadType, law);
+  rtpOut.setReceiving(mediaRecv);
+  if (!rtpOut.begin(RTP_RECV_PORT, PIN_WS_OUT, PIN_BCK_OUT, PIN_DATA_OUT, 1.0f)) {
+    Serial.println("RTPOutput init failed");
+    while (true) delay(100);
+  }
+  Serial.println("RTPOutput ready");
+
+  // Full duplex: the speaker signal is the echo reference for the mic
+  rtpOut.setEchoCanceller(&aec);
+  rtpIn.setEchoCanceller(&aec);
+  rtpIn.setFrameClock(&captureClock);
+  rtpOut.setFrameClock(&playoutClock);
+
+  // RTCP on RTP port + 1, both directions report into the same session
+  rtpIn.setRtcp(&rtcp);
+  rtpOut.setRtcp(&rtcp);
+  if (!rtcp.begin(mediaIp, media.port + 1, RTP_RECV_PORT + 1)) {
+    Serial.println("RTCP init failed, continuing without reports");
+  }
+
+  // Initial state is set before the audio tasks exist, after that only through the queues
+  userInput.setMuted(true);
+  lastMuted   = true;
+  rtpIn.setMuted(true);
+  lastAmpGain = userInput.getVolume();
+  rtpOut.setAmpGain(lastAmpGain);
+
+  xTaskCreatePinnedToCore(captureTask, "capture", AUDIO_STACK, nullptr, CAPTURE_PRIO, nullptr, CAPTURE_CORE);
+  xTaskCreatePinnedToCore(playoutTask, "playout", AUDIO_STACK, nullptr, PLAYOUT_PRIO, nullptr, PLAYOUT_CORE);
+  rtpStarted = true;
+  rtpStartMs = millis();
+}
+
+// A re-INVITE changed the running call: the send direction reaches the capture task through the mute logic, a new
+// address, codec or ptime, and the receive direction, as messages to the audio tasks; RTCP I/O belongs to this task,
+// so it is pointed at a new address directly. Whatever does not fit in the queues now is retried on the next pass.
+static void updateMedia() {
+  const Sdp::Session& media = sipClient.mediaSession();
+  IPAddress ip;
+  bool moved = ip.fromString(media.address) && (uint32_t)ip != 0             // 0.0.0.0 is hold, not a move
+               && (!(ip == mediaIp) || media.port != mediaPort);
+  if (moved) {
+    if (!toCapture.push(ControlMsg{ControlMsg::Retarget, 0.0f, (uint32_t)ip, media.port})) return;   // next pass
+    rtcp.setRemote(ip, media.port + 1);
+    mediaIp   = ip;
+    mediaPort = media.port;
+  }
+
+  // Our 200 has already agreed to the new codec, so both directions switch now
+  G711::Law law = media.codec == Sdp::CODEC_PCMA ? G711::ALAW : G711::ULAW;
+  bool cn = media.cnPayloadType == RTPPacketizer::CN_PAYLOAD_TYPE;
+  if (media.payloadType != mediaPt || law != mediaLaw || media.ptime != mediaPtime || cn != mediaCn) {
+    if (toCapture.size() == toCapture.capacity() || toPlayout.size() == toPlayout.capacity()) return;
+    ControlMsg codec{ControlMsg::Codec, 0.0f, 0, 0, media.payloadType, (uint8_t)law, media.ptime, cn};
+    toCapture.push(codec);
+    toPlayout.push(codec);
+    mediaPt    = media.payloadType;
+    mediaLaw   = law;
+    mediaPtime = media.ptime;
+    mediaCn    = cn;
+  }
+
+  bool recv = Sdp::Receives(media.direction);
+  if (recv != mediaRecv) {
+    if (!toPlayout.push(ControlMsg{ControlMsg::Receive, recv ? 1.0f : 0.0f})) return;
+    mediaRecv = recv;
+  }
+  mediaSend    = Sdp::Sends(media.direction);
+  mediaVersion = sipClient.mediaVersion();
+  Serial.printf("Media now %s:%u, %s/%u ptime %u ms, %s%s\n", mediaIp.toString().c_str(), mediaPort,
+                Sdp::CodecName(media.codec), mediaPt, mediaPtime, mediaSend ? "send" : "", mediaRecv ? "recv" : "");
+}
+
+static void controlTask(void* pv) {
+  for (;;) {
+    userInput.update();
+    // Throttle SIP processing so we don't flood
+    if (millis() - lastSipTick >= SIP_MS) {
+      sipClient.update();
+      lastSipTick = millis();
+    }
+
+    // Call logic
+    if (callLaunched && !rtpStarted && sipClient.isInCall()) {
+      startMedia();
+    }
+
+    // Stream Logic based on user input
+    if (rtpStarted) {
+      if (sipClient.mediaVersion() != mediaVersion) updateMedia();
+      rtcp.update();      // non-blocking, only sends when a report is due
+
+      // Full duplex: always play, mute only stops the mic from being sent
+      float newGain = userInput.getVolume();
+      if (newGain != lastAmpGain && toPlayout.push(ControlMsg{ControlMsg::Volume, newGain})) {
+        lastAmpGain = newGain;
+      }
+      bool muted = userInput.isMuted() || !mediaSend;
+      if (muted != lastMuted && toCapture.push(ControlMsg{ControlMsg::Mute, muted ? 1.0f : 0.0f})) {
+        lastMuted = muted;
+      }
+
+      if (!dcSaved && millis() - rtpStartMs >= DC_SAVE_MS) {
+        toCapture.push(ControlMsg{ControlMsg::ReportDcOffset, 0.0f});
+        dcSaved = true;
+      }
+      if (millis() - lastClockLog >= CLOCK_LOG_MS) {
+        lastClockLog = millis();
+        Serial.printf("[Clock] capture load %u%% jitter %u us late %u | playout load %u%% jitter %u us late %u\n",
+                      captureClock.loadPercent(), captureClock.maxJitterUs(), captureClock.lateWakes(),
+                      playoutClock.loadPercent(), playoutClock.maxJitterUs(), playoutClock.lateWakes());
+      }
+      StatusMsg status;
+      while (fromCapture.pop(status)) {
+        if (status.type == StatusMsg::DcOffset) {
+          prefs.begin("ics", false);
+          prefs.putInt("dcOffset", status.value);
+          prefs.end();
+        }
+      }
+    }
+    vTaskDelay(pdMS_TO_TICKS(CONTROL_MS));
+  }
+}
 
 void setup() {
   Serial.begin(115200);
@@ -59,55 +307,14 @@ void setup() {
   }
   Serial.println("SIP client init OK");
   Serial.println("→ Sending conference INVITE");
-  sipClient.callConference(userInput.readGroup(baseExt, groups), RTP_RECV_PORT);
+  sipClient.callConference(userInput.readGroup(baseExt, groups), RTP_RECV_PORT, RTP_PTIME_MS);
   Serial.printf("Joining group %u\n", userInput.readGroup(baseExt, groups));
   callLaunched = true;
+
+  // SIP, RTCP and the buttons run in the control task; it starts the audio tasks once the call is up
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_STACK, nullptr, CONTROL_PRIO, nullptr, CONTROL_CORE);
 }
 
 void loop() {
-  userInput.update();
-  // Throttle SIP processing so we don't flood
-  if (millis() - lastSipTick >= SIP_MS) {
-    sipClient.update();
-    lastSipTick = millis();
-  }
-
-  // Call logic
-  if (callLaunched && !rtpStarted && sipClient.isInCall()) {
-    userInput.setMuted(true);
-    uint16_t mediaPort = sipClient.getRtpPort();
-    //Serial.printf("Starting RTP to port %u\n", mediaPort);
-
-    // Transmitt pipeline
-    if (!rtpIn.begin(SIP_SERVER, mediaPort, PIN_WS_IN, PIN_BCK_IN, PIN_DATA_IN)) {
-      Serial.println("RTPInput init failed");
-      while (true) delay(100);
-    }
-    Serial.println("RTPInput ready");
-
-      // Recive pipeline
-    if (!rtpOut.begin(RTP_RECV_PORT, PIN_WS_OUT, PIN_BCK_OUT, PIN_DATA_OUT, 1.0f)) {
-      Serial.println("RTPOutput init failed");
-      while (true) delay(100);
-    }
-    Serial.println("RTPOutput ready");
-    rtpStarted = true;
-    lastAmpGain = userInput.getVolume();
-  }
-
-  // Stream Logic based on user input
-
-  if (rtpStarted) { float newGain = userInput.getVolume();
-    if (newGain != lastAmpGain) {
-      rtpOut.setAmpGain(newGain);
-      lastAmpGain = newGain;
-    }
-    
-    if(userInput.isMuted()){
-      rtpOut.update();  // Drives RTP to Amp Output
-    }
-    if(!userInput.isMuted()){
-      rtpIn.update();   // Drives Mic Input to RTP
-    }
-  }
+  vTaskDelete(nullptr);   // all work happens in the pinned tasks
 }
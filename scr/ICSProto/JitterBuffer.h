@@ -0,0 +1,228 @@
+/*
+ * JitterBuffer.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Packet jitter buffer for the receive path. Packets are stored by RTP sequence number, so reordered packets are
+ * played in order and duplicates or packets that arrive after their playout slot are dropped.
+ * The target depth follows the RFC 3550 interarrival jitter estimate: on a clean LAN it sits at the minimum depth,
+ * and it only grows when the network gets worse.
+ * Comfort noise packets (PT 13) are buffered and played in sequence like voice; running dry after one is the
+ * sender's DTX, not an underrun.
+ */
+#pragma once
+#include <Arduino.h>
+#include "RTPOverUDP.h"
+
+class JitterBuffer {
+public:
+  static const size_t SLOTS          = 32;      // power of two, 640 ms at 20 ms ptime
+  static const size_t MAX_FRAME_BYTES = 480;    // 60 ms of G.711
+  static const uint8_t CN_PAYLOAD_TYPE = 13;    // RFC 3389 comfort noise, passed through to the decoder
+
+  struct Frame {
+    bool     valid;
+    bool     marker;
+    uint8_t  payloadType;
+    uint16_t seq;
+    uint32_t timestamp;
+    size_t   len;
+    uint8_t  data[MAX_FRAME_BYTES];
+  };
+
+  enum class Result {
+    Frame,    // next frame in sequence is ready
+    Lost,     // next frame is missing but later ones are buffered
+    Empty     // nothing to play (priming or underrun)
+  };
+
+  JitterBuffer(uint32_t clockRate = 8000, uint16_t minDepthMs = 40, uint16_t maxDepthMs = 300)
+    : _clockRate(clockRate)
+    , _minDepthMs(minDepthMs)
+    , _maxDepthMs(maxDepthMs) {
+    reset();
+  }
+
+  void reset() {
+    for (size_t i = 0; i < SLOTS; ++i) _slots[i].valid = false;
+    _count       = 0;
+    _started     = false;
+    _playing     = false;
+    _haveTransit = false;
+    _jitterQ4    = 0;
+    _dtx         = false;
+    _frameSamples = _clockRate / 50;
+    _targetFrames = 0;
+    _shrinkRun    = 0;
+    updateTarget();
+  }
+
+  // Stores one packet. Returns false if it was dropped (late, duplicate, too large).
+  bool push(const RTPPacket& pkt, uint32_t arrivalMs) {
+    if (pkt.payloadLen == 0 || pkt.payloadLen > MAX_FRAME_BYTES) return false;
+
+    if (_started && pkt.ssrc != _ssrc) reset();     // new sender, start over
+    if (!_started) {
+      _started = true;
+      _ssrc    = pkt.ssrc;
+      _nextSeq = pkt.seq;
+    }
+    updateJitter(pkt.timestamp, arrivalMs);
+    if (pkt.payloadType != CN_PAYLOAD_TYPE) {
+      _frameSamples = pkt.payloadLen;             // G.711: one byte per sample
+    }
+
+    int16_t ahead = (int16_t)(pkt.seq - _nextSeq);
+    if (ahead < 0) {
+      _late++;
+      return false;
+    }
+    if (ahead >= (int16_t)SLOTS) {
+      // Sender jumped far ahead of us; resync on this packet rather than waiting it out
+      _resyncs++;
+      for (size_t i = 0; i < SLOTS; ++i) _slots[i].valid = false;
+      _count   = 0;
+      _playing = false;
+      _nextSeq = pkt.seq;
+    }
+
+    Frame& slot = _slots[pkt.seq & (SLOTS - 1)];
+    if (slot.valid && slot.seq == pkt.seq) {
+      _duplicates++;
+      return false;
+    }
+    if (!slot.valid) _count++;
+    slot.valid       = true;
+    slot.marker      = pkt.marker;
+    slot.payloadType = pkt.payloadType;
+    slot.seq         = pkt.seq;
+    slot.timestamp   = pkt.timestamp;
+    slot.len         = pkt.payloadLen;
+    memcpy(slot.data, pkt.payload, pkt.payloadLen);
+    return true;
+  }
+
+  // Called once per playout frame. On Result::Frame, 'out' points at the frame until the next push().
+  Result pop(const Frame*& out) {
+    out = nullptr;
+    if (!_playing) {
+      if (_count == 0 || _count < _targetFrames) return Result::Empty;
+      _playing = true;
+    }
+    if (_count == 0) {
+      if (!_dtx) _underruns++;
+      _playing = false;                             // re-prime to the target depth
+      return Result::Empty;
+    }
+
+    // Buffer drifted well past the target (e.g. after a burst): skip the oldest frame to catch up. The limit stays
+    // below SLOTS, or a deep target plus a wide margin would never be reached and a full buffer would only resync
+    size_t limit = _targetFrames + _catchUpMargin;
+    if (limit > SLOTS - 1) limit = SLOTS - 1;
+    if (_count > limit) {
+      Frame& old = _slots[_nextSeq & (SLOTS - 1)];
+      if (old.valid && old.seq == _nextSeq) {
+        old.valid = false;
+        _count--;
+        _dropped++;
+      }
+      _nextSeq++;
+    }
+
+    Frame& slot = _slots[_nextSeq & (SLOTS - 1)];
+    _nextSeq++;
+    if (!slot.valid || slot.seq != (uint16_t)(_nextSeq - 1)) {
+      _lost++;
+      return Result::Lost;
+    }
+    slot.valid = false;
+    _count--;
+    _dtx = slot.payloadType == CN_PAYLOAD_TYPE;
+    out = &slot;
+    return Result::Frame;
+  }
+
+  // Frames above target before the oldest one is skipped; a caller that steers the depth itself (drift
+  // resampling) sets this higher, so the skip is only a last resort
+  void setCatchUpMargin(size_t frames) { _catchUpMargin = frames; }
+
+  size_t   depthFrames() const   { return _count; }
+  size_t   targetFrames() const  { return _targetFrames; }
+  uint32_t frameSamples() const  { return _frameSamples; }
+  bool     inDtx() const         { return _dtx; }
+  bool     playing() const       { return _playing; }
+  // Interarrival jitter in timestamp units (RFC 3550 A.8)
+  uint32_t jitter() const        { return _jitterQ4 >> 4; }
+  uint32_t jitterMs() const      { return (jitter() * 1000) / _clockRate; }
+  uint32_t lost() const          { return _lost; }
+  uint32_t late() const          { return _late; }
+  uint32_t duplicates() const    { return _duplicates; }
+  uint32_t underruns() const     { return _underruns; }
+  uint32_t dropped() const       { return _dropped; }
+  uint32_t resyncs() const       { return _resyncs; }
+
+private:
+  static const uint16_t SHRINK_HOLD = 250;      // 5 s at 20 ms ptime
+
+  uint32_t _clockRate;
+  uint16_t _minDepthMs;
+  uint16_t _maxDepthMs;
+
+  Frame    _slots[SLOTS];
+  size_t   _count;
+  size_t   _targetFrames;
+  uint16_t _shrinkRun;
+  size_t   _catchUpMargin = 2;
+  bool     _started;
+  bool     _playing;
+  uint32_t _ssrc;
+  uint16_t _nextSeq;
+  uint32_t _frameSamples;
+  bool     _dtx;
+
+  bool     _haveTransit;
+  int32_t  _lastTransit;
+  uint32_t _jitterQ4;
+
+  uint32_t _lost       = 0;
+  uint32_t _late       = 0;
+  uint32_t _duplicates = 0;
+  uint32_t _underruns  = 0;
+  uint32_t _dropped    = 0;
+  uint32_t _resyncs    = 0;
+
+  void updateJitter(uint32_t timestamp, uint32_t arrivalMs) {
+    // transit time in timestamp units; J += (|D| - J) / 16, kept scaled by 16
+    int32_t transit = (int32_t)((uint32_t)((uint64_t)arrivalMs * _clockRate / 1000) - timestamp);
+    if (_haveTransit) {
+      int32_t d = transit - _lastTransit;
+      if (d < 0) d = -d;
+      _jitterQ4 += d - ((_jitterQ4 + 8) >> 4);
+    }
+    _lastTransit = transit;
+    _haveTransit = true;
+    updateTarget();
+  }
+
+  void updateTarget() {
+    // one frame of playout plus four times the jitter covers nearly all arrivals
+    uint32_t frameMs  = (_frameSamples * 1000) / _clockRate;
+    if (frameMs == 0) frameMs = 20;
+    uint32_t targetMs = frameMs + 4 * jitterMs();
+    if (targetMs < _minDepthMs) targetMs = _minDepthMs;
+    if (targetMs > _maxDepthMs) targetMs = _maxDepthMs;
+    size_t frames = (targetMs + frameMs - 1) / frameMs;
+    // grow at once, shrink only once the lower depth has been enough for SHRINK_HOLD packets in a row: the jitter
+    // estimate is noisy, and near a frame boundary it would flip the target, and the drift loop's set point with
+    // it, several times a second
+    if (frames >= _targetFrames) {
+      _shrinkRun = 0;
+    } else if (++_shrinkRun < SHRINK_HOLD) {
+      frames = _targetFrames;
+    } else {
+      _shrinkRun = 0;
+    }
+    if (frames > SLOTS - 2) frames = SLOTS - 2;
+    _targetFrames = frames;
+  }
+};
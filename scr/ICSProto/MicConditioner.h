@@ -0,0 +1,70 @@
+/*
+ * MicConditioner.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Transmit front end: takes raw 32-bit I2S samples at 16 kHz and, in a single pass per sample, removes the
+ * (adaptively tracked) DC offset, scales to 16 bit with rounding and decimates 2:1 to 8 kHz through an anti-alias
+ * half-band filter. This replaces the FilteredStream -> FormatConverterStream -> EncodedAudioStream chain.
+ * RTPInput runs its frame stages (AEC, NS, AGC, VAD) on the PCM it writes and the packetizer encodes that into the
+ * RTP payload.
+ */
+#pragma once
+#include <Arduino.h>
+#include "OffsetFilter.h"
+#include "HalfBandDecimator.h"
+
+class MicConditioner {
+public:
+  MicConditioner() : _pending(0), _havePending(false) {}
+
+  void reset() {
+    _havePending = false;
+    _decimator.reset();
+  }
+
+  // Consumes n input samples and writes floor((carry + n) / 2) samples at 8 kHz; returns the number written
+  size_t process(const int32_t* in, size_t n, int16_t* out) {
+    size_t produced = 0;
+    size_t i = 0;
+    if (_havePending && n > 0) {
+      out[produced++] = _decimator.process(_pending, toPcm(in[0]));
+      _havePending = false;
+      i = 1;
+    }
+    for (; i + 1 < n; i += 2) {
+      // the DC tracker is stateful, so the samples go through it strictly in order (argument order is unspecified)
+      int16_t even = toPcm(in[i]);
+      int16_t odd  = toPcm(in[i + 1]);
+      out[produced++] = _decimator.process(even, odd);
+    }
+    if (i < n) {
+      _pending     = toPcm(in[i]);
+      _havePending = true;
+    }
+    return produced;
+  }
+
+  // DC calibration of the mic, see OffsetFilter
+  void    seedDcOffset(int32_t offset) { _dc.seed(offset); }
+  int32_t dcOffset() const             { return _dc.offset(); }
+
+  // Output samples produced for n more input samples
+  size_t outputFor(size_t n) const { return (n + (_havePending ? 1 : 0)) / 2; }
+
+  // Input samples needed to produce n output samples
+  size_t inputFor(size_t n) const { return 2 * n - (_havePending ? 1 : 0); }
+
+private:
+  OffsetFilter      _dc;          // concrete member, so process() binds statically and inlines
+  HalfBandDecimator _decimator;
+  int16_t      _pending;
+  bool         _havePending;
+
+  inline int16_t toPcm(int32_t raw) {
+    int64_t v = ((int64_t)_dc.process(raw) + (1 << 15)) >> 16;     // 32 -> 16 bit with rounding
+    if (v >  32767) v =  32767;
+    if (v < -32768) v = -32768;
+    return (int16_t)v;
+  }
+};
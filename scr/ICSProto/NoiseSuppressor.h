@@ -0,0 +1,250 @@
+/*
+ * NoiseSuppressor.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Spectral noise suppression for the 8 kHz mic path (HVAC, fans, machinery).
+ * Works on 10 ms hops: 160-sample sqrt-Hann windows at 50% overlap, zero padded to a 256-point fixed-point FFT
+ * (int32 data, Q15 twiddles, no per-stage scaling so quiet noise keeps its resolution). The noise floor per bin is
+ * tracked by minimum statistics over about 1.5 s of smoothed power, the suppression gain is a floored Wiener-style
+ * rule, smoothed over time and across neighbouring bins to keep musical noise down. Frames are processed in place
+ * and must be a multiple of 10 ms (80 samples); the added delay is one hop. Plain C++ apart from the cycle counter,
+ * so the same header builds on the host for offline runs over WAV files.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+class NoiseSuppressor {
+public:
+  static const size_t HOP = 80;                 // 10 ms
+
+  NoiseSuppressor() {
+    for (size_t n = 0; n < WIN; ++n) {
+      _window[n] = (int16_t)lrintf(32767.0f * sinf((float)M_PI * n / WIN));       // sqrt of periodic Hann
+    }
+    for (size_t k = 0; k < FFT_N / 2; ++k) {
+      _cos[k] = (int16_t)lrintf(32767.0f * cosf(2.0f * (float)M_PI * k / FFT_N));
+      _sin[k] = (int16_t)lrintf(32767.0f * sinf(2.0f * (float)M_PI * k / FFT_N));
+    }
+    for (size_t i = 0; i < FFT_N; ++i) {
+      size_t r = 0;
+      for (size_t b = 0; b < FFT_BITS; ++b) r |= ((i >> b) & 1) << (FFT_BITS - 1 - b);
+      _bitrev[i] = (uint8_t)r;
+    }
+    reset();
+  }
+
+  void reset() {
+    memset(_frame, 0, sizeof(_frame));
+    memset(_ola, 0, sizeof(_ola));
+    for (size_t k = 0; k < BINS; ++k) {
+      _power[k]  = 0;
+      _subMin[k] = UINT64_MAX;
+      _noise[k]  = 0;
+      _gain[k]   = 32767;
+      for (size_t u = 0; u < SUBWINDOWS; ++u) _mins[u][k] = UINT64_MAX;
+    }
+    _hops       = 0;
+    _subCount   = 0;
+    _subIndex   = 0;
+    _lastCycles = 0;
+  }
+
+  // Deepest suppression, as a Q15 gain (default about -18 dB)
+  void setFloor(int16_t q15) { _floor = q15; }
+
+  // Over-subtraction factor in Q4 (16 = 1.0), higher removes more noise at the cost of speech detail
+  void setOverSubtraction(uint16_t q4) { _overSub = q4; }
+
+  void process(int16_t* pcm, size_t n) {
+    uint32_t start = cycleCount();
+    for (size_t i = 0; i + HOP <= n; i += HOP) processHop(pcm + i);
+    _lastCycles = cycleCount() - start;
+  }
+
+  // Cost of the last process() call: CPU cycles on the ESP32, nanoseconds on the host
+  uint32_t lastFrameCycles() const { return _lastCycles; }
+
+  // Estimated noise power of a bin (bin k is k * 31.25 Hz), in FFT units
+  uint64_t noisePower(size_t k) const { return k < BINS ? _noise[k] : 0; }
+
+private:
+  static const size_t   WIN        = 2 * HOP;
+  static const size_t   FFT_N      = 256;
+  static const size_t   FFT_BITS   = 8;
+  static const size_t   BINS       = FFT_N / 2 + 1;
+  static const size_t   SUBWINDOWS = 5;         // minimum search over 5 x 30 hops = 1.5 s
+  static const size_t   SUB_HOPS   = 30;
+  static const uint32_t POWER_ALPHA = 27853;    // 0.85 in Q15, power smoothing for the minimum search
+  static const uint32_t GAIN_ALPHA  = 19661;    // 0.6 in Q15, weight of the previous gain
+  static const uint32_t MIN_BIAS    = 24;       // 1.5 in Q4, the minimum of smoothed power underestimates the mean
+
+  int16_t  _window[WIN];
+  int16_t  _cos[FFT_N / 2];
+  int16_t  _sin[FFT_N / 2];
+  uint8_t  _bitrev[FFT_N];
+
+  int16_t  _frame[WIN];
+  int32_t  _ola[HOP];
+  int32_t  _re[FFT_N];
+  int32_t  _im[FFT_N];
+
+  uint64_t _power[BINS];
+  uint64_t _subMin[BINS];
+  uint64_t _mins[SUBWINDOWS][BINS];
+  uint64_t _noise[BINS];
+  int16_t  _gain[BINS];
+  int16_t  _rawGain[BINS];
+
+  int16_t  _floor   = 4096;   // 0.125, -18 dB
+  uint16_t _overSub = 32;     // 2.0
+  uint32_t _hops;
+  size_t   _subCount;
+  size_t   _subIndex;
+  uint32_t _lastCycles;
+
+  void processHop(int16_t* pcm) {
+    memmove(_frame, _frame + HOP, HOP * sizeof(int16_t));
+    memcpy(_frame + HOP, pcm, HOP * sizeof(int16_t));
+
+    for (size_t n = 0; n < WIN; ++n) {
+      _re[n] = ((int32_t)_frame[n] * _window[n] + (1 << 14)) >> 15;
+      _im[n] = 0;
+    }
+    for (size_t n = WIN; n < FFT_N; ++n) _re[n] = _im[n] = 0;
+    fft(false);
+
+    updateNoise();
+    computeGains();
+
+    for (size_t k = 0; k < BINS; ++k) {
+      int32_t g = _gain[k];
+      _re[k] = (int32_t)(((int64_t)_re[k] * g) >> 15);
+      _im[k] = (int32_t)(((int64_t)_im[k] * g) >> 15);
+      if (k > 0 && k < FFT_N / 2) {
+        _re[FFT_N - k] = _re[k];                // keep the spectrum Hermitian, the output stays real
+        _im[FFT_N - k] = -_im[k];
+      }
+    }
+    fft(true);
+
+    // synthesis window and overlap-add; the first half of this window completes the previous hop
+    for (size_t n = 0; n < HOP; ++n) {
+      int32_t y = (int32_t)(((int64_t)_re[n] * _window[n]) >> 15);
+      int32_t v = _ola[n] + y;
+      if (v >  32767) v =  32767;
+      if (v < -32768) v = -32768;
+      pcm[n]  = (int16_t)v;
+      _ola[n] = (int32_t)(((int64_t)_re[HOP + n] * _window[HOP + n]) >> 15);
+    }
+    _hops++;
+  }
+
+  // Minimum statistics (Martin 2001, simplified): the noise floor is the minimum of the smoothed power over the
+  // last SUBWINDOWS * SUB_HOPS hops, tracked per sub-window so old minima expire
+  void updateNoise() {
+    for (size_t k = 0; k < BINS; ++k) {
+      uint64_t p = (uint64_t)((int64_t)_re[k] * _re[k]) + (uint64_t)((int64_t)_im[k] * _im[k]);
+      if (_hops == 0) _power[k] = p;
+      else _power[k] = mulQ15(_power[k], POWER_ALPHA) + mulQ15(p, 32768 - POWER_ALPHA);
+      if (_power[k] < _subMin[k]) _subMin[k] = _power[k];
+
+      uint64_t m = _subMin[k];
+      for (size_t u = 0; u < SUBWINDOWS; ++u) if (_mins[u][k] < m) m = _mins[u][k];
+      _noise[k] = (m >> 4) * MIN_BIAS;
+    }
+    if (++_subCount == SUB_HOPS) {
+      _subCount = 0;
+      memcpy(_mins[_subIndex], _subMin, sizeof(_subMin));
+      _subIndex = (_subIndex + 1) % SUBWINDOWS;
+      for (size_t k = 0; k < BINS; ++k) _subMin[k] = UINT64_MAX;
+    }
+  }
+
+  // G = 1 - overSub * N / |X|^2, floored, then smoothed over time and with a [1 2 1] kernel across bins
+  void computeGains() {
+    for (size_t k = 0; k < BINS; ++k) {
+      uint64_t p = (uint64_t)((int64_t)_re[k] * _re[k]) + (uint64_t)((int64_t)_im[k] * _im[k]);
+      uint64_t nz = _noise[k];
+      uint64_t big = p > nz ? p : nz;
+      int shift = big ? 64 - __builtin_clzll(big) - 40 : 0;    // keep both under 2^40 so the Q15 ratio fits
+      if (shift > 0) {
+        p  >>= shift;
+        nz >>= shift;
+      }
+      int32_t g;
+      uint64_t sub = (nz * _overSub) >> 4;
+      if (sub >= p) {
+        g = _floor;
+      } else {
+        g = 32767 - (int32_t)((sub << 15) / p);
+        if (g < _floor) g = _floor;
+      }
+      _rawGain[k] = (int16_t)g;
+    }
+    for (size_t k = 0; k < BINS; ++k) {
+      int32_t l = _rawGain[k > 0 ? k - 1 : k];
+      int32_t r = _rawGain[k + 1 < BINS ? k + 1 : k];
+      int32_t g = (l + 2 * _rawGain[k] + r) >> 2;
+      _gain[k] = (int16_t)((GAIN_ALPHA * _gain[k] + (32768 - GAIN_ALPHA) * g) >> 15);
+    }
+  }
+
+  static inline uint64_t mulQ15(uint64_t v, uint32_t q15) {
+    return (v >> 15) * q15 + (((v & 0x7FFF) * q15) >> 15);
+  }
+
+  // In-place radix-2 decimation-in-time FFT on _re/_im; the inverse scales by 1/N
+  void fft(bool inverse) {
+    for (size_t i = 0; i < FFT_N; ++i) {
+      size_t j = _bitrev[i];
+      if (j > i) {
+        int32_t t = _re[i]; _re[i] = _re[j]; _re[j] = t;
+        t = _im[i]; _im[i] = _im[j]; _im[j] = t;
+      }
+    }
+    for (size_t len = 2; len <= FFT_N; len <<= 1) {
+      size_t half = len >> 1;
+      size_t step = FFT_N / len;
+      for (size_t i = 0; i < FFT_N; i += len) {
+        for (size_t j = 0; j < half; ++j) {
+          int32_t wr = _cos[j * step];
+          int32_t wi = inverse ? _sin[j * step] : -_sin[j * step];
+          int32_t* ar = &_re[i + j];
+          int32_t* ai = &_im[i + j];
+          int32_t* br = &_re[i + j + half];
+          int32_t* bi = &_im[i + j + half];
+          int32_t tr = (int32_t)(((int64_t)*br * wr - (int64_t)*bi * wi + (1 << 14)) >> 15);
+          int32_t ti = (int32_t)(((int64_t)*br * wi + (int64_t)*bi * wr + (1 << 14)) >> 15);
+          *br = *ar - tr;
+          *bi = *ai - ti;
+          *ar += tr;
+          *ai += ti;
+        }
+      }
+    }
+    if (inverse) {
+      for (size_t i = 0; i < FFT_N; ++i) {
+        _re[i] = (_re[i] + (1 << (FFT_BITS - 1))) >> FFT_BITS;
+        _im[i] = (_im[i] + (1 << (FFT_BITS - 1))) >> FFT_BITS;
+      }
+    }
+  }
+
+  static inline uint32_t cycleCount() {
+#ifdef ARDUINO
+    return ESP.getCycleCount();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+};
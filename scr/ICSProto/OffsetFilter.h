@@ -1,15 +1,32 @@
 #pragma once
 #include "AudioTools.h"
 
+using namespace audio_tools;
+
+// Adaptive DC blocker for the raw 32-bit mic samples. A leaky integrator tracks the offset of this particular
+// microphone (time constant 2^SHIFT samples, ~2.5 Hz corner at 16 kHz) and subtracts it, so no per-board constant
+// is needed. seed() starts it from a stored calibration so it is converged right at boot.
 class OffsetFilter : public Filter<int32_t> {
   public:
-    OffsetFilter(int32_t offsetVal = 223031000) : offset(offsetVal) {}
+    // offsetVal is the correction that gets added, i.e. minus the expected DC (the old fixed constant by default)
+    OffsetFilter(int32_t offsetVal = 223031000) { seed(offsetVal); }
     virtual ~OffsetFilter() = default;
 
     virtual int32_t process(int32_t in) override {
-    return in + offset;
+      int32_t dc  = (int32_t)(_acc >> SHIFT);
+      int64_t out = (int64_t)in - dc;
+      _acc += out;
+      if (out > INT32_MAX) return INT32_MAX;
+      if (out < INT32_MIN) return INT32_MIN;
+      return (int32_t)out;
     }
 
+    void seed(int32_t offsetVal) { _acc = -(int64_t)offsetVal * (1 << SHIFT); }
+
+    // Current correction, in the same sense as the constructor argument; store this as calibration
+    int32_t offset() const { return (int32_t)-(_acc >> SHIFT); }
+
 protected:
-  int32_t offset;
+  static const int SHIFT = 10;
+  int64_t _acc;       // DC estimate scaled by 2^SHIFT
 };
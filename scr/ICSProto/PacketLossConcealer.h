@@ -0,0 +1,158 @@
+/*
+ * PacketLossConcealer.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Packet loss concealment for 8 kHz G.711 playback, after ITU-T G.711 Appendix I.
+ * Good frames are fed through goodFrame() to keep a short history. When a frame is missing, conceal() estimates
+ * the pitch period from that history and repeats it (1, 2, then 3 periods as the loss grows), smoothing the joins
+ * with a quarter-period overlap-add. The substituted signal fades by 20% per 10 ms after the first 10 ms and is
+ * silent after 60 ms. The first good frame after a loss is cross-faded with the synthetic signal.
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+class PacketLossConcealer {
+public:
+  PacketLossConcealer() { reset(); }
+
+  void reset() {
+    memset(_history, 0, sizeof(_history));
+    _erasedSamples = 0;
+  }
+
+  bool concealing() const { return _erasedSamples > 0; }
+
+  // Records a decoded frame (in place, since it may be cross-faded with the concealment tail)
+  void goodFrame(int16_t* pcm, size_t n) {
+    if (_erasedSamples > 0) {
+      // fade in over 4 ms, plus 4 ms for each extra 10 ms lost, at most 10 ms
+      size_t olen = 32 + ((_erasedSamples - 1) / 80) * 32;
+      if (olen > 80) olen = 80;
+      if (olen > n) olen = n;
+      if (_erasedSamples < MAX_ERASED) {
+        int16_t tail[80];
+        synthesize(tail, olen);
+        for (size_t i = 0; i < olen; ++i) {
+          int32_t w = ((int32_t)(i + 1) << 15) / (int32_t)(olen + 1);
+          pcm[i] = (int16_t)((pcm[i] * w + tail[i] * (32768 - w)) >> 15);
+        }
+      }
+      _erasedSamples = 0;
+    }
+    appendHistory(pcm, n);
+  }
+
+  // Fills one missing frame
+  void conceal(int16_t* out, size_t n) {
+    if (_erasedSamples == 0) startErasure();
+    synthesize(out, n);
+    appendHistory(out, n);      // keeps the OLA at the next good frame continuous
+  }
+
+  uint16_t pitch() const { return _pitch; }
+
+private:
+  static const size_t  HISTORY    = 390;     // 48.75 ms
+  static const size_t  PITCH_MIN  = 40;      // 200 Hz
+  static const size_t  PITCH_MAX  = 120;     // 66.7 Hz
+  static const size_t  CORR_LEN   = 160;     // 20 ms correlation window
+  static const size_t  PITCH_BUF  = 3 * PITCH_MAX + PITCH_MAX / 4;
+  static const uint32_t MAX_ERASED = 480;    // 60 ms, then silence
+
+  int16_t  _history[HISTORY];
+  int16_t  _origTail[PITCH_BUF];            // untouched history at the start of the loss
+  int16_t  _pitchBuf[PITCH_BUF];
+  uint16_t _pitch;
+  uint16_t _periods;
+  uint32_t _pos;
+  uint32_t _erasedSamples;
+
+  void appendHistory(const int16_t* pcm, size_t n) {
+    if (n >= HISTORY) {
+      memcpy(_history, pcm + n - HISTORY, sizeof(_history));
+      return;
+    }
+    memmove(_history, _history + n, (HISTORY - n) * sizeof(int16_t));
+    memcpy(_history + HISTORY - n, pcm, n * sizeof(int16_t));
+  }
+
+  // Normalised cross-correlation of the last CORR_LEN samples against earlier ones,
+  // coarse search at 2:1 then refined around the best lag
+  uint16_t findPitch() const {
+    const int16_t* end = _history + HISTORY - CORR_LEN;
+    size_t best = PITCH_MIN;
+    float  bestScore = -1e30f;
+    for (int pass = 0; pass < 2; ++pass) {
+      size_t lo   = pass == 0 ? PITCH_MIN : (best > PITCH_MIN + 1 ? best - 1 : PITCH_MIN);
+      size_t hi   = pass == 0 ? PITCH_MAX : (best + 1 < PITCH_MAX ? best + 1 : PITCH_MAX);
+      size_t step = pass == 0 ? 2 : 1;
+      for (size_t lag = lo; lag <= hi; lag += step) {
+        const int16_t* l = end - lag;
+        int64_t corr = 0, energy = 1;
+        for (size_t i = 0; i < CORR_LEN; i += step) {
+          corr   += (int32_t)end[i] * l[i];
+          energy += (int32_t)l[i] * l[i];
+        }
+        float score = (float)corr * (float)(corr < 0 ? -corr : corr) / (float)energy;
+        if (score > bestScore) {
+          bestScore = score;
+          best = lag;
+        }
+      }
+    }
+    return (uint16_t)best;
+  }
+
+  void startErasure() {
+    _pitch   = findPitch();
+    _periods = 1;
+    _pos     = 0;
+    // 3 periods plus a quarter period of history for the overlap at the wrap point
+    memcpy(_origTail, _history + HISTORY - PITCH_BUF, sizeof(_origTail));
+    memcpy(_pitchBuf, _origTail, sizeof(_pitchBuf));
+    smoothWrap();
+  }
+
+  // Cross-fades the quarter period before the repeated segment into its end, so the loop point has no step
+  void smoothWrap() {
+    size_t span = (size_t)_pitch * _periods;
+    size_t ola  = _pitch / 4;
+    int16_t* seg = _pitchBuf + PITCH_BUF - span;
+    for (size_t i = 0; i < ola; ++i) {
+      int32_t w = ((int32_t)(i + 1) << 15) / (int32_t)(ola + 1);
+      int16_t* dst = seg + span - ola + i;
+      const int16_t* pre = seg - ola + i;
+      *dst = (int16_t)((*dst * w + *pre * (32768 - w)) >> 15);
+    }
+  }
+
+  void synthesize(int16_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      uint32_t erased = _erasedSamples + i;
+      if (erased >= MAX_ERASED) {
+        out[i] = 0;
+        continue;
+      }
+      // use more pitch periods as the loss gets longer to avoid a buzzy repetition
+      uint16_t periods = erased >= 160 ? 3 : (erased >= 80 ? 2 : 1);
+      if (periods != _periods) {
+        _periods = periods;
+        memcpy(_pitchBuf, _origTail, sizeof(_pitchBuf));
+        smoothWrap();
+      }
+      size_t span = (size_t)_pitch * _periods;
+      int32_t s = _pitchBuf[PITCH_BUF - span + (_pos % span)];
+      _pos++;
+      // 20% attenuation per 10 ms after the first 10 ms
+      if (erased >= 80) {
+        int32_t gain = 32768 - (int32_t)(((erased - 80) * 32768) / 400);
+        s = (s * gain) >> 15;
+      }
+      out[i] = (int16_t)s;
+    }
+    _erasedSamples += n;
+    if (_erasedSamples > MAX_ERASED) _erasedSamples = MAX_ERASED;   // stays silent, never wraps
+  }
+};
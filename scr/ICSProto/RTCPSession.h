@@ -0,0 +1,313 @@
+/*
+ * RTCPSession.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Minimal RTCP (RFC 3550) for one local source and one remote source on RTP port + 1.
+ * The RTP paths report every sent and received packet, the receive path with the interarrival jitter its jitter
+ * buffer measured (RFC 3550 A.8 is computed there only); update() sends an SR (or RR while we are not sending)
+ * with SDES CNAME at the randomised RFC 3550 interval and parses incoming SR/RR packets.
+ * Loss, interarrival jitter and the round-trip time derived from LSR/DLSR are available through getters, both as
+ * we measure the remote stream and as the remote side reports ours.
+ */
+#pragma once
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "RTPOverUDP.h"
+#include "SPSCQueue.h"
+
+class RTCPSession : public RTPStatsListener {
+public:
+  explicit RTCPSession(uint32_t clockRate = 8000)
+    : _clockRate(clockRate) {}
+
+  bool begin(const IPAddress& remote, uint16_t remotePort, uint16_t localPort, const char* cname = "ics@esp32") {
+    _remote     = remote;
+    _remotePort = remotePort;
+    _cname      = cname;
+    if (!_udp.begin(localPort)) {
+      Serial.printf("[RTCP] Error: bind failed on port %u\n", localPort);
+      return false;
+    }
+    _nextReportMs = millis() + interval() / 2;     // first report comes sooner, as RFC 3550 6.2 allows
+    _running = true;
+    Serial.printf("[RTCP] Reporting to %s:%u from port %u\n", remote.toString().c_str(), remotePort, localPort);
+    return true;
+  }
+
+  void setLocalSSRC(uint32_t ssrc) { _localSsrc = ssrc; }
+
+  // Control task only: the next report goes to the new address, e.g. after a re-INVITE moved the far end's media
+  void setRemote(const IPAddress& remote, uint16_t remotePort) {
+    _remote     = remote;
+    _remotePort = remotePort;
+  }
+
+  // Transmit side: called by RTPOverUDP in the capture task for every packet sent
+  void onRtpSent(uint32_t rtpTimestamp, size_t payloadLen) override {
+    if (!_sentQueue.push(SentEvent{rtpTimestamp, (uint32_t)payloadLen, (uint32_t)millis()})) _sentDropped++;
+  }
+
+  // Receive side: called by RTPOutput in the playout task for every valid packet received
+  void onRtpReceived(const RTPPacket& pkt, uint32_t jitter) override {
+    if (!_receivedQueue.push(ReceivedEvent{pkt.ssrc, jitter, pkt.seq})) _receivedDropped++;
+  }
+
+  // Control task only, non-blocking: folds in the packet events queued by the audio tasks, handles any incoming RTCP
+  // and sends a report when one is due
+  void update() {
+    SentEvent sent;
+    while (_sentQueue.pop(sent)) applySent(sent);
+    ReceivedEvent rcvd;
+    while (_receivedQueue.pop(rcvd)) applyReceived(rcvd);
+    if (!_running) return;
+    int size;
+    while ((size = _udp.parsePacket()) > 0) {
+      int len = _udp.read(_buf, sizeof(_buf));
+      if (len > 0) handlePacket(_buf, (size_t)len);
+    }
+    uint32_t now = millis();
+    if ((int32_t)(now - _nextReportMs) >= 0) {
+      sendReport(now);
+      _nextReportMs = now + interval();
+    }
+  }
+
+  // Remote stream as we receive it
+  uint32_t cumulativeLost() const { return _cumulativeLost; }
+  uint8_t  fractionLost() const   { return _fractionLost; }       // 1/256 units, last interval
+  uint32_t jitter() const         { return _jitter; }           // timestamp units
+  uint32_t jitterMs() const       { return (jitter() * 1000) / _clockRate; }
+  // Our stream as reported by the remote side
+  uint32_t remoteCumulativeLost() const { return _remoteCumLost; }
+  uint8_t  remoteFractionLost() const   { return _remoteFractionLost; }
+  uint32_t remoteJitterMs() const       { return (_remoteJitter * 1000) / _clockRate; }
+  // Round-trip time from LSR/DLSR, 0 until the first report block about us arrives
+  uint32_t rttMs() const                { return _rttMs; }
+  // Packet events lost because update() fell behind the audio tasks
+  uint32_t eventsDropped() const        { return _sentDropped + _receivedDropped; }
+
+private:
+  // The audio tasks only push events, all statistics live in the control task
+  struct SentEvent {
+    uint32_t rtpTimestamp;
+    uint32_t payloadLen;
+    uint32_t sentMs;
+  };
+  struct ReceivedEvent {
+    uint32_t ssrc;
+    uint32_t jitter;
+    uint16_t seq;
+  };
+
+  void applySent(const SentEvent& ev) {
+    _sentPackets++;
+    _sentOctets      += ev.payloadLen;
+    _lastRtpTs        = ev.rtpTimestamp;
+    _lastRtpSentMs    = ev.sentMs;
+    _sentSinceReport  = true;
+  }
+
+  // RFC 3550 A.1; the A.8 jitter comes with the event
+  void applyReceived(const ReceivedEvent& pkt) {
+    if (!_haveSource || pkt.ssrc != _remoteSsrc) {
+      _haveSource     = true;
+      _remoteSsrc     = pkt.ssrc;
+      _baseSeq        = pkt.seq;
+      _maxSeq         = pkt.seq;
+      _cycles         = 0;
+      _received       = 0;
+      _expectedPrior  = 0;
+      _receivedPrior  = 0;
+    }
+    uint16_t delta = pkt.seq - _maxSeq;
+    if (delta < MAX_DROPOUT) {
+      if (pkt.seq < _maxSeq) _cycles += 1UL << 16;   // sequence number wrapped
+      _maxSeq = pkt.seq;
+    }
+    _received++;
+    _jitter = pkt.jitter;
+  }
+
+  static const uint16_t MAX_DROPOUT = 3000;
+  static const uint8_t  PT_SR   = 200;
+  static const uint8_t  PT_RR   = 201;
+  static const uint8_t  PT_SDES = 202;
+
+  uint32_t    _clockRate;
+  WiFiUDP     _udp;
+  IPAddress   _remote;
+  uint16_t    _remotePort = 0;
+  const char* _cname      = "";
+  bool        _running    = false;
+  uint32_t    _nextReportMs = 0;
+  uint8_t     _buf[256];
+
+  // one queue per producing task, about 1.3 s of packets each
+  SPSCQueue<SentEvent, 64>     _sentQueue;
+  SPSCQueue<ReceivedEvent, 64> _receivedQueue;
+  volatile uint32_t            _sentDropped     = 0;
+  volatile uint32_t            _receivedDropped = 0;
+
+  // sender state
+  uint32_t _localSsrc       = 0;
+  uint32_t _sentPackets     = 0;
+  uint32_t _sentOctets      = 0;
+  uint32_t _lastRtpTs       = 0;
+  uint32_t _lastRtpSentMs   = 0;
+  bool     _sentSinceReport = false;
+
+  // receiver state
+  bool     _haveSource = false;
+  uint32_t _remoteSsrc = 0;
+  uint16_t _baseSeq    = 0;
+  uint16_t _maxSeq     = 0;
+  uint32_t _cycles     = 0;
+  uint32_t _received   = 0;
+  uint32_t _expectedPrior = 0;
+  uint32_t _receivedPrior = 0;
+  uint32_t _cumulativeLost = 0;
+  uint8_t  _fractionLost   = 0;
+  uint32_t _jitter      = 0;
+  uint32_t _lastSr      = 0;     // middle 32 bits of the remote SR NTP timestamp
+  uint32_t _lastSrMs    = 0;
+
+  // what the remote side says about us
+  uint32_t _remoteCumLost      = 0;
+  uint8_t  _remoteFractionLost = 0;
+  uint32_t _remoteJitter       = 0;
+  uint32_t _rttMs              = 0;
+
+  // 5 s minimum, randomised over [0.5, 1.5] and divided by e - 3/2 as in RFC 3550 6.3.1
+  uint32_t interval() const {
+    uint32_t r = 500 + (esp_random() % 1001);      // per mille
+    return (5000UL * r / 1000UL) * 100000UL / 121828UL;
+  }
+
+  // Local clock as NTP: no wall clock needed, RTT only uses our own timestamps
+  static uint64_t ntpNow(uint32_t ms) {
+    return ((uint64_t)(ms / 1000) << 32) | (((uint64_t)(ms % 1000) << 32) / 1000);
+  }
+  static uint32_t ntpMiddle(uint64_t ntp) { return (uint32_t)(ntp >> 16); }
+
+  static void put16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+  static void put32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+  static uint32_t get32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+  }
+
+  size_t writeReportBlock(uint8_t* p, uint32_t now) {
+    uint32_t extMax   = _cycles + _maxSeq;
+    uint32_t expected = extMax - _baseSeq + 1;
+    int32_t  lost     = (int32_t)(expected - _received);
+    if (lost < 0) lost = 0;
+    if (lost > 0x7FFFFF) lost = 0x7FFFFF;
+    uint32_t expInt  = expected - _expectedPrior;
+    uint32_t recvInt = _received - _receivedPrior;
+    _expectedPrior = expected;
+    _receivedPrior = _received;
+    int32_t lostInt = (int32_t)(expInt - recvInt);
+    uint32_t frac   = (expInt == 0 || lostInt <= 0) ? 0 : ((uint32_t)lostInt << 8) / expInt;
+    _fractionLost   = frac > 255 ? 255 : (uint8_t)frac;
+    _cumulativeLost = lost;
+
+    // delay since last SR in 1/65536 s
+    uint32_t dlsr = _lastSr ? (uint32_t)(((uint64_t)(now - _lastSrMs) << 16) / 1000) : 0;
+
+    put32(p, _remoteSsrc);
+    p[4] = _fractionLost;
+    p[5] = (lost >> 16) & 0xFF; p[6] = (lost >> 8) & 0xFF; p[7] = lost & 0xFF;
+    put32(p + 8,  extMax);
+    put32(p + 12, jitter());
+    put32(p + 16, _lastSr);
+    put32(p + 20, dlsr);
+    return 24;
+  }
+
+  void sendReport(uint32_t now) {
+    uint8_t pkt[128];
+    size_t  len = 0;
+    uint8_t rc  = _haveSource ? 1 : 0;
+
+    if (_sentSinceReport) {
+      uint64_t ntp = ntpNow(now);
+      uint32_t rtpTs = _lastRtpTs + (uint32_t)((uint64_t)(now - _lastRtpSentMs) * _clockRate / 1000);
+      pkt[0] = 0x80 | rc;
+      pkt[1] = PT_SR;
+      put32(pkt + 4,  _localSsrc);
+      put32(pkt + 8,  (uint32_t)(ntp >> 32));
+      put32(pkt + 12, (uint32_t)ntp);
+      put32(pkt + 16, rtpTs);
+      put32(pkt + 20, _sentPackets);
+      put32(pkt + 24, _sentOctets);
+      len = 28;
+    } else {
+      pkt[0] = 0x80 | rc;
+      pkt[1] = PT_RR;
+      put32(pkt + 4, _localSsrc);
+      len = 8;
+    }
+    if (rc) len += writeReportBlock(pkt + len, now);
+    put16(pkt + 2, len / 4 - 1);
+    _sentSinceReport = false;
+
+    // SDES with CNAME, padded to a 32-bit boundary
+    size_t cnameLen = strlen(_cname);
+    if (cnameLen > 64) cnameLen = 64;
+    size_t sdes = len;
+    pkt[sdes]     = 0x81;
+    pkt[sdes + 1] = PT_SDES;
+    put32(pkt + sdes + 4, _localSsrc);
+    pkt[sdes + 8] = 1;                                // CNAME
+    pkt[sdes + 9] = (uint8_t)cnameLen;
+    memcpy(pkt + sdes + 10, _cname, cnameLen);
+    size_t end = sdes + 10 + cnameLen;
+    do { pkt[end++] = 0; } while (end % 4);           // item list terminator and padding
+    put16(pkt + sdes + 2, (end - sdes) / 4 - 1);
+
+    _udp.beginPacket(_remote, _remotePort);
+    _udp.write(pkt, end);
+    _udp.endPacket();
+  }
+
+  void handlePacket(const uint8_t* p, size_t len) {
+    uint32_t now = millis();
+    while (len >= 8) {
+      if ((p[0] >> 6) != 2) return;
+      size_t plen = ((size_t)((p[2] << 8) | p[3]) + 1) * 4;
+      if (plen > len) return;
+      uint8_t count = p[0] & 0x1F;
+      const uint8_t* blocks = nullptr;
+
+      if (p[1] == PT_SR && plen >= 28) {
+        _lastSr   = (get32(p + 8) << 16) | (get32(p + 12) >> 16);
+        _lastSrMs = now;
+        blocks = p + 28;
+      } else if (p[1] == PT_RR) {
+        blocks = p + 8;
+      }
+      if (blocks) {
+        for (uint8_t i = 0; i < count && blocks + 24 <= p + plen; ++i, blocks += 24) {
+          if (get32(blocks) != _localSsrc) continue;
+          handleReportBlock(blocks, now);
+        }
+      }
+      p   += plen;
+      len -= plen;
+    }
+  }
+
+  void handleReportBlock(const uint8_t* b, uint32_t now) {
+    _remoteFractionLost = b[4];
+    _remoteCumLost      = ((uint32_t)b[5] << 16) | ((uint32_t)b[6] << 8) | b[7];
+    _remoteJitter       = get32(b + 12);
+    uint32_t lsr  = get32(b + 16);
+    uint32_t dlsr = get32(b + 20);
+    if (lsr == 0) return;
+    // RTT = A - LSR - DLSR, all in 1/65536 s
+    uint32_t a   = ntpMiddle(ntpNow(now));
+    uint32_t rtt = a - lsr - dlsr;
+    if ((int32_t)rtt < 0) return;
+    _rttMs = (uint32_t)(((uint64_t)rtt * 1000) >> 16);
+  }
+};
@@ -13,9 +13,15 @@
 #include "AudioTools.h"
 #include "AudioTools/Communication/UDPStream.h"
 #include "RTPOverUDP.h"
-#include "AudioTools/AudioCodecs/CodecG7xx.h"
-#include "AudioTools/CoreAudio/Buffers.h"
-#include "OffsetFilter.h"
+#include "RTPPacketizer.h"
+#include "RTCPSession.h"
+#include "MicConditioner.h"
+#include "EchoCanceller.h"
+#include "AutoGainControl.h"
+#include "NoiseSuppressor.h"
+#include "VoiceActivityDetector.h"
+#include "ComfortNoise.h"
+#include "FrameClock.h"
 
 using namespace audio_tools;
 
@@ -26,11 +32,7 @@ public:
     , _password(password)
     , _udpStream{_ssid, _password}
     , _rtp{_udpStream}
-    , _encoder{&_rtp, new G711_ULAWEncoder()}
-    , _sender{_encoder, _toNet}
-    , _toNet{_dcCorrect}
-    , _offsetFilter{}
-    , _dcCorrect{_i2sIn, 1}
+    , _packetizer{_rtp}
     , _i2sIn{}
   {}
 
@@ -50,25 +52,15 @@ public:
     cfg.pin_data   = pin_data;
     cfg.is_master  = true;
     cfg.port_no  = I2S_NUM_0;
+    // DMA buffers are sized in frames: one 20 ms block per buffer, so each completion wakes update() once
+    cfg.buffer_size  = sizeof(_raw) / sizeof(_raw[0]);
+    cfg.buffer_count = 4;
     if (!_i2sIn.begin(cfg)) {
       Serial.println("[RTPInput] Error: I2S input begin failed");
       return false;
     }
 
-    // Build filters and converters
-    _dcCorrect.setFilter(0, _offsetFilter);
-    if (!_dcCorrect.begin(_pcmIn)) {
-      Serial.println("[RTPInput] Error: dcCorrect begin failed");
-      return false;
-    }
-    if (!_toNet.begin(_pcmIn, _pcmNet)) {
-      Serial.println("[RTPInput] Error: toNet begin failed");
-      return false;
-    }
-    if (!_encoder.begin(_pcmNet)) {
-      Serial.println("[RTPInput] Error: Encoder begin failed");
-      return false;
-    }
+    _conditioner.reset();
     if (!_udpStream.begin(dest, port)) {
       Serial.println("[RTPInput] Error: UDPStream.begin() failed");
       return false;
@@ -87,26 +79,147 @@ public:
     return true;
   }
 
+  // Sends to a new address from the next packet on, when a re-INVITE moved the far end's media; capture task only
+  bool retarget(const IPAddress& dest, uint16_t port) {
+    _dest = dest;
+    _port = port;
+    if (!_udpStream.begin(dest, port)) {
+      Serial.println("[RTPInput] Error: UDPStream.begin() failed");
+      return false;
+    }
+    Serial.printf("[RTPInput] Media now goes to %s:%u\n", dest.toString().c_str(), port);
+    return true;
+  }
+
+  // Feeds the RTCP sender report; the session reports under our RTP SSRC
+  void setRtcp(RTCPSession* rtcp) {
+    if (rtcp) rtcp->setLocalSSRC(_rtp.ssrc());
+    _rtp.setStatsListener(rtcp);
+  }
+
+  // Mic DC offset calibration: seed at boot from storage, read back once converged
+  void    seedDcOffset(int32_t offset) { _conditioner.seedDcOffset(offset); }
+  int32_t dcOffset() const             { return _conditioner.dcOffset(); }
+
+  // Packet time in ms (10/20/30/40/60), as negotiated in SDP; from the capture task once running
+  bool setPtime(uint8_t ms) { return _packetizer.setPtime(ms); }
+
+  // Negotiated codec: the RTP payload type and the G.711 law it stands for; from the capture task once running
+  void setCodec(uint8_t payloadType, G711::Law law) {
+    _rtp.setPayloadType(payloadType);
+    _packetizer.setLaw(law);
+  }
+
+  // Runs the mic through the echo canceller before encoding; RTPOutput feeds it what the speaker plays
+  void setEchoCanceller(EchoCanceller* aec) { _aec = aec; }
+
+  // Reports each DMA wake and how long the frame took to process
+  void setFrameClock(FrameClock* clock) { _clock = clock; }
+
+  // Muted: keep capturing (so the DMA queue stays drained and the canceller keeps adapting) but send nothing; the RTP
+  // timestamp still advances, so the first packet after unmuting is on time and carries the marker bit
+  void setMuted(bool muted) { _muted = muted; }
+
+  // Mic AGC, on by default; its gain and clip counters are available for telemetry
+  void setAgcEnabled(bool on)         { _agcEnabled = on; }
+  AutoGainControl& agc()              { return _agc; }
+
+  // Spectral noise suppression ahead of the AGC, on by default
+  void setNoiseSuppression(bool on)   { _nsEnabled = on; }
+  NoiseSuppressor& noiseSuppressor()  { return _ns; }
+
+  // DTX: no media during silence, only RFC 3389 comfort noise updates; on by default
+  void setDtxEnabled(bool on)         { _dtxEnabled = on; }
+  uint32_t voiceBlocks() const        { return _voiceBlocks; }
+  uint32_t silentBlocks() const       { return _silentBlocks; }
+
+  // One frame per call: blocks until the I2S DMA buffer holding the next frame completes, then runs the pipeline on it
   void update() {
-    size_t sent = _sender.copy();
-    //Serial.printf("[RTPInput] Sent %u RTP bytes\n", sent);
+    size_t bytes = _i2sIn.readBytes(reinterpret_cast<uint8_t*>(_raw), sizeof(_raw));
+    if (_clock) _clock->onWake();
+    processFrame(bytes / sizeof(int32_t));
+    if (_clock) _clock->onIdle();
   }
 
 private:
+  static const uint32_t CN_REFRESH_SAMPLES = 8000;   // resend the CN level at least once a second
+  static const uint8_t  CN_LEVEL_STEP      = 3;      // or as soon as it moves by 3 dB
+
+  void processFrame(size_t n) {
+    const int32_t* in = _raw;
+
+    // Condition to 8 kHz PCM, cancel the echo, remove steady noise, level it, then encode into the payload; stages that
+    // are switched off are skipped.
+    // The VAD decides before the AGC: residual noise that opens the AGC gate gets pumped up by the full gain and
+    // would read as speech for the rest of the pause.
+    size_t produced = _conditioner.process(in, n, _pcm);
+    if (_aec) _aec->process(_pcm, produced);
+    if (_nsEnabled) _ns.process(_pcm, produced);
+    bool voice = !_dtxEnabled || _vad.process(_pcm, produced);
+    if (_agcEnabled) _agc.process(_pcm, produced);
+    if (_muted) {
+      _packetizer.skipSamples(_pcm, produced);   // the RTP clock keeps running, unmuting starts a talkspurt
+      return;
+    }
+    if (voice) {
+      _packetizer.writeSamples(_pcm, produced);
+      _cnSent = false;
+      _voiceBlocks++;
+    } else {
+      _packetizer.skipSamples(_pcm, produced);
+      updateComfortNoise(produced);
+      _silentBlocks++;
+    }
+    //Serial.printf("[RTPInput] Conditioned %u samples\n", bytes / sizeof(int32_t));
+  }
+
+  // First silent block after speech sends CN, then only refreshes or level changes. The level is taken after the
+  // AGC, so the comfort noise matches what the far end heard at the end of the hangover, and averaged over about
+  // 80 ms: the suppressed noise swings by several dB from frame to frame and would send a CN packet for each swing.
+  void updateComfortNoise(size_t samples) {
+    _sinceCn += samples;
+    uint64_t energy = 0;
+    for (size_t i = 0; i < samples; ++i) energy += (int32_t)_pcm[i] * _pcm[i];
+    uint64_t power = samples ? energy / samples : 0;
+    if (!_cnSent) _cnPower = power;
+    else _cnPower = _cnPower - (_cnPower >> 2) + (power >> 2);
+    if (!_packetizer.frameBoundary()) return;
+    uint8_t level = ComfortNoise::levelOf(_cnPower, 1);
+    int     delta = (int)level - (int)_cnLevel;
+    if (_cnSent && _sinceCn < CN_REFRESH_SAMPLES && delta < CN_LEVEL_STEP && delta > -CN_LEVEL_STEP) return;
+    _packetizer.sendComfortNoise(level);
+    _cnSent  = true;
+    _cnLevel = level;
+    _sinceCn = 0;
+  }
+
   const char*                       _ssid;
   const char*                       _password;
 
   UDPStream                         _udpStream;
   RTPOverUDP                        _rtp;
-  OffsetFilter                      _offsetFilter;
-  FilteredStream<int32_t, int32_t>  _dcCorrect;
-  FormatConverterStream             _toNet;
-  EncodedAudioStream                _encoder;
-  StreamCopy                        _sender;
+  RTPPacketizer                     _packetizer;
+  MicConditioner                    _conditioner;
+  NoiseSuppressor                   _ns;
+  AutoGainControl                   _agc;
+  VoiceActivityDetector             _vad;
   I2SStream                         _i2sIn;
 
   uint16_t                          _port;
   IPAddress                         _dest;
   AudioInfo                         _pcmIn{16000, 1, 32};
-  AudioInfo                         _pcmNet{8000, 1, 16};
+  int32_t                           _raw[320];          // 20 ms at 16 kHz
+  int16_t                           _pcm[161];          // 20 ms at 8 kHz plus a carried sample
+  EchoCanceller*                    _aec   = nullptr;
+  FrameClock*                       _clock = nullptr;
+  bool                              _muted = false;
+  bool                              _nsEnabled  = true;
+  bool                              _agcEnabled = true;
+  bool                              _dtxEnabled = true;
+  bool                              _cnSent     = false;
+  uint8_t                           _cnLevel    = ComfortNoise::SILENT_LEVEL;
+  uint32_t                          _sinceCn    = 0;
+  uint64_t                          _cnPower    = 0;     // smoothed mean square of the silent frames
+  uint32_t                          _voiceBlocks  = 0;
+  uint32_t                          _silentBlocks = 0;
 };
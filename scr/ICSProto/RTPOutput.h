@@ -13,8 +13,14 @@
 #include "AudioTools.h"
 #include "AudioTools/Communication/UDPStream.h"
 #include "RTPOverUDP.h"
-#include "AudioTools/AudioCodecs/CodecG7xx.h"
-#include "AudioTools/CoreAudio/Buffers.h"
+#include "JitterBuffer.h"
+#include "PacketLossConcealer.h"
+#include "RTCPSession.h"
+#include "EchoCanceller.h"
+#include "ComfortNoise.h"
+#include "VolumeDecoder.h"
+#include "DriftResampler.h"
+#include "FrameClock.h"
 
 using namespace audio_tools;
 
@@ -25,11 +31,7 @@ public:
     , _password{password}
     , _udpStream{_ssid, _password}
     , _rtp{_udpStream}
-    , _decoder{&_rtp, new G711_ULAWDecoder()}
-    , _bufCopy{_jitterBuffer, _decoder}
-    , _jitterBuffer{JITTER_BUF_SIZE}
-    , _player{_volume, _jitterBuffer} 
-    , _volume{_i2sOut}
+    , _jitterBuffer{}
     , _i2sOut{}
     {}
 
@@ -50,65 +52,190 @@ bool begin(uint16_t port, int pin_ws, int pin_bck, int pin_data, float volumeLev
     cfg.pin_data = pin_data;
     cfg.i2s_format = I2S_STD_FORMAT;
     cfg.port_no  = I2S_NUM_1;
-    cfg.buffer_size  = 1024;
-    cfg.buffer_count = 16;
+    cfg.buffer_size  = BLOCK_SAMPLES;      // DMA frames: one 20 ms block per buffer, the jitter buffer holds the slack
+    cfg.buffer_count = 4;
     if (!_i2sOut.begin(cfg)) {
       Serial.println("[RTPOutput]Error: I2SStream begin failed");
       return false;
     }
-    //Configure  Decoder
-    if (!_decoder.begin(_pcmMono)) {
-      Serial.println("[RTPOutput]Error: Decoder begin failed");
-      return false;
-    }
-
-    // Configure volume control
-    auto vcfg = _volume.defaultConfig();
-    vcfg.copyFrom(_pcmMono);
-    _volume.begin(vcfg);
-    _volume.setVolume(volumeLevel);
-
-    Serial.println("[RTPOutput] FormatConverter begin OK");
-    // Pre-fill jitter buffer
-    while (_jitterBuffer.available() < MONO_FRAME_BYTES *5) {
-      _bufCopy.copy(); // pump in 5×20 ms = 200 ms of audio
-      delay(1);
-    }
-    Serial.println("[RTPOutput]Buffer warmed up—starting playback");
-
-    // Begin playback
-    _player.begin();
+    // Volume is applied by the decoder tables, no separate stage
+    _decoder.reset((int32_t)(constrain(volumeLevel, 0.0f, 1.0f) * VolumeDecoder::UNITY));
 
+    // No pre-fill here: the jitter buffer primes itself to its adaptive target depth
+    _jitterBuffer.reset();
+    _jitterBuffer.setCatchUpMargin(DRIFT_CATCH_UP_FRAMES);
+    _plc.reset();
+    _cn.reset();
+    _resampler.reset();
+    _comfortNoise = false;
+    Serial.println("[RTPOutput]Playback started");
     return true;
   }
 
   void update() {
-    // Refill jitter
-    while (_jitterBuffer.availableForWrite() >= MONO_FRAME_BYTES && _jitterBuffer.available() < REFILL_THRESHOLD) {
-      _bufCopy.copy();
+    // Move everything that arrived into the jitter buffer
+    RTPPacket pkt;
+    uint32_t now = millis();
+    while (_rtp.receive(pkt)) {
+      if (!_receiving) continue;
+      _jitterBuffer.push(pkt, now);
+      if (_rtcp) _rtcp->onRtpReceived(pkt, _jitterBuffer.jitter());
+    }
+
+    // Keep the resampler fed, then play one block; the blocking I2S write returns once a DMA buffer has been played
+    // out, so each call advances the pipeline by exactly one frame
+    while (!_resampler.canProduce(BLOCK_SAMPLES)) {
+      if (!decodeNextFrame()) break;
     }
-    _player.copy();
+    // Render straight into the canceller's reference slot when there is one, so the block is never copied again
+    int16_t* block = _aec ? _aec->reserveFarEnd() : nullptr;
+    if (!block) block = _out;
+    _resampler.produce(block, BLOCK_SAMPLES);
+    steerDrift();
+
+    if (_clock) _clock->onIdle();
+    _i2sOut.write(reinterpret_cast<const uint8_t*>(block), BLOCK_SAMPLES * sizeof(int16_t));
+    if (_clock) _clock->onWake();
+    if (block != _out) _aec->commitFarEnd();
   }
 
+  // Ramped over 16 ms by the decoder, so volume steps do not click
   void setAmpGain(float g){
-    _volume.setVolume(constrain(g, 0.0f, 1.0f));
+    _decoder.setVolume(g);
+  }
+
+  // Negotiated codec of the incoming stream: its payload type and G.711 law. Until it is set any payload type is
+  // decoded; after a change mid-call, packets still in the old one are concealed rather than decoded with the new law
+  void setCodec(uint8_t payloadType, G711::Law law) {
+    _payloadType = payloadType;
+    _decoder.setLaw(law);
+  }
+
+  // Off while the call is sendonly or inactive from our side: arriving packets are dropped and the speaker plays
+  // silence; back on, the jitter buffer primes again
+  void setReceiving(bool on) {
+    if (on && !_receiving) {
+      _jitterBuffer.reset();
+      _plc.reset();
+      _lastUnderruns = _jitterBuffer.underruns();
+    }
+    _receiving    = on;
+    _comfortNoise = false;
   }
+  bool receiving() const { return _receiving; }
+
+  // Hands every played frame to the echo canceller as its far-end reference
+  void setEchoCanceller(EchoCanceller* aec) { _aec = aec; }
+
+  // Reports each DMA wake and how long the frame took to prepare
+  void setFrameClock(FrameClock* clock) { _clock = clock; }
+
+  // Feeds the RTCP receiver statistics, jitter included, from the jitter buffer
+  void setRtcp(RTCPSession* rtcp) { _rtcp = rtcp; }
+
+  const JitterBuffer& jitterBuffer() const { return _jitterBuffer; }
+  uint32_t concealedFrames() const         { return _concealed; }
+  int32_t  driftPpm() const                { return _resampler.driftPpm(); }
 
 private:
+  // Pops one frame from the jitter buffer and hands its PCM (decoded, concealed or comfort noise) to the resampler
+  bool decodeNextFrame() {
+    const JitterBuffer::Frame* frame;
+    size_t samples = _jitterBuffer.frameSamples();
+    if (samples > MAX_FRAME_SAMPLES) samples = MAX_FRAME_SAMPLES;
+    if (!_receiving) {
+      memset(_pcm, 0, samples * sizeof(int16_t));
+      return _resampler.push(_pcm, samples);
+    }
+    switch (_jitterBuffer.pop(frame)) {
+      case JitterBuffer::Result::Frame:
+        if (frame->payloadType == JitterBuffer::CN_PAYLOAD_TYPE) {
+          // sender went quiet: keep playing its background noise until the next talkspurt
+          _cn.setLevel(frame->len > 0 ? frame->data[0] : ComfortNoise::SILENT_LEVEL);
+          _comfortNoise = true;
+          _cn.generate(_pcm, samples);
+          _decoder.applyGain(_pcm, samples);
+          _plc.goodFrame(_pcm, samples);
+          break;
+        }
+        _comfortNoise = false;
+        samples = frame->len < MAX_FRAME_SAMPLES ? frame->len : MAX_FRAME_SAMPLES;
+        if (_payloadType >= 0 && frame->payloadType != _payloadType) {
+          _plc.conceal(_pcm, samples);              // the codec before a re-INVITE changed it
+          _concealed++;
+          break;
+        }
+        _decoder.decode(frame->data, _pcm, samples);          // decode and volume in one lookup
+        _plc.goodFrame(_pcm, samples);
+        break;
+      case JitterBuffer::Result::Lost:
+        if (_comfortNoise) {
+          _cn.generate(_pcm, samples);              // most likely a lost CN update
+          _decoder.applyGain(_pcm, samples);
+          _plc.goodFrame(_pcm, samples);
+          break;
+        }
+        _plc.conceal(_pcm, samples);
+        _concealed++;
+        break;
+      case JitterBuffer::Result::Empty:
+        if (_comfortNoise) {
+          _cn.generate(_pcm, samples);
+          _decoder.applyGain(_pcm, samples);
+          _plc.goodFrame(_pcm, samples);
+          break;
+        }
+        // an underrun mid-talk is concealed (and faded out) too, otherwise play silence
+        if (_plc.concealing() || _jitterBuffer.underruns() != _lastUnderruns) {
+          _lastUnderruns = _jitterBuffer.underruns();
+          _plc.conceal(_pcm, samples);
+        } else {
+          memset(_pcm, 0, samples * sizeof(int16_t));
+        }
+        break;
+    }
+    // the concealer works on the scaled signal, so its output already has the volume applied
+    return _resampler.push(_pcm, samples);
+  }
+
+  // Holds buffered audio (jitter buffer plus resampler FIFO) at the jitter buffer target while voice is playing;
+  // priming, DTX and underruns restart the average but keep the learned drift
+  void steerDrift() {
+    if (!_jitterBuffer.playing() || _jitterBuffer.inDtx() || _comfortNoise) {
+      _resampler.holdSteering();
+      return;
+    }
+    // measured right after a block was produced, when the FIFO holds on average half a frame
+    uint32_t frame    = _jitterBuffer.frameSamples();
+    int32_t  buffered = (int32_t)(_jitterBuffer.depthFrames() * frame + _resampler.available());
+    int32_t  target   = (int32_t)(_jitterBuffer.targetFrames() * frame + frame / 2);
+    _resampler.steer(buffered - target, BLOCK_SAMPLES);
+  }
+
+  static const size_t BLOCK_SAMPLES      = EchoCanceller::REF_BLOCK;   // one I2S DMA buffer, 20 ms
+  static const size_t DRIFT_CATCH_UP_FRAMES = 6;         // the resampler holds the depth, skipping is a last resort
+  static const size_t MAX_FRAME_SAMPLES  = JitterBuffer::MAX_FRAME_BYTES;
+
   const char*           _ssid;
   const char*           _password;
   UDPStream             _udpStream;
-  RTPOverUDP             _rtp;
-  EncodedAudioStream    _decoder;
-  StreamCopy            _bufCopy;
-  RingBufferStream      _jitterBuffer;
-  StreamCopy            _player;
-  VolumeStream          _volume;
+  RTPOverUDP            _rtp;
+  JitterBuffer          _jitterBuffer;
+  PacketLossConcealer   _plc;
+  ComfortNoise          _cn;
+  bool                  _comfortNoise  = false;
+  bool                  _receiving     = true;
+  int16_t               _payloadType   = -1;        // -1 = any
+  int16_t               _pcm[MAX_FRAME_SAMPLES];
+  DriftResampler        _resampler;
+  int16_t               _out[BLOCK_SAMPLES];
+  VolumeDecoder         _decoder;
   I2SStream             _i2sOut;
-
-  static const size_t MONO_FRAME_BYTES   = 160 * 2;
-  static const size_t REFILL_THRESHOLD   = MONO_FRAME_BYTES * 1;
-  static const size_t JITTER_BUF_SIZE    = 160 * 2 * 2 * 30;
+  uint32_t              _concealed     = 0;
+  uint32_t              _lastUnderruns = 0;
+  EchoCanceller*        _aec           = nullptr;
+  FrameClock*           _clock         = nullptr;
+  RTCPSession*          _rtcp          = nullptr;
 
   AudioInfo _pcmMono   {8000, 1, 16};
-};
\ No newline at end of file
+};
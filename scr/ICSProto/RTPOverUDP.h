@@ -4,7 +4,8 @@
  * Licensed under the GNU General Public License v3.0
  * (c) 2025 Hugo Schroeder
 
- * This class serves as a bare bones RTP over UDP class, as it just strips the header file and returns the payload.
+ * This class serves as a bare bones RTP over UDP class. On receive it parses the full RTP header (CSRC list,
+ * extension, padding) and hands back one packet at a time, or the bare payload through the Stream API.
  * For sending packets, it will construct RTP packets, but does not handle the UDP stream
 
  */
@@ -17,6 +18,31 @@ using namespace audio_tools;
 
 static const size_t RTP_HEADER_SIZE = 12;
 
+// One received RTP datagram; payload points into the receive buffer of RTPOverUDP
+struct RTPPacket {
+  uint8_t        version;
+  bool           padding;
+  bool           extension;
+  uint8_t        csrcCount;
+  bool           marker;
+  uint8_t        payloadType;
+  uint16_t       seq;
+  uint32_t       timestamp;
+  uint32_t       ssrc;
+  const uint8_t* payload;
+  size_t         payloadLen;
+};
+
+// Gets told about every packet sent and received, e.g. by RTCPSession for its reports. Sends are reported by
+// RTPOverUDP; receives by the playout path once its jitter buffer has taken the packet, together with the
+// RFC 3550 A.8 interarrival jitter (timestamp units) measured there, so there is only one estimator.
+class RTPStatsListener {
+public:
+  virtual ~RTPStatsListener() = default;
+  virtual void onRtpSent(uint32_t rtpTimestamp, size_t payloadLen) = 0;
+  virtual void onRtpReceived(const RTPPacket& pkt, uint32_t jitter) = 0;
+};
+
 class RTPOverUDP : public BaseStream {
 public:
   explicit RTPOverUDP(UDPStream& udpStream)
@@ -24,71 +50,137 @@ public:
     , _seq(0)
     , _timestamp(0)
     , _ssrc(esp_random())
-    , _payloadType(0)
-    , _sampleRate(8000) {}
+    , _payloadType(0) {
+    // V=2, P=0, X=0, CC=0 and the SSRC never change, so they are written once
+    _txPacket[0] = 0x80;
+    setPayloadType(_payloadType);
+    setSSRC(_ssrc);
+  }
+
+  void setSSRC(uint32_t s) {
+    _ssrc = s;
+    _txPacket[8]  = (_ssrc >> 24) & 0xFF;
+    _txPacket[9]  = (_ssrc >> 16) & 0xFF;
+    _txPacket[10] = (_ssrc >> 8 ) & 0xFF;
+    _txPacket[11] = (_ssrc      ) & 0xFF;
+  }
+  void setPayloadType(uint8_t pt) { _payloadType = pt & 0x7F; _txPacket[1] = _payloadType; }
+  void setStatsListener(RTPStatsListener* l) { _stats = l; }
+  uint32_t ssrc() const           { return _ssrc; }
 
-  void setSSRC(uint32_t s)        { _ssrc = s; }
-  void setPayloadType(uint8_t pt) { _payloadType = pt; }
-  void setSampleRate(uint32_t sr) { _sampleRate = sr; }
+  // Payload slot of the reusable packet buffer; encoders write straight into it and then call sendPacket()
+  uint8_t* payloadBuffer()               { return _txPacket + RTP_HEADER_SIZE; }
+  static constexpr size_t maxPayload()   { return RTP_MAX_PAYLOAD; }
 
-  size_t write(const uint8_t* payload, size_t len) override {
-    // build RTP header
-    uint8_t header[12];                     // V=2, P=0, X=0, CC=0
-    header[0] = 0x80;
-    header[1] = _payloadType;                // M=0 - Payload type
-    header[2] = (_seq >> 8) & 0xFF;          // Sequence Numebr
-    header[3] = (_seq     ) & 0xFF;          // timestamp
-    header[4] = (_timestamp >> 24) & 0xFF;
-    header[5] = (_timestamp >> 16) & 0xFF;
-    header[6] = (_timestamp >>  8) & 0xFF;
-    header[7] = (_timestamp      ) & 0xFF;    // SSRC
-    header[8]  = (_ssrc >> 24) & 0xFF;
-    header[9]  = (_ssrc >> 16) & 0xFF;
-    header[10] = (_ssrc >> 8 ) & 0xFF;
-    header[11] = (_ssrc      ) & 0xFF;
-
-    //_udp.write(header, RTP_HEADER_SIZE);
-    //_udp.write(payload, len);
-    size_t total = RTP_HEADER_SIZE + len;
-    auto* pkt = (uint8_t*)malloc(total);
-    memcpy(pkt, header, RTP_HEADER_SIZE);
-    memcpy(pkt+RTP_HEADER_SIZE, payload, len);
-    size_t sent = _udp.write(pkt, total);
-    free(pkt);
+  // Sends payloadLen bytes already placed in payloadBuffer() and advances the timestamp by 'samples'.
+  // 'marker' flags the first packet of a talkspurt, 'payloadType' overrides the session type for this packet (CN).
+  size_t sendPacket(size_t payloadLen, uint32_t samples, bool marker = false, int16_t payloadType = -1) {
+    if (payloadLen > RTP_MAX_PAYLOAD) payloadLen = RTP_MAX_PAYLOAD;
+    _txPacket[1] = (marker ? 0x80 : 0x00) | (payloadType < 0 ? _payloadType : (payloadType & 0x7F));
+    _txPacket[2] = (_seq >> 8) & 0xFF;          // Sequence Number
+    _txPacket[3] = (_seq     ) & 0xFF;
+    _txPacket[4] = (_timestamp >> 24) & 0xFF;   // Timestamp
+    _txPacket[5] = (_timestamp >> 16) & 0xFF;
+    _txPacket[6] = (_timestamp >>  8) & 0xFF;
+    _txPacket[7] = (_timestamp      ) & 0xFF;
+
+    // one contiguous datagram, no heap traffic
+    _udp.write(_txPacket, RTP_HEADER_SIZE + payloadLen);
+    if (_stats) _stats->onRtpSent(_timestamp, payloadLen);
 
     _seq++;
-    _timestamp += (len * 8000) / (_sampleRate * sizeof(int16_t));
-    return RTP_HEADER_SIZE + len;
+    _timestamp += samples;
+    return RTP_HEADER_SIZE + payloadLen;
   }
 
-  int available() override {
-    int total = _udp.available();
-    if (total <= RTP_HEADER_SIZE) {
-      if (total > 0) {
-        uint8_t discard[total];
-        _udp.readBytes(discard, total);
+  // Advances the media clock over samples that are not sent (DTX), so the next packet carries the right timestamp
+  void skipSamples(uint32_t samples) { _timestamp += samples; }
+
+  size_t write(const uint8_t* payload, size_t len) override {
+    // Stream API fallback for callers that own their own buffer of G.711 bytes; large writes are split into several
+    // packets. One byte is one sample, so the timestamp advances by the byte count.
+    size_t done = 0;
+    while (done < len) {
+      size_t chunk = len - done;
+      if (chunk > RTP_MAX_PAYLOAD) chunk = RTP_MAX_PAYLOAD;
+      memcpy(payloadBuffer(), payload + done, chunk);
+      sendPacket(chunk, chunk);
+      done += chunk;
+    }
+    return len;
+  }
+
+  // Reads and parses the next valid datagram. Datagrams that are not valid RTP are dropped and counted, so a
+  // stray packet never stops a drain loop; returns false only once nothing is pending.
+  // The payload view stays valid until the next call to receive() or readBytes().
+  bool receive(RTPPacket& pkt) {
+    for (;;) {
+      int total = _udp.available();
+      if (total <= 0) return false;
+
+      // Read the whole datagram so nothing of it can leak into the next one
+      size_t len = (size_t)total < sizeof(_rxPacket) ? (size_t)total : sizeof(_rxPacket);
+      len = _udp.readBytes(_rxPacket, len);
+      discard(total - (int)len);
+
+      if (!parse(_rxPacket, len, pkt)) {
+        _rejected++;
+        continue;
       }
-      return 0;
+      return true;
     }
-    return total - RTP_HEADER_SIZE;
+  }
+
+  // Datagrams dropped by receive() because they were not valid RTP
+  uint32_t rejected() const { return _rejected; }
+
+  // Parses one RTP datagram in place, honouring CSRC list, header extension and padding
+  static bool parse(const uint8_t* data, size_t len, RTPPacket& pkt) {
+    if (len < RTP_HEADER_SIZE) return false;
+    pkt.version     = data[0] >> 6;
+    pkt.padding     = (data[0] & 0x20) != 0;
+    pkt.extension   = (data[0] & 0x10) != 0;
+    pkt.csrcCount   = data[0] & 0x0F;
+    pkt.marker      = (data[1] & 0x80) != 0;
+    pkt.payloadType = data[1] & 0x7F;
+    pkt.seq         = ((uint16_t)data[2] << 8) | data[3];
+    pkt.timestamp   = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) | ((uint32_t)data[6] << 8) | data[7];
+    pkt.ssrc        = ((uint32_t)data[8] << 24) | ((uint32_t)data[9] << 16) | ((uint32_t)data[10] << 8) | data[11];
+    if (pkt.version != 2) return false;
+
+    size_t offset = RTP_HEADER_SIZE + 4 * pkt.csrcCount;
+    if (pkt.extension) {
+      if (offset + 4 > len) return false;
+      size_t extWords = ((size_t)data[offset + 2] << 8) | data[offset + 3];
+      offset += 4 + 4 * extWords;
+    }
+    size_t end = len;
+    if (pkt.padding) {
+      uint8_t pad = data[len - 1];
+      if (pad == 0 || pad > end) return false;
+      end -= pad;
+    }
+    if (offset > end) return false;
+
+    pkt.payload    = data + offset;
+    pkt.payloadLen = end - offset;
+    return true;
+  }
+
+  // Stream API for the decoder: payload bytes of the current packet, the next packet is only pulled once it is used up
+  int available() override {
+    if (_rxRemaining == 0) fetchPayload();
+    return (int)_rxRemaining;
   }
 
   // Read up to 'len' payload bytes into buffer
   size_t readBytes(uint8_t* buffer, size_t len) override {
-    int total = _udp.available();
-    if (total <= 12) {
-      if (total > 0) {
-        uint8_t discardBuf[total];
-        _udp.readBytes(discardBuf, total);
-      }
-      return 0;
-    }
-    // Skip the 12-byte RTP header
-    uint8_t headerBuf[12];
-    _udp.readBytes(headerBuf, 12);
-    size_t toCopy = total - 12;
-    if (toCopy > len) toCopy = len;
-    return _udp.readBytes(buffer, toCopy);
+    if (_rxRemaining == 0 && !fetchPayload()) return 0;
+    size_t toCopy = _rxRemaining < len ? _rxRemaining : len;
+    memcpy(buffer, _rxPayload, toCopy);
+    _rxPayload   += toCopy;
+    _rxRemaining -= toCopy;
+    return toCopy;
   }
 
 private:
@@ -97,7 +189,34 @@ private:
   uint32_t _timestamp;
   uint32_t _ssrc;
   uint8_t  _payloadType;
-  uint32_t _sampleRate;
+  RTPStatsListener* _stats = nullptr;
+  uint32_t _rejected = 0;
 
   static constexpr size_t RTP_HEADER_SIZE = 12;
+  static constexpr size_t RTP_MAX_PAYLOAD = 480;   // 60 ms of G.711 at 8 kHz
+  static constexpr size_t RTP_MAX_DATAGRAM = 1024;
+  uint8_t  _txPacket[RTP_HEADER_SIZE + RTP_MAX_PAYLOAD];
+  uint8_t  _rxPacket[RTP_MAX_DATAGRAM];
+  const uint8_t* _rxPayload = nullptr;
+  size_t   _rxRemaining = 0;
+
+  bool fetchPayload() {
+    RTPPacket pkt;
+    while (receive(pkt)) {
+      if (pkt.payloadLen == 0) continue;
+      _rxPayload   = pkt.payload;
+      _rxRemaining = pkt.payloadLen;
+      return true;
+    }
+    return false;
+  }
+
+  void discard(int n) {
+    uint8_t scratch[64];
+    while (n > 0) {
+      size_t got = _udp.readBytes(scratch, n < (int)sizeof(scratch) ? n : sizeof(scratch));
+      if (got == 0) break;
+      n -= got;
+    }
+  }
 };
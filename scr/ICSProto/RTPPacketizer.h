@@ -0,0 +1,143 @@
+/*
+ * RTPPacketizer.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Sits between the encoder and RTPOverUDP and cuts the encoded byte stream into packets of exactly one ptime.
+ * Encoded bytes (or PCM through writeSamples(), which encodes in the same pass) are accumulated straight into the
+ * payload slot of the RTPOverUDP packet buffer, so a full frame is sent without any extra copy. The RTP timestamp
+ * advances by the true sample count of each frame. For DTX, skipSamples() lets the clock run without sending, the
+ * next frame then carries the marker bit, and sendComfortNoise() emits an RFC 3389 packet (PT 13) between talkspurts.
+ * The law and the ptime may change mid-call (re-INVITE): a half filled frame of the old format is dropped, its time
+ * skipped, and the next packet starts a talkspurt.
+ */
+#pragma once
+#include <Arduino.h>
+#include "RTPOverUDP.h"
+#include "G711.h"
+
+class RTPPacketizer : public Print {
+public:
+  explicit RTPPacketizer(RTPOverUDP& rtp, uint32_t clockRate = 8000, uint8_t bytesPerSample = 1)
+    : _rtp(rtp)
+    , _clockRate(clockRate)
+    , _bytesPerSample(bytesPerSample)
+    , _ptime(0)
+    , _fill(0)
+    , _law(G711::ULAW) {
+    setPtime(20);
+  }
+
+  // G.711 law used by writeSamples(); the payload type to match is set on RTPOverUDP
+  void setLaw(G711::Law law) {
+    if (law != _law) dropFrame();
+    _law = law;
+  }
+  G711::Law law() const { return _law; }
+
+  // Valid packet times are 10, 20, 30, 40 and 60 ms; anything else is rejected
+  bool setPtime(uint8_t ms) {
+    if (ms != 10 && ms != 20 && ms != 30 && ms != 40 && ms != 60) return false;
+    uint32_t samples = (_clockRate * ms) / 1000;
+    if (samples * _bytesPerSample > RTPOverUDP::maxPayload()) return false;
+    if (ms == _ptime) return true;
+    dropFrame();
+    _ptime          = ms;
+    _frameSamples   = samples;
+    _frameBytes     = samples * _bytesPerSample;
+    return true;
+  }
+
+  uint8_t  ptime() const        { return _ptime; }
+  uint32_t frameSamples() const { return _frameSamples; }
+  size_t   frameBytes() const   { return _frameBytes; }
+
+  // Zero-copy access for fused encoders: write up to 'room' bytes at the returned pointer, then commit()
+  uint8_t* reserve(size_t& room) {
+    room = _frameBytes - _fill;
+    return _rtp.payloadBuffer() + _fill;
+  }
+
+  void commit(size_t bytes) {
+    _fill += bytes;
+    if (_fill >= _frameBytes) sendFrame();
+  }
+
+  // 16-bit PCM in, encoded to G.711 straight into the packet payload
+  void writeSamples(const int16_t* pcm, size_t n) {
+    while (n > 0) {
+      size_t chunk = (_frameBytes - _fill) / _bytesPerSample;
+      if (chunk > n) chunk = n;
+      G711::encode(_law, pcm, _rtp.payloadBuffer() + _fill, chunk);
+      _fill += chunk * _bytesPerSample;
+      pcm   += chunk;
+      n     -= chunk;
+      if (_fill == _frameBytes) sendFrame();
+    }
+  }
+
+  // True between frames, i.e. nothing is half filled
+  bool frameBoundary() const { return _fill == 0; }
+
+  // Silence: a half filled frame is completed with these samples, the rest only advances the timestamp
+  void skipSamples(const int16_t* pcm, size_t n) {
+    if (_fill > 0) {
+      size_t chunk = (_frameBytes - _fill) / _bytesPerSample;
+      if (chunk > n) chunk = n;
+      writeSamples(pcm, chunk);
+      n -= chunk;
+    }
+    if (n == 0) return;
+    _rtp.skipSamples(n);
+    _marker = true;                  // the next voice packet starts a talkspurt
+  }
+
+  // RFC 3389 comfort noise with only the level byte (-dBov); must be sent on a frame boundary
+  void sendComfortNoise(uint8_t levelDbov) {
+    if (_fill != 0) return;
+    _rtp.payloadBuffer()[0] = levelDbov & 0x7F;
+    _rtp.sendPacket(1, 0, false, CN_PAYLOAD_TYPE);
+    _marker = true;
+  }
+
+  static const uint8_t CN_PAYLOAD_TYPE = 13;
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  size_t write(const uint8_t* data, size_t len) override {
+    size_t done = 0;
+    while (done < len) {
+      size_t chunk = _frameBytes - _fill;
+      if (chunk > len - done) chunk = len - done;
+      memcpy(_rtp.payloadBuffer() + _fill, data + done, chunk);
+      _fill += chunk;
+      done  += chunk;
+      if (_fill == _frameBytes) sendFrame();
+    }
+    return len;
+  }
+
+private:
+  void dropFrame() {
+    if (_fill == 0) return;
+    _rtp.skipSamples(_fill / _bytesPerSample);
+    _fill   = 0;
+    _marker = true;
+  }
+
+  void sendFrame() {
+    _rtp.sendPacket(_frameBytes, _frameSamples, _marker);
+    _marker = false;
+    _fill   = 0;
+  }
+
+  RTPOverUDP& _rtp;
+  uint32_t    _clockRate;
+  uint8_t     _bytesPerSample;
+  uint8_t     _ptime;
+  uint32_t    _frameSamples;
+  size_t      _frameBytes;
+  size_t      _fill;
+  G711::Law   _law;
+  bool        _marker = true;        // the very first packet starts a talkspurt too
+};
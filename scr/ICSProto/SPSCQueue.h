@@ -0,0 +1,123 @@
+/*
+ * SPSCQueue.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Lock-free single-producer / single-consumer ring of fixed-size items (audio frames, messages) for handing data
+ * between FreeRTOS tasks. One task may only produce and one other task may only consume. The producer owns the tail
+ * index and the consumer the head index; each publishes its index with a release store and reads the other's with
+ * an acquire load, so slot contents are visible before the index that covers them. Wait-free on both sides: no
+ * locks, no allocation, calls fail instead of blocking.
+ * The indices sit on separate cache lines and each side keeps a cached copy of the other's index, so the shared
+ * lines are only touched when the ring looks full or empty. Besides copying push()/pop() there is zero-copy access
+ * (reserve()/commit() to fill a slot in place, front()/release() to read one in place) and batch versions that
+ * publish several items with one index store. Only std::atomic is used, so the same header builds on the host.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SPSCQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SPSCQueue size must be a power of two");
+
+public:
+  static const size_t CACHE_LINE = 64;
+
+  SPSCQueue() : _head(0), _tailCache(0), _tail(0), _headCache(0) {}
+
+  // ---- producer side ----
+
+  // Slot to fill in place, or nullptr if full; the item becomes visible on commit()
+  T* reserve() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _headCache >= N) {
+      _headCache = _head.load(std::memory_order_acquire);
+      if (tail - _headCache >= N) return nullptr;
+    }
+    return &_items[tail & (N - 1)];
+  }
+
+  void commit() {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  bool push(const T& item) {
+    T* slot = reserve();
+    if (!slot) return false;
+    *slot = item;
+    commit();
+    return true;
+  }
+
+  // Pushes up to n items with a single publish; returns how many fitted
+  size_t push(const T* items, size_t n) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    size_t room = N - (tail - _headCache);
+    if (room < n) {
+      _headCache = _head.load(std::memory_order_acquire);
+      room = N - (tail - _headCache);
+    }
+    if (n > room) n = room;
+    for (size_t i = 0; i < n; ++i) _items[(tail + i) & (N - 1)] = items[i];
+    if (n) _tail.store(tail + (uint32_t)n, std::memory_order_release);
+    return n;
+  }
+
+  // ---- consumer side ----
+
+  // Oldest item, read in place, or nullptr if empty; the slot is handed back on release()
+  const T* front() {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tailCache) {
+      _tailCache = _tail.load(std::memory_order_acquire);
+      if (head == _tailCache) return nullptr;
+    }
+    return &_items[head & (N - 1)];
+  }
+
+  void release() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  bool pop(T& item) {
+    const T* slot = front();
+    if (!slot) return false;
+    item = *slot;
+    release();
+    return true;
+  }
+
+  // Pops up to n items with a single publish; returns how many were available
+  size_t pop(T* items, size_t n) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    size_t avail = _tailCache - head;
+    if (avail < n) {
+      _tailCache = _tail.load(std::memory_order_acquire);
+      avail = _tailCache - head;
+    }
+    if (n > avail) n = avail;
+    for (size_t i = 0; i < n; ++i) items[i] = _items[(head + i) & (N - 1)];
+    if (n) _head.store(head + (uint32_t)n, std::memory_order_release);
+    return n;
+  }
+
+  // Approximate from any task, exact from either end
+  size_t size() const {
+    return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+  }
+  bool empty() const                 { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T _items[N];
+
+  // consumer-owned line: the head it publishes and its last look at the tail
+  alignas(CACHE_LINE) std::atomic<uint32_t> _head;
+  uint32_t _tailCache;
+  // producer-owned line: the tail it publishes and its last look at the head
+  alignas(CACHE_LINE) std::atomic<uint32_t> _tail;
+  uint32_t _headCache;
+  char     _pad[CACHE_LINE - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+};
@@ -21,6 +21,7 @@ public:
     , _port(port)
     , _localPort(localPort)
     , _sip(outBuf, sizeof(outBuf))
+    , _sdpLen(0)
     , _lastRegisterMs(0)
   {}
 
@@ -63,12 +64,26 @@ public:
   }
 
   void update() {
-    // pump incoming SIP packets through the SIP state machine
+    // pump incoming SIP packets through the SIP state machine; this also runs the retransmission timers
     _sip.Processing(inBuf, sizeof(inBuf));
 
-        //Check if it’s time to re-REGISTER (every 200 000 ms = 200 seconds)
+    // A request that went unanswered for 32 s despite retransmissions: try again rather than wait a full cycle
     unsigned long now = millis();
-    if (now - _lastRegisterMs >= 200000UL) {
+    if (_sip.PollRegisterTimeout()) {
+      Serial.println("SIP: REGISTER timed out, retrying shortly");
+      _lastRegisterMs = now - REGISTER_MS + REGISTER_RETRY_MS;
+    }
+    if (_sip.PollDialTimeout() && _extBuf[0]) {
+      Serial.println("SIP: INVITE timed out, dialling again");
+      _sip.Dial(_extBuf, "ESP32 Call", _sdp, _sdpLen);
+    }
+    int failure = _sip.PollDialFailure();
+    if (failure) {
+      Serial.printf("SIP: call refused with %d\n", failure);
+    }
+
+        //Check if it’s time to re-REGISTER (every 200 000 ms = 200 seconds)
+    if (now - _lastRegisterMs >= REGISTER_MS) {
       if (_sip.Register()) {
         Serial.println("SIP: REGISTER refresh sent");
       } else {
@@ -78,25 +93,32 @@ public:
     }
   }
 
-  bool callConference(uint16_t conferenceExt, uint16_t localRTPPort) {
+  bool callConference(uint16_t conferenceExt, uint16_t localRTPPort, uint8_t ptimeMs = 20) {
     snprintf(_extBuf, sizeof(_extBuf), "%u", (unsigned)conferenceExt);
-    _pendingSdp =
-      String(F("v=0\r\n")) +
-      "o=- 0 0 IN IP4 " + WiFi.localIP().toString() + "\r\n" +
-      "s=ESP32 SIP Call\r\n" +
-      "c=IN IP4 " + WiFi.localIP().toString() + "\r\n" +
-      "t=0 0\r\n" +
-      "m=audio " + String(localRTPPort) + " RTP/AVP 0\r\n" +
-      "a=rtpmap:0 PCMU/8000\r\n";
-      "a=ptime:20\r\n";
+
+    // What we can do, cheapest codec first; the same description answers an incoming INVITE
+    Sdp::Media local;
+    Sdp::Clear(local);
+    strncpy(local.address, _localIp, sizeof(local.address) - 1);
+    local.port = localRTPPort;
+    Sdp::Add(local, 0, Sdp::CODEC_PCMU);
+    Sdp::Add(local, 8, Sdp::CODEC_PCMA);
+    Sdp::Add(local, 13, Sdp::CODEC_CN);
+    local.ptime = ptimeMs;
+    local.direction = Sdp::SENDRECV;
+    _sip.SetLocalMedia(local);
+
+    // The offer is formatted in place; it stays in _sdp for the re-INVITE after a 401 or a timeout
+    SipBuilder sdp(_sdp, sizeof(_sdp));
+    if (!Sdp::Write(sdp, local, "ESP32 SIP Call", _sip.NewSdpOrigin())) {
+      Serial.println("SIP: SDP offer does not fit");
+      _sdpLen = 0;
+      return false;
+    }
+    _sdpLen = sdp.Length();
 
     // this will drive the 401/ack/invite dance
-  return _sip.Dial(
-    _extBuf,
-    "ESP32 Call",  
-    _pendingSdp.c_str(),
-    _pendingSdp.length()
-    );
+    return _sip.Dial(_extBuf, "ESP32 Call", _sdp, _sdpLen);
   }
   bool isInCall() const {
     bool reg = _sip.IsInCall();
@@ -106,8 +128,16 @@ public:
 
   uint16_t getRtpPort() const {return _sip.GetRemoteRtpPort();}
 
+  // Where to send media, with which codec, ptime and direction, as negotiated for the current call
+  const Sdp::Session& mediaSession() const { return _sip.GetMediaSession(); }
+  // Changes whenever mediaSession() does, e.g. when the far end puts the call on hold or moves its media
+  uint32_t mediaVersion() const { return _sip.GetMediaVersion(); }
+
 
 private:
+  static const unsigned long REGISTER_MS       = 200000UL;
+  static const unsigned long REGISTER_RETRY_MS = 5000UL;
+
   const char*     _ssid;
   const char*     _wifiPass;
   const char*     _user;
@@ -121,6 +151,7 @@ private:
   Sip             _sip;
   char            _extBuf[8];
   char            _localIp[16]; 
-  String          _pendingSdp;
+  char            _sdp[320];
+  size_t          _sdpLen;
   unsigned long   _lastRegisterMs;
 };
@@ -0,0 +1,80 @@
+/*
+ * VoiceActivityDetector.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Frame energy VAD for DTX on the mic path.
+ * The noise floor follows the frame energy down immediately and creeps up slowly (about 3 dB per second), so it
+ * settles on the background between words. A frame is speech when it is 9 dB above that floor and above an absolute
+ * minimum; once speech has lasted 40 ms, a 250 ms hangover keeps word endings and short pauses inside the talkspurt.
+ * A noise swing that clears the threshold for a frame or two is sent as it is, without the hangover behind it. The
+ * decision is made on the frame that is about to be sent, so speech onsets are never clipped by lookahead.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class VoiceActivityDetector {
+public:
+  VoiceActivityDetector() { reset(); }
+
+  void reset() {
+    _noise      = 0;
+    _haveNoise  = false;
+    _hangover   = 0;
+    _burst      = 0;
+    _lastEnergy = 0;
+    _lastLen    = 0;
+  }
+
+  // Returns true while the frame should be sent as speech
+  bool process(const int16_t* pcm, size_t n) {
+    if (n == 0) return _hangover > 0;
+    uint64_t energy = 0;
+    for (size_t i = 0; i < n; ++i) energy += (int32_t)pcm[i] * pcm[i];
+    _lastEnergy = energy;
+    _lastLen    = n;
+    uint32_t ms = (uint32_t)(energy / n);
+
+    if (!_haveNoise || ms < _noise) {
+      _noise     = ms;
+      _haveNoise = true;
+    } else {
+      // +3 dB/s at any frame length: multiply by 2^(ms/1000) ~ 1 + 0.69 * ms / 1000
+      uint32_t frameMs = (uint32_t)(n / 8);
+      uint64_t rise    = ((uint64_t)_noise * 693 * frameMs) / 1000000;
+      _noise += rise ? (uint32_t)rise : 1;
+    }
+
+    bool speech = ms > MIN_SPEECH && (uint64_t)ms > (uint64_t)_noise * SPEECH_RATIO;
+    if (speech) {
+      _burst += n;
+      if (_burst >= BURST_SAMPLES) _hangover = HANGOVER_SAMPLES;
+    } else if (_hangover > 0) {
+      _burst    = 0;
+      _hangover = _hangover > n ? _hangover - n : 0;
+      speech = true;
+    } else {
+      _burst = 0;
+    }
+    return speech;
+  }
+
+  // Energy of the last frame
+  uint64_t lastEnergy() const { return _lastEnergy; }
+  size_t   lastLength() const { return _lastLen; }
+  uint32_t noiseFloor() const { return _noise; }
+
+private:
+  static const uint32_t SPEECH_RATIO     = 8;        // 9 dB
+  static const uint32_t MIN_SPEECH       = 400;      // mean square, about -59 dBov
+  static const size_t   HANGOVER_SAMPLES = 2000;     // 250 ms
+  static const size_t   BURST_SAMPLES    = 320;      // 40 ms of speech before the hangover applies
+
+  uint32_t _noise;
+  bool     _haveNoise;
+  size_t   _hangover;
+  size_t   _burst;          // samples of speech in a row, hangover not counted
+  uint64_t _lastEnergy;
+  size_t   _lastLen;
+};
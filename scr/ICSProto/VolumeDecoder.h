@@ -0,0 +1,102 @@
+/*
+ * VolumeDecoder.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Fused G.711 decode and playback volume.
+ * The volume is baked into a 256 entry G.711 -> int16 table (mu-law or A-law, as negotiated) that is only rebuilt
+ * when the volume changes, so decoding a frame at any volume is one lookup per sample. On a change the previous table
+ * is kept and the output is ramped linearly from one to the other over 16 ms, which removes the zipper noise of an
+ * instant gain step.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "G711.h"
+
+class VolumeDecoder {
+public:
+  static const int32_t UNITY = 1 << 15;
+
+  VolumeDecoder() : _law(G711::ULAW) { reset(UNITY); }
+
+  // Codec of the incoming stream; rebuilds both tables, so it takes effect from the next decode()
+  void setLaw(G711::Law law) {
+    if (law == _law) return;
+    _law = law;
+    buildTable(_table, _gain);
+    buildTable(_prevTable, _fromGain);
+  }
+
+  // Sets the volume without a ramp (start of playback)
+  void reset(int32_t gainQ15) {
+    _gain     = clampGain(gainQ15);
+    _fromGain = _gain;
+    buildTable(_table, _gain);
+    buildTable(_prevTable, _gain);
+    _rampPos  = RAMP;
+  }
+
+  // Volume 0..1; ramps from wherever the output currently is
+  void setVolume(float v) {
+    if (v < 0.0f) v = 0.0f;
+    if (v > 1.0f) v = 1.0f;
+    setGain((int32_t)(v * UNITY + 0.5f));
+  }
+
+  void setGain(int32_t gainQ15) {
+    gainQ15 = clampGain(gainQ15);
+    if (gainQ15 == _gain) return;
+    _fromGain = currentGain();
+    buildTable(_prevTable, _fromGain);
+    _gain = gainQ15;
+    buildTable(_table, _gain);
+    _rampPos = 0;
+  }
+
+  void decode(const uint8_t* in, int16_t* out, size_t n) {
+    size_t i = 0;
+    for (; i < n && _rampPos < RAMP; ++i, ++_rampPos) {
+      int32_t a = _prevTable[in[i]];
+      int32_t b = _table[in[i]];
+      out[i] = (int16_t)(a + (((b - a) * (int32_t)_rampPos) >> RAMP_SHIFT));
+    }
+    const int16_t* table = _table;
+    for (; i < n; ++i) out[i] = table[in[i]];
+  }
+
+  // Same gain (and ramp) for PCM that did not come through the decoder, e.g. comfort noise
+  void applyGain(int16_t* pcm, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      int32_t g = currentGain();
+      if (_rampPos < RAMP) _rampPos++;
+      pcm[i] = (int16_t)(((int32_t)pcm[i] * g) >> 15);
+    }
+  }
+
+  int32_t gain() const { return _gain; }
+
+private:
+  static const uint32_t RAMP_SHIFT = 7;
+  static const uint32_t RAMP       = 1u << RAMP_SHIFT;     // 128 samples, 16 ms at 8 kHz
+
+  G711::Law _law;
+  int16_t  _table[256];
+  int16_t  _prevTable[256];
+  int32_t  _gain;
+  int32_t  _fromGain;
+  uint32_t _rampPos;
+
+  int32_t currentGain() const {
+    if (_rampPos >= RAMP) return _gain;
+    return _fromGain + (((_gain - _fromGain) * (int32_t)_rampPos) >> RAMP_SHIFT);
+  }
+
+  static int32_t clampGain(int32_t g) { return g < 0 ? 0 : (g > UNITY ? UNITY : g); }
+
+  void buildTable(int16_t* table, int32_t gainQ15) const {
+    for (int c = 0; c < 256; ++c) {
+      table[c] = (int16_t)(((int32_t)G711::toLinear(_law, (uint8_t)c) * gainQ15) >> 15);
+    }
+  }
+};
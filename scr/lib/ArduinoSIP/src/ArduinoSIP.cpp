@@ -35,6 +35,7 @@
    SUCH DAMAGE.
 
    ====================================================================*/
+#include <strings.h>
 #include <MD5Builder.h>
 #include <WiFiUdp.h>
 #include "ArduinoSIP.h"
@@ -45,10 +46,8 @@
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-Sip::Sip(char *pBuf, size_t lBuf) {
+Sip::Sip(char *pBuf, size_t lBuf) : out(pBuf, lBuf) {
 
-  pbuf = pBuf;
-  lbuf = lBuf;
   pDialNr = "";
   pDialDesc = "";
 
@@ -65,7 +64,7 @@ void Sip::Init(const char *SipIp, int SipPort, const char *MyIp, int MyPort, con
   Udp.begin(MyPort);
   
   caRead[0] = 0;
-  pbuf[0] = 0;
+  out.Reset();
   pSipIp = SipIp;
   iSipPort = SipPort;
   pSipUser = SipUser;
@@ -73,87 +72,44 @@ void Sip::Init(const char *SipIp, int SipPort, const char *MyIp, int MyPort, con
   pMyIp = MyIp;
   iMyPort = MyPort;
   iAuthCnt = 0;
+  iRegAuthCnt = 0;
+  iReqAuthCnt = 0;
+  auth.valid = false;
+  regid = Random();
+  iRegCSeq = 0;
   iRingTime = 0;
   iMaxTime = MaxDialSec * 1000;
+  for ( int i = 0; i < TRANSACTIONS; i++ )
+    transactions[i].state = TS_FREE;
 }
 
-bool Sip::Register(const char* challenge) {
-    // If authentication in progress, iAuthCnt > 0, a "401 Unauthorized" challenge first.
-    // Otherwise, this is the first REGISTER attempt.
-    char realm[128] = { 0 }, nonce[128] = { 0 }, opaque[128] = { 0 }, qop[32] = { 0 };
-    uint16_t cseq = (iAuthCnt == 0) ? 1 : (1 + iAuthCnt);
+// A new registration or refresh, or with retry the same one again after a 401; authenticates up front once a
+// challenge has been seen
+bool Sip::Register(bool retry) {
+
+    if (!retry) iRegAuthCnt = 0;
+    char uri[64];
+    snprintf(uri, sizeof(uri), "sip:%s", pSipIp);
 
     // Build the REGISTER request
-    pbuf[0] = '\0';
-    AddSipLine("REGISTER sip:%s SIP/2.0", pSipIp);                   // Request‐URI = server
-    AddSipLine("Via: SIP/2.0/UDP %s:%u;branch=%010u;rport=%u",      // Via: our IP:port
+    out.Reset();
+    out.Line("REGISTER %s SIP/2.0", uri);                           // Request‐URI = server
+    out.Line("Via: SIP/2.0/UDP %s:%u;branch=z9hG4bK%010u;rport=%u",    // Via: our IP:port, RFC 3261 branch
         pMyIp, iMyPort, Random(), iMyPort);
-    AddSipLine("Max-Forwards: 70");
-    AddSipLine("From: <sip:%s@%s>;tag=%010u",                        // From: our user
+    out.Line("Max-Forwards: 70");
+    out.Line("From: <sip:%s@%s>;tag=%010u",                          // From: our user
         pSipUser, pSipIp, Random());
-    AddSipLine("To: <sip:%s@%s>", pSipUser, pSipIp);                  // To: same as From
-    if (iAuthCnt == 0) { regid = Random(); }                          // Pick a random 32-bit regId; server to challenge
-    AddSipLine("Call-ID: %010u@%s", regid, pMyIp);
-    AddSipLine("CSeq: %u REGISTER", cseq);
-    AddSipLine("Contact: <sip:%s@%s:%u;transport=udp>",
+    out.Line("To: <sip:%s@%s>", pSipUser, pSipIp);                    // To: same as From
+    out.Line("Call-ID: %010u@%s", regid, pMyIp);
+    out.Line("CSeq: %u REGISTER", ++iRegCSeq);
+    out.Line("Contact: <sip:%s@%s:%u;transport=udp>",
         pSipUser, pMyIp, iMyPort);
-    AddSipLine("User-Agent: arduino-sip/0.1");
-
-    // If iAuthCnt > 0, process challenge from 401
-    if (challenge != nullptr && iAuthCnt > 0) {
-        // Parse out realm, nonce, opaque, qop from the challenge text
-        bool ok = ParseParameter(realm, sizeof(realm), "realm=\"", challenge, '"') &&
-            ParseParameter(nonce, sizeof(nonce), "nonce=\"", challenge, '"') &&
-            ParseParameter(opaque, sizeof(opaque), "opaque=\"", challenge, '"') &&
-            ParseParameter(qop, sizeof(qop), "qop=\"", challenge, '"');
-        if (!ok) {
-            // Malformed challenge: give up
-            return false;
-        }
-        char nc[9], cnonce[17];                                     //Build nc and cnonce
-        snprintf(nc, sizeof(nc), "%08X", iAuthCnt + 1);
-        snprintf(cnonce, sizeof(cnonce), "%08X", (uint32_t)millis());
-
-        MD5Builder md5;                                             // HA1 = MD5(user:realm:pass)
-        md5.begin(); md5.add(pSipUser); md5.add(":"); md5.add(realm);
-        md5.add(":"); md5.add(pSipPassWd); md5.calculate();
-        char ha1[33]; strcpy(ha1, md5.toString().c_str());
-
-        // HA2 = MD5("REGISTER:sip:user@host")
-        md5.begin(); md5.add("REGISTER:sip:"); md5.add(pSipUser);
-        md5.add("@"); md5.add(pSipIp); md5.calculate();
-        char ha2[33]; strcpy(ha2, md5.toString().c_str());
-
-        // response = MD5(HA1:nonce:nc:cnonce:qop:HA2)
-        md5.begin();
-        md5.add(ha1); md5.add(":"); md5.add(nonce);
-        md5.add(":"); md5.add(nc);
-        md5.add(":"); md5.add(cnonce);
-        md5.add(":"); md5.add(qop);
-        md5.add(":"); md5.add(ha2);
-        md5.calculate();
-        char resp[33]; strcpy(resp, md5.toString().c_str());
-
-        // Add Authorization header
-        AddSipLine(
-            "Authorization: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"sip:%s@%s\","
-            "response=\"%s\", algorithm=MD5, opaque=\"%s\", qop=\"%s\", nc=%s, cnonce=\"%s\"",
-            pSipUser, realm, nonce,
-            pSipUser, pSipIp,
-            resp, opaque, qop,
-            nc, cnonce
-        );
-        iAuthCnt++;
-    }
-    // End of headers. Content-Length = 0
-    AddSipLine("Expires: 3600");         // optional: tell server to keep registration 1 hour
-    AddSipLine("Content-Length: 0");
-    AddSipLine("");                      // blank line
-    SendUdp();
-
-    // Clear any previous challenge‐data so that new 401 will re‐populate it
-    caRead[0] = '\0';
-    return true;
+    out.Line("User-Agent: arduino-sip/0.1");
+    AddAuthorization("REGISTER", uri);
+    out.Line("Expires: 3600");           // optional: tell server to keep registration 1 hour
+    out.Line("Content-Length: 0");
+    out.Line("");                        // blank line
+    return SendRequest();
 }
 
 bool Sip::Dial(const char *DialNr, const char *DialDesc, const char* sdpPtr, size_t sdpLength) {
@@ -165,59 +121,37 @@ bool Sip::Dial(const char *DialNr, const char *DialDesc, const char* sdpPtr, siz
   pDialDesc = DialDesc;
   sdpBody = sdpPtr;
   sdpLen = sdpLength;
-  iDialRetries = 0;
   Invite();
-  iDialRetries++;
   iRingTime = Millis();
 
   return true;
 }
 
 
+// Never sleeps: reads what has arrived, answers into the transmit queue, runs the transaction timers and flushes
 void Sip::Processing(char* readBuf, size_t bufLen) {
-    int packetSize = Udp.parsePacket();
-    if (packetSize > 0) {
+    FlushTx();                                  // anything lwIP refused on the last pass
+    for (int i = 0; i < RX_BURST && Udp.parsePacket() > 0; ++i) {
         // read into buffer and null-terminate
         int len = Udp.read(readBuf, bufLen - 1);
         if (len > 0) {
           readBuf[len] = '\0';
          //Serial.printf("[SIP Rx %d bytes]\n", len);            // Lines added for debug
          //Serial.println(readBuf);                              // Lines added for debug
-          HandleUdpPacket(readBuf);
-        }
-    }
-    // handle initial retransmits (no auth yet)
-    if (!caRead[0] && iAuthCnt == 0 && iDialRetries < 5) {
-        unsigned long elapsed = millis() - iRingTime;
-        if (elapsed > (iDialRetries * 200)) {
-            iDialRetries++;
-            delay(30);
-            Invite();
+          if (rx.Parse(readBuf, len) && MatchResponse(rx))
+            HandleUdpPacket(rx);
         }
     }
+    // retransmissions and timeouts of every outstanding request (Timer A/B/E/F)
+    Tick();
     return;
 }
 
 
-void Sip::HandleUdpPacket(const char *p) {
-  
-    if (strstr(p, "OPTIONS sip:1009@")) {     // This reply to the keep alive needs to be at the top of the stack
-        ParseReturnParams(p);
-        // build minimal 200 response
-        pbuf[0] = '\0';
-        AddSipLine("SIP/2.0 200 OK");
-        AddCopySipLine(p, "Via: ");
-        AddCopySipLine(p, "To: ");
-        AddCopySipLine(p, "From: ");
-        AddCopySipLine(p, "Call-ID: ");
-        AddCopySipLine(p, "CSeq: ");
-        AddSipLine("Content-Length: 0");
-        AddSipLine("");
-        SendUdp();
-    }
-    
-    uint32_t iWorkTime = iRingTime ? (Millis() - iRingTime) : 0;
-  
+void Sip::HandleUdpPacket(const SipMessage &m) {
+
+  uint32_t iWorkTime = iRingTime ? (Millis() - iRingTime) : 0;
+
   if ( iRingTime && iWorkTime > iMaxTime )
   {
     // Cancel(3);
@@ -225,435 +159,712 @@ void Sip::HandleUdpPacket(const char *p) {
     iRingTime = 0;
   }
 
-  if ( !p )
+  // Requests from the server, classified by the start line
+  switch ( m.GetMethod() )
   {
-    // max 5 dial retry when loos first invite packet
-    if ( iAuthCnt == 0 && iDialRetries < 5 && iWorkTime > (iDialRetries * 200) )
-    {
-      iDialRetries++;
-      delay(30);
-      Invite();
-    }
-	
-    return;
-  }
-
+    case SipMessage::M_NONE:
+      break;                              // a response, see below
+
+    case SipMessage::M_OPTIONS:           // keep-alive, answer with a minimal 200
+      ParseReturnParams(m);
+      out.Reset();
+      out.Line("SIP/2.0 200 OK");
+      AddCopySipLine(out, m, SipMessage::H_VIA);
+      AddCopySipLine(out, m, SipMessage::H_TO);
+      AddCopySipLine(out, m, SipMessage::H_FROM);
+      AddCopySipLine(out, m, SipMessage::H_CALL_ID);
+      AddCopySipLine(out, m, SipMessage::H_CSEQ);
+      out.Line("Content-Length: 0");
+      out.Line("");
+      SendUdp();
+      return;
 
-  
-  if (strstr(p, "INVITE sip:100")) {       //Auto accept INVITE and move to that call
-      AnswerInvite(p);
+    case SipMessage::M_INVITE:            // auto accept INVITE and move to that call
+      AnswerInvite(m);
       /*if (isInCall) {
           Bye(iLastCSeq);
           isInCall = false;
           iRingTime = 0;
       } */
-      iLastCSeq = GrepInteger(p, "\nCSeq: ");
+      iLastCSeq = m.CSeqNumber();
       return;
-  }
 
-  if ( strstr(p, "SIP/2.0 401 Unauthorized"))
-  {
-      if (strstr(p, "CSeq:") && strstr(p, "REGISTER")) { Register(p); return; }
-     //Serial.println(">>> Got 401 Unauthorized!");               // Serial Print Debug lines
-     //Serial.println(">>> Challenge before Ack():");
-     //Serial.println(p);
-      
-     Ack(p);
-     //Serial.println(">>> Challenge after Ack():");
-     //Serial.println(p);
-     // call Invite with response data (p) to build auth md5 hashes
-     Invite(p);
-     return;
-  }
+    case SipMessage::M_ACK:               // to our 200; carries the answer when the 200 carried our offer
+      if ( bAwaitingAnswer )
+      {
+        bAwaitingAnswer = false;
+        if ( NegotiateMedia(m) )
+          isInCall = true;
+        else
+        {
+          // RFC 3264 5: an answer we cannot use still completes the INVITE, then the call is ended
+          Bye(iLastCSeq + 1);
+          isInCall = false;
+          iRingTime = 0;
+        }
+      }
+      return;
 
-  else if ( strstr(p, "SIP/2.0 200 OK") && strstr(p, "CSeq:"))		// OK
-  {
-    isInCall = true;
-    Serial.println(">>> Got 200 OK for our INVITE — sending ACK");
-    ParseReturnParams(p);
-    remoteRtpPort = parseRemoteRtpPort(p);
-    Serial.printf(">>> remoteRtpPort = %u\n", remoteRtpPort);
-    Ack(p);
-    return;
+    case SipMessage::M_INFO:
+      iLastCSeq = m.CSeqNumber();
+      Ok(m);
+      return;
+
+    case SipMessage::M_BYE:
+      Ok(m);
+      isInCall = false;
+      iRingTime = 0;
+      return;
+
+    default:
+      return;
   }
-  else if (    strstr(p, "SIP/2.0 183 ") 	// Session Progress
-            || strstr(p, "SIP/2.0 100 ")	// Trying
-            || strstr(p, "SIP/2.0 180 "))	// Ringing
+
+  // Responses, classified by status code and the method they answer
+  int status = m.Status();
+  if ( status == 401 || status == 407 )
   {
-    ParseReturnParams(p);
+    switch ( m.CSeqMethod() )
+    {
+      case SipMessage::M_REGISTER:
+        if ( TakeChallenge(m, iRegAuthCnt) ) Register(true);
+        return;
+
+      case SipMessage::M_BYE:             // a new request in the dialog: next CSeq, new branch, now with credentials
+        if ( TakeChallenge(m, iReqAuthCnt) ) Bye(m.CSeqNumber() + 1, true);
+        return;
+
+      case SipMessage::M_CANCEL:          // still has to match the INVITE: same CSeq and branch, now with credentials
+      {
+        char branch[32] = { 0 };
+        m.Param(SipMessage::H_VIA, "branch", branch, sizeof(branch));
+        if ( !TakeChallenge(m, iReqAuthCnt) )
+          return;
+        for ( int i = 0; i < TRANSACTIONS; i++ )
+        {
+          Transaction &t = transactions[i];
+          if ( t.invite && t.cancelled && t.state == TS_PROCEEDING && strcmp(t.branch, branch) == 0 )
+          {
+            Cancel(t, true);
+            break;
+          }
+        }
+        return;
+      }
+
+      case SipMessage::M_INVITE:
+      {
+        bool retry = TakeChallenge(m, iAuthCnt);
+        //Serial.println(">>> Got 401 Unauthorized!");               // Serial Print Debug lines
+
+        // the transaction has ACKed it; same call again, now with credentials for the new nonce
+        if ( retry ) Invite(true);
+        else
+        {
+          iRingTime = 0;
+          iDialFailure = status;
+        }
+        return;
+      }
+
+      default:
+        return;
+    }
   }
 
-  else if (    strstr(p, "SIP/2.0 486 ")	// Busy Here
-            || strstr(p, "SIP/2.0 603 ") 	// Decline
-            || strstr(p, "SIP/2.0 487 ")) 	// Request Terminatet
+  if ( status >= 200 && status < 300 )   // the credentials were accepted
   {
-    Ack(p);
-    iRingTime = 0;
+    if ( m.CSeqMethod() == SipMessage::M_REGISTER ) iRegAuthCnt = 0;
+    else iAuthCnt = 0;
   }
-  else if (strstr(p, "INFO"))
+
+  if ( status == 200 && m.CSeqMethod() != SipMessage::M_INVITE )
   {
-    iLastCSeq = GrepInteger(p, "\nCSeq: ");
-    Ok(p);
+    return;                               // REGISTER, BYE, ...: not a call
   }
-
-  else if (strstr(p, "BYE"))
+  else if ( status == 200 )		// OK
   {
-      Ack(p);
+    isInCall = true;
+    Serial.println(">>> Got 200 OK for our INVITE — sending ACK");
+    ParseReturnParams(m);
+    bool media = NegotiateMedia(m);
+    Ack(m);
+    if ( !media )
+    {
+      // RFC 3264 6.1: an answer we cannot use still completes the INVITE, then the call is ended
+      Bye(iLastCSeq + 1);
       isInCall = false;
       iRingTime = 0;
+    }
+    return;
   }
-
-}
-
-
-void Sip::AddSipLine(const char* constFormat , ... ) {
-  
-  va_list arglist;
-  va_start(arglist, constFormat);
-  uint16_t l = (uint16_t)strlen(pbuf);
-  char *p = pbuf + l;
-  vsnprintf(p, lbuf - l, constFormat, arglist );
-  va_end(arglist);
-  l = (uint16_t)strlen(pbuf);
-  if ( l < (lbuf - 2) )
+  else if (    status == 183 	// Session Progress
+            || status == 100	// Trying
+            || status == 180)	// Ringing
   {
-    pbuf[l] = '\r';
-    pbuf[l + 1] = '\n';
-    pbuf[l + 2] = 0;
+    ParseReturnParams(m);
   }
-}
-
 
-// Search a line in response date (p) and append on pbuf
-bool Sip::AddCopySipLine(const char *p, const char *psearch) {
-
-  char *pa = strstr((char*)p, psearch);
-
-  if ( pa )
+  else if ( status >= 300 && m.CSeqMethod() == SipMessage::M_INVITE )
   {
-    char *pe = strstr(pa, "\r");
-
-    if ( pe == 0 )
-      pe = strstr(pa, "\n");
-
-    if ( pe > pa )
-    {
-      char c = *pe;
-      *pe = 0;
-      AddSipLine("%s", pa);
-      *pe = c;
-	  
-      return true;
-    }
+    // Busy Here, Decline, ...: the transaction has ACKed it, the call is over
+    iRingTime = 0;
+    iDialFailure = status;
   }
-  
-  return false;
+
 }
 
 
-// Parse parameter value from http formated string
-bool Sip::ParseParameter(char *dest, int destlen, const char *name, const char *line, char cq) {
+// Append a header line of the received message, as received
+bool Sip::AddCopySipLine(SipBuilder &b, const SipMessage &m, SipMessage::Header h) {
 
-  const char *qp;
-  const char *r;
+  size_t len;
+  const char *line = m.Line(h, len);
+
+  if ( line && len > 0 )
+    return b.Write(line, len) && b.Write("\r\n", 2);
 
-  if ( ( r = strstr(line, name) ) != NULL )
-  {
-    r = r + strlen(name);
-    qp = strchr(r, cq);
-    int l = qp - r;
-    if ( l < destlen )
-    {
-      strncpy(dest, r, l);
-      dest[l] = 0;
-	  
-      return true;
-    }
-  }
-  
   return false;
 }
 
 
-// Copy Call-ID, From, Via and To from response to caRead using later for BYE or CANCEL the call
-bool Sip::ParseReturnParams(const char *p) {
+// Copy Call-ID, From and To from response to caRead (CRLF terminated) using later for BYE the call; the BYE is a new
+// transaction and writes its own Via
+bool Sip::ParseReturnParams(const SipMessage &m) {
   
-  pbuf[0] = 0;
+  SipBuilder dialog(caRead, sizeof(caRead));
   
-  AddCopySipLine(p, "Call-ID: ");
-  AddCopySipLine(p, "From: ");
-  AddCopySipLine(p, "Via: ");
-  AddCopySipLine(p, "To: ");
+  AddCopySipLine(dialog, m, SipMessage::H_CALL_ID);
+  AddCopySipLine(dialog, m, SipMessage::H_FROM);
+  AddCopySipLine(dialog, m, SipMessage::H_TO);
   
-  if ( strlen(pbuf) >= 2 )
+  if ( dialog.Overflow() )
   {
-    strcpy(caRead, pbuf);
-    caRead[strlen(caRead) - 2] = 0;
+    caRead[0] = 0;                      // a partial dialog would only produce a BYE nobody can match
+    return false;
   }
   
   return true;
 }
 
+// Matches the SDP body of an offer or answer against localMedia. Only a usable result replaces mediaSession, so a
+// rejected re-INVITE leaves the running call as it was; iMediaVersion counts the changes
+bool Sip::NegotiateMedia(const SipMessage &msg) {
 
-int Sip::GrepInteger(const char *p, const char *psearch) {
-
-  int param = -1;
-  const char *pc = strstr(p, psearch);
-
-  if ( pc )
+  size_t len;
+  const char *body = msg.Body(len);
+  Sdp::Media remote;
+  Sdp::Session s;
+  if ( !Sdp::Parse(body, len, remote) || !Sdp::Negotiate(localMedia, remote, s) )
   {
-    param = atoi(pc + strlen(psearch));
+    Serial.printf("SIP: no usable audio stream in the SDP\r\n");
+    return false;
   }
-  
-  return param;
-}
-
-// Extract the port number from the first "m=audio <port>" line
-uint16_t Sip::parseRemoteRtpPort(const char* p) {
-    Serial.println(">>> Full SDP payload:");
-    Serial.println(p);
-
-    // extract the port
-    uint16_t port = 0;
-    const char* m = strstr(p, "m=audio ");
-    if (m) {
-        m += strlen("m=audio ");
-        port = atoi(m);
-    }
-    Serial.printf(">>> parsed remoteRtpPort = %u\n", port);
-    return port;
+  if ( memcmp(&s, &mediaSession, sizeof(s)) != 0 )
+  {
+    mediaSession = s;
+    iMediaVersion++;
+  }
+  Serial.printf("SIP: media %s:%u %s/%u ptime %u ms, CN %s, %s%s\r\n", mediaSession.address, mediaSession.port,
+      Sdp::CodecName(mediaSession.codec), (unsigned)mediaSession.payloadType, (unsigned)mediaSession.ptime,
+      mediaSession.cnPayloadType >= 0 ? "on" : "off",
+      Sdp::Sends(mediaSession.direction) ? "send" : "", Sdp::Receives(mediaSession.direction) ? "recv" : "");
+  return true;
 }
 
 
-void Sip::Ack(const char* p) {
+void Sip::Ack(const SipMessage &m) {
     //Serial.println(">>> Sip::Ack(): has been reached");
-    //Serial.println(">>> Ack() got this packet:");
-    //Serial.println(p);   // ← dump the full SIP text
-    if (strstr(p, "SIP/2.0 200 OK") && strstr(p, "INVITE")) {
-        isInCall = true;
-    }
     char uri[64] = { 0 };
-    if (!ParseParameter(uri, sizeof(uri), "To: <", p, '>'))
+    if (!m.Uri(SipMessage::H_TO, uri, sizeof(uri)))
         return;
 
     char tag[64] = { 0 };
-    ParseParameter(tag, sizeof(tag), "tag=", p, '\r');
-    pbuf[0] = 0;
+    m.Param(SipMessage::H_TO, "tag", tag, sizeof(tag));
+    out.Reset();
 
-    AddSipLine("ACK %s SIP/2.0", uri);         // request‐line
-    AddCopySipLine(p, "Call-ID: ");
-    int cseq = GrepInteger(p, "\nCSeq: ");
-    AddSipLine("CSeq: %i ACK", cseq);
-    AddCopySipLine(p, "From: ");
-    AddCopySipLine(p, "Via: ");
+    out.Line("ACK %s SIP/2.0", uri);         // request‐line
+    AddCopySipLine(out, m, SipMessage::H_CALL_ID);
+    out.Line("CSeq: %u ACK", (unsigned)m.CSeqNumber());
+    AddCopySipLine(out, m, SipMessage::H_FROM);
+    AddCopySipLine(out, m, SipMessage::H_VIA);
 
-    if (tag[0]) { AddSipLine("To: <%s>;tag=%s", uri, tag); }
+    if (tag[0]) { out.Line("To: <%s>;tag=%s", uri, tag); }
     else {
         // fallback if no tag was found
-        AddCopySipLine(p, "To: ");}
-    AddSipLine("Content-Length: 0");
-    AddSipLine("");            // blank line
+        AddCopySipLine(out, m, SipMessage::H_TO);}
+    out.Line("Content-Length: 0");
+    out.Line("");            // blank line
     SendUdp();                 // kick it onto the wire
 }
 
 
+// RFC 3261 9.1: Request-URI, Call-ID, From, To, Via and the CSeq number are those of the INVITE being cancelled;
+// with retry the same CANCEL again after a 401/407
+void Sip::Cancel(const Transaction &invite, bool retry) {
 
-void Sip::Cancel(int cseq) {
-  
-  if ( caRead[0] == 0 )
+  SipMessage inv;
+  char uri[64];
+  if ( !inv.Parse(invite.msg, invite.len) || !CopyToken(uri, sizeof(uri), invite.msg + 7) )
     return;
 
-  pbuf[0] = 0;
-  AddSipLine("%s sip:%s@%s SIP/2.0",  "CANCEL", pDialNr, pSipIp);
-  AddSipLine("%s",  caRead);
-  AddSipLine("CSeq: %i %s",  cseq, "CANCEL");
-  AddSipLine("Max-Forwards: 70");
-  AddSipLine("User-Agent: sip-client/0.0.1");
-  AddSipLine("Content-Length: 0");
-  AddSipLine("");
-  SendUdp();
+  if ( !retry ) iReqAuthCnt = 0;
+  out.Reset();
+  out.Line("CANCEL %s SIP/2.0", uri);
+  AddCopySipLine(out, inv, SipMessage::H_VIA);
+  AddCopySipLine(out, inv, SipMessage::H_CALL_ID);
+  AddCopySipLine(out, inv, SipMessage::H_FROM);
+  AddCopySipLine(out, inv, SipMessage::H_TO);
+  out.Line("CSeq: %u CANCEL", (unsigned)inv.CSeqNumber());
+  out.Line("Max-Forwards: 70");
+  out.Line("User-Agent: sip-client/0.0.1");
+  AddAuthorization("CANCEL", uri);
+  out.Line("Content-Length: 0");
+  out.Line("");
+  SendRequest();
 }
 
 
-void Sip::Bye(int cseq) {
+// Ends the dialog in caRead; a new transaction each time, so a new branch, and with retry the BYE a 401/407 refused
+void Sip::Bye(int cseq, bool retry) {
   
-  if ( caRead[0] == 0 )
+  if ( caRead[0] == 0 || peerUri[0] == 0 )
     return;
 
-  pbuf[0] = 0;
-  AddSipLine("%s sip:%s@%s SIP/2.0",  "BYE", pDialNr, pSipIp);
-  AddSipLine("%s",  caRead);
-  AddSipLine("CSeq: %i %s", cseq, "BYE");
-  AddSipLine("Max-Forwards: 70");
-  AddSipLine("User-Agent: sip-client/0.0.1");
-  AddSipLine("Content-Length: 0");
-  AddSipLine("");
-  SendUdp();
+  if ( !retry ) iReqAuthCnt = 0;
+  out.Reset();
+  out.Line("%s %s SIP/2.0",  "BYE", peerUri);
+  out.Line("Via: SIP/2.0/UDP %s:%u;branch=z9hG4bK%010u;rport=%u", pMyIp, iMyPort, Random(), iMyPort);
+  out.Write(caRead, strlen(caRead));
+  out.Line("CSeq: %i %s", cseq, "BYE");
+  out.Line("Max-Forwards: 70");
+  out.Line("User-Agent: sip-client/0.0.1");
+  AddAuthorization("BYE", peerUri);
+  out.Line("Content-Length: 0");
+  out.Line("");
+  SendRequest();
+  iLastCSeq = cseq;
 }
 
 
-void Sip::Ok(const char *p) {
+void Sip::Ok(const SipMessage &m) {
   
-  pbuf[0] = 0;
-  AddSipLine("SIP/2.0 200 OK");
-  AddCopySipLine(p, "Call-ID: ");
-  AddCopySipLine(p, "CSeq: ");
-  AddCopySipLine(p, "From: ");
-  AddCopySipLine(p, "Via: ");
-  AddCopySipLine(p, "To: ");
-  AddSipLine("Content-Length: 0");
-  AddSipLine("");
+  out.Reset();
+  out.Line("SIP/2.0 200 OK");
+  AddCopySipLine(out, m, SipMessage::H_CALL_ID);
+  AddCopySipLine(out, m, SipMessage::H_CSEQ);
+  AddCopySipLine(out, m, SipMessage::H_FROM);
+  AddCopySipLine(out, m, SipMessage::H_VIA);
+  AddCopySipLine(out, m, SipMessage::H_TO);
+  out.Line("Content-Length: 0");
+  out.Line("");
   SendUdp();
 }
 
 
-// Call invite without or with the response from peer
-void Sip::Invite(const char* challenge) {
-    //Serial.println(">>> Challenge at top of Invite():");
-    //Serial.println(challenge);
-    // limit auth retries
-    if (challenge && iAuthCnt > 3) return;
-
-    // parse challenge parameters if present
-    char realm[128] = { 0 }, nonce[128] = { 0 };
-    char opaque[128] = { 0 }, qop[32] = { 0 };
-    uint16_t cseq = challenge ? 2 : 1;
-
-    if (challenge) {
-        //Serial.println("Raw 401 payload:");
-        //Serial.println(challenge);
-        // pull out realm, nonce, opaque, qop
-        bool ok =
-            ParseParameter(realm, sizeof(realm), "realm=\"", challenge) &&
-            ParseParameter(nonce, sizeof(nonce), "nonce=\"", challenge) &&
-            ParseParameter(opaque, sizeof(opaque), "opaque=\"", challenge) &&
-            ParseParameter(qop, sizeof(qop), "qop=\"", challenge);
-        //Serial.printf("parse ok=%d → realm=\"%s\", nonce=\"%s\", opaque=\"%s\", qop=\"%s\"\n", ok, realm, nonce, opaque, qop);
-        if (!ok) {
-            //Serial.println("Malformed challenge, giving up.");
-            return;
-        }
+// A new call, or with retry the same call again after a 401/407; authenticates up front once a challenge has been seen
+void Sip::Invite(bool retry) {
+
+    uint16_t cseq;
+    if (retry) {
+        cseq = iLastCSeq + 1;
     }
     else {
-        // first INVITE, generate new call IDs
-        if (iDialRetries == 0) {
-            callid = Random();
-            tagid = Random();
-            branchid = Random();
-        }
+        // new call, new IDs; lost copies are retransmitted by the transaction, not rebuilt here
+        callid = Random();
+        tagid = Random();
         iAuthCnt = 0;
+        cseq = 1;
     }
+    branchid = Random();                        // a new request, so a new transaction
+    char uri[64];
+    snprintf(uri, sizeof(uri), "sip:%s@%s", pDialNr, pSipIp);
+    strcpy(peerUri, uri);
 
     // start with empty buffer
-    pbuf[0] = '\0';
+    out.Reset();
 
     // standard INVITE headers
-    AddSipLine("INVITE sip:%s@%s SIP/2.0", pDialNr, pSipIp);
-    AddSipLine("Call-ID: %010u@%s", callid, pMyIp);
-    AddSipLine("CSeq: %u INVITE", cseq);
-    AddSipLine("Max-Forwards: 70");
-    AddSipLine("From: \"%s\" <sip:%s@%s>;tag=%010u", pDialDesc, pSipUser, pSipIp, tagid);
-    AddSipLine("Via: SIP/2.0/UDP %s:%u;branch=%010u;rport=%u", pMyIp, iMyPort, branchid, iMyPort);
-    AddSipLine("To: <sip:%s@%s>", pDialNr, pSipIp);
-    AddSipLine("Contact: \"%s\" <sip:%s@%s:%u;transport=udp>", pSipUser, pSipUser, pMyIp, iMyPort);
-
-    // add Authorization if required
-    if (challenge) {
-        // build nc and cnonce
-        char nc[9], cnonce[17];
-        snprintf(nc, sizeof(nc), "%08X", iAuthCnt + 1);
-        snprintf(cnonce, sizeof(cnonce), "%08X", (uint32_t)millis());
-
-        MD5Builder md5;
-        // HA1 = MD5(user:realm:pass)
-        md5.begin(); md5.add(pSipUser); md5.add(":"); md5.add(realm);
-        md5.add(":"); md5.add(pSipPassWd); md5.calculate();
-        char ha1[33]; strcpy(ha1, md5.toString().c_str());
-
-        // HA2 = MD5("INVITE:sip:user@host")
-        md5.begin(); md5.add("INVITE:"); md5.add("sip:"); md5.add(pDialNr);
-        md5.add("@");     md5.add(pSipIp); md5.calculate();
-        char ha2[33]; strcpy(ha2, md5.toString().c_str());
-
-        // response = MD5(HA1:nonce:nc:cnonce:qop:HA2)
-        md5.begin();
-        md5.add(ha1); md5.add(":"); md5.add(nonce);
-        md5.add(":"); md5.add(nc);
-        md5.add(":"); md5.add(cnonce);
-        md5.add(":"); md5.add(qop);
-        md5.add(":"); md5.add(ha2);
-        md5.calculate();
-        char resp[33]; strcpy(resp, md5.toString().c_str());
-
-        AddSipLine(
-            "Authorization: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"sip:%s@%s\","
-            " response=\"%s\", algorithm=MD5, opaque=\"%s\", qop=\"%s\", nc=%s, cnonce=\"%s\"",
-            pSipUser, realm, nonce,
-            pDialNr, pSipIp,
-            resp, opaque, qop,
-            nc, cnonce
-        );
-        iAuthCnt++;
-    }
+    out.Line("INVITE %s SIP/2.0", uri);
+    out.Line("Call-ID: %010u@%s", callid, pMyIp);
+    out.Line("CSeq: %u INVITE", cseq);
+    out.Line("Max-Forwards: 70");
+    out.Line("From: \"%s\" <sip:%s@%s>;tag=%010u", pDialDesc, pSipUser, pSipIp, tagid);
+    out.Line("Via: SIP/2.0/UDP %s:%u;branch=z9hG4bK%010u;rport=%u", pMyIp, iMyPort, branchid, iMyPort);
+    out.Line("To: <%s>", uri);
+    out.Line("Contact: \"%s\" <sip:%s@%s:%u;transport=udp>", pSipUser, pSipUser, pMyIp, iMyPort);
+    AddAuthorization("INVITE", uri);
 
     // SDP headers & body
-    AddSipLine("Content-Type: application/sdp");
-    AddSipLine("Content-Length: %u", (unsigned)sdpLen);
-    AddSipLine(""); // blank line
-    if (sdpBody && sdpLen) {
-        size_t used = strlen(pbuf);
-        size_t space = lbuf - used - 1;
-        size_t toCp = (sdpLen < space) ? sdpLen : space;
-        memcpy(pbuf + used, sdpBody, toCp);
-        pbuf[used + toCp] = '\0';
-    }
-    SendUdp();
+    out.Line("Content-Type: application/sdp");
+    out.BeginBody();
+    if (sdpBody && sdpLen) out.Write(sdpBody, sdpLen);
+    out.EndBody();
+    SendRequest();
     iLastCSeq = cseq;
 }
 
-//Helper function to allow Auto-Answer of invites
-void Sip::AnswerInvite(const char* inviteMsg) {
-    remoteRtpPort = parseRemoteRtpPort(inviteMsg);
-
-    // Building custom Invite resopnse
-    static char ourSdp[256];
-    snprintf(ourSdp, sizeof(ourSdp),
-        "v=0\r\n"
-        "o=- 0 0 IN IP4 %s\r\n"
-        "s=AutoAnswer\r\n"
-        "c=IN IP4 %s\r\n"
-        "t=0 0\r\n"
-        "m=audio 5004 RTP/AVP 0\r\n"
-        "a=rtpmap:0 PCMU/8000\r\n"
-        "a=recvonly\r\n",
-        pMyIp, pMyIp
-    );
+
+// Caches realm, nonce, opaque and qop of a 401/407 and HA1 for the realm; returns whether to send the request again,
+// counting the attempt in tries
+bool Sip::TakeChallenge(const SipMessage &m, int &tries) {
+
+  SipMessage::Header h = m.Status() == 407 ? SipMessage::H_PROXY_AUTHENTICATE : SipMessage::H_WWW_AUTHENTICATE;
+  char realm[sizeof(auth.realm)] = { 0 }, nonce[sizeof(auth.nonce)] = { 0 };
+  char qop[32] = { 0 }, stale[8] = { 0 };
+  if ( !m.Param(h, "realm", realm, sizeof(realm)) || !m.Param(h, "nonce", nonce, sizeof(nonce)) )
+    return false;                                   // malformed challenge: give up
+
+  bool fresh = !auth.valid || strcmp(nonce, auth.nonce) != 0;
+  bool expired = m.Param(h, "stale", stale, sizeof(stale)) && strcasecmp(stale, "true") == 0;
+
+  if ( !auth.valid || strcmp(realm, auth.realm) != 0 )
+  {
+    char a1[160];
+    strcpy(auth.realm, realm);
+    snprintf(a1, sizeof(a1), "%s:%s:%s", pSipUser, realm, pSipPassWd);
+    MakeMd5Digest(auth.ha1, a1);
+  }
+  if ( fresh )
+  {
+    strcpy(auth.nonce, nonce);
+    auth.nc = 0;
+  }
+  auth.opaque[0] = 0;
+  m.Param(h, "opaque", auth.opaque, sizeof(auth.opaque));
+  // qop is a list ("auth,auth-int"); we only do auth
+  m.Param(h, "qop", qop, sizeof(qop));
+  const char *q = strstr(qop, "auth");
+  strcpy(auth.qop, q && (q[4] == 0 || q[4] == ',') ? "auth" : "");
+  auth.proxy = m.Status() == 407;
+  auth.valid = true;
+
+  // only an expired nonce is worth retrying for free, anything else counts against the credentials
+  if ( expired && fresh )
+    return true;
+  return ++tries <= MAX_AUTH_TRIES;
+}
+
+
+// Authorization (or Proxy-Authorization) from the cached challenge with the next nonce-count; nothing before the
+// first challenge
+void Sip::AddAuthorization(const char *method, const char *uri) {
+
+  if ( !auth.valid )
+    return;
+
+  char ha2[33], resp[33], nc[9], cnonce[9], a[320];
+  snprintf(nc, sizeof(nc), "%08x", (unsigned)++auth.nc);
+  snprintf(cnonce, sizeof(cnonce), "%08x", (unsigned)Random());
+
+  snprintf(a, sizeof(a), "%s:%s", method, uri);                          // HA2 = MD5(method:uri)
+  MakeMd5Digest(ha2, a);
+  if ( auth.qop[0] )                                                      // MD5(HA1:nonce:nc:cnonce:qop:HA2)
+    snprintf(a, sizeof(a), "%s:%s:%s:%s:%s:%s", auth.ha1, auth.nonce, nc, cnonce, auth.qop, ha2);
+  else                                                                    // RFC 2069: MD5(HA1:nonce:HA2)
+    snprintf(a, sizeof(a), "%s:%s:%s", auth.ha1, auth.nonce, ha2);
+  MakeMd5Digest(resp, a);
+
+  out.Append("%s: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"%s\", response=\"%s\", algorithm=MD5",
+      auth.proxy ? "Proxy-Authorization" : "Authorization", pSipUser, auth.realm, auth.nonce, uri, resp);
+  if ( auth.opaque[0] )
+    out.Append(", opaque=\"%s\"", auth.opaque);
+  if ( auth.qop[0] )
+    out.Append(", qop=%s, nc=%s, cnonce=\"%s\"", auth.qop, nc, cnonce);
+  out.Line("");
+}
+
+// Auto-answers an INVITE: a new call, or a re-INVITE inside the dialog (hold, resume, a new media address), which
+// keeps the To line and its tag. An INVITE without an offer gets ours in the 200; its answer comes with the ACK
+// (RFC 3264 5)
+void Sip::AnswerInvite(const SipMessage &invite) {
+
     char uri[64] = { 0 };
-    if (!ParseParameter(uri, sizeof(uri), "To: <", inviteMsg, '>')) {
+    if (!invite.Uri(SipMessage::H_TO, uri, sizeof(uri))) {
         return;
     }
-    static char myToTag[32];
-    snprintf(myToTag, sizeof(myToTag), "%08X", (unsigned)rand());
-    int cseq = GrepInteger(inviteMsg, "\nCSeq: ");
-
-    // 200 OK response
-    pbuf[0] = '\0';
-    AddSipLine("SIP/2.0 200 OK");
-    AddCopySipLine(inviteMsg, "Via: ");
-    AddSipLine("To: <%s>;tag=%s", uri, myToTag);
-    AddCopySipLine(inviteMsg, "From: ");
-    AddCopySipLine(inviteMsg, "Call-ID: ");
-    AddSipLine("CSeq: %d INVITE", cseq);
-    AddSipLine("Contact: <sip:%s@%s:%u;transport=udp>", pSipUser, pMyIp, iMyPort);
-    AddSipLine("Content-Type: application/sdp");
-    AddSipLine("Content-Length: %u", (unsigned)strlen(ourSdp));
-    AddSipLine("");
-    AddSipLine("%s", ourSdp);
+    size_t offerLen;
+    invite.Body(offerLen);
+    bool accept = offerLen == 0 || NegotiateMedia(invite);
+
+    char tag[32] = { 0 }, branch[32] = { 0 };
+    bool reinvite = invite.Param(SipMessage::H_TO, "tag", tag, sizeof(tag));
+    invite.Param(SipMessage::H_VIA, "branch", branch, sizeof(branch));
+    if (!reinvite && strcmp(branch, answeredBranch) != 0) {
+        snprintf(toTag, sizeof(toTag), "%08X", (unsigned)Random());
+        snprintf(answeredBranch, sizeof(answeredBranch), "%s", branch);
+        Sdp::Begin(sdpOrigin, Random());
+    }
+    unsigned cseq = invite.CSeqNumber();
+
+    // 200 OK response, or 488 when the offer has no codec we can use; a rejected re-INVITE leaves the call as it was
+    out.Reset();
+    out.Line(accept ? "SIP/2.0 200 OK" : "SIP/2.0 488 Not Acceptable Here");
+    AddCopySipLine(out, invite, SipMessage::H_VIA);
+    if (reinvite) AddCopySipLine(out, invite, SipMessage::H_TO);
+    else out.Line("To: <%s>;tag=%s", uri, toTag);
+    AddCopySipLine(out, invite, SipMessage::H_FROM);
+    AddCopySipLine(out, invite, SipMessage::H_CALL_ID);
+    out.Line("CSeq: %u INVITE", cseq);
+    if (!accept) {
+        out.Line("Content-Length: 0");
+        out.Line("");
+        SendUdp();
+        bAwaitingAnswer = false;
+        return;
+    }
+    out.Line("Contact: <sip:%s@%s:%u;transport=udp>", pSipUser, pMyIp, iMyPort);
+    out.Line("Content-Type: application/sdp");
+
+    // The answer, or our offer when the INVITE had none, formatted in place as the body; a retransmission or a
+    // re-INVITE that changes nothing gets the same o= version
+    Sdp::Media answer;
+    if (offerLen) Sdp::Answer(localMedia, mediaSession, answer);
+    else answer = localMedia;
+    out.BeginBody();
+    Sdp::Write(out, answer, "AutoAnswer", sdpOrigin);
+    out.EndBody();
 
     SendUdp();
 
-    // Mark “in call,” so that your application will start RTP
-    isInCall = true;
+    if (!reinvite) {
+        // The dialog from our side, for the BYE: the INVITE's To with our tag is our From, its From our To
+        size_t len = 0;
+        const char *from = invite.Value(SipMessage::H_FROM, len);
+        if (!from) from = "";
+        SipBuilder dialog(caRead, sizeof(caRead));
+        AddCopySipLine(dialog, invite, SipMessage::H_CALL_ID);
+        dialog.Line("From: <%s>;tag=%s", uri, toTag);
+        dialog.Line("To: %.*s", (int)len, from);
+        if (dialog.Overflow()) caRead[0] = 0;
+        if (!invite.Uri(SipMessage::H_CONTACT, peerUri, sizeof(peerUri)))
+            invite.Uri(SipMessage::H_FROM, peerUri, sizeof(peerUri));
+    }
+
+    // Mark “in call” once there is a session, so that your application will start RTP
+    bAwaitingAnswer = offerLen == 0;
+    if (offerLen) isInCall = true;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Client transactions (RFC 3261 17.1) over UDP
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Starts a client transaction for the request just built, so Tick() can retransmit it, and sends it
+bool Sip::SendRequest() {
+
+  if ( out.Overflow() )
+  {
+    Serial.printf("SIP: request does not fit, not sent\r\n");
+    return false;
+  }
+
+  char method[12] = { 0 }, branch[32] = { 0 };
+  CopyToken(method, sizeof(method), out.Text());
+  const char *b = strstr(out.Text(), "branch=");
+  if ( b )
+    CopyToken(branch, sizeof(branch), b + 7);
+
+  // the same request again (a CANCEL resent with credentials keeps the INVITE's branch), else a free slot, else a
+  // completed one, else the request this one supersedes
+  Transaction *t = 0;
+  for ( int i = 0; i < TRANSACTIONS && !t && branch[0]; i++ )
+    if ( transactions[i].state != TS_FREE && strcmp(transactions[i].branch, branch) == 0
+         && strcmp(transactions[i].method, method) == 0 ) t = &transactions[i];
+  for ( int i = 0; i < TRANSACTIONS && !t; i++ )
+    if ( transactions[i].state == TS_FREE ) t = &transactions[i];
+  for ( int i = 0; i < TRANSACTIONS && !t; i++ )
+    if ( transactions[i].state == TS_COMPLETED ) t = &transactions[i];
+  for ( int i = 0; i < TRANSACTIONS && !t; i++ )
+    if ( strcmp(transactions[i].method, method) == 0 ) t = &transactions[i];
+  if ( !t )
+    t = &transactions[0];
+
+  size_t len = out.Length();
+  if ( len > TX_SIZE )
+    len = TX_SIZE;
+  uint32_t now = Millis();
+  t->state = TS_CALLING;
+  t->invite = SipMessage::MethodOf(method, strlen(method)) == SipMessage::M_INVITE;
+  t->cancelled = false;
+  strcpy(t->method, method);
+  strcpy(t->branch, branch);
+  t->interval = T1;
+  t->retransmitAt = now + T1;
+  t->deadline = now + 64 * T1;
+  memcpy(t->msg, out.Text(), len);
+  t->len = (uint16_t)len;
+  QueueTx(t->msg, t->len);
+  return true;
+}
+
+
+// One timer pass over all transactions; called from Processing(), never blocks
+void Sip::Tick() {
+
+  uint32_t now = Millis();
+  for ( int i = 0; i < TRANSACTIONS; i++ )
+  {
+    Transaction &t = transactions[i];
+    if ( t.state == TS_FREE )
+      continue;
+
+    // a provisional response ends Timer B for INVITE and starts Timer C: on expiry the call is reported as timed
+    // out and cancelled, and the transaction lives on for 64*T1 so the 487 that ends it still gets its ACK
+    if ( t.invite && t.state == TS_PROCEEDING )
+    {
+      if ( (int32_t)(now - t.deadline) < 0 )
+        continue;
+      if ( t.cancelled )
+      {
+        t.state = TS_FREE;
+        continue;
+      }
+      TransactionTimeout(t);
+      t.cancelled = true;
+      t.deadline = now + 64 * T1;
+      Cancel(t);
+      continue;
+    }
+
+    if ( (int32_t)(now - t.deadline) >= 0 )
+    {
+      if ( t.state != TS_COMPLETED )
+        TransactionTimeout(t);                // Timer B / F
+      t.state = TS_FREE;                      // or Timer D / K: no more duplicates expected
+      continue;
+    }
+
+    // INVITE retransmits only until something is heard, non-INVITE until the final response (every T2 once 1xx)
+    bool resend = t.state == TS_CALLING || (t.state == TS_PROCEEDING && !t.invite);
+    if ( resend && (int32_t)(now - t.retransmitAt) >= 0 )
+    {
+      QueueTx(t.msg, t.len);
+      iRetransmits++;
+      t.interval *= 2;
+      if ( !t.invite && t.interval > T2 )
+        t.interval = T2;
+      t.retransmitAt = now + t.interval;
+    }
+  }
+}
+
+
+// Hands a response to its transaction. Returns false for duplicates the transaction absorbs; requests and
+// responses it does not own (e.g. a retransmitted 2xx to INVITE, which must be ACKed again) go on to the caller.
+bool Sip::MatchResponse(const SipMessage &m) {
+
+  if ( m.IsRequest() )
+    return true;
+  int code = m.Status();
+
+  char branch[32] = { 0 };
+  if ( !m.Param(SipMessage::H_VIA, "branch", branch, sizeof(branch)) )     // top Via is ours
+    return true;
+
+  Transaction *t = 0;
+  for ( int i = 0; i < TRANSACTIONS && !t; i++ )
+  {
+    Transaction &c = transactions[i];
+    if ( c.state != TS_FREE && strcmp(c.branch, branch) == 0
+         && SipMessage::MethodOf(c.method, strlen(c.method)) == m.CSeqMethod() )
+      t = &c;
+  }
+  if ( !t )
+    return true;
+
+  uint32_t now = Millis();
+  if ( code < 200 )
+  {
+    if ( t->state == TS_CALLING )
+    {
+      t->state = TS_PROCEEDING;
+      t->interval = T2;
+      t->retransmitAt = now + T2;
+    }
+    if ( t->invite && !t->cancelled )
+      t->deadline = now + TIMER_C;            // every provisional response restarts Timer C
+    return true;
+  }
+  if ( t->state == TS_COMPLETED )
+  {
+    if ( t->invite )
+      Ack(m);                                 // duplicate final: ACK it again, 17.1.1.2
+    return false;
+  }
+  if ( t->invite && code < 300 && !t->cancelled )
+  {
+    t->state = TS_FREE;                       // 2xx ends the INVITE transaction, the dialog ACKs it
+    return true;
+  }
+  if ( t->invite && code < 300 )
+  {
+    // answered as the CANCEL crossed it: the call was already given up, so confirm and end it at once
+    ParseReturnParams(m);
+    Ack(m);
+    Bye(iLastCSeq + 1);
+  }
+  else if ( t->invite )
+  {
+    Ack(m);                                   // the ACK to a non-2xx final belongs to the transaction, 17.1.1.2
+  }
+  t->state = TS_COMPLETED;
+  t->deadline = now + (t->invite ? 64 * T1 : T4);      // Timer D / K
+  return !t->cancelled;                       // a cancelled call was reported when Timer C fired
+}
+
+
+void Sip::TransactionTimeout(const Transaction &t) {
+
+  Serial.printf("SIP: %s timed out after %u retransmissions\n", t.method, (unsigned)iRetransmits);
+  if ( t.invite )
+  {
+    iRingTime = 0;
+    bDialTimeout = true;
+  }
+  else if ( strcmp(t.method, "REGISTER") == 0 )
+  {
+    bRegisterTimeout = true;
+  }
+}
+
+
+bool Sip::PollRegisterTimeout() {
+
+  bool r = bRegisterTimeout;
+  bRegisterTimeout = false;
+  return r;
+}
+
+
+bool Sip::PollDialTimeout() {
+
+  bool r = bDialTimeout;
+  bDialTimeout = false;
+  return r;
+}
+
+
+int Sip::PollDialFailure() {
+
+  int r = iDialFailure;
+  iDialFailure = 0;
+  return r;
+}
+
+
+// Copies up to the next delimiter (space, ';', ',', '>' or line end); false if empty or too long
+bool Sip::CopyToken(char *dest, size_t destlen, const char *src) {
+
+  size_t l = strcspn(src, " ;,>\r\n");
+  if ( l == 0 || l >= destlen )
+    return false;
+  memcpy(dest, src, l);
+  dest[l] = 0;
+  return true;
 }
 
 
@@ -678,22 +889,62 @@ uint32_t Sip::Random() {
 }
 
 
+// Queues the message just built and sends what lwIP will take right now; returns -1 if it overflowed or the
+// queue was full
 int Sip::SendUdp() {
 	
-  Udp.beginPacket(pSipIp, iSipPort);
-  Udp.write((const uint8_t*)pbuf, strlen(pbuf));
-  Udp.endPacket();
-  delay(10);
+  if ( out.Overflow() )
+  {
+    Serial.printf("SIP: response does not fit, not sent\r\n");
+    return -1;
+  }
 #ifdef DEBUGLOG
-  Serial.printf("\r\n----- send %i bytes -----------------------\r\n%s", strlen(pbuf), pbuf);
+  Serial.printf("\r\n----- send %u bytes -----------------------\r\n%s", (unsigned)out.Length(), out.Text());
   Serial.printf("------------------------------------------------\r\n");
 #endif
+  return QueueTx(out.Text(), out.Length());
+}
+
+
+int Sip::QueueTx(const char *p, size_t len) {
+
+  if ( len > TX_SIZE )
+    len = TX_SIZE;
+
+  FlushTx();
+  if ( txCount == TX_SLOTS )
+  {
+    txDropped++;
+    return -1;
+  }
+  TxSlot &slot = txSlots[(txHead + txCount) % TX_SLOTS];
+  memcpy(slot.data, p, len);
+  slot.len = (uint16_t)len;
+  txCount++;
+  FlushTx();
 
   return 0;
 }
 
 
-void Sip::MakeMd5Digest(char *pOutHex33, char *pIn) {
+// Sends queued datagrams in order; stops at the first one lwIP has no buffer for and keeps it for the next call
+void Sip::FlushTx() {
+
+  while ( txCount > 0 )
+  {
+    TxSlot &slot = txSlots[txHead];
+    if ( !Udp.beginPacket(pSipIp, iSipPort) )
+      return;
+    Udp.write((const uint8_t*)slot.data, slot.len);
+    if ( !Udp.endPacket() )
+      return;
+    txHead = (txHead + 1) % TX_SLOTS;
+    txCount--;
+  }
+}
+
+
+void Sip::MakeMd5Digest(char *pOutHex33, const char *pIn) {
   
   MD5Builder aMd5;
   
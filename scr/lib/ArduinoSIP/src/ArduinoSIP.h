@@ -47,6 +47,9 @@
 
 #include <WiFiUdp.h>
 #include <stdlib.h>
+#include "SipMessage.h"
+#include "SipBuilder.h"
+#include "Sdp.h"
    
 class Sip
 {
@@ -58,16 +61,32 @@ class Sip
 	void        Init(const char *SipIp, int SipPort, const char *MyIp, int MyPort, const char *SipUser, const char *SipPassWd, int MaxDialSec = 10);
     bool        Dial(const char *DialNr, const char *DialDesc, const char *sdpBody, size_t   sdpLen);
 	void		Processing(char *pBuf, size_t lBuf);
-    bool        Register(const char* pIn = 0);
+    bool        Register(bool retry = false);
     bool        IsBusy() { return iRingTime != 0; }
     bool        IsInCall() const { return isInCall; }
-    uint16_t    GetRemoteRtpPort() const { return remoteRtpPort; }
+    uint16_t    GetRemoteRtpPort() const { return mediaSession.port; }
+    // What we can do (address, RTP port, codecs cheapest first, ptime, direction), offered and answered with
+    void        SetLocalMedia(const Sdp::Media &m) { localMedia = m; }
+    // Starts the o= line of a new call, for the offer written with it and passed to Dial()
+    Sdp::Origin &NewSdpOrigin() { Sdp::Begin(sdpOrigin, Random()); return sdpOrigin; }
+    // The stream negotiated by the last INVITE exchange; valid once IsInCall()
+    const Sdp::Session &GetMediaSession() const { return mediaSession; }
+    // Counts changes to GetMediaSession(), so a running call notices a re-INVITE (hold, resume, new media address)
+    uint32_t    GetMediaVersion() const { return iMediaVersion; }
+    void        FlushTx();
+    int         TxPending() const { return txCount; }
+    uint32_t    TxDropped() const { return txDropped; }
+    bool        PollRegisterTimeout();
+    bool        PollDialTimeout();
+    // Final status of a call the far end refused (486, 603, ...), 0 if none since the last poll
+    int         PollDialFailure();
+    uint32_t    Retransmissions() const { return iRetransmits; }
 	
   private:
     bool        isInCall = false;
-    char       *pbuf;
-    size_t      lbuf;
+    SipBuilder  out;                // the message being built, over the buffer given to the constructor
     char        caRead[256];
+    SipMessage  rx;                 // index of the message being handled
 
     const char *pSipIp;
     int         iSipPort;
@@ -81,37 +100,105 @@ class Sip
     size_t      sdpLen;
 
     uint32_t    callid;
-    uint32_t    regid;
+    uint32_t    regid;              // one Call-ID for every REGISTER of this boot, RFC 3261 10.2
+    uint32_t    iRegCSeq;
     uint32_t    tagid;
     uint32_t    branchid;
-    uint16_t    remoteRtpPort = 0;
+    Sdp::Media  localMedia = {};
+    Sdp::Session mediaSession = {};
+    uint32_t    iMediaVersion = 0;
+    Sdp::Origin sdpOrigin = {};     // our o= line in the current dialog
+    bool        bAwaitingAnswer = false;    // our 200 carried the offer, the answer comes with the ACK
+    char        peerUri[64] = "";           // Request-URI of requests inside the current dialog
+    char        toTag[12] = "";             // our tag in a dialog an incoming INVITE opened
+    char        answeredBranch[32] = "";    // the INVITE it was made for, so a retransmission gets the same tag
 
-    int         iAuthCnt;
+    int         iAuthCnt;           // challenges answered for the current call
+    int         iRegAuthCnt;        // and for the current registration
+    int         iReqAuthCnt;        // and for the current BYE or CANCEL
+
+    // Digest credentials (RFC 2617) kept from the last challenge, so every later request authenticates up front
+    static const int MAX_AUTH_TRIES = 1;     // a second challenge that is not just a stale nonce means bad credentials
+    struct DigestAuth {
+      bool      valid;
+      bool      proxy;              // 407: answered with Proxy-Authorization
+      char      realm[64];
+      char      nonce[128];
+      char      opaque[128];
+      char      qop[8];             // "auth", or empty when the server offered none
+      char      ha1[33];            // MD5(user:realm:password), only recomputed when the realm changes
+      uint32_t  nc;                 // nonce-count, restarts with each new nonce
+    };
+    DigestAuth  auth = {};
     uint32_t    iRingTime;
     uint32_t    iMaxTime;
-    int         iDialRetries;
     int         iLastCSeq;
     
 	WiFiUDP 	Udp;
+
+    // Outbound datagrams: SendUdp() only queues, FlushTx() hands them to lwIP without waiting
+    static const int    TX_SLOTS = 4;
+    static const size_t TX_SIZE  = 1024;
+    static const int    RX_BURST = 4;        // datagrams handled per Processing() call
+    struct TxSlot {
+      uint16_t  len;
+      char      data[TX_SIZE];
+    };
+    TxSlot      txSlots[TX_SLOTS];
+    int         txHead = 0;
+    int         txCount = 0;
+    uint32_t    txDropped = 0;
+
+    // RFC 3261 client transactions (17.1), one per outstanding request, keyed by Via branch and CSeq method.
+    // Timer A/E retransmit with exponential backoff, B/F give up after 64*T1, D/K absorb late duplicate responses.
+    // Timer C (16.6) cancels an INVITE that has rung for 3 minutes without another provisional response.
+    static const uint32_t T1 = 500;
+    static const uint32_t T2 = 4000;
+    static const uint32_t T4 = 5000;
+    static const uint32_t TIMER_C = 180000;
+    static const int      TRANSACTIONS = 4;
+    enum TransactionState : uint8_t { TS_FREE, TS_CALLING, TS_PROCEEDING, TS_COMPLETED };
+    struct Transaction {
+      TransactionState state;
+      bool      invite;
+      bool      cancelled;          // Timer C fired and a CANCEL went out; waits 64*T1 for the 487 to ACK it
+      char      method[12];
+      char      branch[32];
+      uint32_t  retransmitAt;       // Timer A (INVITE) or E
+      uint32_t  interval;
+      uint32_t  deadline;           // Timer B/F while waiting, C once an INVITE rings, D/K once completed
+      uint16_t  len;
+      char      msg[TX_SIZE];
+    };
+    Transaction transactions[TRANSACTIONS];
+    uint32_t    iRetransmits = 0;
+    bool        bRegisterTimeout = false;
+    bool        bDialTimeout = false;
+    int         iDialFailure = 0;
 	
-	void        HandleUdpPacket(const char *p);
-	void        AddSipLine(const char* constFormat , ... );
-    bool        AddCopySipLine(const char *p, const char *psearch);
-    bool        ParseParameter(char *dest, int destlen, const char *name, const char *line, char cq = '\"');
-    bool        ParseReturnParams(const char *p);
-    uint16_t    parseRemoteRtpPort(const char* p);
-    int         GrepInteger(const char *p, const char *psearch);
-    void        Ack(const char *pIn);
-    void        Cancel(int seqn);
-    void        Bye(int cseq);
-    void        Ok(const char *pIn);
-    void        Invite(const char *pIn = 0);
-    void        AnswerInvite(const char* inviteMsg);
+	void        HandleUdpPacket(const SipMessage &m);
+    bool        AddCopySipLine(SipBuilder &b, const SipMessage &m, SipMessage::Header h);
+    bool        ParseReturnParams(const SipMessage &m);
+    bool        NegotiateMedia(const SipMessage &m);
+    void        Ack(const SipMessage &m);
+    void        Cancel(const Transaction &invite, bool retry = false);
+    void        Bye(int cseq, bool retry = false);
+    void        Ok(const SipMessage &m);
+    void        Invite(bool retry = false);
+    bool        TakeChallenge(const SipMessage &m, int &tries);
+    void        AddAuthorization(const char *method, const char *uri);
+    void        AnswerInvite(const SipMessage &invite);
 
     uint32_t    Millis();
     uint32_t    Random();
     int         SendUdp();
-    void        MakeMd5Digest(char *pOutHex33, char *pIn);
+    int         QueueTx(const char *p, size_t len);
+    bool        SendRequest();
+    void        Tick();
+    bool        MatchResponse(const SipMessage &m);
+    void        TransactionTimeout(const Transaction &t);
+    static bool CopyToken(char *dest, size_t destlen, const char *src);
+    void        MakeMd5Digest(char *pOutHex33, const char *pIn);
 
 };
 
@@ -0,0 +1,337 @@
+/*
+ * Sdp.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * SDP offer/answer for one audio stream, see Sdp.h
+ */
+#include <string.h>
+#include <strings.h>
+#include "Sdp.h"
+
+static const char *const DIRECTION_NAMES[] = { "sendrecv", "sendonly", "recvonly", "inactive" };
+
+// Decimal number at p; advances p past it
+static uint32_t Number(const char *&p, const char *end) {
+
+  uint32_t v = 0;
+  while ( p < end && *p >= '0' && *p <= '9' )
+    v = v * 10 + (uint32_t)(*p++ - '0');
+  return v;
+}
+
+static bool Starts(const char *p, size_t len, const char *prefix) {
+
+  size_t n = strlen(prefix);
+  return len >= n && memcmp(p, prefix, n) == 0;
+}
+
+static void CopyText(char *dest, size_t destlen, const char *p, size_t len) {
+
+  if ( len >= destlen )
+    len = destlen - 1;
+  memcpy(dest, p, len);
+  dest[len] = 0;
+}
+
+// Address of "IN IP4 <address>" (or IP6)
+static void ConnectionAddress(const char *v, size_t len, char *dest, size_t destlen) {
+
+  const char *end = v + len;
+  const char *a = v;
+  for ( int spaces = 0; a < end && spaces < 2; a++ )
+    if ( *a == ' ' )
+      spaces++;
+  const char *b = a;
+  while ( b < end && *b != ' ' && *b != '/' )       // a multicast TTL follows a slash
+    b++;
+  CopyText(dest, destlen, a, b - a);
+}
+
+
+void Sdp::Clear(Media &m) {
+
+  memset(&m, 0, sizeof(m));
+  m.direction = SENDRECV;
+}
+
+
+bool Sdp::Add(Media &m, uint8_t payloadType, Codec codec) {
+
+  if ( m.count >= MAX_FORMATS )
+    return false;
+  m.payloadTypes[m.count] = payloadType;
+  m.codecs[m.count] = codec;
+  m.count++;
+  return true;
+}
+
+
+Sdp::Codec Sdp::CodecOf(const char *name, size_t len) {
+
+  if ( len == 4 && strncasecmp(name, "PCMU", 4) == 0 ) return CODEC_PCMU;
+  if ( len == 4 && strncasecmp(name, "PCMA", 4) == 0 ) return CODEC_PCMA;
+  if ( len == 2 && strncasecmp(name, "CN", 2) == 0 ) return CODEC_CN;
+  return CODEC_OTHER;
+}
+
+
+const char *Sdp::CodecName(Codec c) {
+
+  switch ( c )
+  {
+    case CODEC_PCMU: return "PCMU";
+    case CODEC_PCMA: return "PCMA";
+    case CODEC_CN:   return "CN";
+    default:         return 0;
+  }
+}
+
+
+Sdp::Direction Sdp::DirectionOf(bool send, bool receive) {
+
+  if ( send && receive ) return SENDRECV;
+  if ( send ) return SENDONLY;
+  if ( receive ) return RECVONLY;
+  return INACTIVE;
+}
+
+
+// One pass over the lines; session-level c=, a=ptime and direction apply unless the audio section sets its own
+bool Sdp::Parse(const char *body, size_t len, Media &m) {
+
+  Clear(m);
+  if ( !body )
+    return false;
+
+  enum { SESSION, AUDIO, OTHER } section = SESSION;
+  bool found = false;
+  char sessionAddress[sizeof(m.address)] = { 0 };
+  uint8_t sessionPtime = 0;
+  int sessionDirection = -1, mediaDirection = -1;
+
+  const char *p = body;
+  const char *end = body + len;
+  while ( p < end )
+  {
+    const char *eol = (const char*)memchr(p, '\n', end - p);
+    const char *stop = eol ? eol : end;
+    const char *lineEnd = (stop > p && stop[-1] == '\r') ? stop - 1 : stop;
+    size_t n = lineEnd - p;
+
+    if ( n >= 2 && p[1] == '=' )
+    {
+      const char *v = p + 2;
+      size_t vn = n - 2;
+      if ( p[0] == 'm' )
+      {
+        if ( found )
+          break;                                  // only the first audio stream is ours
+        if ( Starts(v, vn, "audio ") )
+        {
+          section = AUDIO;
+          found = true;
+          const char *q = v + 6;
+          m.port = (uint16_t)Number(q, lineEnd);
+          while ( q < lineEnd && *q != ' ' )      // skip a "/<port count>"
+            q++;
+          while ( q < lineEnd && *q == ' ' )
+            q++;
+          if ( !Starts(q, lineEnd - q, "RTP/AVP") )
+            return false;                         // formats are only payload types over RTP
+          while ( q < lineEnd && *q != ' ' )
+            q++;
+          while ( q < lineEnd )
+          {
+            while ( q < lineEnd && *q == ' ' )
+              q++;
+            if ( q == lineEnd )
+              break;
+            uint32_t pt = Number(q, lineEnd);
+            if ( pt > 127 )
+              return false;
+            Codec c = pt == 0 ? CODEC_PCMU : pt == 8 ? CODEC_PCMA : pt == 13 ? CODEC_CN : CODEC_OTHER;
+            Add(m, (uint8_t)pt, c);
+            while ( q < lineEnd && *q != ' ' )
+              q++;
+          }
+        }
+        else
+          section = OTHER;
+      }
+      else if ( section != OTHER )
+      {
+        bool media = section == AUDIO;
+        if ( p[0] == 'c' )
+          ConnectionAddress(v, vn, media ? m.address : sessionAddress, sizeof(m.address));
+        else if ( p[0] == 'a' )
+        {
+          if ( Starts(v, vn, "rtpmap:") && media )
+          {
+            // a=rtpmap:<pt> <name>/<clock rate>[/<channels>]; our codecs all run at 8 kHz
+            const char *q = v + 7;
+            uint32_t pt = Number(q, lineEnd);
+            while ( q < lineEnd && *q == ' ' )
+              q++;
+            const char *name = q;
+            while ( q < lineEnd && *q != '/' )
+              q++;
+            Codec c = CodecOf(name, q - name);
+            if ( c != CODEC_OTHER && !Starts(q, lineEnd - q, "/8000") )
+              c = CODEC_OTHER;
+            for ( int i = 0; i < m.count; i++ )
+              if ( m.payloadTypes[i] == pt )
+                m.codecs[i] = c;
+          }
+          else if ( Starts(v, vn, "ptime:") )
+          {
+            const char *q = v + 6;
+            uint32_t ms = Number(q, lineEnd);
+            uint8_t ptime = ms > 255 ? 0 : (uint8_t)ms;
+            if ( media )
+              m.ptime = ptime;
+            else
+              sessionPtime = ptime;
+          }
+          else
+          {
+            for ( int d = 0; d < 4; d++ )
+              if ( vn == 8 && memcmp(v, DIRECTION_NAMES[d], 8) == 0 )
+                (media ? mediaDirection : sessionDirection) = d;
+          }
+        }
+      }
+    }
+    if ( !eol )
+      break;
+    p = eol + 1;
+  }
+
+  if ( !found )
+    return false;
+  if ( !m.address[0] )
+    memcpy(m.address, sessionAddress, sizeof(m.address));
+  if ( !m.ptime )
+    m.ptime = sessionPtime;
+  int d = mediaDirection >= 0 ? mediaDirection : sessionDirection;
+  m.direction = d >= 0 ? (Direction)d : SENDRECV;
+  return true;
+}
+
+
+bool Sdp::Negotiate(const Media &local, const Media &remote, Session &s) {
+
+  memset(&s, 0, sizeof(s));
+  s.cnPayloadType = -1;
+  if ( remote.port == 0 || !remote.address[0] )
+    return false;                                   // stream rejected, or nowhere to send it
+
+  bool localCn = false, remoteCn = false;
+  for ( int i = 0; i < local.count && !s.valid; i++ )
+  {
+    if ( local.codecs[i] == CODEC_CN )
+      continue;
+    for ( int j = 0; j < remote.count; j++ )
+      if ( remote.codecs[j] == local.codecs[i] )
+      {
+        s.codec = local.codecs[i];
+        s.payloadType = remote.payloadTypes[j];     // the other side's numbering
+        s.valid = true;
+        break;
+      }
+  }
+  if ( !s.valid )
+    return false;
+
+  for ( int i = 0; i < local.count; i++ )
+    if ( local.codecs[i] == CODEC_CN )
+      localCn = true;
+  for ( int j = 0; j < remote.count && !remoteCn; j++ )
+    if ( remote.codecs[j] == CODEC_CN )
+    {
+      remoteCn = true;
+      if ( localCn )
+        s.cnPayloadType = remote.payloadTypes[j];
+    }
+
+  // a=ptime is what the other side wants to receive; fall back to ours if it is not a frame size we packetize
+  uint8_t pt = remote.ptime;
+  if ( pt != 10 && pt != 20 && pt != 30 && pt != 40 && pt != 60 )
+    pt = local.ptime ? local.ptime : 20;
+  s.ptime = pt;
+
+  // 0.0.0.0 is the old (RFC 2543) way of putting us on hold
+  bool held = strcmp(remote.address, "0.0.0.0") == 0;
+  s.direction = DirectionOf(Sends(local.direction) && Receives(remote.direction) && !held,
+                            Receives(local.direction) && Sends(remote.direction));
+  memcpy(s.address, remote.address, sizeof(s.address));
+  s.port = remote.port;
+  return true;
+}
+
+
+void Sdp::Answer(const Media &local, const Session &s, Media &answer) {
+
+  Clear(answer);
+  memcpy(answer.address, local.address, sizeof(answer.address));
+  answer.port = local.port;
+  Add(answer, s.payloadType, s.codec);              // answer with the offer's numbering
+  if ( s.cnPayloadType >= 0 )
+    Add(answer, (uint8_t)s.cnPayloadType, CODEC_CN);
+  answer.ptime = s.ptime;
+  answer.direction = s.direction;
+}
+
+
+void Sdp::Begin(Origin &o, uint32_t sessionId) {
+
+  memset(&o, 0, sizeof(o));
+  o.sessionId = sessionId;
+}
+
+
+bool Sdp::Write(SipBuilder &b, const Media &m, const char *sessionName) {
+
+  Origin o;
+  Begin(o, 0);
+  return Write(b, m, sessionName, o);
+}
+
+
+bool Sdp::Write(SipBuilder &b, const Media &m, const char *sessionName, Origin &o) {
+
+  if ( o.written && !Same(m, o.last) )
+    o.version++;
+  o.last = m;
+  o.written = true;
+
+  b.Line("v=0");
+  b.Line("o=- %lu %lu IN IP4 %s", (unsigned long)o.sessionId, (unsigned long)o.version, m.address);
+  b.Line("s=%s", sessionName);
+  b.Line("c=IN IP4 %s", m.address);
+  b.Line("t=0 0");
+  b.Append("m=audio %u RTP/AVP", (unsigned)m.port);
+  for ( int i = 0; i < m.count; i++ )
+    b.Append(" %u", (unsigned)m.payloadTypes[i]);
+  b.Line("");
+  for ( int i = 0; i < m.count; i++ )
+    if ( CodecName(m.codecs[i]) )
+      b.Line("a=rtpmap:%u %s/8000", (unsigned)m.payloadTypes[i], CodecName(m.codecs[i]));
+  if ( m.ptime )
+    b.Line("a=ptime:%u", (unsigned)m.ptime);
+  b.Line("a=%s", DIRECTION_NAMES[m.direction]);
+  return !b.Overflow();
+}
+
+
+// Field by field, so the unused format slots and padding do not count
+bool Sdp::Same(const Media &a, const Media &b) {
+
+  if ( strcmp(a.address, b.address) != 0 || a.port != b.port || a.count != b.count || a.ptime != b.ptime
+       || a.direction != b.direction )
+    return false;
+  for ( int i = 0; i < a.count; i++ )
+    if ( a.payloadTypes[i] != b.payloadTypes[i] || a.codecs[i] != b.codecs[i] )
+      return false;
+  return true;
+}
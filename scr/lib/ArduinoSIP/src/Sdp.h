@@ -0,0 +1,79 @@
+/*
+ * Sdp.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * SDP offer/answer (RFC 4566, RFC 3264) for a single audio stream. Parse() reads the first m=audio section of a
+ * body: the connection address (media level over session level), the port, every payload type with the codec it
+ * stands for (static types, or the a=rtpmap name of dynamic ones), a=ptime and the direction. Negotiate() matches
+ * that against what we can do and yields the Session the RTP pipelines run with; Answer() turns a Session back
+ * into the description we reply with, and Write() formats a description through a SipBuilder. An Origin keeps the
+ * o= line of one dialog: the same session id throughout, and a version that goes up by one with every description
+ * that differs from the one sent before (RFC 3264 8).
+ */
+#ifndef SIP_SDP_H
+#define SIP_SDP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SipBuilder.h"
+
+class Sdp
+{
+  public:
+    enum Codec : uint8_t { CODEC_NONE, CODEC_PCMU, CODEC_PCMA, CODEC_CN, CODEC_OTHER };
+    enum Direction : uint8_t { SENDRECV, SENDONLY, RECVONLY, INACTIVE };
+    static const int MAX_FORMATS = 12;
+
+    // One side's description of the audio stream
+    struct Media {
+      char      address[40];
+      uint16_t  port;                           // 0 = stream rejected
+      uint8_t   count;
+      uint8_t   payloadTypes[MAX_FORMATS];      // in order of preference
+      Codec     codecs[MAX_FORMATS];
+      uint8_t   ptime;                          // 0 = not given
+      Direction direction;
+    };
+
+    // The negotiated stream, from our point of view
+    struct Session {
+      bool      valid;
+      char      address[40];                    // where to send media
+      uint16_t  port;
+      uint8_t   payloadType;
+      Codec     codec;
+      int16_t   cnPayloadType;                  // -1 = no comfort noise
+      uint8_t   ptime;
+      Direction direction;
+    };
+
+    // The o= line of one dialog, and the description it last went out with
+    struct Origin {
+      uint32_t  sessionId;
+      uint32_t  version;
+      bool      written;
+      Media     last;
+    };
+
+    static void        Clear(Media &m);
+    static bool        Add(Media &m, uint8_t payloadType, Codec codec);
+    static bool        Parse(const char *body, size_t len, Media &m);
+    // The first of our codecs (ours are listed cheapest first) that the other side has, with its payload type
+    static bool        Negotiate(const Media &local, const Media &remote, Session &s);
+    static void        Answer(const Media &local, const Session &s, Media &answer);
+    static void        Begin(Origin &o, uint32_t sessionId);
+    // A one-off description, o=- 0 0
+    static bool        Write(SipBuilder &b, const Media &m, const char *sessionName);
+    // The next description of o's dialog; the version is bumped when m differs from the last one written
+    static bool        Write(SipBuilder &b, const Media &m, const char *sessionName, Origin &o);
+    static bool        Same(const Media &a, const Media &b);
+
+    static Codec       CodecOf(const char *name, size_t len);
+    static const char *CodecName(Codec c);
+    static bool        Sends(Direction d) { return d == SENDRECV || d == SENDONLY; }
+    static bool        Receives(Direction d) { return d == SENDRECV || d == RECVONLY; }
+    static Direction   DirectionOf(bool send, bool receive);
+};
+
+#endif	// SIP_SDP_H
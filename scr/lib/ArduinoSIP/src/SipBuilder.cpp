@@ -0,0 +1,127 @@
+/*
+ * SipBuilder.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Cursor-based SIP/SDP message builder, see SipBuilder.h
+ */
+#include <stdio.h>
+#include <string.h>
+#include "SipBuilder.h"
+
+SipBuilder::SipBuilder(char *pBuf, size_t lBuf) {
+
+  buf = pBuf;
+  size = lBuf;
+  Reset();
+}
+
+
+void SipBuilder::Reset() {
+
+  len = 0;
+  lengthAt = 0;
+  bodyAt = 0;
+  overflow = size == 0;
+  if ( size )
+    buf[0] = 0;
+}
+
+
+// Latches the overflow and cuts the text back to the last complete piece
+bool SipBuilder::Fail() {
+
+  overflow = true;
+  if ( size )
+    buf[len] = 0;
+  return false;
+}
+
+
+bool SipBuilder::Line(const char *format, ...) {
+
+  va_list args;
+  va_start(args, format);
+  bool ok = VLine(format, args);
+  va_end(args);
+  return ok;
+}
+
+
+bool SipBuilder::VLine(const char *format, va_list args) {
+
+  return Format(format, args, true);
+}
+
+
+bool SipBuilder::Append(const char *format, ...) {
+
+  va_list args;
+  va_start(args, format);
+  bool ok = Format(format, args, false);
+  va_end(args);
+  return ok;
+}
+
+
+bool SipBuilder::Format(const char *format, va_list args, bool crlf) {
+
+  if ( overflow )
+    return false;
+
+  size_t room = size - len;
+  size_t tail = crlf ? 2 : 0;
+  int n = vsnprintf(buf + len, room, format, args);
+  if ( n < 0 || (size_t)n + tail >= room )    // the text, CRLF and the terminator must all fit
+    return Fail();
+
+  len += n;
+  if ( crlf )
+  {
+    buf[len] = '\r';
+    buf[len + 1] = '\n';
+    buf[len + 2] = 0;
+    len += 2;
+  }
+  return true;
+}
+
+
+bool SipBuilder::Write(const char *p, size_t n) {
+
+  if ( overflow )
+    return false;
+  if ( n >= size - len )
+    return Fail();
+
+  memcpy(buf + len, p, n);
+  len += n;
+  buf[len] = 0;
+  return true;
+}
+
+
+bool SipBuilder::BeginBody() {
+
+  if ( !Line("Content-Length: %*s", LENGTH_DIGITS, "0") || !Line("") )
+    return false;
+  lengthAt = len - 4 - LENGTH_DIGITS;               // value, CRLF, blank line CRLF
+  bodyAt = len;
+  return true;
+}
+
+
+// Writes the body length right-aligned into the space BeginBody() left; the padding is allowed white space
+bool SipBuilder::EndBody() {
+
+  if ( overflow || lengthAt == 0 )
+    return false;
+  if ( len - bodyAt > 99999 )
+    return Fail();
+
+  char digits[LENGTH_DIGITS + 1];
+  snprintf(digits, sizeof(digits), "%*u", LENGTH_DIGITS, (unsigned)(len - bodyAt));
+  memcpy(buf + lengthAt, digits, LENGTH_DIGITS);
+  lengthAt = 0;
+  return true;
+}
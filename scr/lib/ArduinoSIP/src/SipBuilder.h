@@ -0,0 +1,53 @@
+/*
+ * SipBuilder.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Bounded builder for outgoing SIP messages and SDP bodies. It keeps its write cursor, so each line is formatted
+ * straight onto the end of the text without measuring what is already there. BeginBody() leaves a fixed-width
+ * Content-Length that EndBody() fills in once the body has been written in place. A line that does not fit is
+ * dropped whole and latches Overflow(), so the caller can refuse to send a cut-off message.
+ */
+#ifndef SIP_BUILDER_H
+#define SIP_BUILDER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+class SipBuilder
+{
+  public:
+    SipBuilder(char *pBuf, size_t lBuf);
+
+    void        Reset();
+    // Formatted text followed by CRLF; Line("") ends the headers
+    bool        Line(const char *format, ...);
+    bool        VLine(const char *format, va_list args);
+    // Formatted text without a line break, for lines assembled piece by piece
+    bool        Append(const char *format, ...);
+    // Raw bytes, e.g. a body built elsewhere or a block of saved header lines
+    bool        Write(const char *p, size_t len);
+
+    // "Content-Length:" with room for the value, then the blank line; EndBody() writes the value
+    bool        BeginBody();
+    bool        EndBody();
+
+    const char *Text() const { return buf; }
+    size_t      Length() const { return len; }
+    bool        Overflow() const { return overflow; }
+
+  private:
+    static const int LENGTH_DIGITS = 5;
+
+    char       *buf;
+    size_t      size;
+    size_t      len;
+    size_t      lengthAt;           // first digit of the Content-Length value, 0 if there is none
+    size_t      bodyAt;
+    bool        overflow;
+
+    bool        Fail();
+    bool        Format(const char *format, va_list args, bool crlf);
+};
+
+#endif	// SIP_BUILDER_H
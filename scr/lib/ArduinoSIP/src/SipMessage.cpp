@@ -0,0 +1,297 @@
+/*
+ * SipMessage.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * One-pass SIP message index, see SipMessage.h
+ */
+#include <string.h>
+#include "SipMessage.h"
+
+static inline char Lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+// Case-insensitive compare of n characters against a lower-case literal
+static bool EqualsLower(const char *p, const char *lower, size_t n) {
+
+  for ( size_t i = 0; i < n; i++ )
+    if ( Lower(p[i]) != lower[i] )
+      return false;
+  return true;
+}
+
+void SipMessage::Clear() {
+
+  text = "";
+  length = 0;
+  method = M_NONE;
+  status = 0;
+  cseq = 0;
+  cseqMethod = M_NONE;
+  body = 0;
+  memset(fields, 0, sizeof(fields));
+}
+
+
+// Dispatch on length and first letter, so each header line costs at most one string compare
+int SipMessage::HeaderOf(const char *name, size_t len) {
+
+  char c = len ? Lower(name[0]) : 0;
+  switch ( len )
+  {
+    case 1:                                 // compact forms, RFC 3261 7.3.3
+      switch ( c )
+      {
+        case 'v': return H_VIA;
+        case 'f': return H_FROM;
+        case 't': return H_TO;
+        case 'i': return H_CALL_ID;
+        case 'm': return H_CONTACT;
+        case 'c': return H_CONTENT_TYPE;
+        case 'l': return H_CONTENT_LENGTH;
+      }
+      return -1;
+    case 2:
+      return EqualsLower(name, "to", 2) ? H_TO : -1;
+    case 3:
+      return EqualsLower(name, "via", 3) ? H_VIA : -1;
+    case 4:
+      if ( c == 'f' ) return EqualsLower(name, "from", 4) ? H_FROM : -1;
+      if ( c == 'c' ) return EqualsLower(name, "cseq", 4) ? H_CSEQ : -1;
+      return -1;
+    case 7:
+      if ( c == 'e' ) return EqualsLower(name, "expires", 7) ? H_EXPIRES : -1;
+      if ( c != 'c' ) return -1;
+      if ( EqualsLower(name, "call-id", 7) ) return H_CALL_ID;
+      return EqualsLower(name, "contact", 7) ? H_CONTACT : -1;
+    case 12:
+      return EqualsLower(name, "content-type", 12) ? H_CONTENT_TYPE : -1;
+    case 14:
+      return EqualsLower(name, "content-length", 14) ? H_CONTENT_LENGTH : -1;
+    case 16:
+      return EqualsLower(name, "www-authenticate", 16) ? H_WWW_AUTHENTICATE : -1;
+    case 18:
+      return EqualsLower(name, "proxy-authenticate", 18) ? H_PROXY_AUTHENTICATE : -1;
+  }
+  return -1;
+}
+
+
+SipMessage::Method SipMessage::MethodOf(const char *p, size_t len) {
+
+  switch ( len )
+  {
+    case 3:
+      if ( memcmp(p, "BYE", 3) == 0 ) return M_BYE;
+      if ( memcmp(p, "ACK", 3) == 0 ) return M_ACK;
+      break;
+    case 4:
+      if ( memcmp(p, "INFO", 4) == 0 ) return M_INFO;
+      break;
+    case 6:
+      if ( memcmp(p, "INVITE", 6) == 0 ) return M_INVITE;
+      if ( memcmp(p, "CANCEL", 6) == 0 ) return M_CANCEL;
+      if ( memcmp(p, "NOTIFY", 6) == 0 ) return M_NOTIFY;
+      break;
+    case 7:
+      if ( memcmp(p, "OPTIONS", 7) == 0 ) return M_OPTIONS;
+      break;
+    case 8:
+      if ( memcmp(p, "REGISTER", 8) == 0 ) return M_REGISTER;
+      break;
+  }
+  return M_OTHER;
+}
+
+
+// Single walk over the text: start line, then one header per line up to the blank line before the body
+bool SipMessage::Parse(const char *p, size_t len) {
+
+  Clear();
+  if ( len > 0xFFFF )
+    return false;
+  text = p;
+  length = len;
+
+  const char *end = p + len;
+  const char *eol = (const char*)memchr(p, '\n', len);
+  if ( !eol )
+    return false;
+
+  // start line: "SIP/2.0 200 OK" or "INVITE sip:... SIP/2.0"
+  if ( len > 12 && memcmp(p, "SIP/2.0 ", 8) == 0 )
+  {
+    for ( int i = 8; i < 11; i++ )
+      if ( p[i] < '0' || p[i] > '9' )
+        return false;
+    status = (p[8] - '0') * 100 + (p[9] - '0') * 10 + (p[10] - '0');
+    if ( status < 100 || status > 699 )
+      return false;
+  }
+  else
+  {
+    const char *sp = (const char*)memchr(p, ' ', eol - p);
+    if ( !sp || sp == p )
+      return false;
+    method = MethodOf(p, sp - p);
+  }
+
+  const char *line = eol + 1;
+  while ( line < end )
+  {
+    eol = (const char*)memchr(line, '\n', end - line);
+    const char *stop = eol ? eol : end;
+    const char *lineEnd = (stop > line && stop[-1] == '\r') ? stop - 1 : stop;
+    if ( lineEnd == line )
+    {
+      body = (uint16_t)((eol ? eol + 1 : end) - p);
+      break;
+    }
+
+    const char *colon = (const char*)memchr(line, ':', lineEnd - line);
+    if ( colon )
+    {
+      const char *nameEnd = colon;
+      while ( nameEnd > line && (nameEnd[-1] == ' ' || nameEnd[-1] == '\t') )
+        nameEnd--;
+      int h = HeaderOf(line, nameEnd - line);
+      if ( h >= 0 && fields[h].line == 0 )              // first one wins: the top Via is ours
+      {
+        const char *v = colon + 1;
+        while ( v < lineEnd && (*v == ' ' || *v == '\t') )
+          v++;
+        fields[h].line = (uint16_t)(line - p);
+        fields[h].value = (uint16_t)(v - p);
+        fields[h].end = (uint16_t)(lineEnd - p);
+
+        if ( h == H_CSEQ )
+        {
+          while ( v < lineEnd && *v >= '0' && *v <= '9' )
+            cseq = cseq * 10 + (uint32_t)(*v++ - '0');
+          while ( v < lineEnd && *v == ' ' )
+            v++;
+          const char *m = v;
+          while ( v < lineEnd && *v != ' ' )
+            v++;
+          cseqMethod = v > m ? MethodOf(m, v - m) : M_NONE;
+        }
+      }
+    }
+    if ( !eol )
+      break;
+    line = eol + 1;
+  }
+  if ( body == 0 )
+    body = (uint16_t)len;
+  return true;
+}
+
+
+const char *SipMessage::Line(Header h, size_t &len) const {
+
+  const Field &f = fields[h];
+  len = f.line ? f.end - f.line : 0;
+  return f.line ? text + f.line : 0;
+}
+
+
+const char *SipMessage::Value(Header h, size_t &len) const {
+
+  const Field &f = fields[h];
+  len = f.line ? f.end - f.value : 0;
+  return f.line ? text + f.value : 0;
+}
+
+
+// Finds name=value inside the header value, stepping from one parameter to the next (quoted strings are skipped
+// whole, so a nonce cannot fake a parameter); the name is given in lower case
+bool SipMessage::Param(Header h, const char *name, char *dest, size_t destlen) const {
+
+  size_t len;
+  const char *s = Value(h, len);
+  if ( !s )
+    return false;
+  size_t n = strlen(name);
+  const char *end = s + len;
+
+  while ( s < end )
+  {
+    if ( *s == ';' || *s == ',' || *s == ' ' || *s == '\t' )
+    {
+      s++;
+      continue;
+    }
+    if ( (size_t)(end - s) > n && s[n] == '=' && EqualsLower(s, name, n) )
+    {
+      const char *a = s + n + 1;
+      const char *b;
+      if ( a < end && *a == '"' )
+      {
+        a++;
+        b = (const char*)memchr(a, '"', end - a);
+        if ( !b )
+          return false;
+      }
+      else
+      {
+        b = a;
+        while ( b < end && *b != ';' && *b != ',' && *b != ' ' && *b != '>' )
+          b++;
+      }
+      if ( (size_t)(b - a) >= destlen )
+        return false;
+      memcpy(dest, a, b - a);
+      dest[b - a] = 0;
+      return true;
+    }
+    // not it: skip to the next delimiter outside quotes
+    while ( s < end && *s != ';' && *s != ',' && *s != ' ' && *s != '\t' )
+    {
+      if ( *s++ == '"' )
+      {
+        const char *q = (const char*)memchr(s, '"', end - s);
+        s = q ? q + 1 : end;
+      }
+    }
+  }
+  return false;
+}
+
+
+bool SipMessage::Uri(Header h, char *dest, size_t destlen) const {
+
+  size_t len;
+  const char *v = Value(h, len);
+  if ( !v )
+    return false;
+  const char *end = v + len;
+  const char *a = (const char*)memchr(v, '<', len);
+  const char *b;
+  if ( a )
+  {
+    a++;
+    b = (const char*)memchr(a, '>', end - a);
+    if ( !b )
+      return false;
+  }
+  else
+  {
+    a = v;
+    b = a;
+    while ( b < end && *b != ';' && *b != ' ' )
+      b++;
+  }
+  if ( b == a || (size_t)(b - a) >= destlen )
+    return false;
+  memcpy(dest, a, b - a);
+  dest[b - a] = 0;
+  return true;
+}
+
+
+const char *SipMessage::Body(size_t &len) const {
+
+  len = length - body;
+  return text + body;
+}
@@ -0,0 +1,71 @@
+/*
+ * SipMessage.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * One-pass index over a received SIP message. Parse() walks the text once, classifies the start line (request method
+ * and URI, or status code) and records where each known header line and its value start and end, accepting compact
+ * forms (v, f, t, i, m, l, c) and any letter case. Later lookups (a whole line to copy into a reply, a header
+ * parameter, the URI in a name-addr, CSeq, the body) read the index instead of searching the message again.
+ * The text is neither copied nor modified, so it must outlive the index.
+ */
+#ifndef SIP_MESSAGE_H
+#define SIP_MESSAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class SipMessage
+{
+  public:
+    enum Method : uint8_t { M_NONE, M_INVITE, M_ACK, M_BYE, M_CANCEL, M_OPTIONS, M_REGISTER, M_INFO, M_NOTIFY,
+                            M_OTHER };
+    enum Header : uint8_t { H_VIA, H_FROM, H_TO, H_CALL_ID, H_CSEQ, H_CONTACT, H_CONTENT_TYPE, H_CONTENT_LENGTH,
+                            H_WWW_AUTHENTICATE, H_PROXY_AUTHENTICATE, H_EXPIRES, H_COUNT };
+
+    SipMessage() { Clear(); }
+
+    void        Clear();
+    bool        Parse(const char *p, size_t len);
+
+    const char *Text() const { return text; }
+    bool        IsRequest() const { return method != M_NONE; }
+    Method      GetMethod() const { return method; }
+    int         Status() const { return status; }
+    bool        Has(Header h) const { return fields[h].line != 0; }
+
+    // Whole header line as received ("Via: ..." or "v: ..."), without the line break
+    const char *Line(Header h, size_t &len) const;
+    // Header value after the colon and leading white space
+    const char *Value(Header h, size_t &len) const;
+    // Parameter of a header, quoted or not: Param(H_VIA, "branch", ...), Param(H_WWW_AUTHENTICATE, "nonce", ...)
+    bool        Param(Header h, const char *name, char *dest, size_t destlen) const;
+    // URI of a name-addr header (inside <>), or of a bare addr-spec up to its parameters
+    bool        Uri(Header h, char *dest, size_t destlen) const;
+
+    uint32_t    CSeqNumber() const { return cseq; }
+    Method      CSeqMethod() const { return cseqMethod; }
+    const char *Body(size_t &len) const;
+
+    static Method MethodOf(const char *p, size_t len);
+
+  private:
+    struct Field {
+      uint16_t  line;               // 0 = not present (offset 0 is the start line, never a header)
+      uint16_t  value;
+      uint16_t  end;
+    };
+
+    const char *text;
+    size_t      length;
+    Method      method;
+    int         status;
+    uint32_t    cseq;
+    Method      cseqMethod;
+    uint16_t    body;
+    Field       fields[H_COUNT];
+
+    static int  HeaderOf(const char *name, size_t len);
+};
+
+#endif	// SIP_MESSAGE_H
@@ -0,0 +1,79 @@
+/*
+ * G711Reference.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * The classic Sun Microsystems g711.c conversions (public domain), one sample per call with the segment search
+ * loop, as the reference for the G.711 test and benchmark. The mu-law encoder is the original 16-bit one; the
+ * later 14-bit revision floors negative inputs before biasing and lands one step lower at 381 segment edges.
+ * The A-law encoder is the 13-bit revision, the original mishandles small negative inputs.
+ */
+#pragma once
+#include <stdint.h>
+
+namespace g711ref {
+
+static const int16_t SEG_AEND[8] = { 0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF };
+static const int32_t SEG_END[8]  = { 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF };
+static const int BIAS = 0x84;
+
+template <typename T>
+inline int16_t search(T val, const T* table, int16_t size) {
+  for (int16_t i = 0; i < size; i++) {
+    if (val <= *table++) return i;
+  }
+  return size;
+}
+
+inline uint8_t linear2alaw(int16_t pcm) {
+  int16_t mask;
+  pcm = pcm >> 3;
+  if (pcm >= 0) {
+    mask = 0xD5;
+  } else {
+    mask = 0x55;
+    pcm = -pcm - 1;
+  }
+  int16_t seg = search(pcm, SEG_AEND, 8);
+  if (seg >= 8) return (uint8_t)(0x7F ^ mask);
+  uint8_t aval = (uint8_t)(seg << 4);
+  if (seg < 2) aval |= (pcm >> 1) & 0x0F;
+  else         aval |= (pcm >> seg) & 0x0F;
+  return (uint8_t)(aval ^ mask);
+}
+
+inline int16_t alaw2linear(uint8_t a) {
+  a ^= 0x55;
+  int16_t t = (a & 0x0F) << 4;
+  int16_t seg = (a & 0x70) >> 4;
+  switch (seg) {
+    case 0:  t += 8; break;
+    case 1:  t += 0x108; break;
+    default: t += 0x108; t <<= seg - 1;
+  }
+  return (a & 0x80) ? t : -t;
+}
+
+inline uint8_t linear2ulaw(int32_t pcm) {
+  int32_t mask;
+  if (pcm < 0) {
+    pcm = BIAS - pcm;
+    mask = 0x7F;
+  } else {
+    pcm += BIAS;
+    mask = 0xFF;
+  }
+  int16_t seg = search(pcm, SEG_END, 8);
+  if (seg >= 8) return (uint8_t)(0x7F ^ mask);
+  uint8_t uval = (uint8_t)((seg << 4) | ((pcm >> (seg + 3)) & 0x0F));
+  return (uint8_t)(uval ^ mask);
+}
+
+inline int16_t ulaw2linear(uint8_t u) {
+  u = ~u;
+  int16_t t = ((u & 0x0F) << 3) + BIAS;
+  t <<= (u & 0x70) >> 4;
+  return (u & 0x80) ? (BIAS - t) : (t - BIAS);
+}
+
+}   // namespace g711ref
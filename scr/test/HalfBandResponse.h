@@ -0,0 +1,59 @@
+/*
+ * HalfBandResponse.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Reads the 47 taps back out of a HalfBandDecimator with unit impulses and evaluates its frequency response, so the
+ * test and the benchmark measure the filter as implemented (Q15 coefficients and all).
+ */
+#pragma once
+#include "HalfBandDecimator.h"
+#include <math.h>
+#include <vector>
+
+namespace halfband {
+
+// h[0..46] scaled to 1.0, from impulses on the even and on the odd input phase
+inline std::vector<double> taps() {
+  const int16_t ONE = 16384;
+  std::vector<double> h(47, 0.0);
+  for (int phase = 0; phase < 2; ++phase) {
+    HalfBandDecimator d;
+    for (int j = 0; j < 30; ++j) {
+      int16_t even = (j == 0 && phase == 0) ? ONE : 0;
+      int16_t odd  = (j == 0 && phase == 1) ? ONE : 0;
+      int16_t y = d.process(even, odd);
+      // output j sees input 2j+1 as its newest sample; the impulse sits 2j+1-phase samples back
+      int idx = 2 * j + 1 - phase;
+      if (idx >= 0 && idx < 47) h[idx] = (double)y / ONE;
+    }
+  }
+  return h;
+}
+
+// Magnitude in dB at 'freq' for a 16 kHz input rate
+inline double gainDb(const std::vector<double>& h, double freq) {
+  double w = 2 * M_PI * freq / 16000.0, re = 0, im = 0;
+  for (size_t n = 0; n < h.size(); ++n) {
+    re += h[n] * cos(w * n);
+    im -= h[n] * sin(w * n);
+  }
+  return 20 * log10(sqrt(re * re + im * im) + 1e-12);
+}
+
+struct Band {
+  double minDb, maxDb, atHz;
+};
+
+// Extremes of the response between lo and hi Hz, on a 1 Hz grid; atHz is where the maximum is
+inline Band band(const std::vector<double>& h, double lo, double hi) {
+  Band b = { 1e9, -1e9, lo };
+  for (double f = lo; f <= hi; f += 1) {
+    double g = gainDb(h, f);
+    if (g < b.minDb) b.minDb = g;
+    if (g > b.maxDb) { b.maxDb = g; b.atHz = f; }
+  }
+  return b;
+}
+
+}   // namespace halfband
@@ -0,0 +1,23 @@
+/*
+ * HostAlloc.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Counts heap allocations for the benchmarks by wrapping malloc. Include it in exactly one translation unit of a
+ * binary; on a libc other than glibc the counter just stays at zero.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace host {
+  inline uint64_t allocations = 0;
+}
+
+#ifdef __GLIBC__
+extern "C" void* __libc_malloc(size_t n);
+extern "C" void* malloc(size_t n) {
+  host::allocations++;
+  return __libc_malloc(n);
+}
+#endif
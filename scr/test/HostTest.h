@@ -0,0 +1,63 @@
+/*
+ * HostTest.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Minimal check macros for the host tests. A failed check prints where and why and the run carries on, so one
+ * binary reports every broken case; finish() prints the summary and gives the exit code for make.
+ */
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+namespace host {
+  inline int checks = 0;
+  inline int failures = 0;
+
+  inline void fail(const char* file, int line, const char* what) {
+    failures++;
+    printf("  FAIL %s:%d: %s\n", file, line, what);
+  }
+
+  inline int finish(const char* name) {
+    printf("%s: %d checks, %d failed\n", name, checks, failures);
+    return failures ? 1 : 0;
+  }
+
+  // Wall clock for the benchmarks, in nanoseconds
+  inline uint64_t wallNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // Keeps the optimiser from dropping a benchmark's result
+  template <typename T> inline void keep(const T& v) { asm volatile("" : : "g"(&v) : "memory"); }
+}
+
+#define CHECK(cond) do { \
+    host::checks++; \
+    if (!(cond)) host::fail(__FILE__, __LINE__, #cond); \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    host::checks++; \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+      char _m[256]; \
+      snprintf(_m, sizeof(_m), "%s == %s (%lld vs %lld)", #a, #b, _a, _b); \
+      host::fail(__FILE__, __LINE__, _m); \
+    } \
+  } while (0)
+
+#define CHECK_NEAR(a, b, tol) do { \
+    host::checks++; \
+    double _a = (double)(a), _b = (double)(b); \
+    if (fabs(_a - _b) > (tol)) { \
+      char _m[256]; \
+      snprintf(_m, sizeof(_m), "%s ~ %s (%g vs %g, tolerance %g)", #a, #b, _a, _b, (double)(tol)); \
+      host::fail(__FILE__, __LINE__, _m); \
+    } \
+  } while (0)
@@ -0,0 +1,41 @@
+/*
+ * HostWav.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * 16-bit mono WAV in and out for the host tests that can also run over a recording. read() skips the canonical
+ * 44-byte header without looking at it; write() produces one.
+ */
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+namespace wav {
+
+inline std::vector<int16_t> read(const char* path) {
+  std::vector<int16_t> pcm;
+  FILE* f = fopen(path, "rb");
+  if (!f) return pcm;
+  fseek(f, 44, SEEK_SET);
+  int16_t buf[1024];
+  size_t n;
+  while ((n = fread(buf, sizeof(int16_t), 1024, f)) > 0) pcm.insert(pcm.end(), buf, buf + n);
+  fclose(f);
+  return pcm;
+}
+
+inline void write(const char* path, const std::vector<int16_t>& pcm, uint32_t rate = 8000) {
+  FILE* f = fopen(path, "wb");
+  if (!f) return;
+  uint32_t bytes = pcm.size() * 2, riff = 36 + bytes, fmtLen = 16, byteRate = rate * 2;
+  uint16_t pcmFmt = 1, channels = 1, align = 2, bits = 16;
+  fwrite("RIFF", 1, 4, f); fwrite(&riff, 4, 1, f); fwrite("WAVEfmt ", 1, 8, f);
+  fwrite(&fmtLen, 4, 1, f); fwrite(&pcmFmt, 2, 1, f); fwrite(&channels, 2, 1, f);
+  fwrite(&rate, 4, 1, f); fwrite(&byteRate, 4, 1, f); fwrite(&align, 2, 1, f); fwrite(&bits, 2, 1, f);
+  fwrite("data", 1, 4, f); fwrite(&bytes, 4, 1, f);
+  fwrite(pcm.data(), 2, pcm.size(), f);
+  fclose(f);
+}
+
+}   // namespace wav
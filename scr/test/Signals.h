@@ -0,0 +1,199 @@
+/*
+ * Signals.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Synthetic test signals for the host tests, so no recordings have to be checked in: a speech model (glottal
+ * pulses through formant resonators, syllables and pauses, unvoiced fricatives), noise, and the I2S capture
+ * format of the mic (32-bit left-justified samples riding on a large DC offset).
+ */
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+namespace signals {
+
+// Deterministic noise source, independent of esp_random() so tests do not disturb each other's sequences
+class Rng {
+public:
+  explicit Rng(uint32_t seed = 1) : _s(seed ? seed : 1) {}
+  uint32_t next() {
+    _s ^= _s << 13;
+    _s ^= _s >> 17;
+    _s ^= _s << 5;
+    return _s;
+  }
+  double uniform() { return (next() >> 8) * (1.0 / 16777216.0); }         // [0, 1)
+  double gauss() {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+  }
+
+private:
+  uint32_t _s;
+};
+
+// Two-pole resonator
+class Resonator {
+public:
+  Resonator(double freq, double bandwidth, double rate) {
+    double r = exp(-M_PI * bandwidth / rate);
+    _a1 = 2 * r * cos(2 * M_PI * freq / rate);
+    _a2 = -r * r;
+    _g  = (1 - r) * sqrt(1 - 2 * r * cos(4 * M_PI * freq / rate) + r * r);
+  }
+  double process(double x) {
+    double y = _g * x + _a1 * _y1 + _a2 * _y2;
+    _y2 = _y1;
+    _y1 = y;
+    return y;
+  }
+
+private:
+  double _a1, _a2, _g, _y1 = 0, _y2 = 0;
+};
+
+// Talker at 'rate' Hz. Syllables of 120-300 ms, each voiced or (one in five) a fricative, separated by short gaps;
+// with talkspurts on, the talker also pauses for 0.5-2 s between phrases of 1-3 s. Peak level about 'peak'.
+class Speech {
+public:
+  Speech(double rate, double peak = 8000, bool talkspurts = false, uint32_t seed = 7)
+    : _rate(rate), _peak(peak), _talkspurts(talkspurts), _rng(seed)
+    , _f1(650, 90, rate), _f2(1150, 110, rate), _f3(2500, 170, rate), _fric(3500, 1200, rate) {
+    nextPhrase();
+    nextSyllable();
+  }
+
+  double next() {
+    if (_talkspurts && _phraseLeft-- <= 0) nextPhrase();
+    if (_inPause) {
+      advance();
+      return 0;
+    }
+    if (_syllableLeft-- <= 0) nextSyllable();
+    double pos = 1.0 - (double)_syllableLeft / _syllableLen;
+    double env = pos < 0.8 ? sin(M_PI * pos / 0.8) : 0;         // the last 20% of a syllable is a gap
+    double x;
+    if (_fricative) {
+      x = _fric.process(_rng.gauss()) * 6;
+    } else {
+      _phase += _f0 * (1 + 0.08 * sin(_t * 2 * M_PI * 3.1)) / _rate;
+      x = 0;
+      if (_phase >= 1) {
+        _phase -= 1;
+        x = 40;
+      }
+      x = _f1.process(x) + 0.6 * _f2.process(x) + 0.25 * _f3.process(x);
+    }
+    advance();
+    return _peak * env * x / 4;
+  }
+
+  // True while the talker is in a phrase (not in a pause between phrases)
+  bool talking() const { return !_inPause; }
+
+private:
+  double    _rate, _peak;
+  bool      _talkspurts;
+  Rng       _rng;
+  Resonator _f1, _f2, _f3, _fric;
+  double    _t = 0, _phase = 0, _f0 = 120;
+  long      _syllableLeft = 0, _syllableLen = 1, _phraseLeft = 0;
+  bool      _fricative = false, _inPause = false;
+
+  void advance() { _t += 1 / _rate; }
+
+  void nextSyllable() {
+    _syllableLen  = (long)(_rate * (0.12 + 0.18 * _rng.uniform()));
+    _syllableLeft = _syllableLen;
+    _fricative    = _rng.next() % 5 == 0;
+    _f0           = 100 + 60 * _rng.uniform();
+  }
+
+  void nextPhrase() {
+    if (!_talkspurts) return;
+    _inPause    = !_inPause;
+    _phraseLeft = (long)(_rate * (_inPause ? 0.5 + 1.5 * _rng.uniform() : 1.0 + 2.0 * _rng.uniform()));
+  }
+};
+
+// Two people taking turns, as one side's mic hears it: this side's turns of 2-8 s alternate with the other side's
+// (quiet here), and after one turn in three both go quiet for 3-10 s. Each side talks about 40% of the time.
+class Turns {
+public:
+  Turns(double rate, double peak, uint32_t seed = 7) : _rate(rate), _talker(rate, peak, false, seed), _rng(seed + 3) {
+    nextTurn();
+  }
+
+  double next() {
+    if (_left-- <= 0) nextTurn();
+    return _state == NEAR ? _talker.next() : 0;
+  }
+
+  // True during this side's turn
+  bool talking() const { return _state == NEAR; }
+
+private:
+  enum State { NEAR, FAR, IDLE };
+  double _rate;
+  Speech _talker;
+  Rng    _rng;
+  State  _state = IDLE;
+  long   _left  = 0;
+
+  void nextTurn() {
+    if (_state == FAR && _rng.next() % 3 == 0) {
+      _state = IDLE;
+      _left  = (long)(_rate * (3 + 7 * _rng.uniform()));
+      return;
+    }
+    _state = _state == NEAR ? FAR : NEAR;
+    _left  = (long)(_rate * (2 + 6 * _rng.uniform()));
+  }
+};
+
+// Stationary ventilation style noise: low-passed rumble, a 120 Hz hum and a broadband hiss, at 'level' RMS
+class HvacNoise {
+public:
+  HvacNoise(double rate, double level, uint32_t seed = 11) : _level(1), _rng(seed), _hum(120, 40, rate) {
+    _lp = exp(-2 * M_PI * 400 / rate);
+    HvacNoise probe(*this);                  // same seed: calibrate the mix on 2 s of the noise itself
+    double e = 0;
+    long   n = (long)(2 * rate);
+    for (long i = 0; i < n; ++i) {
+      double x = probe.next();
+      e += x * x;
+    }
+    _level = level / sqrt(e / n);
+  }
+  double next() {
+    _low = _lp * _low + (1 - _lp) * _rng.gauss();
+    double x = 9 * _low + 0.35 * _rng.gauss() + 2 * _hum.process(_rng.gauss());
+    return _level * x;
+  }
+
+private:
+  double    _level;
+  Rng       _rng;
+  Resonator _hum;
+  double    _lp, _low = 0;
+};
+
+inline int16_t toPcm(double v) { return (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : lround(v))); }
+
+// What the I2S mic delivers for a 16-bit signal: the sample in the top bits plus the mic's DC offset
+inline int32_t toI2S(double v, int32_t dcOffset = -220000000) {
+  double raw = v * 65536.0 + dcOffset;
+  if (raw > 2147483647.0) raw = 2147483647.0;
+  if (raw < -2147483648.0) raw = -2147483648.0;
+  return (int32_t)raw;
+}
+
+inline double rms(const int16_t* p, size_t n) {
+  double e = 0;
+  for (size_t i = 0; i < n; ++i) e += (double)p[i] * p[i];
+  return n ? sqrt(e / n) : 0;
+}
+
+}   // namespace signals
@@ -0,0 +1,175 @@
+/*
+ * SipCorpus.h
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * What a registered phone hears from an Asterisk-style server over a call: the registration challenge and its 200,
+ * the call's progress, challenge, answer and teardown, keep-alives and an incoming call. Full header names in the
+ * canonical case, as the strstr parser this replaced required, so both parsers can run over the same text.
+ */
+#pragma once
+#include <stddef.h>
+
+namespace sipcorpus {
+
+static const char* const MESSAGES[] = {
+  // 401 to REGISTER
+  "SIP/2.0 401 Unauthorized\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK0001234567;received=192.168.1.50;rport=5060\r\n"
+  "Call-ID: 0000012345@192.168.1.50\r\n"
+  "From: <sip:1001@192.168.1.10>;tag=0000987654\r\n"
+  "To: <sip:1001@192.168.1.10>;tag=as5f2c1e0b\r\n"
+  "CSeq: 1 REGISTER\r\n"
+  "Server: Asterisk PBX 18.10.0\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "WWW-Authenticate: Digest algorithm=MD5, realm=\"asterisk\", nonce=\"1a2b3c4d\", opaque=\"5e6f7a8b\", qop=\"auth\"\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  // 200 to the authenticated REGISTER
+  "SIP/2.0 200 OK\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK0007654321;received=192.168.1.50;rport=5060\r\n"
+  "Call-ID: 0000012345@192.168.1.50\r\n"
+  "From: <sip:1001@192.168.1.10>;tag=0000987655\r\n"
+  "To: <sip:1001@192.168.1.10>;tag=as5f2c1e0c\r\n"
+  "CSeq: 2 REGISTER\r\n"
+  "Server: Asterisk PBX 18.10.0\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Expires: 3600\r\n"
+  "Contact: <sip:1001@192.168.1.50:5060;transport=udp>;expires=3600\r\n"
+  "Date: Sat, 18 Oct 2025 10:12:44 GMT\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  // 407 to INVITE
+  "SIP/2.0 407 Proxy Authentication Required\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK0001111111;received=192.168.1.50;rport=5060\r\n"
+  "Call-ID: 0000222222@192.168.1.50\r\n"
+  "From: \"ESP32 Call\" <sip:1001@192.168.1.10>;tag=0000333333\r\n"
+  "To: <sip:100@192.168.1.10>;tag=as0b1c2d3e\r\n"
+  "CSeq: 1 INVITE\r\n"
+  "Server: Asterisk PBX 18.10.0\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Proxy-Authenticate: Digest algorithm=MD5, realm=\"asterisk\", nonce=\"7c8d9e0f\", opaque=\"1a2b3c4d\", qop=\"auth\"\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  // 100 Trying to the authenticated INVITE
+  "SIP/2.0 100 Trying\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK0002222222;received=192.168.1.50;rport=5060\r\n"
+  "Call-ID: 0000222222@192.168.1.50\r\n"
+  "From: \"ESP32 Call\" <sip:1001@192.168.1.10>;tag=0000333333\r\n"
+  "To: <sip:100@192.168.1.10>\r\n"
+  "CSeq: 2 INVITE\r\n"
+  "Server: Asterisk PBX 18.10.0\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Contact: <sip:100@192.168.1.10:5060>\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  // 200 to the INVITE, with the answer
+  "SIP/2.0 200 OK\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK0002222222;received=192.168.1.50;rport=5060\r\n"
+  "Call-ID: 0000222222@192.168.1.50\r\n"
+  "From: \"ESP32 Call\" <sip:1001@192.168.1.10>;tag=0000333333\r\n"
+  "To: <sip:100@192.168.1.10>;tag=as4e5f6a7b\r\n"
+  "CSeq: 2 INVITE\r\n"
+  "Server: Asterisk PBX 18.10.0\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Contact: <sip:100@192.168.1.10:5060>\r\n"
+  "Content-Type: application/sdp\r\n"
+  "Content-Length: 205\r\n"
+  "\r\n"
+  "v=0\r\n"
+  "o=- 1184726103 1184726104 IN IP4 192.168.1.10\r\n"
+  "s=Asterisk\r\n"
+  "c=IN IP4 192.168.1.10\r\n"
+  "t=0 0\r\n"
+  "m=audio 17362 RTP/AVP 0 13\r\n"
+  "a=rtpmap:0 PCMU/8000\r\n"
+  "a=rtpmap:13 CN/8000\r\n"
+  "a=ptime:20\r\n"
+  "a=maxptime:150\r\n"
+  "a=sendrecv\r\n",
+
+  // keep-alive from the server
+  "OPTIONS sip:1001@192.168.1.50:5060;transport=udp SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.10:5060;branch=z9hG4bK7a0c3e41;rport\r\n"
+  "Max-Forwards: 70\r\n"
+  "From: \"asterisk\" <sip:asterisk@192.168.1.10>;tag=as1d2e3f4a\r\n"
+  "To: <sip:1001@192.168.1.50:5060;transport=udp>\r\n"
+  "Contact: <sip:asterisk@192.168.1.10:5060>\r\n"
+  "Call-ID: 6b8d1e2f3a4b5c6d7e8f9a0b1c2d3e4f@192.168.1.10:5060\r\n"
+  "CSeq: 102 OPTIONS\r\n"
+  "User-Agent: Asterisk PBX 18.10.0\r\n"
+  "Date: Sat, 18 Oct 2025 10:13:14 GMT\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  // an incoming call
+  "INVITE sip:1001@192.168.1.50:5060;transport=udp SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.10:5060;branch=z9hG4bK3c5e7a9b;rport\r\n"
+  "Max-Forwards: 70\r\n"
+  "From: \"Conference\" <sip:100@192.168.1.10>;tag=as6c7d8e9f\r\n"
+  "To: <sip:1001@192.168.1.50:5060;transport=udp>\r\n"
+  "Contact: <sip:100@192.168.1.10:5060>\r\n"
+  "Call-ID: 2f4a6c8e0b1d3f5a7c9e1b3d5f7a9c1e@192.168.1.10:5060\r\n"
+  "CSeq: 102 INVITE\r\n"
+  "User-Agent: Asterisk PBX 18.10.0\r\n"
+  "Date: Sat, 18 Oct 2025 10:14:02 GMT\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Content-Type: application/sdp\r\n"
+  "Content-Length: 245\r\n"
+  "\r\n"
+  "v=0\r\n"
+  "o=- 1497285221 1497285221 IN IP4 192.168.1.10\r\n"
+  "s=Asterisk\r\n"
+  "c=IN IP4 192.168.1.10\r\n"
+  "t=0 0\r\n"
+  "m=audio 14288 RTP/AVP 0 8 101\r\n"
+  "a=rtpmap:0 PCMU/8000\r\n"
+  "a=rtpmap:8 PCMA/8000\r\n"
+  "a=rtpmap:101 telephone-event/8000\r\n"
+  "a=fmtp:101 0-16\r\n"
+  "a=ptime:20\r\n"
+  "a=sendrecv\r\n",
+
+  // the far end hangs up
+  "BYE sip:1001@192.168.1.50:5060;transport=udp SIP/2.0\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.10:5060;branch=z9hG4bK5e7a9c1d;rport\r\n"
+  "Max-Forwards: 70\r\n"
+  "From: \"Conference\" <sip:100@192.168.1.10>;tag=as6c7d8e9f\r\n"
+  "To: <sip:1001@192.168.1.50:5060;transport=udp>;tag=4F2A9C1B\r\n"
+  "Call-ID: 2f4a6c8e0b1d3f5a7c9e1b3d5f7a9c1e@192.168.1.10:5060\r\n"
+  "CSeq: 103 BYE\r\n"
+  "User-Agent: Asterisk PBX 18.10.0\r\n"
+  "X-Asterisk-HangupCause: Normal Clearing\r\n"
+  "X-Asterisk-HangupCauseCode: 16\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+
+  // a refused call
+  "SIP/2.0 486 Busy Here\r\n"
+  "Via: SIP/2.0/UDP 192.168.1.50:5060;branch=z9hG4bK0004444444;received=192.168.1.50;rport=5060\r\n"
+  "Call-ID: 0000555555@192.168.1.50\r\n"
+  "From: \"ESP32 Call\" <sip:1001@192.168.1.10>;tag=0000666666\r\n"
+  "To: <sip:100@192.168.1.10>;tag=as8a9b0c1d\r\n"
+  "CSeq: 2 INVITE\r\n"
+  "Server: Asterisk PBX 18.10.0\r\n"
+  "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, SUBSCRIBE, NOTIFY, INFO, PUBLISH, MESSAGE\r\n"
+  "Supported: replaces, timer\r\n"
+  "Content-Length: 0\r\n"
+  "\r\n",
+};
+
+static const size_t COUNT = sizeof(MESSAGES) / sizeof(MESSAGES[0]);
+
+}  // namespace sipcorpus
@@ -0,0 +1,101 @@
+/*
+ * bench_g711.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Samples per second of the G711 block kernels against the path they replaced. arduino-audio-tools is not built
+ * on the host, so its G711 encoder/decoder is reproduced here the way it runs: the Sun conversion called through
+ * a function pointer for every sample, behind a virtual Print::write per block.
+ */
+#include "HostTest.h"
+#include "Arduino.h"
+#include "G711.h"
+#include "G711Reference.h"
+#include <vector>
+
+// What EncodedAudioStream did per write: one indirect conversion per sample, then a virtual write downstream
+class PerSampleCodec : public Print {
+public:
+  PerSampleCodec(Print& out, bool encode) : _out(out), _encode(encode) {}
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    if (_encode) {
+      const int16_t* pcm = (const int16_t*)data;
+      size_t n = len / 2;
+      for (size_t i = 0; i < n; ++i) _buf[i] = _enc(pcm[i]);
+      _out.write(_buf, n);
+    } else {
+      int16_t* pcm = (int16_t*)_buf;
+      for (size_t i = 0; i < len; ++i) pcm[i] = _dec(data[i]);
+      _out.write(_buf, len * 2);
+    }
+    return len;
+  }
+
+private:
+  Print&  _out;
+  bool    _encode;
+  uint8_t (*volatile _enc)(int16_t) = [](int16_t s) { return g711ref::linear2ulaw(s); };
+  int16_t (*volatile _dec)(uint8_t) = g711ref::ulaw2linear;
+  uint8_t _buf[640];
+};
+
+class Sink : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t* data, size_t len) override {
+    host::keep(data);
+    bytes += len;
+    return len;
+  }
+  uint64_t bytes = 0;
+};
+
+static const size_t FRAME  = 160;
+static const int    FRAMES = 200000;
+
+static void report(const char* name, uint64_t ns) {
+  printf("  %-34s %8.1f Msamples/s\n", name, (double)FRAMES * FRAME * 1000.0 / ns);
+}
+
+int main() {
+  std::vector<int16_t> pcm(FRAME * 50);
+  for (size_t i = 0; i < pcm.size(); ++i) pcm[i] = (int16_t)(12000 * sin(i * 0.031) + 3000 * sin(i * 0.77));
+  std::vector<uint8_t> coded(pcm.size());
+  G711::ulawEncode(pcm.data(), coded.data(), pcm.size());
+  uint8_t  enc[FRAME];
+  int16_t  dec[FRAME];
+  Sink sink;
+
+  printf("bench_g711: %d frames of %zu samples\n", FRAMES, FRAME);
+
+  PerSampleCodec oldEnc(sink, true), oldDec(sink, false);
+  uint64_t t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) oldEnc.write((const uint8_t*)&pcm[(f % 50) * FRAME], FRAME * 2);
+  report("encode, per sample (old path)", host::wallNs() - t0);
+  t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) {
+    G711::ulawEncode(&pcm[(f % 50) * FRAME], enc, FRAME);
+    host::keep(enc);
+  }
+  report("encode, G711::ulawEncode", host::wallNs() - t0);
+  t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) {
+    G711::alawEncode(&pcm[(f % 50) * FRAME], enc, FRAME);
+    host::keep(enc);
+  }
+  report("encode, G711::alawEncode", host::wallNs() - t0);
+
+  t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) oldDec.write(&coded[(f % 50) * FRAME], FRAME);
+  report("decode, per sample (old path)", host::wallNs() - t0);
+  t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) {
+    G711::ulawDecode(&coded[(f % 50) * FRAME], dec, FRAME);
+    host::keep(dec);
+  }
+  report("decode, G711::ulawDecode", host::wallNs() - t0);
+
+  CHECK_EQ(sink.bytes, (uint64_t)FRAMES * FRAME * 3);
+  return host::finish("bench_g711");
+}
@@ -0,0 +1,177 @@
+/*
+ * bench_mic_conditioner.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Time per 20 ms capture frame (320 raw I2S samples in, one RTP packet out) for:
+ *  - the old stream chain, reproduced here as it ran (arduino-audio-tools does not build on the host): a virtual
+ *    Filter::process per sample with a buffer copy, a 32 -> 16 bit converter and a 2:1 resampler without an
+ *    anti-alias filter, then a G.711 encoder calling through a function pointer per sample;
+ *  - MicConditioner alone, PCM out;
+ *  - RTPInput with every frame stage off, i.e. conditioning plus the packetizer's encoder;
+ *  - RTPInput in the default configuration (NS, AGC and DTX on), i.e. what the device actually runs.
+ *
+ *   bench_mic_conditioner [capture.raw]
+ * uses a recorded I2S capture (32-bit little endian, 16 kHz mono) instead of the synthetic one.
+ */
+#include "HostTest.h"
+#include "RTPInput.h"
+#include "G711Reference.h"
+#include "Signals.h"
+
+// ---- the old chain -------------------------------------------------------------------------------------------
+class OldEncoder : public Print {
+public:
+  explicit OldEncoder(Print& out) : _out(out) {}
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    const int16_t* pcm = (const int16_t*)data;
+    for (size_t i = 0; i < len / 2; ++i) _buf[i] = _enc(pcm[i]);
+    return _out.write(_buf, len / 2);
+  }
+
+private:
+  Print&  _out;
+  uint8_t (*volatile _enc)(int16_t) = [](int16_t s) { return g711ref::linear2ulaw(s); };
+  uint8_t _buf[320];
+};
+
+class OldConverter : public Print {
+public:
+  explicit OldConverter(Print& out) : _out(out) {}
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    const int32_t* in = (const int32_t*)data;
+    size_t n = len / 4;
+    for (size_t i = 0; i < n; ++i) _narrow[i] = (int16_t)(in[i] >> 16);          // NumberFormatConverter
+    size_t produced = 0;
+    while (_pos < n - 1) {                                                   // linear interpolation, step 2
+      size_t k = (size_t)_pos;
+      float  frac = _pos - k;
+      _out16[produced++] = (int16_t)(_narrow[k] + frac * (_narrow[k + 1] - _narrow[k]));
+      _pos += _step;
+    }
+    _pos -= n;
+    return _out.write((const uint8_t*)_out16, produced * 2) ? len : 0;
+  }
+
+private:
+  Print&  _out;
+  float   _pos = 0, _step = 2.0f;
+  int16_t _narrow[320];
+  int16_t _out16[161];
+};
+
+class OldFilteredStream : public Print {
+public:
+  OldFilteredStream(Print& out, Filter<int32_t>& filter) : _out(out), _filter(&filter) {}
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override {
+    const int32_t* in = (const int32_t*)data;
+    for (size_t i = 0; i < len / 4; ++i) _buf[i] = _filter->process(in[i]);
+    return _out.write((const uint8_t*)_buf, len);
+  }
+
+private:
+  Print&           _out;
+  Filter<int32_t>* _filter;
+  int32_t          _buf[320];
+};
+
+class PayloadSink : public Print {
+public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t* data, size_t len) override {
+    memcpy(payload, data, len);
+    host::keep(payload);
+    return len;
+  }
+  uint8_t payload[320];
+};
+
+// ---------------------------------------------------------------------------------------------------------------
+static std::vector<int32_t> capture;
+static size_t capturePos = 0;
+
+static const int32_t* nextFrame() {
+  if (capturePos + 320 > capture.size()) capturePos = 0;
+  const int32_t* p = &capture[capturePos];
+  capturePos += 320;
+  return p;
+}
+
+static void report(const char* name, uint64_t ns, int frames) {
+  printf("  %-44s %7.2f us/frame\n", name, ns / 1000.0 / frames);
+}
+
+static double runRtpInput(bool defaults, int frames) {
+  host::resetI2S();
+  host::i2s(0).read = [](uint8_t* data, size_t len) {
+    memcpy(data, nextFrame(), len);
+    return len;
+  };
+  static RTPInput* in = nullptr;
+  delete in;
+  in = new RTPInput("", "");
+  in->begin(IPAddress(10, 0, 0, 33), 5004, 1, 2, 3);
+  if (!defaults) {
+    in->setNoiseSuppression(false);
+    in->setAgcEnabled(false);
+    in->setDtxEnabled(false);
+  }
+  for (int f = 0; f < 50; ++f) in->update();                 // settle
+  uint64_t t0 = host::wallNs();
+  for (int f = 0; f < frames; ++f) in->update();
+  return (double)(host::wallNs() - t0);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+      printf("bench_mic_conditioner: cannot open %s\n", argv[1]);
+      return 1;
+    }
+    int32_t buf[1024];
+    size_t n;
+    while ((n = fread(buf, sizeof(int32_t), 1024, f)) > 0) capture.insert(capture.end(), buf, buf + n);
+    fclose(f);
+  } else {
+    signals::Speech talker(16000, 9000);
+    signals::HvacNoise noise(16000, 60);
+    for (int i = 0; i < 16000 * 10; ++i) capture.push_back(signals::toI2S(talker.next() + noise.next()));
+  }
+  if (capture.size() < 320) {
+    printf("bench_mic_conditioner: capture too short\n");
+    return 1;
+  }
+  host::resetNet();
+  host::keepSent = false;
+  const int FRAMES = 20000;
+  printf("bench_mic_conditioner: %d frames of 20 ms, %s capture\n", FRAMES, argc > 1 ? "recorded" : "synthetic");
+
+  PayloadSink sink;
+  OldEncoder encoder(sink);
+  OldConverter converter(encoder);
+  OffsetFilter offset;
+  OldFilteredStream filtered(converter, offset);
+  uint64_t t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) filtered.write((const uint8_t*)nextFrame(), 320 * sizeof(int32_t));
+  report("old stream chain (reproduced)", host::wallNs() - t0, FRAMES);
+
+  MicConditioner conditioner;
+  int16_t pcm[161];
+  t0 = host::wallNs();
+  for (int f = 0; f < FRAMES; ++f) {
+    conditioner.process(nextFrame(), 320, pcm);
+    host::keep(pcm);
+  }
+  report("MicConditioner, PCM out", host::wallNs() - t0, FRAMES);
+
+  uint64_t before = host::sentCount;
+  report("RTPInput, frame stages off", (uint64_t)runRtpInput(false, FRAMES), FRAMES);
+  CHECK(host::sentCount - before >= (uint64_t)FRAMES);
+  report("RTPInput, default (NS, AGC, DTX on)", (uint64_t)runRtpInput(true, FRAMES), FRAMES);
+
+  return host::finish("bench_mic_conditioner");
+}
@@ -0,0 +1,85 @@
+/*
+ * bench_rtp_send.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Cost of sending one 20 ms G.711 packet: the old write() path, which built every packet in a fresh malloc()
+ * block, against sendPacket() from the preallocated buffer. Datagrams are only counted, not stored, so the
+ * socket stub adds no allocation of its own.
+ */
+#include "HostTest.h"
+#include "HostAlloc.h"
+#include "RTPOverUDP.h"
+
+// The baseline send path, kept here as the reference
+class MallocRTP {
+public:
+  explicit MallocRTP(UDPStream& udp) : _udp(udp) {}
+  size_t write(const uint8_t* payload, size_t len) {
+    uint8_t header[12];
+    header[0] = 0x80;
+    header[1] = _payloadType;
+    header[2] = (_seq >> 8) & 0xFF;
+    header[3] = (_seq     ) & 0xFF;
+    header[4] = (_timestamp >> 24) & 0xFF;
+    header[5] = (_timestamp >> 16) & 0xFF;
+    header[6] = (_timestamp >>  8) & 0xFF;
+    header[7] = (_timestamp      ) & 0xFF;
+    header[8]  = (_ssrc >> 24) & 0xFF;
+    header[9]  = (_ssrc >> 16) & 0xFF;
+    header[10] = (_ssrc >> 8 ) & 0xFF;
+    header[11] = (_ssrc      ) & 0xFF;
+    size_t total = RTP_HEADER_SIZE + len;
+    auto* pkt = (uint8_t*)malloc(total);
+    memcpy(pkt, header, RTP_HEADER_SIZE);
+    memcpy(pkt + RTP_HEADER_SIZE, payload, len);
+    _udp.write(pkt, total);
+    free(pkt);
+    _seq++;
+    _timestamp += len;
+    return total;
+  }
+
+private:
+  UDPStream& _udp;
+  uint16_t   _seq = 0;
+  uint32_t   _timestamp = 0;
+  uint32_t   _ssrc = 0x12345678;
+  uint8_t    _payloadType = 0;
+};
+
+static const int PACKETS = 2000000;
+
+static void report(const char* name, uint64_t ns, uint64_t allocs) {
+  printf("  %-28s %7.1f ns/packet  %5.2f allocations/packet\n", name, (double)ns / PACKETS, (double)allocs / PACKETS);
+}
+
+int main() {
+  host::resetNet();
+  host::keepSent = false;
+  UDPStream udp("", "");
+  udp.begin(IPAddress(10, 0, 0, 33), 5004);
+  uint8_t payload[160];
+  memset(payload, 0xFF, sizeof(payload));
+
+  printf("bench_rtp_send: %d packets of 160 bytes\n", PACKETS);
+
+  MallocRTP old(udp);
+  uint64_t a0 = host::allocations, t0 = host::wallNs();
+  for (int i = 0; i < PACKETS; ++i) old.write(payload, sizeof(payload));
+  report("malloc per packet (old)", host::wallNs() - t0, host::allocations - a0);
+
+  RTPOverUDP rtp(udp);
+  a0 = host::allocations;
+  t0 = host::wallNs();
+  for (int i = 0; i < PACKETS; ++i) {
+    memcpy(rtp.payloadBuffer(), payload, sizeof(payload));
+    rtp.sendPacket(sizeof(payload), sizeof(payload));
+  }
+  uint64_t allocs = host::allocations - a0;
+  report("sendPacket, fixed buffer", host::wallNs() - t0, allocs);
+
+  CHECK_EQ(host::sentCount, 2 * (uint64_t)PACKETS);
+  CHECK_EQ(allocs, 0);
+  return host::finish("bench_rtp_send");
+}
@@ -0,0 +1,270 @@
+/*
+ * bench_sip_auth.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Time from Register() or Dial() to the 200 OK, against a registrar stand-in that checks every digest, over a link
+ * with 10 ms each way (20 ms RTT) and no loss. The stand-in challenges REGISTER and INVITE with 401, as Asterisk
+ * does, and accepts a request only if username, realm, nonce, opaque, uri (the Request-URI), qop and a rising
+ * nonce-count are right and response= matches MD5 of the password it knows. A request for a nonce it has retired
+ * gets a 401 with stale=true. Each request is timed once from a client without a cached challenge and once from one
+ * that already has it. A client with the wrong password must give up after two challenges.
+ */
+#include "HostTest.h"
+#include "ArduinoSIP.h"
+#include "MD5Builder.h"
+#include <map>
+#include <string>
+#include <vector>
+
+static const char    *SERVER      = "10.0.0.1";
+static const uint16_t SERVER_PORT = 5060;
+static const uint16_t LOCAL_PORT  = 5070;
+static const uint32_t ONE_WAY     = 10;             // ms
+static const uint32_t RTT         = 2 * ONE_WAY;
+
+static char outBuf[1500], inBuf[1500];
+
+static std::string header(const SipMessage &m, SipMessage::Header h) {
+  size_t len = 0;
+  const char *v = m.Value(h, len);
+  return v ? std::string(v, len) : std::string();
+}
+
+static std::string md5(const std::string &s) {
+  MD5Builder m;
+  m.begin();
+  m.add(s.c_str());
+  m.calculate();
+  char hex[33];
+  m.getChars(hex);
+  return hex;
+}
+
+static std::string param(const std::string &line, const char *name) {
+  size_t at = line.find(std::string(" ") + name + "=");
+  if ( at == std::string::npos ) return std::string();
+  at += strlen(name) + 2;
+  if ( line[at] == '"' ) return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+  return line.substr(at, line.find(',', at) - at);
+}
+
+// Datagrams in flight both ways, each delivered ONE_WAY ms after it was sent
+class Link {
+public:
+  struct Datagram {
+    uint32_t    due;
+    std::string text;
+  };
+  std::vector<Datagram> toServer, toClient;
+
+  void send(std::vector<Datagram> &way, const std::string &text, uint32_t now) {
+    way.push_back({ now + ONE_WAY, text });
+  }
+
+  // The datagrams due by now, oldest first
+  static std::vector<std::string> take(std::vector<Datagram> &way, uint32_t now) {
+    std::vector<std::string> due;
+    for ( size_t i = 0; i < way.size(); )
+      if ( way[i].due <= now )
+      {
+        due.push_back(way[i].text);
+        way.erase(way.begin() + i);
+      }
+      else
+        i++;
+    return due;
+  }
+};
+
+class Registrar {
+public:
+  Registrar(Link &link) : _link(link) {}
+
+  uint32_t challenges = 0, stale = 0, rejected = 0, accepted = 0;
+  uint32_t okAt = 0;                          // when the last 200 OK went out
+
+  // Retire the current nonce; it is still recognised, and answered with stale=true
+  void expire() {
+    _old = _nonce;
+    _nonce = "n" + std::to_string(++_nonces);
+  }
+
+  void receive(const std::string &text, uint32_t now) {
+    SipMessage m;
+    CHECK(m.Parse(text.data(), text.size()));
+    SipMessage::Method method = m.GetMethod();
+    if ( method != SipMessage::M_REGISTER && method != SipMessage::M_INVITE ) return;   // ACKs
+
+    const char *name = method == SipMessage::M_REGISTER ? "REGISTER" : "INVITE";
+    std::string uri = text.substr(text.find(' ') + 1, text.find(" SIP/2.0") - text.find(' ') - 1);
+    std::string auth = credentials(text);
+    if ( auth.empty() )
+      challenge(m, false, now);
+    else if ( !verify(auth, name, uri) )
+    {
+      rejected++;
+      challenge(m, false, now);
+    }
+    else if ( param(auth, "nonce") != _nonce )
+      challenge(m, true, now);
+    else
+    {
+      accepted++;
+      if ( method == SipMessage::M_INVITE ) _link.send(_link.toClient, response(m, 100, "Trying"), now);
+      _link.send(_link.toClient, response(m, 200, "OK", method == SipMessage::M_REGISTER ? "Expires: 3600\r\n"
+                                          : "Contact: <sip:100@10.0.0.1:5060>\r\n", method == SipMessage::M_INVITE),
+                 now);
+      okAt = now;
+    }
+  }
+
+private:
+  Link                           &_link;
+  std::string                     _nonce = "n1", _old;
+  uint32_t                        _nonces = 1;
+  std::map<std::string, uint32_t> _nc;       // highest nonce-count seen per nonce
+
+  static std::string credentials(const std::string &text) {
+    size_t at = text.find("\r\nAuthorization: Digest ");
+    if ( at == std::string::npos ) return std::string();
+    at += 2;
+    return text.substr(at, text.find("\r\n", at) - at);
+  }
+
+  // Everything a registrar checks before it believes the request, RFC 2617 3.2.2 and 3.3
+  bool verify(const std::string &auth, const char *method, const std::string &uri) {
+    std::string nonce = param(auth, "nonce"), nc = param(auth, "nc"), cnonce = param(auth, "cnonce");
+    if ( param(auth, "username") != "alice" || param(auth, "realm") != "pbx" ) return false;
+    if ( param(auth, "uri") != uri ) return false;
+    if ( param(auth, "opaque") != "5ccc069c" || param(auth, "qop") != "auth" || cnonce.empty() ) return false;
+    if ( nonce != _nonce && nonce != _old ) return false;
+    uint32_t count = (uint32_t)strtoul(nc.c_str(), nullptr, 16);
+    if ( nc.size() != 8 || count <= _nc[nonce] ) return false;                // a replay
+    _nc[nonce] = count;
+    std::string ha1 = md5("alice:pbx:secret"), ha2 = md5(std::string(method) + ":" + uri);
+    return param(auth, "response") == md5(ha1 + ":" + nonce + ":" + nc + ":" + cnonce + ":auth:" + ha2);
+  }
+
+  void challenge(const SipMessage &m, bool expired, uint32_t now) {
+    challenges++;
+    stale += expired;
+    std::string h = "WWW-Authenticate: Digest realm=\"pbx\", nonce=\"" + _nonce + "\", opaque=\"5ccc069c\", "
+                    "algorithm=MD5, qop=\"auth\"" + (expired ? ", stale=true" : "") + "\r\n";
+    _link.send(_link.toClient, response(m, 401, "Unauthorized", h.c_str()), now);
+  }
+
+  static std::string response(const SipMessage &req, int code, const char *reason, const char *extra = "",
+                              bool sdp = false) {
+    std::string to = header(req, SipMessage::H_TO);
+    if ( code > 100 && to.find("tag=") == std::string::npos ) to += ";tag=srv1";
+    std::string body = sdp ? "v=0\r\no=- 1 1 IN IP4 10.0.0.1\r\ns=-\r\nc=IN IP4 10.0.0.1\r\nt=0 0\r\n"
+                             "m=audio 17000 RTP/AVP 0\r\na=rtpmap:0 PCMU/8000\r\na=ptime:20\r\n" : "";
+    return "SIP/2.0 " + std::to_string(code) + " " + reason + "\r\n"
+         + "Via: " + header(req, SipMessage::H_VIA) + "\r\n"
+         + "From: " + header(req, SipMessage::H_FROM) + "\r\n"
+         + "To: " + to + "\r\n"
+         + "Call-ID: " + header(req, SipMessage::H_CALL_ID) + "\r\n"
+         + "CSeq: " + header(req, SipMessage::H_CSEQ) + "\r\n"
+         + extra
+         + (sdp ? "Content-Type: application/sdp\r\n" : "")
+         + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+};
+
+static Link      *link_;
+static Registrar *registrar;
+static Sip       *sip;
+static uint32_t   now;
+static char       sdp[320];
+static size_t     sdpLen;
+
+static void start(const char *password = "secret") {
+  host::reset();
+  host::resetNet();
+  delete sip;
+  delete registrar;
+  delete link_;
+  link_ = new Link;
+  registrar = new Registrar(*link_);
+  sip = new Sip(outBuf, sizeof(outBuf));
+  sip->Init(SERVER, SERVER_PORT, "10.0.0.2", LOCAL_PORT, "alice", password);
+  now = 0;
+
+  Sdp::Media local;
+  Sdp::Clear(local);
+  strcpy(local.address, "10.0.0.2");
+  local.port = 4000;
+  Sdp::Add(local, 0, Sdp::CODEC_PCMU);
+  local.ptime = 20;
+  sip->SetLocalMedia(local);
+  SipBuilder offer(sdp, sizeof(sdp));
+  CHECK(Sdp::Write(offer, local, "test"));
+  sdpLen = offer.Length();
+}
+
+// One millisecond: the client takes what reached it and sends, the registrar takes what reached it and answers
+static void step() {
+  for ( const std::string &text : Link::take(link_->toClient, now) ) host::deliver(LOCAL_PORT, text);
+  sip->Processing(inBuf, sizeof(inBuf));
+  for ( const HostDatagram &d : host::sent() )
+  {
+    CHECK(d.address == SERVER && d.port == SERVER_PORT);
+    link_->send(link_->toServer, d.data, now);
+  }
+  host::sent().clear();
+  for ( const std::string &text : Link::take(link_->toServer, now) ) registrar->receive(text, now);
+  host::advanceMs(1);
+  now++;
+}
+
+// ms from now until the client has the registrar's 200 OK for its REGISTER
+static uint32_t registerMs() {
+  uint32_t from = now, accepted = registrar->accepted;
+  CHECK(sip->Register());
+  while ( now - from < 5000 && (registrar->accepted == accepted || now < registrar->okAt + ONE_WAY) ) step();
+  step();                                           // the client handles it
+  return now - 1 - from;
+}
+
+// ms from now until the client is in the call
+static uint32_t inviteMs() {
+  uint32_t from = now;
+  CHECK(sip->Dial("100", "Test", sdp, sdpLen));
+  while ( now - from < 5000 && !sip->IsInCall() ) step();
+  CHECK(sip->IsInCall());
+  return now - 1 - from;
+}
+
+static void report(const char *what, uint32_t ms, uint32_t rtts) {
+  printf("  %-44s %3u ms  %u RTT\n", what, (unsigned)ms, (unsigned)(ms / RTT));
+  CHECK_EQ(ms, rtts * RTT);
+}
+
+int main() {
+  printf("bench_sip_auth: time to 200 OK against a verifying registrar, %u ms RTT\n", (unsigned)RTT);
+
+  start();
+  report("REGISTER, no cached challenge", registerMs(), 2);
+  report("REGISTER refresh, cached challenge", registerMs(), 1);
+  report("INVITE, cached challenge", inviteMs(), 1);
+  registrar->expire();
+  report("REGISTER refresh, nonce expired", registerMs(), 2);
+  CHECK_EQ(registrar->stale, 1);
+  CHECK_EQ(registrar->rejected, 0);
+
+  start();
+  report("INVITE, no cached challenge", inviteMs(), 2);
+  report("REGISTER, cached from the INVITE", registerMs(), 1);
+  CHECK_EQ(registrar->rejected, 0);
+
+  start("wrong");
+  sip->Register();
+  for ( int i = 0; i < 5000; i++ ) step();
+  printf("  wrong password: %u challenges, %u rejected, %u accepted\n", (unsigned)registrar->challenges,
+         (unsigned)registrar->rejected, (unsigned)registrar->accepted);
+  CHECK_EQ(registrar->challenges, 2);
+  CHECK_EQ(registrar->rejected, 1);
+  CHECK_EQ(registrar->accepted, 0);
+  return host::finish("bench_sip_auth");
+}
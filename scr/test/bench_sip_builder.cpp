@@ -0,0 +1,181 @@
+/*
+ * bench_sip_builder.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Building an authenticated INVITE with its SDP offer, the largest message the phone sends, against the path
+ * SipBuilder replaced (reproduced here): AddSipLine formatting at pbuf + strlen(pbuf) and measuring again for the
+ * CRLF, an SDP offer concatenated as Strings, and the body copied in behind a Content-Length from its length. The
+ * digest response is a fixed string in both, so only the text building is timed. Reports time and heap
+ * allocations per message; both outputs are checked to carry the same headers and body first.
+ */
+#include "HostTest.h"
+#include "HostAlloc.h"
+#include "SipBuilder.h"
+#include "SipMessage.h"
+#include "Sdp.h"
+#include <stdarg.h>
+#include <string>
+
+static const int MESSAGES = 300000;
+
+static const char *SIP_IP = "192.168.1.10", *MY_IP = "192.168.1.50", *USER = "1001", *DIAL = "100";
+static const char *DESC = "ESP32 Call", *REALM = "asterisk", *NONCE = "7c8d9e0f1a2b3c4d", *OPAQUE = "1a2b3c4d";
+static const char *RESPONSE = "0123456789abcdef0123456789abcdef";
+static const unsigned PORT = 5060, RTP_PORT = 4000, PTIME = 20;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// The old path
+
+static char pbuf[1024];
+static const size_t lbuf = sizeof(pbuf);
+
+static void AddSipLine(const char *constFormat, ...) {
+  va_list arglist;
+  va_start(arglist, constFormat);
+  uint16_t l = (uint16_t)strlen(pbuf);
+  char *p = pbuf + l;
+  vsnprintf(p, lbuf - l, constFormat, arglist);
+  va_end(arglist);
+  l = (uint16_t)strlen(pbuf);
+  if ( l < (lbuf - 2) )
+  {
+    pbuf[l] = '\r';
+    pbuf[l + 1] = '\n';
+    pbuf[l + 2] = 0;
+  }
+}
+
+// SimpleSIPClient's offer, one String concatenation per piece
+static std::string oldSdp() {
+  return std::string("v=0\r\n") +
+    "o=- 0 0 IN IP4 " + MY_IP + "\r\n" +
+    "s=ESP32 SIP Call\r\n" +
+    "c=IN IP4 " + MY_IP + "\r\n" +
+    "t=0 0\r\n" +
+    "m=audio " + std::to_string(RTP_PORT) + " RTP/AVP 0 8 13\r\n" +
+    "a=rtpmap:0 PCMU/8000\r\n" +
+    "a=rtpmap:8 PCMA/8000\r\n" +
+    "a=rtpmap:13 CN/8000\r\n" +
+    "a=ptime:" + std::to_string(PTIME) + "\r\n" +
+    "a=sendrecv\r\n";
+}
+
+static size_t oldInvite(uint32_t n) {
+  std::string sdp = oldSdp();
+  pbuf[0] = '\0';
+  AddSipLine("INVITE sip:%s@%s SIP/2.0", DIAL, SIP_IP);
+  AddSipLine("Call-ID: %010u@%s", n, MY_IP);
+  AddSipLine("CSeq: %u INVITE", 2u);
+  AddSipLine("Max-Forwards: 70");
+  AddSipLine("From: \"%s\" <sip:%s@%s>;tag=%010u", DESC, USER, SIP_IP, n);
+  AddSipLine("Via: SIP/2.0/UDP %s:%u;branch=z9hG4bK%010u;rport=%u", MY_IP, PORT, n, PORT);
+  AddSipLine("To: <sip:%s@%s>", DIAL, SIP_IP);
+  AddSipLine("Contact: \"%s\" <sip:%s@%s:%u;transport=udp>", USER, USER, MY_IP, PORT);
+  AddSipLine("Proxy-Authorization: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"sip:%s@%s\", "
+             "response=\"%s\", algorithm=MD5, opaque=\"%s\", qop=auth, nc=%08x, cnonce=\"%08x\"",
+             USER, REALM, NONCE, DIAL, SIP_IP, RESPONSE, OPAQUE, 1u, n);
+  AddSipLine("Content-Type: application/sdp");
+  AddSipLine("Content-Length: %u", (unsigned)sdp.size());
+  AddSipLine("");
+  size_t used = strlen(pbuf);
+  size_t space = lbuf - used - 1;
+  size_t toCp = sdp.size() < space ? sdp.size() : space;
+  memcpy(pbuf + used, sdp.data(), toCp);
+  pbuf[used + toCp] = '\0';
+  return strlen(pbuf);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// The new path: Sip::Invite() and Sdp::Write() through one builder
+
+static char obuf[1024];
+
+static size_t newInvite(SipBuilder &out, const Sdp::Media &local, uint32_t n) {
+  out.Reset();
+  out.Line("INVITE sip:%s@%s SIP/2.0", DIAL, SIP_IP);
+  out.Line("Call-ID: %010u@%s", n, MY_IP);
+  out.Line("CSeq: %u INVITE", 2u);
+  out.Line("Max-Forwards: 70");
+  out.Line("From: \"%s\" <sip:%s@%s>;tag=%010u", DESC, USER, SIP_IP, n);
+  out.Line("Via: SIP/2.0/UDP %s:%u;branch=z9hG4bK%010u;rport=%u", MY_IP, PORT, n, PORT);
+  out.Line("To: <sip:%s@%s>", DIAL, SIP_IP);
+  out.Line("Contact: \"%s\" <sip:%s@%s:%u;transport=udp>", USER, USER, MY_IP, PORT);
+  out.Append("Proxy-Authorization: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"sip:%s@%s\", "
+             "response=\"%s\", algorithm=MD5", USER, REALM, NONCE, DIAL, SIP_IP, RESPONSE);
+  out.Append(", opaque=\"%s\"", OPAQUE);
+  out.Append(", qop=%s, nc=%08x, cnonce=\"%08x\"", "auth", 1u, n);
+  out.Line("");
+  out.Line("Content-Type: application/sdp");
+  out.BeginBody();
+  Sdp::Write(out, local, "ESP32 SIP Call");
+  out.EndBody();
+  return out.Length();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string headers(const char *text) {
+  SipMessage m;
+  std::string s;
+  CHECK(m.Parse(text, strlen(text)));
+  for ( int h = 0; h < SipMessage::H_COUNT; h++ )
+  {
+    size_t len = 0;
+    const char *v = m.Value((SipMessage::Header)h, len);
+    s += v ? std::string(v, len) : std::string("-");
+    s += '\n';
+  }
+  size_t len;
+  const char *body = m.Body(len);
+  CHECK_EQ((size_t)atoi(m.Value(SipMessage::H_CONTENT_LENGTH, len)), strlen(body));
+  return s + body;
+}
+
+int main() {
+  Sdp::Media local;
+  Sdp::Clear(local);
+  strcpy(local.address, MY_IP);
+  local.port = RTP_PORT;
+  Sdp::Add(local, 0, Sdp::CODEC_PCMU);
+  Sdp::Add(local, 8, Sdp::CODEC_PCMA);
+  Sdp::Add(local, 13, Sdp::CODEC_CN);
+  local.ptime = PTIME;
+  local.direction = Sdp::SENDRECV;
+  SipBuilder out(obuf, sizeof(obuf));
+
+  // Same message from both, Content-Length padding aside
+  oldInvite(7);
+  newInvite(out, local, 7);
+  std::string a = headers(pbuf), b = headers(obuf);
+  CHECK(a.substr(0, a.find("application/sdp")) == b.substr(0, b.find("application/sdp")));
+  CHECK(a.substr(a.find("v=0")) == b.substr(b.find("v=0")));
+  CHECK(!out.Overflow());
+  printf("bench_sip_builder: authenticated INVITE with SDP, %zu bytes, %d messages\n", strlen(obuf), MESSAGES);
+
+  size_t bytes = 0;
+  uint64_t allocs = host::allocations, t0 = host::wallNs();
+  for ( int i = 0; i < MESSAGES; i++ )
+  {
+    bytes += oldInvite(i);
+    host::keep(pbuf);
+  }
+  uint64_t oldNs = host::wallNs() - t0, oldAllocs = host::allocations - allocs;
+
+  allocs = host::allocations;
+  t0 = host::wallNs();
+  for ( int i = 0; i < MESSAGES; i++ )
+  {
+    bytes += newInvite(out, local, i);
+    host::keep(obuf);
+  }
+  uint64_t newNs = host::wallNs() - t0, newAllocs = host::allocations - allocs;
+  host::keep(bytes);
+
+  printf("  %-36s %6.2f us  %5.1f allocations\n", "AddSipLine + String SDP (old path)", oldNs / 1000.0 / MESSAGES,
+         (double)oldAllocs / MESSAGES);
+  printf("  %-36s %6.2f us  %5.1f allocations  (%.2fx)\n", "SipBuilder + Sdp::Write", newNs / 1000.0 / MESSAGES,
+         (double)newAllocs / MESSAGES, (double)oldNs / newNs);
+  CHECK_EQ(newAllocs, 0);
+  return host::finish("bench_sip_builder");
+}
@@ -0,0 +1,241 @@
+/*
+ * bench_sip_message.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Messages per second through the receive path, over the corpus in SipCorpus.h: the strstr chain SipMessage replaced
+ * (reproduced here: ParseParameter, GrepInteger, CSeqMethod and the AddCopySipLine searches, plus the start line
+ * tests HandleUdpPacket ran one after the other) against one Parse() and index lookups. Both pull out what the
+ * handlers use, transaction match, dialog lines, digest challenge and RTP port, and are checked to agree.
+ * glibc's strstr is vectorised; the byte-wise variant stands in for a libc without vector string routines.
+ */
+#include "HostTest.h"
+#include "SipMessage.h"
+#include "SipCorpus.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const int ROUNDS = 200000;
+
+// What the handlers take from a received message
+struct Extract {
+  int      status;
+  uint32_t cseq;
+  char     cseqMethod[12];
+  char     branch[32];
+  char     toUri[64];
+  char     tag[32];
+  char     dialog[256];           // Call-ID, From, Via and To lines, as kept for BYE and CANCEL
+  char     realm[32], nonce[32], opaque[32], qop[16];
+  int      rtpPort;
+
+  bool operator==(const Extract &o) const {
+    return status == o.status && cseq == o.cseq && !strcmp(cseqMethod, o.cseqMethod) && !strcmp(branch, o.branch)
+        && !strcmp(toUri, o.toUri) && !strcmp(tag, o.tag) && !strcmp(dialog, o.dialog) && !strcmp(realm, o.realm)
+        && !strcmp(nonce, o.nonce) && !strcmp(opaque, o.opaque) && !strcmp(qop, o.qop) && rtpPort == o.rtpPort;
+  }
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// The old path, as ArduinoSIP had it, over a pluggable strstr
+
+typedef const char *(*StrStr)(const char *, const char *);
+static StrStr volatile search;
+
+static const char *libcStrstr(const char *h, const char *n) { return strstr(h, n); }
+
+static const char *byteStrstr(const char *h, const char *n) {
+  for ( ; *h; h++ )
+  {
+    const char *a = h, *b = n;
+    while ( *b && *a == *b ) { a++; b++; }
+    if ( !*b ) return h;
+  }
+  return 0;
+}
+
+static bool ParseParameter(char *dest, int destlen, const char *name, const char *line, char cq = '"') {
+  const char *r = search(line, name);
+  if ( !r ) return false;
+  r += strlen(name);
+  const char *qp = strchr(r, cq);
+  if ( !qp ) return false;
+  int l = qp - r;
+  if ( l >= destlen ) return false;
+  strncpy(dest, r, l);
+  dest[l] = 0;
+  return true;
+}
+
+static int GrepInteger(const char *p, const char *psearch) {
+  const char *pc = search(p, psearch);
+  return pc ? atoi(pc + strlen(psearch)) : -1;
+}
+
+static bool CopyToken(char *dest, size_t destlen, const char *src) {
+  size_t l = strcspn(src, " ;,>\r\n");
+  if ( l == 0 || l >= destlen ) return false;
+  memcpy(dest, src, l);
+  dest[l] = 0;
+  return true;
+}
+
+static bool CSeqMethod(char *dest, size_t destlen, const char *p) {
+  const char *c = search(p, "\nCSeq: ");
+  if ( !c ) return false;
+  c += 7;
+  while ( *c >= '0' && *c <= '9' ) c++;
+  while ( *c == ' ' ) c++;
+  return CopyToken(dest, destlen, c);
+}
+
+static void AddCopySipLine(char *buf, size_t size, const char *p, const char *psearch) {
+  const char *pa = search(p, psearch);
+  if ( !pa ) return;
+  const char *pe = search(pa, "\r");
+  if ( !pe ) pe = search(pa, "\n");
+  size_t l = strlen(buf);
+  snprintf(buf + l, size - l, "%.*s\r\n", (int)(pe - pa), pa);
+}
+
+static void oldPath(const char *p, Extract &x) {
+  memset(&x, 0, sizeof(x));
+  // MatchResponse
+  if ( strncmp(p, "SIP/2.0 ", 8) == 0 ) x.status = atoi(p + 8);
+  const char *b = search(p, "branch=");
+  if ( b ) CopyToken(x.branch, sizeof(x.branch), b + 7);
+  CSeqMethod(x.cseqMethod, sizeof(x.cseqMethod), p);
+  // HandleUdpPacket's chain of start line tests, then the handler's own lookups
+  bool options = search(p, "OPTIONS sip:") != 0;
+  bool invite = !options && search(p, "INVITE sip:") != 0;
+  bool challenge = !invite && (search(p, "SIP/2.0 401 ") || search(p, "SIP/2.0 407 "));
+  bool ok = !challenge && search(p, "SIP/2.0 200 OK") && search(p, "CSeq:");
+  bool progress = !ok && (search(p, "SIP/2.0 183 ") || search(p, "SIP/2.0 100 ") || search(p, "SIP/2.0 180 "));
+  bool failed = !progress && (search(p, "SIP/2.0 486 ") || search(p, "SIP/2.0 603 ") || search(p, "SIP/2.0 487 "));
+  if ( !failed ) search(p, "INFO");
+  if ( !failed ) search(p, "BYE");
+  (void)progress;
+  x.cseq = GrepInteger(p, "\nCSeq: ");
+  ParseParameter(x.toUri, sizeof(x.toUri), "To: <", p, '>');
+  ParseParameter(x.tag, sizeof(x.tag), "tag=", search(p, "\nTo: ") ? search(p, "\nTo: ") : p, '\r');
+  AddCopySipLine(x.dialog, sizeof(x.dialog), p, "Call-ID: ");
+  AddCopySipLine(x.dialog, sizeof(x.dialog), p, "From: ");
+  AddCopySipLine(x.dialog, sizeof(x.dialog), p, "Via: ");
+  AddCopySipLine(x.dialog, sizeof(x.dialog), p, "To: ");
+  if ( challenge )
+  {
+    ParseParameter(x.realm, sizeof(x.realm), "realm=\"", p);
+    ParseParameter(x.nonce, sizeof(x.nonce), "nonce=\"", p);
+    ParseParameter(x.opaque, sizeof(x.opaque), "opaque=\"", p);
+    ParseParameter(x.qop, sizeof(x.qop), "qop=\"", p);
+  }
+  const char *m = search(p, "m=audio ");
+  if ( m ) x.rtpPort = atoi(m + 8);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// The new path: one walk, then lookups on the index
+
+static const char *methodName(SipMessage::Method m) {
+  static const char *names[] = { "", "INVITE", "ACK", "BYE", "CANCEL", "OPTIONS", "REGISTER", "INFO", "NOTIFY", "" };
+  return names[m];
+}
+
+static void copyLine(char *buf, size_t size, const SipMessage &m, SipMessage::Header h) {
+  size_t len;
+  const char *line = m.Line(h, len);
+  if ( !line ) return;
+  size_t l = strlen(buf);
+  snprintf(buf + l, size - l, "%.*s\r\n", (int)len, line);
+}
+
+static void newPath(SipMessage &m, const char *p, size_t len, Extract &x) {
+  memset(&x, 0, sizeof(x));
+  if ( !m.Parse(p, len) ) return;
+  x.status = m.Status();
+  m.Param(SipMessage::H_VIA, "branch", x.branch, sizeof(x.branch));
+  strcpy(x.cseqMethod, methodName(m.CSeqMethod()));
+  x.cseq = m.CSeqNumber();
+  m.Uri(SipMessage::H_TO, x.toUri, sizeof(x.toUri));
+  m.Param(SipMessage::H_TO, "tag", x.tag, sizeof(x.tag));
+  copyLine(x.dialog, sizeof(x.dialog), m, SipMessage::H_CALL_ID);
+  copyLine(x.dialog, sizeof(x.dialog), m, SipMessage::H_FROM);
+  copyLine(x.dialog, sizeof(x.dialog), m, SipMessage::H_VIA);
+  copyLine(x.dialog, sizeof(x.dialog), m, SipMessage::H_TO);
+  if ( x.status == 401 || x.status == 407 )
+  {
+    SipMessage::Header h = x.status == 407 ? SipMessage::H_PROXY_AUTHENTICATE : SipMessage::H_WWW_AUTHENTICATE;
+    m.Param(h, "realm", x.realm, sizeof(x.realm));
+    m.Param(h, "nonce", x.nonce, sizeof(x.nonce));
+    m.Param(h, "opaque", x.opaque, sizeof(x.opaque));
+    m.Param(h, "qop", x.qop, sizeof(x.qop));
+  }
+  size_t bodyLen;
+  const char *body = m.Body(bodyLen);
+  const char *a = bodyLen ? (const char*)memmem(body, bodyLen, "m=audio ", 8) : 0;
+  if ( a ) x.rtpPort = atoi(a + 8);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static double rate(uint64_t ns, int rounds = ROUNDS) { return (double)rounds * sipcorpus::COUNT * 1e9 / ns; }
+
+static double runOld(StrStr s, int rounds) {
+  search = s;
+  Extract x;
+  uint64_t t0 = host::wallNs();
+  for ( int r = 0; r < rounds; r++ )
+    for ( size_t i = 0; i < sipcorpus::COUNT; i++ )
+    {
+      oldPath(sipcorpus::MESSAGES[i], x);
+      host::keep(x);
+    }
+  return rate(host::wallNs() - t0, rounds);
+}
+
+int main() {
+  size_t lengths[sipcorpus::COUNT], bytes = 0;
+  for ( size_t i = 0; i < sipcorpus::COUNT; i++ ) bytes += lengths[i] = strlen(sipcorpus::MESSAGES[i]);
+  printf("bench_sip_message: %zu messages, %zu bytes on average, %d rounds\n", sipcorpus::COUNT,
+         bytes / sipcorpus::COUNT, ROUNDS);
+
+  // Same answers from both parsers before anything is timed
+  SipMessage m;
+  for ( size_t i = 0; i < sipcorpus::COUNT; i++ )
+  {
+    Extract a, b;
+    search = libcStrstr;
+    oldPath(sipcorpus::MESSAGES[i], a);
+    newPath(m, sipcorpus::MESSAGES[i], lengths[i], b);
+    CHECK(a == b);
+  }
+
+  double libc = runOld(libcStrstr, ROUNDS);
+  double bytewise = runOld(byteStrstr, ROUNDS / 10);
+
+  Extract x;
+  uint64_t t0 = host::wallNs();
+  for ( int r = 0; r < ROUNDS; r++ )
+    for ( size_t i = 0; i < sipcorpus::COUNT; i++ )
+    {
+      newPath(m, sipcorpus::MESSAGES[i], lengths[i], x);
+      host::keep(x);
+    }
+  double indexed = rate(host::wallNs() - t0);
+
+  t0 = host::wallNs();
+  for ( int r = 0; r < ROUNDS; r++ )
+    for ( size_t i = 0; i < sipcorpus::COUNT; i++ )
+    {
+      m.Parse(sipcorpus::MESSAGES[i], lengths[i]);
+      host::keep(m);
+    }
+  double parseOnly = rate(host::wallNs() - t0);
+
+  printf("  %-38s %6.2f M msg/s\n", "strstr chain, glibc strstr", libc / 1e6);
+  printf("  %-38s %6.2f M msg/s\n", "strstr chain, byte-wise strstr", bytewise / 1e6);
+  printf("  %-38s %6.2f M msg/s  (%.1fx glibc, %.1fx byte-wise)\n", "SipMessage::Parse + lookups", indexed / 1e6,
+         indexed / libc, indexed / bytewise);
+  printf("  %-38s %6.2f M msg/s\n", "SipMessage::Parse alone", parseOnly / 1e6);
+  return host::finish("bench_sip_message");
+}
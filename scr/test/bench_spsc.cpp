@@ -0,0 +1,223 @@
+/*
+ * bench_spsc.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Time per 20 ms frame (160 samples at 8 kHz plus a sequence number) handed from a producer to a consumer pthread:
+ *  - through RingBufferStream, reproduced here as the library runs it (arduino-audio-tools does not build on the
+ *    host): RingBuffer<uint8_t> copies one byte per virtual write()/read() call and wraps its index with a modulo.
+ *    The library does no locking of its own, so each call takes a mutex, the least that makes it safe between tasks;
+ *  - through SPSCQueue with push()/pop(), with reserve()/commit() and front()/release() in place, and in batches
+ *    of up to 4 frames per index store.
+ * Every frame is checked on arrival. A side that finds the ring full or empty yields, as in test_spsc, so on a
+ * single core the numbers include the thread switches.
+ */
+#include "HostTest.h"
+#include "SPSCQueue.h"
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+
+static const uint32_t FRAMES = 200000;
+static const size_t   DEPTH  = 8;                 // frames in flight, as the echo canceller's reference queue
+
+struct Frame {
+  uint32_t seq;
+  int16_t  pcm[160];
+  void fill(uint32_t s) {
+    seq = s;
+    for (int i = 0; i < 160; ++i) pcm[i] = (int16_t)(s + i);
+  }
+  bool intact() const { return pcm[0] == (int16_t)seq && pcm[159] == (int16_t)(seq + 159); }
+};
+
+// ---- RingBufferStream ------------------------------------------------------------------------------------------
+class ByteRing {
+public:
+  explicit ByteRing(size_t size) : _buf(new uint8_t[size]), _size(size) {}
+  virtual ~ByteRing() { delete[] _buf; }
+  virtual bool write(uint8_t b) {
+    if (_count == _size) return false;
+    _buf[_tail] = b;
+    _tail = (_tail + 1) % _size;
+    _count++;
+    return true;
+  }
+  virtual bool read(uint8_t& b) {
+    if (_count == 0) return false;
+    b = _buf[_head];
+    _head = (_head + 1) % _size;
+    _count--;
+    return true;
+  }
+  // BaseBuffer::writeArray()/readArray(): one virtual call per element
+  int writeArray(const uint8_t* data, int len) {
+    int n = 0;
+    while (n < len && write(data[n])) n++;
+    return n;
+  }
+  int readArray(uint8_t* data, int len) {
+    int n = 0;
+    while (n < len && read(data[n])) n++;
+    return n;
+  }
+  int available() const         { return (int)_count; }
+  int availableForWrite() const { return (int)(_size - _count); }
+
+private:
+  uint8_t* _buf;
+  size_t   _size, _head = 0, _tail = 0, _count = 0;
+};
+
+class RingBufferStream {
+public:
+  explicit RingBufferStream(size_t size) : _ring(size) {}
+  size_t write(const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ring.writeArray(data, (int)len);
+  }
+  size_t readBytes(uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ring.readArray(data, (int)len);
+  }
+  int available() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ring.available();
+  }
+  int availableForWrite() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ring.availableForWrite();
+  }
+
+private:
+  std::mutex _mutex;
+  ByteRing   _ring;
+};
+
+// ---------------------------------------------------------------------------------------------------------------
+enum class Style { Stream, Copy, ZeroCopy, Batch };
+
+struct Run {
+  RingBufferStream          stream{DEPTH * sizeof(Frame)};
+  SPSCQueue<Frame, DEPTH>   q;
+  Style                     style;
+  uint32_t                  received = 0, bad = 0;
+};
+
+static void* producer(void* arg) {
+  Run& run = *(Run*)arg;
+  uint32_t next = 0;
+  Frame batch[4];
+  while (next < FRAMES) {
+    switch (run.style) {
+      case Style::Stream: {
+        if (run.stream.availableForWrite() < (int)sizeof(Frame)) {
+          sched_yield();
+          break;
+        }
+        Frame f;
+        f.fill(next++);
+        run.stream.write((const uint8_t*)&f, sizeof(f));
+        break;
+      }
+      case Style::Copy: {
+        Frame f;
+        f.fill(next);
+        if (run.q.push(f)) next++;
+        else sched_yield();
+        break;
+      }
+      case Style::ZeroCopy: {
+        Frame* slot = run.q.reserve();
+        if (!slot) {
+          sched_yield();
+          break;
+        }
+        slot->fill(next++);
+        run.q.commit();
+        break;
+      }
+      case Style::Batch: {
+        size_t n = FRAMES - next < 4 ? FRAMES - next : 4;
+        for (size_t i = 0; i < n; ++i) batch[i].fill(next + (uint32_t)i);
+        size_t pushed = run.q.push(batch, n);
+        if (pushed == 0) sched_yield();
+        next += (uint32_t)pushed;
+        break;
+      }
+    }
+  }
+  return nullptr;
+}
+
+static void* consumer(void* arg) {
+  Run& run = *(Run*)arg;
+  Frame batch[4];
+  auto check = [&](const Frame& f) {
+    if (f.seq != run.received || !f.intact()) run.bad++;
+    run.received++;
+  };
+  while (run.received < FRAMES) {
+    switch (run.style) {
+      case Style::Stream: {
+        Frame f;
+        if (run.stream.available() < (int)sizeof(Frame)) {
+          sched_yield();
+          break;
+        }
+        run.stream.readBytes((uint8_t*)&f, sizeof(f));
+        check(f);
+        break;
+      }
+      case Style::Copy: {
+        Frame f;
+        if (run.q.pop(f)) check(f);
+        else sched_yield();
+        break;
+      }
+      case Style::ZeroCopy: {
+        const Frame* slot = run.q.front();
+        if (!slot) {
+          sched_yield();
+          break;
+        }
+        check(*slot);
+        run.q.release();
+        break;
+      }
+      case Style::Batch: {
+        size_t n = run.q.pop(batch, 4);
+        if (n == 0) sched_yield();
+        for (size_t i = 0; i < n; ++i) check(batch[i]);
+        break;
+      }
+    }
+  }
+  return nullptr;
+}
+
+static void bench(Style style, const char* name) {
+  static Run* run = nullptr;
+  delete run;
+  run = new Run;
+  run->style = style;
+  pthread_t prod, cons;
+  uint64_t t0 = host::wallNs();
+  CHECK_EQ(pthread_create(&cons, nullptr, consumer, run), 0);
+  CHECK_EQ(pthread_create(&prod, nullptr, producer, run), 0);
+  pthread_join(prod, nullptr);
+  pthread_join(cons, nullptr);
+  uint64_t ns = host::wallNs() - t0;
+  printf("  %-40s %7.0f ns/frame\n", name, (double)ns / FRAMES);
+  CHECK_EQ(run->received, FRAMES);
+  CHECK_EQ(run->bad, 0);
+}
+
+int main() {
+  printf("bench_spsc: %u frames of 20 ms, %zu in flight\n", FRAMES, DEPTH);
+  bench(Style::Stream, "RingBufferStream (reproduced), copying");
+  bench(Style::Copy, "SPSCQueue push()/pop()");
+  bench(Style::ZeroCopy, "SPSCQueue reserve()/commit() in place");
+  bench(Style::Batch, "SPSCQueue batches of up to 4");
+  return host::finish("bench_spsc");
+}
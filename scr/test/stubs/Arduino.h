@@ -0,0 +1,130 @@
+/*
+ * Arduino.h (host stub)
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Just enough of the Arduino core for the sketch headers and ArduinoSIP to build and run on a PC.
+ * Time is simulated: millis() and micros() read a clock that only moves when a test calls host::advanceMs() (or
+ * the code under test calls delay()), so timers and timeouts can be stepped through without waiting.
+ * Serial output is dropped unless host::verbose is set.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define F(x) x
+typedef bool boolean;
+
+namespace host {
+  inline uint64_t nowUs  = 0;
+  inline bool     verbose = false;
+  inline uint32_t randomState = 0x2545F491u;
+
+  inline void advanceMs(uint32_t ms) { nowUs += (uint64_t)ms * 1000; }
+  inline void advanceUs(uint32_t us) { nowUs += us; }
+  inline void reset() { nowUs = 0; randomState = 0x2545F491u; }
+}
+
+inline unsigned long millis() { return (unsigned long)(host::nowUs / 1000); }
+inline unsigned long micros() { return (unsigned long)host::nowUs; }
+inline void delay(unsigned long ms) { host::advanceMs((uint32_t)ms); }
+
+// xorshift, so runs are repeatable
+inline uint32_t esp_random() {
+  uint32_t x = host::randomState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return host::randomState = x;
+}
+
+template <class T, class L, class H> T constrain(T x, L lo, H hi) { return x < lo ? lo : (x > hi ? hi : x); }
+
+class String {
+public:
+  String() {}
+  String(const char* s) : _s(s ? s : "") {}
+  String(const std::string& s) : _s(s) {}
+  const char* c_str() const { return _s.c_str(); }
+  size_t length() const { return _s.size(); }
+  String operator+(const String& o) const { return String(_s + o._s); }
+private:
+  std::string _s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    if (!host::verbose) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n > 0 ? (size_t)n : 0;
+  }
+  size_t print(const char* s)   { return host::verbose ? (size_t)fputs(s, stdout) : 0; }
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t println(const char* s = "") { return host::verbose ? (size_t)puts(s) : 0; }
+  size_t println(const String& s)    { return println(s.c_str()); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  virtual size_t readBytes(uint8_t* buffer, size_t length) {
+    size_t n = 0;
+    int c;
+    while (n < length && (c = read()) >= 0) buffer[n++] = (uint8_t)c;
+    return n;
+  }
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override { return host::verbose ? (size_t)(putchar(c) != EOF) : 1; }
+};
+inline HardwareSerial Serial;
+
+class IPAddress {
+public:
+  IPAddress() : _addr{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr{a, b, c, d} {}
+  bool fromString(const char* s) {
+    unsigned a, b, c, d;
+    char tail;
+    if (!s || sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+      return false;
+    _addr[0] = a; _addr[1] = b; _addr[2] = c; _addr[3] = d;
+    return true;
+  }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr[0], _addr[1], _addr[2], _addr[3]);
+    return String(buf);
+  }
+  uint8_t operator[](int i) const { return _addr[i]; }
+  bool operator==(const IPAddress& o) const { return memcmp(_addr, o._addr, 4) == 0; }
+private:
+  uint8_t _addr[4];
+};
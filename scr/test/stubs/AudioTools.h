@@ -0,0 +1,142 @@
+/*
+ * AudioTools.h (host stub)
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * The parts of arduino-audio-tools the sketch uses. I2SStream keeps the configuration it was started with and
+ * takes its samples from (or hands them to) the test through host::i2s(port); UDPStream sends and
+ * receives one datagram per call through the WiFiUDP stub, like the real one.
+ */
+#pragma once
+#include "Arduino.h"
+#include "WiFiUdp.h"
+#include <functional>
+
+namespace audio_tools {
+
+struct AudioInfo {
+  int sample_rate;
+  int channels;
+  int bits_per_sample;
+  AudioInfo(int sr = 0, int ch = 0, int bits = 0) : sample_rate(sr), channels(ch), bits_per_sample(bits) {}
+};
+
+enum RxTxMode { RX_MODE, TX_MODE };
+enum I2SFormat { I2S_STD_FORMAT };
+enum I2SPort { I2S_NUM_0, I2S_NUM_1 };
+
+struct I2SConfig : AudioInfo {
+  RxTxMode  rx_tx_mode = TX_MODE;
+  I2SFormat i2s_format = I2S_STD_FORMAT;
+  int       pin_ws = -1, pin_bck = -1, pin_data = -1;
+  int       port_no = 0;
+  int       buffer_size = 512;          // DMA buffer length, in frames
+  int       buffer_count = 6;
+  bool      is_master = true;
+  void copyFrom(const AudioInfo& info) {
+    sample_rate = info.sample_rate;
+    channels = info.channels;
+    bits_per_sample = info.bits_per_sample;
+  }
+};
+
+class BaseStream : public Stream {
+public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t len) override = 0;
+};
+
+class AudioStream : public BaseStream {};
+
+// Sources and sinks for the I2S ports, per port number
+struct HostI2S {
+  std::function<size_t(uint8_t*, size_t)>       read;      // fills the buffer, returns bytes; zeros if unset
+  std::function<void(const uint8_t*, size_t)>   write;
+  I2SConfig                                     config;
+  bool                                          started = false;
+};
+
+class I2SStream : public AudioStream {
+public:
+  I2SConfig defaultConfig(RxTxMode mode) {
+    I2SConfig cfg;
+    cfg.rx_tx_mode = mode;
+    return cfg;
+  }
+  bool begin(const I2SConfig& cfg) {
+    _port = cfg.port_no;
+    port(_port).config = cfg;
+    port(_port).started = true;
+    return true;
+  }
+  size_t readBytes(uint8_t* data, size_t len) override {
+    HostI2S& p = port(_port);
+    if (p.read) return p.read(data, len);
+    memset(data, 0, len);
+    return len;
+  }
+  size_t write(const uint8_t* data, size_t len) override {
+    HostI2S& p = port(_port);
+    if (p.write) p.write(data, len);
+    return len;
+  }
+
+  static HostI2S& port(int n) {
+    static HostI2S ports[2];
+    return ports[n & 1];
+  }
+
+private:
+  int _port = 0;
+};
+
+class UDPStream : public BaseStream {
+public:
+  UDPStream(const char*, const char*) {}
+  bool begin(uint16_t port) {
+    _udp.begin(port);
+    return true;
+  }
+  bool begin(const IPAddress& remote, uint16_t port) {
+    _remote = remote;
+    _remotePort = port;
+    _udp.begin(port);
+    return true;
+  }
+  size_t write(const uint8_t* data, size_t len) override {
+    _udp.beginPacket(_remote, _remotePort);
+    size_t n = _udp.write(data, len);
+    _udp.endPacket();
+    return n;
+  }
+  // Bytes left of the current datagram, or the size of the next one once it is used up
+  int available() override {
+    int n = _udp.available();
+    return n > 0 ? n : _udp.parsePacket();
+  }
+  size_t readBytes(uint8_t* data, size_t len) override {
+    if (available() <= 0) return 0;
+    return _udp.readBytes(data, len);
+  }
+
+private:
+  WiFiUDP   _udp;
+  IPAddress _remote;
+  uint16_t  _remotePort = 0;
+};
+
+template <class T> class Filter {
+public:
+  virtual ~Filter() {}
+  virtual T process(T in) = 0;
+};
+
+}   // namespace audio_tools
+
+namespace host {
+  inline audio_tools::HostI2S& i2s(int port) { return audio_tools::I2SStream::port(port); }
+  inline void resetI2S() {
+    i2s(0) = audio_tools::HostI2S();
+    i2s(1) = audio_tools::HostI2S();
+  }
+}
@@ -0,0 +1,114 @@
+/*
+ * WiFiUdp.h (host stub)
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * In-memory UDP for host tests. Every datagram a socket sends is appended to host::sent() with its destination;
+ * tests deliver datagrams with host::deliver(), to whichever socket is bound to that local port. Nothing is ever
+ * lost or reordered here, tests that want a bad network do that to the datagrams themselves.
+ */
+#pragma once
+#include "Arduino.h"
+#include <deque>
+#include <map>
+#include <string>
+
+struct HostDatagram {
+  std::string address;          // destination host of a sent datagram
+  uint16_t    port;             // destination port
+  std::string data;
+};
+
+namespace host {
+  inline std::deque<HostDatagram>& sent() {
+    static std::deque<HostDatagram> q;
+    return q;
+  }
+  inline std::map<uint16_t, std::deque<std::string>>& inbox() {
+    static std::map<uint16_t, std::deque<std::string>> m;
+    return m;
+  }
+  inline void deliver(uint16_t localPort, const void* data, size_t len) {
+    inbox()[localPort].push_back(std::string((const char*)data, len));
+  }
+  inline void deliver(uint16_t localPort, const std::string& data) { inbox()[localPort].push_back(data); }
+  // When set, beginPacket() fails as lwIP does when it is out of buffers
+  inline bool     txBlocked = false;
+  // Benchmarks turn this off: datagrams are only counted, so sending costs no allocation
+  inline bool     keepSent = true;
+  inline uint64_t sentCount = 0;
+  inline void resetNet() {
+    sent().clear();
+    inbox().clear();
+    txBlocked = false;
+    keepSent = true;
+    sentCount = 0;
+  }
+}
+
+class WiFiUDP : public Stream {
+public:
+  uint8_t begin(uint16_t port) {
+    _local = port;
+    return 1;
+  }
+  void stop() {}
+
+  // Receive: one datagram at a time, as lwIP hands them out
+  int parsePacket() {
+    auto& q = host::inbox()[_local];
+    if (q.empty()) {
+      _rx.clear();
+      _rxPos = 0;
+      return 0;
+    }
+    _rx = q.front();
+    q.pop_front();
+    _rxPos = 0;
+    return (int)_rx.size();
+  }
+  int available() override { return (int)(_rx.size() - _rxPos); }
+  int read() override { return _rxPos < _rx.size() ? (uint8_t)_rx[_rxPos++] : -1; }
+  int read(uint8_t* buf, size_t len) {
+    size_t n = std::min(len, _rx.size() - _rxPos);
+    memcpy(buf, _rx.data() + _rxPos, n);
+    _rxPos += n;
+    return (int)n;
+  }
+  int read(char* buf, size_t len) { return read((uint8_t*)buf, len); }
+  size_t readBytes(uint8_t* buf, size_t len) override { return (size_t)read(buf, len); }
+
+  // Send
+  int beginPacket(const char* address, uint16_t port) {
+    if (host::txBlocked) return 0;
+    if (_txHost != address) _txHost = address;
+    _txPort = port;
+    _tx.clear();
+    return 1;
+  }
+  int beginPacket(const IPAddress& ip, uint16_t port) { return beginPacket(ip.toString().c_str(), port); }
+  size_t write(uint8_t c) override {
+    _tx.push_back((char)c);
+    return 1;
+  }
+  size_t write(const uint8_t* buf, size_t len) override {
+    _tx.append((const char*)buf, len);
+    return len;
+  }
+  int endPacket() {
+    host::sentCount++;
+    if (host::keepSent) host::sent().push_back(HostDatagram{_txHost, _txPort, _tx});
+    _tx.clear();
+    return 1;
+  }
+
+  uint16_t localPort() const { return _local; }
+
+private:
+  uint16_t    _local = 0;
+  std::string _rx;
+  size_t      _rxPos = 0;
+  std::string _txHost;
+  uint16_t    _txPort = 0;
+  std::string _tx;
+};
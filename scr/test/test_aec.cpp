@@ -0,0 +1,133 @@
+/*
+ * test_aec.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * EchoCanceller on the host. The far end talks (synthetic speech with pauses), every 20 ms block goes to
+ * pushFarEnd() as the playout task would, and the mic hears it back through a synthetic echo path: a bulk delay
+ * followed by a decaying room response, plus a quiet room noise floor (-78 dBFS). Checks the delay estimate, the
+ * echo return loss enhancement (ERLE) once converged, that the filter follows the echo path when the delay moves,
+ * and that double talk neither gets cancelled nor throws the filter off.
+ */
+#include "HostTest.h"
+#include "Arduino.h"
+#include "EchoCanceller.h"
+#include "Signals.h"
+#include <vector>
+
+static const size_t BLOCK = 160;
+static const int    RATE  = 8000;
+
+// Bulk delay plus a room response: direct path, a few early reflections, a decaying diffuse tail
+struct EchoPath {
+  uint32_t            delay;
+  std::vector<double> h;
+
+  EchoPath(uint32_t bulk, double gain, uint32_t seed) : delay(bulk), h(200, 0.0) {
+    signals::Rng rng(seed);
+    h[0] = gain;
+    h[23] = -0.4 * gain;
+    h[61] = 0.25 * gain;
+    for (size_t k = 1; k < h.size(); ++k) h[k] += 0.08 * gain * rng.gauss() * exp(-(double)k / 40.0);
+  }
+};
+
+class Room {
+public:
+  Room() : _far(RATE, 12000, true, 7), _near(RATE, 9000, false, 99), _noise(3) {}
+
+  // Runs 'blocks' blocks; echo, residual and near-end energy are summed over the blocks from 'measureFrom' on
+  void run(EchoCanceller& aec, const EchoPath& path, int blocks, int measureFrom, bool doubleTalk) {
+    _echo = _out = _nearIn = _nearOut = 0;
+    for (int b = 0; b < blocks; ++b) {
+      int16_t far[BLOCK], mic[BLOCK];
+      double echo[BLOCK], near[BLOCK];
+      for (size_t i = 0; i < BLOCK; ++i) {
+        far[i] = signals::toPcm(_far.next());
+        _history.push_back(far[i]);
+      }
+      aec.pushFarEnd(far, BLOCK);
+
+      size_t end = _history.size();
+      for (size_t i = 0; i < BLOCK; ++i) {
+        size_t t = end - BLOCK + i;
+        double e = 0;
+        for (size_t k = 0; k < path.h.size(); ++k) {
+          if (t >= path.delay + k) e += path.h[k] * _history[t - path.delay - k];
+        }
+        echo[i] = e;
+        near[i] = doubleTalk ? _near.next() : 0.0;
+        mic[i] = signals::toPcm(e + near[i] + 4 * _noise.gauss());
+      }
+      aec.process(mic, BLOCK);
+
+      if (b < measureFrom) continue;
+      for (size_t i = 0; i < BLOCK; ++i) {
+        _echo += echo[i] * echo[i];
+        _nearIn += near[i] * near[i];
+        double residual = mic[i] - near[i];
+        _out += residual * residual;
+        _nearOut += (double)mic[i] * mic[i];
+      }
+    }
+  }
+
+  double erleDb() const { return 10 * log10(_echo / _out); }
+  // Near-end level after the canceller against what was said, in dB
+  double nearKeptDb() const { return 10 * log10(_nearOut / _nearIn); }
+
+private:
+  signals::Speech      _far;
+  signals::Speech      _near;
+  signals::Rng         _noise;
+  std::vector<int16_t> _history;
+  double               _echo = 0, _out = 0, _nearIn = 0, _nearOut = 0;
+};
+
+// 60 ms bulk delay, about 10 dB of acoustic loss: the Geigel detector assumes the echo stays 6 dB under the far end
+static void testConvergence() {
+  EchoCanceller aec;
+  Room room;
+  EchoPath path(480, 0.3, 11);
+
+  room.run(aec, path, 250, 150, false);             // 5 s, ERLE over the last 2 s
+  CHECK_NEAR(aec.delaySamples(), path.delay - 16, 8);
+  printf("  60 ms path: delay %u, ERLE %.1f dB\n", (unsigned)aec.delaySamples(), room.erleDb());
+  CHECK(room.erleDb() > 20);
+  CHECK_EQ(aec.referenceDropped(), 0);
+}
+
+// The echo path moves (a different DMA depth after a restart): a new estimate, then the filter re-converges
+static void testDelayChange() {
+  EchoCanceller aec;
+  Room room;
+  EchoPath first(480, 0.3, 11), second(1200, 0.3, 12);
+
+  room.run(aec, first, 200, 200, false);
+  room.run(aec, second, 300, 200, false);
+  CHECK_NEAR(aec.delaySamples(), second.delay - 16, 8);
+  printf("  150 ms path: delay %u, ERLE %.1f dB\n", (unsigned)aec.delaySamples(), room.erleDb());
+  CHECK(room.erleDb() > 20);
+}
+
+// Both ends talk for 3 s: the near talker comes through, and the echo is still cancelled once they stop
+static void testDoubleTalk() {
+  EchoCanceller aec;
+  Room room;
+  EchoPath path(480, 0.3, 11);
+
+  room.run(aec, path, 250, 250, false);
+  room.run(aec, path, 150, 0, true);
+  printf("  double talk: near end kept %.1f dB\n", room.nearKeptDb());
+  CHECK_NEAR(room.nearKeptDb(), 0, 3);
+  room.run(aec, path, 100, 0, false);
+  printf("  after double talk: ERLE %.1f dB\n", room.erleDb());
+  CHECK(room.erleDb() > 15);
+}
+
+int main() {
+  testConvergence();
+  testDelayChange();
+  testDoubleTalk();
+  return host::finish("test_aec");
+}
@@ -0,0 +1,192 @@
+/*
+ * test_capture.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * RTPInput on the host, fed from the I2S stub one DMA block per update(): every packet carries the timestamp of
+ * the capture block it came from, also across mute, and the first packet after unmuting starts a talkspurt. The
+ * mic port must be set up with one 20 ms frame per DMA buffer, so that each completion is one update(). A re-INVITE
+ * that moves the far end's media moves the stream without a gap in sequence numbers or timestamps.
+ */
+#include "HostTest.h"
+#include "RTPInput.h"
+#include "Signals.h"
+#include <vector>
+
+static const uint16_t RTP_PORT = 5004;
+static uint32_t blockIndex = 0;
+
+struct Sent {
+  RTPPacket pkt;
+  uint32_t  block;            // capture block during which it went out
+};
+
+enum class Config { Default, NoDtx, Fallback };
+
+// A steady 440 Hz tone at -12 dBFS
+static size_t readTone(uint8_t* data, size_t len) {
+  int32_t* raw = (int32_t*)data;
+  for (size_t i = 0; i < len / 4; ++i) {
+    double t = (blockIndex * 320 + i) / 16000.0;
+    raw[i] = signals::toI2S(8000 * sin(2 * M_PI * 440 * t));
+  }
+  return len;
+}
+
+// A talker with pauses, for the DTX case
+static size_t readSpeech(uint8_t* data, size_t len) {
+  static signals::Speech* talker = nullptr;
+  if (blockIndex == 0) {
+    delete talker;
+    talker = new signals::Speech(16000, 9000, true);
+  }
+  int32_t* raw = (int32_t*)data;
+  for (size_t i = 0; i < len / 4; ++i) raw[i] = signals::toI2S(talker->next());
+  return len;
+}
+
+static std::vector<Sent> run(Config config) {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  host::i2s(0).read = config == Config::Default ? readSpeech : readTone;
+  blockIndex = 0;
+
+  static RTPInput* in = nullptr;
+  delete in;
+  in = new RTPInput("", "");
+  CHECK(in->begin(IPAddress(10, 0, 0, 33), RTP_PORT, 1, 2, 3));
+  host::sent().clear();                                    // the HELLO datagrams
+  if (config != Config::Default) in->setDtxEnabled(false);
+  if (config == Config::Fallback) {
+    in->setNoiseSuppression(false);
+    in->setAgcEnabled(false);
+  }
+
+  std::vector<Sent> sent;
+  for (blockIndex = 0; blockIndex < 200; ++blockIndex) {
+    in->setMuted(blockIndex >= 60 && blockIndex < 110);
+    in->update();
+    for (const HostDatagram& d : host::sent()) {
+      Sent s;
+      CHECK(RTPOverUDP::parse((const uint8_t*)d.data.data(), d.data.size(), s.pkt));
+      s.block = blockIndex;
+      sent.push_back(s);
+    }
+    host::sent().clear();
+  }
+  return sent;
+}
+
+// 16 kHz 32-bit mono, DMA buffers sized in frames to hold exactly the block update() reads
+static size_t lastRead = 0;
+
+static void checkConfig() {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  host::i2s(0).read = [](uint8_t* data, size_t len) {
+    lastRead = len;
+    memset(data, 0, len);
+    return len;
+  };
+  RTPInput in("", "");
+  CHECK(in.begin(IPAddress(10, 0, 0, 33), RTP_PORT, 1, 2, 3));
+  const I2SConfig& cfg = host::i2s(0).config;
+  CHECK(host::i2s(0).started);
+  CHECK(cfg.rx_tx_mode == RX_MODE);
+  CHECK_EQ(cfg.sample_rate, 16000);
+  CHECK_EQ(cfg.channels, 1);
+  CHECK_EQ(cfg.bits_per_sample, 32);
+  CHECK_EQ(cfg.buffer_size, 320);                          // frames, not bytes
+  CHECK_EQ(cfg.pin_ws, 1);
+  CHECK_EQ(cfg.pin_bck, 2);
+  CHECK_EQ(cfg.pin_data, 3);
+
+  FrameClock clock;
+  in.setFrameClock(&clock);
+  in.update();
+  CHECK_EQ(lastRead, (size_t)cfg.buffer_size * cfg.channels * cfg.bits_per_sample / 8);
+  CHECK_EQ(clock.frames(), 1);
+}
+
+// Every block is sent: timestamps follow the capture clock straight through the mute
+static void checkMute(Config config) {
+  std::vector<Sent> sent = run(config);
+  CHECK_EQ(sent.size(), 150);                              // 200 blocks less 50 muted
+  if (sent.size() < 2) return;
+  uint32_t ts0 = sent[0].pkt.timestamp - sent[0].block * 160;
+  for (size_t i = 0; i < sent.size(); ++i) {
+    const Sent& s = sent[i];
+    CHECK(s.block < 60 || s.block >= 110);
+    CHECK_EQ(s.pkt.timestamp - ts0, s.block * 160);
+    CHECK_EQ(s.pkt.payloadLen, 160);
+    if (i > 0) CHECK_EQ((uint16_t)(s.pkt.seq - sent[i - 1].pkt.seq), 1);
+    CHECK_EQ(s.pkt.marker, s.block == 0 || s.block == 110);
+  }
+}
+
+// With DTX the silent blocks send comfort noise or nothing; voice packets still sit on the capture clock and the
+// first one after unmuting starts a talkspurt
+static void checkMuteWithDtx() {
+  std::vector<Sent> sent = run(Config::Default);
+  uint32_t ts0 = 0;
+  bool haveTs0 = false, afterUnmute = false;
+  int voice = 0;
+  for (const Sent& s : sent) {
+    CHECK(s.block < 60 || s.block >= 110);
+    if (s.pkt.payloadType == RTPPacketizer::CN_PAYLOAD_TYPE) continue;
+    voice++;
+    if (!haveTs0) {
+      ts0 = s.pkt.timestamp - s.block * 160;
+      haveTs0 = true;
+    }
+    CHECK_EQ(s.pkt.timestamp - ts0, s.block * 160);
+    if (s.block >= 110 && !afterUnmute) {
+      afterUnmute = true;
+      CHECK(s.pkt.marker);
+    }
+  }
+  CHECK(voice > 20);
+  CHECK(afterUnmute);
+}
+
+// Retargeted mid-call: the next packet goes to the new address and the stream carries on where it was
+static void checkRetarget() {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  host::i2s(0).read = readTone;
+  RTPInput in("", "");
+  CHECK(in.begin(IPAddress(10, 0, 0, 33), RTP_PORT, 1, 2, 3));
+  in.setDtxEnabled(false);
+  host::sent().clear();
+  std::vector<RTPPacket> pkts;
+  std::vector<std::string> to;
+  for (blockIndex = 0; blockIndex < 20; ++blockIndex) {
+    if (blockIndex == 10) CHECK(in.retarget(IPAddress(10, 0, 0, 40), 17000));
+    in.update();
+    for (const HostDatagram& d : host::sent()) {
+      RTPPacket p;
+      if (!RTPOverUDP::parse((const uint8_t*)d.data.data(), d.data.size(), p)) continue;    // the HELLO datagrams
+      pkts.push_back(p);
+      to.push_back(d.address + ":" + std::to_string(d.port));
+    }
+    host::sent().clear();
+  }
+  CHECK_EQ(pkts.size(), 20);
+  for (size_t i = 0; i < pkts.size(); ++i) {
+    CHECK(to[i] == (i < 10 ? "10.0.0.33:5004" : "10.0.0.40:17000"));
+    if (i > 0) CHECK_EQ((uint16_t)(pkts[i].seq - pkts[i - 1].seq), 1);
+    if (i > 0) CHECK_EQ(pkts[i].timestamp - pkts[i - 1].timestamp, 160);
+  }
+}
+
+int main() {
+  checkConfig();
+  checkRetarget();
+  checkMute(Config::NoDtx);
+  checkMute(Config::Fallback);
+  checkMuteWithDtx();
+  return host::finish("test_capture");
+}
@@ -0,0 +1,121 @@
+/*
+ * test_drift.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * RTPOutput over a simulated 24 hour call with the sender's sample clock off by +-150 ppm (plus a +-500 ppm cheap
+ * crystal case) and 5-30 ms of random network delay. The I2S clock is the reference: one update() per 20 ms. After
+ * priming there must be no underrun, no skipped or concealed frame, the learned drift must match the real one on
+ * average and the jitter buffer must hold its depth.
+ */
+#include "HostTest.h"
+#include "RTPOutput.h"
+#include <queue>
+#include <vector>
+
+static const uint16_t RTP_PORT = 5004;
+static const uint64_t BLOCK_US = 20000;
+
+struct InFlight {
+  uint64_t arrivalUs;
+  uint16_t seq;
+  bool operator>(const InFlight& o) const { return arrivalUs != o.arrivalUs ? arrivalUs > o.arrivalUs : seq > o.seq; }
+};
+
+static std::string datagram(uint16_t seq, uint32_t ts) {
+  std::string d(RTP_HEADER_SIZE + 160, (char)0x9A);
+  const uint32_t ssrc = 0x0D81F7;
+  const uint8_t hdr[12] = { 0x80, 0, (uint8_t)(seq >> 8), (uint8_t)seq,
+                            (uint8_t)(ts >> 24), (uint8_t)(ts >> 16), (uint8_t)(ts >> 8), (uint8_t)ts,
+                            (uint8_t)(ssrc >> 24), (uint8_t)(ssrc >> 16), (uint8_t)(ssrc >> 8), (uint8_t)ssrc };
+  memcpy(&d[0], hdr, sizeof(hdr));
+  return d;
+}
+
+static void simulate(int ppm, double hours) {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  uint32_t rng = 0x1234567u + (uint32_t)ppm;
+
+  static RTPOutput* out = nullptr;
+  delete out;
+  out = new RTPOutput("", "");
+  CHECK(out->begin(RTP_PORT, 25, 26, 27));
+  const JitterBuffer& jb = out->jitterBuffer();
+
+  // The sender's packets are 20 ms apart on its own clock
+  const double sendIntervalUs = BLOCK_US / (1.0 + ppm * 1e-6);
+  std::priority_queue<InFlight, std::vector<InFlight>, std::greater<InFlight>> network;
+  uint64_t nextSendUs = 0;
+  uint16_t seq = 0;
+  uint32_t sent = 0;
+
+  const uint64_t blocks = (uint64_t)(hours * 3600 * 50);
+  const uint64_t settled = 50 * 600;              // the loop has 10 minutes to learn the drift
+  uint32_t underruns0 = 0, dropped0 = 0, lost0 = 0, concealed0 = 0;
+  size_t minDepth = SIZE_MAX, maxDepth = 0;
+  int32_t minPpm = INT32_MAX, maxPpm = INT32_MIN;
+  double  sumPpm = 0;
+  size_t  targetChanges = 0, lastTarget = 0;
+
+  for (uint64_t b = 0; b < blocks; ++b) {
+    uint64_t nowUs = b * BLOCK_US;
+    while (nextSendUs <= nowUs) {
+      rng = rng * 1664525u + 1013904223u;
+      network.push({ (uint64_t)nextSendUs + 5000 + (rng >> 8) % 25000, seq++ });
+      sent++;
+      nextSendUs = (uint64_t)(sent * sendIntervalUs);
+    }
+    while (!network.empty() && network.top().arrivalUs <= nowUs) {
+      uint16_t s = network.top().seq;
+      host::deliver(RTP_PORT, datagram(s, (uint32_t)s * 160u));
+      network.pop();
+    }
+    out->update();
+    host::advanceMs(20);
+
+    if (b == 50 * 5) {                            // priming done, count from here
+      underruns0 = jb.underruns();
+      dropped0   = jb.dropped();
+      lost0      = jb.lost();
+      concealed0 = out->concealedFrames();
+    }
+    if (b >= settled) {
+      minDepth = std::min(minDepth, jb.depthFrames());
+      maxDepth = std::max(maxDepth, jb.depthFrames());
+      minPpm = std::min(minPpm, out->driftPpm());
+      maxPpm = std::max(maxPpm, out->driftPpm());
+      sumPpm += out->driftPpm();
+      if (jb.targetFrames() != lastTarget) targetChanges++;
+      lastTarget = jb.targetFrames();
+    }
+  }
+
+  double meanPpm = sumPpm / (blocks - settled);
+  printf("  %+4d ppm, %2.0f h: learned %+.0f ppm (%+d..%+d), depth %zu..%zu frames, %zu target changes, "
+         "underruns %u, skipped %u, concealed %u\n", ppm, hours, meanPpm, (int)minPpm, (int)maxPpm, minDepth, maxDepth,
+         targetChanges, (unsigned)(jb.underruns() - underruns0), (unsigned)(jb.dropped() - dropped0),
+         (unsigned)(out->concealedFrames() - concealed0));
+  CHECK_EQ(jb.underruns() - underruns0, 0);
+  CHECK_EQ(jb.dropped() - dropped0, 0);
+  CHECK_EQ(jb.lost() - lost0, 0);
+  CHECK_EQ(out->concealedFrames() - concealed0, 0);
+  CHECK_EQ(jb.resyncs(), 0);
+  // The learned drift wanders with the arrival noise (a frame of jitter is 160 samples of error), but on average
+  // it is the real drift and it never reaches the +-1000 ppm clamp
+  CHECK_NEAR(meanPpm, ppm, 0.2 * abs(ppm) + 10);
+  CHECK_NEAR(minPpm, ppm, 250);
+  CHECK_NEAR(maxPpm, ppm, 250);
+  CHECK(minDepth >= 2);
+  CHECK(maxDepth <= 7);
+  CHECK(targetChanges < hours * 3600 / 5);              // no flapping between depths
+}
+
+int main() {
+  simulate(150, 24);
+  simulate(-150, 24);
+  simulate(500, 2);
+  simulate(-500, 2);
+  return host::finish("test_drift");
+}
@@ -0,0 +1,96 @@
+/*
+ * test_frame_clock.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * FrameClock on the host: wait() keeps a steady frame rate without drifting, the jitter, late wake and load
+ * figures describe what the task did, and the audio pipelines report one wake per update(). Timing is real, so the
+ * bounds leave room for a busy machine: the host scheduler, unlike the DMA, can wake a task a few ms late.
+ */
+#include "HostTest.h"
+#include "FrameClock.h"
+#include "RTPInput.h"
+#include "RTPOutput.h"
+#include <thread>
+
+static const uint32_t FRAME_US = 20000;
+
+static void busyFor(uint32_t us) {
+  uint64_t end = host::wallNs() + (uint64_t)us * 1000;
+  while (host::wallNs() < end) {}
+}
+
+// 100 frames take 2 s: the boundaries come from the timer, not from the end of the last sleep
+static void testPacing() {
+  FrameClock clock(FRAME_US);
+  uint64_t t0 = host::wallNs();
+  for (int i = 0; i < 100; ++i) {
+    clock.wait();
+    clock.onIdle();
+  }
+  double ms = (host::wallNs() - t0) / 1e6;
+  printf("  100 frames: %.1f ms, worst jitter %u us, %u late\n", ms, clock.maxJitterUs(), clock.lateWakes());
+  CHECK_EQ(clock.frames(), 100);
+  CHECK_NEAR(ms, 2000, 20);
+  CHECK(clock.lateWakes() < clock.frames() / 10);
+  CHECK(clock.loadPercent() < 20);
+}
+
+// A frame that overruns its slot: the next wake comes late and the clock says so, then it catches up
+static void testLateWake() {
+  FrameClock clock(FRAME_US);
+  for (int i = 0; i < 5; ++i) clock.wait();
+  uint32_t late = clock.lateWakes();
+  std::this_thread::sleep_for(std::chrono::microseconds(3 * FRAME_US));
+  clock.wait();                                             // the boundary is long past: no sleep
+  CHECK_EQ(clock.lateWakes(), late + 1);
+  CHECK(clock.maxJitterUs() >= 2 * FRAME_US);
+  clock.reset();
+  CHECK_EQ(clock.frames(), 0);
+  CHECK_EQ(clock.lateWakes(), 0);
+  CHECK_EQ(clock.maxJitterUs(), 0);
+  CHECK_EQ(clock.loadPercent(), 0);
+}
+
+// Half of every frame spent working shows as about 50% load and a worst case of at least the work
+static void testLoad() {
+  FrameClock clock(FRAME_US);
+  clock.onIdle();                                           // before the first wake there is nothing to measure
+  CHECK_EQ(clock.maxBusyUs(), 0);
+  for (int i = 0; i < 50; ++i) {
+    clock.wait();
+    busyFor(FRAME_US / 2);
+    clock.onIdle();
+  }
+  printf("  half-busy frames: load %u%%, worst %u us\n", clock.loadPercent(), clock.maxBusyUs());
+  CHECK_NEAR(clock.loadPercent(), 50, 10);
+  CHECK(clock.maxBusyUs() >= FRAME_US / 2);
+}
+
+// Both pipelines mark one wake per update(), whatever the frame contains
+static void testPipelines() {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  FrameClock capture, playout;
+  RTPInput in("", "");
+  RTPOutput out("", "");
+  CHECK(in.begin(IPAddress(10, 0, 0, 33), 5004, 1, 2, 3));
+  CHECK(out.begin(5006, 4, 5, 6));
+  in.setFrameClock(&capture);
+  out.setFrameClock(&playout);
+  for (int i = 0; i < 25; ++i) {
+    in.update();
+    out.update();
+  }
+  CHECK_EQ(capture.frames(), 25);
+  CHECK_EQ(playout.frames(), 25);
+}
+
+int main() {
+  testPacing();
+  testLateWake();
+  testLoad();
+  testPipelines();
+  return host::finish("test_frame_clock");
+}
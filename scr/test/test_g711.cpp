@@ -0,0 +1,59 @@
+/*
+ * test_g711.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * G711 against the Sun reference: every 16-bit input encoded and every code decoded, per sample and through the
+ * block kernels.
+ */
+#include "HostTest.h"
+#include "G711.h"
+#include "G711Reference.h"
+#include <vector>
+
+int main() {
+  std::vector<int16_t> pcm(65536);
+  for (int i = 0; i < 65536; ++i) pcm[i] = (int16_t)(i - 32768);
+  std::vector<uint8_t> ulaw(65536), alaw(65536);
+  G711::ulawEncode(pcm.data(), ulaw.data(), pcm.size());
+  G711::alawEncode(pcm.data(), alaw.data(), pcm.size());
+
+  int ulawBad = 0, alawBad = 0;
+  for (int i = 0; i < 65536; ++i) {
+    if (ulaw[i] != g711ref::linear2ulaw(pcm[i]) || G711::linearToUlaw(pcm[i]) != ulaw[i]) ulawBad++;
+    if (alaw[i] != g711ref::linear2alaw(pcm[i]) || G711::linearToAlaw(pcm[i]) != alaw[i]) alawBad++;
+  }
+  CHECK_EQ(ulawBad, 0);
+  CHECK_EQ(alawBad, 0);
+
+  uint8_t codes[256];
+  for (int c = 0; c < 256; ++c) codes[c] = (uint8_t)c;
+  int16_t ulawPcm[256], alawPcm[256];
+  G711::ulawDecode(codes, ulawPcm, 256);
+  G711::alawDecode(codes, alawPcm, 256);
+  for (int c = 0; c < 256; ++c) {
+    CHECK_EQ(ulawPcm[c], g711ref::ulaw2linear((uint8_t)c));
+    CHECK_EQ(alawPcm[c], g711ref::alaw2linear((uint8_t)c));
+    CHECK_EQ(G711::toLinear(G711::ULAW, (uint8_t)c), ulawPcm[c]);
+    CHECK_EQ(G711::toLinear(G711::ALAW, (uint8_t)c), alawPcm[c]);
+  }
+
+  // encode(decode(c)) gives c back for every code but the two zeros of mu-law
+  int roundTripBad = 0;
+  for (int c = 0; c < 256; ++c) {
+    if (G711::linearToAlaw(alawPcm[c]) != c) roundTripBad++;
+    if (c != 0x7F && G711::linearToUlaw(ulawPcm[c]) != c) roundTripBad++;
+  }
+  CHECK_EQ(roundTripBad, 0);
+
+  // the law dispatch picks the right kernel
+  uint8_t a[160], b[160];
+  G711::encode(G711::ALAW, pcm.data() + 30000, a, 160);
+  G711::alawEncode(pcm.data() + 30000, b, 160);
+  CHECK(memcmp(a, b, 160) == 0);
+  G711::encode(G711::ULAW, pcm.data() + 30000, a, 160);
+  G711::ulawEncode(pcm.data() + 30000, b, 160);
+  CHECK(memcmp(a, b, 160) == 0);
+
+  return host::finish("test_g711");
+}
@@ -0,0 +1,61 @@
+/*
+ * test_halfband.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * HalfBandDecimator on the host: the response of the implemented filter against the figures in its header, and
+ * sine waves through it at pass band, transition and stop band frequencies.
+ */
+#include "HostTest.h"
+#include "HalfBandResponse.h"
+
+// Output amplitude for a full run of a sine at 'freq' (16 kHz in), fitted against the 8 kHz sine it should become
+static double sineGainDb(double freq) {
+  HalfBandDecimator d;
+  const double amp = 20000;
+  double fOut = freq < 4000 ? freq : 8000 - freq;          // where an alias would land
+  double sc = 0, ss = 0;
+  int count = 0;
+  for (int j = 0; j < 8000; ++j) {
+    int16_t even = (int16_t)lround(amp * sin(2 * M_PI * freq * (2 * j) / 16000.0));
+    int16_t odd  = (int16_t)lround(amp * sin(2 * M_PI * freq * (2 * j + 1) / 16000.0));
+    int16_t y = d.process(even, odd);
+    if (j < 100) continue;
+    sc += y * cos(2 * M_PI * fOut * j / 8000.0);
+    ss += y * sin(2 * M_PI * fOut * j / 8000.0);
+    count++;
+  }
+  double a = 2 * sqrt(sc * sc + ss * ss) / count;
+  return 20 * log10(a / amp + 1e-12);
+}
+
+int main() {
+  std::vector<double> h = halfband::taps();
+
+  // half-band structure: symmetric, every other tap zero, 0.5 in the centre
+  for (int n = 0; n < 47; ++n) {
+    CHECK_NEAR(h[n], h[46 - n], 1e-9);
+    if (n != 23 && (n - 23) % 2 == 0) CHECK_EQ(h[n], 0);
+  }
+  CHECK_NEAR(h[23], 0.5, 1e-3);
+  CHECK_EQ(HalfBandDecimator::delay(), 23);
+
+  halfband::Band pass = halfband::band(h, 0, 3400);
+  halfband::Band stop = halfband::band(h, 4600, 8000);
+  halfband::Band far  = halfband::band(h, 5000, 8000);
+  printf("  pass band 0-3.4 kHz %+.4f .. %+.4f dB, stop band from 4.6 kHz <= %.1f dB (at %.0f Hz), from 5 kHz <= %.1f dB\n",
+         pass.minDb, pass.maxDb, stop.maxDb, stop.atHz, far.maxDb);
+  CHECK(pass.minDb >= -0.02 && pass.maxDb <= 0.02);
+  CHECK(stop.maxDb <= -54.9);
+  CHECK(far.maxDb <= -63);
+  CHECK_NEAR(halfband::gainDb(h, 4000), -6.02, 0.05);       // half-band: -6 dB at the new Nyquist
+
+  CHECK_NEAR(sineGainDb(300), 0, 0.03);
+  CHECK_NEAR(sineGainDb(1000), 0, 0.03);
+  CHECK_NEAR(sineGainDb(3400), 0, 0.03);
+  CHECK(sineGainDb(4661) <= -54);
+  CHECK(sineGainDb(6000) <= -65);
+  CHECK(sineGainDb(7500) <= -65);
+
+  return host::finish("test_halfband");
+}
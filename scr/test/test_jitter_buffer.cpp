@@ -0,0 +1,226 @@
+/*
+ * test_jitter_buffer.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * JitterBuffer on the host: playout order under reordering, duplicates, late packets and loss, the target
+ * depth following the measured interarrival jitter, and catching up after a burst.
+ */
+#include "HostTest.h"
+#include "JitterBuffer.h"
+
+static const uint32_t SSRC = 0xCAFE0001;
+static uint8_t payload[160];
+static uint16_t firstSeq = 0;                   // sequence number sent at timestamp 1000
+
+static uint16_t index(uint16_t seq) { return (uint16_t)(seq - firstSeq); }
+
+static RTPPacket packet(uint16_t seq, uint8_t pt = 0) {
+  RTPPacket pkt = {};
+  pkt.version     = 2;
+  pkt.payloadType = pt;
+  pkt.seq         = seq;
+  pkt.timestamp   = 1000u + index(seq) * 160u;
+  pkt.ssrc        = SSRC;
+  payload[0]      = (uint8_t)seq;              // lets the test see which frame came out
+  pkt.payload     = payload;
+  pkt.payloadLen  = sizeof(payload);
+  return pkt;
+}
+
+// Arrival time of a packet sent on the 20 ms grid, plus extra network delay
+static uint32_t arrival(uint16_t seq, uint32_t delayMs = 0) { return 5000u + index(seq) * 20u + delayMs; }
+
+// Everything is pushed before the first pop, so the catch-up skip is moved out of the way as RTPOutput does
+static void testReorder() {
+  JitterBuffer jb;
+  jb.setCatchUpMargin(6);
+  const uint16_t order[] = { 0, 2, 1, 3, 5, 4, 6, 7 };
+  for (uint16_t s : order) CHECK(jb.push(packet(s), arrival(s, s == 1 || s == 4 ? 25 : 0)));
+  const JitterBuffer::Frame* f;
+  for (uint16_t s = 0; s < 8; ++s) {
+    CHECK(jb.pop(f) == JitterBuffer::Result::Frame);
+    CHECK(f && f->seq == s && f->data[0] == s);
+  }
+  CHECK(jb.pop(f) == JitterBuffer::Result::Empty);
+  CHECK_EQ(jb.lost(), 0);
+  CHECK_EQ(jb.underruns(), 1);
+}
+
+static void testDuplicateAndLate() {
+  JitterBuffer jb;
+  const JitterBuffer::Frame* f;
+  firstSeq = 100;
+  CHECK(jb.push(packet(100), arrival(100)));
+  CHECK(jb.push(packet(101), arrival(101)));
+  CHECK(!jb.push(packet(101), arrival(101)));        // duplicate while buffered
+  CHECK_EQ(jb.duplicates(), 1);
+  CHECK(jb.pop(f) == JitterBuffer::Result::Frame && f->seq == 100);
+  CHECK(!jb.push(packet(100), arrival(102)));        // its slot has already been played
+  CHECK_EQ(jb.late(), 1);
+  CHECK(jb.pop(f) == JitterBuffer::Result::Frame && f->seq == 101);
+  firstSeq = 0;
+}
+
+static void testLoss() {
+  JitterBuffer jb;
+  const JitterBuffer::Frame* f;
+  for (uint16_t s = 0; s < 6; ++s) {
+    if (s == 2 || s == 3) continue;
+    jb.push(packet(s), arrival(s));
+  }
+  JitterBuffer::Result expect[] = { JitterBuffer::Result::Frame, JitterBuffer::Result::Frame,
+                                    JitterBuffer::Result::Lost,  JitterBuffer::Result::Lost,
+                                    JitterBuffer::Result::Frame, JitterBuffer::Result::Frame };
+  for (int i = 0; i < 6; ++i) CHECK(jb.pop(f) == expect[i]);
+  CHECK_EQ(jb.lost(), 2);
+  CHECK(f && f->seq == 5);
+
+  // Sequence numbers wrap without a resync
+  JitterBuffer wrap;
+  wrap.setCatchUpMargin(6);
+  firstSeq = 65534;
+  for (uint16_t s = 65534; s != 3; ++s) wrap.push(packet(s), arrival(s));
+  for (int i = 0; i < 5; ++i) CHECK(wrap.pop(f) == JitterBuffer::Result::Frame);
+  CHECK(f && f->seq == 2);
+  CHECK_EQ(wrap.resyncs(), 0);
+  firstSeq = 0;
+}
+
+// On a clean LAN the buffer runs at its 40 ms minimum; Wi-Fi style jitter pushes it deeper, and it comes back
+static void testAdaptiveTarget() {
+  JitterBuffer jb;
+  const JitterBuffer::Frame* f;
+  uint16_t seq = 0;
+  for (int i = 0; i < 200; ++i, ++seq) {
+    jb.push(packet(seq), arrival(seq, esp_random() % 2));
+    jb.pop(f);
+  }
+  CHECK_EQ(jb.targetFrames(), 2);
+  CHECK(jb.jitterMs() <= 1);
+
+  for (int i = 0; i < 200; ++i, ++seq) {
+    jb.push(packet(seq), arrival(seq, esp_random() % 60));
+    jb.pop(f);
+  }
+  CHECK(jb.jitterMs() >= 10);
+  CHECK(jb.targetFrames() >= 3);
+  size_t deep = jb.targetFrames();
+
+  for (int i = 0; i < 400; ++i, ++seq) {
+    jb.push(packet(seq), arrival(seq));
+    jb.pop(f);
+  }
+  CHECK(jb.targetFrames() < deep);
+  CHECK_EQ(jb.targetFrames(), 2);
+}
+
+// A new SSRC starts over; a jump far ahead resyncs instead of waiting out the gap
+static void testResync() {
+  JitterBuffer jb;
+  const JitterBuffer::Frame* f;
+  jb.push(packet(10), arrival(10));
+  jb.push(packet(11), arrival(11));
+  jb.push(packet(500), arrival(500));
+  CHECK_EQ(jb.resyncs(), 1);
+  jb.push(packet(501), arrival(501));
+  CHECK(jb.pop(f) == JitterBuffer::Result::Frame && f->seq == 500);
+
+  RTPPacket other = packet(7);
+  other.ssrc = SSRC + 1;
+  jb.push(other, arrival(502));
+  CHECK_EQ(jb.depthFrames(), 1);
+}
+
+// A burst after a stall (Wi-Fi power save, a roam): the oldest frames are skipped until the depth is back within
+// the margin, in order and without a resync
+static void testBurst() {
+  JitterBuffer jb;
+  jb.setCatchUpMargin(6);
+  const JitterBuffer::Frame* f;
+  uint16_t seq = 0;
+  for (int i = 0; i < 50; ++i, ++seq) {
+    jb.push(packet(seq), arrival(seq));
+    jb.pop(f);
+  }
+  CHECK_EQ(jb.targetFrames(), 2);
+
+  // 400 ms without packets: the buffer runs dry and re-primes, then all 20 frames land at once
+  for (int i = 0; i < 20; ++i) jb.pop(f);
+  uint32_t now = arrival(seq + 20);
+  for (int i = 0; i < 20; ++i, ++seq) CHECK(jb.push(packet(seq), now));
+  CHECK_EQ(jb.depthFrames(), 20);
+
+  uint16_t last = 0;
+  bool first = true, ordered = true;
+  for (int i = 0; i < 60; ++i, ++seq) {
+    jb.push(packet(seq), arrival(seq));
+    if (jb.pop(f) == JitterBuffer::Result::Frame) {
+      if (!first && (int16_t)(f->seq - last) <= 0) ordered = false;
+      last = f->seq;
+      first = false;
+    }
+  }
+  CHECK(ordered);
+  CHECK(jb.dropped() > 0);
+  CHECK(jb.depthFrames() <= jb.targetFrames() + 6);
+  CHECK_EQ(jb.resyncs(), 0);
+}
+
+// However deep the target and wide the margin, a full buffer still catches up rather than resyncing
+static void testCatchUpLimit() {
+  JitterBuffer jb(8000, 40, 600);
+  jb.setCatchUpMargin(40);
+  const JitterBuffer::Frame* f;
+  for (uint16_t s = 0; s < JitterBuffer::SLOTS; ++s) CHECK(jb.push(packet(s), arrival(s, s % 2 ? 120 : 0)));
+  CHECK_EQ(jb.depthFrames(), JitterBuffer::SLOTS);
+  CHECK(jb.targetFrames() + 40 > JitterBuffer::SLOTS);
+  CHECK(jb.pop(f) == JitterBuffer::Result::Frame);
+  CHECK(f && f->seq == 1);
+  CHECK_EQ(jb.dropped(), 1);
+  CHECK_EQ(jb.depthFrames(), JitterBuffer::SLOTS - 2);
+  CHECK(jb.pop(f) == JitterBuffer::Result::Frame && f->seq == 2);
+  CHECK_EQ(jb.dropped(), 1);
+}
+
+// Jitter that keeps the estimate around a frame boundary does not flip the target: it grows at once and only
+// shrinks after 5 s of needing less
+static void testTargetHold() {
+  JitterBuffer jb;
+  const JitterBuffer::Frame* f;
+  uint16_t seq = 0;
+  size_t changes = 0, last = jb.targetFrames();
+  for (int i = 0; i < 3000; ++i, ++seq) {
+    jb.push(packet(seq), arrival(seq, 5 + esp_random() % 25));
+    jb.pop(f);
+    if (jb.targetFrames() != last) changes++;
+    last = jb.targetFrames();
+  }
+  CHECK(changes <= 20);                     // 60 s
+
+  // A short jitter spike: deeper at once, back to the minimum only once 5 s of clean arrivals have been enough
+  JitterBuffer spike;
+  for (int i = 0; i < 100; ++i, ++seq) {
+    spike.push(packet(seq), arrival(seq, i >= 50 && i < 60 ? esp_random() % 60 : 0));
+    spike.pop(f);
+    if (i == 59) CHECK(spike.targetFrames() >= 3);
+  }
+  CHECK(spike.targetFrames() >= 3);
+  for (int i = 0; i < 300; ++i, ++seq) {
+    spike.push(packet(seq), arrival(seq));
+    spike.pop(f);
+  }
+  CHECK_EQ(spike.targetFrames(), 2);
+}
+
+int main() {
+  testReorder();
+  testDuplicateAndLate();
+  testLoss();
+  testAdaptiveTarget();
+  testResync();
+  testBurst();
+  testCatchUpLimit();
+  testTargetHold();
+  return host::finish("test_jitter_buffer");
+}
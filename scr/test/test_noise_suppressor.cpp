@@ -0,0 +1,165 @@
+/*
+ * test_noise_suppressor.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * NoiseSuppressor on the host. Synthetic speech with pauses is mixed with ventilation noise at a few SNRs and run
+ * through in 20 ms frames as RTPInput does. Checks that the noise floor is found, that the pauses get quieter by
+ * close to the configured floor, that speech keeps its level, and the SNR improvement; reports the cost per
+ * frame.
+ *
+ *   test_noise_suppressor noisy.wav [suppressed.wav]
+ * runs the suppressor over a recording (8 kHz 16-bit mono WAV), reports the level change in the quietest and
+ * loudest frames and optionally writes the result for listening.
+ */
+#include "HostTest.h"
+#include "Arduino.h"
+#include "NoiseSuppressor.h"
+#include "Signals.h"
+#include "HostWav.h"
+#include <algorithm>
+#include <vector>
+
+static const size_t FRAME = 160;
+static const size_t DELAY = NoiseSuppressor::HOP;      // one hop of analysis delay
+static const size_t WARMUP = 8000 * 2;                 // 2 s for the minimum search to settle
+
+struct Mix {
+  std::vector<bool>    talking;
+  std::vector<int16_t> in, out;
+};
+
+static Mix mix(double noiseRms, size_t n) {
+  Mix m;
+  signals::Speech talker(8000, 9000, true);
+  signals::HvacNoise hvac(8000, noiseRms);
+  for (size_t i = 0; i < n; ++i) {
+    m.in.push_back(signals::toPcm(talker.next() + hvac.next()));
+    m.talking.push_back(talker.talking());
+  }
+  m.out = m.in;
+  NoiseSuppressor ns;
+  for (size_t i = 0; i + FRAME <= n; i += FRAME) ns.process(&m.out[i], FRAME);
+  return m;
+}
+
+// SNR as ITU-T G.160 measures it: the noise level comes from the pauses, the speech level is the talkspurt level
+// less that noise. On the output this credits the suppressor with the pause attenuation even where its gains open
+// up during speech, so the speech level change is checked on its own.
+struct Result {
+  double snrIn, snrOut;
+  double pauseDb;              // level change in the pauses
+  double speechDb;             // level change of the speech, noise taken out as above
+};
+
+static Result measure(const Mix& m) {
+  double pauseIn = 0, pauseOut = 0, talkIn = 0, talkOut = 0;
+  size_t pauses = 0, talks = 0;
+  for (size_t i = WARMUP; i + DELAY < m.in.size(); ++i) {
+    double x = m.in[i], y = m.out[i + DELAY];
+    if (m.talking[i]) {
+      talkIn += x * x;
+      talkOut += y * y;
+      talks++;
+    } else {
+      pauseIn += x * x;
+      pauseOut += y * y;
+      pauses++;
+    }
+  }
+  pauseIn /= pauses;
+  pauseOut /= pauses;
+  talkIn /= talks;
+  talkOut /= talks;
+  return { 10 * log10((talkIn - pauseIn) / pauseIn), 10 * log10((talkOut - pauseOut) / pauseOut),
+           10 * log10(pauseOut / pauseIn), 10 * log10((talkOut - pauseOut) / (talkIn - pauseIn)) };
+}
+
+// A fresh suppressor knows no noise; after a few seconds of HVAC noise the floor is found and has its spectral
+// tilt (rumble below 400 Hz, hiss above)
+static void testNoiseFloor() {
+  std::vector<int16_t> pcm(8000 * 4);
+  signals::HvacNoise hvac(8000, 300);
+  for (int16_t& v : pcm) v = signals::toPcm(hvac.next());
+  NoiseSuppressor ns;
+  CHECK_EQ(ns.noisePower(4), 0);
+  for (size_t i = 0; i + FRAME <= pcm.size(); i += FRAME) ns.process(&pcm[i], FRAME);
+  CHECK(ns.noisePower(100) > 0);
+  CHECK(ns.noisePower(4) > 10 * ns.noisePower(100));       // 125 Hz against 3.1 kHz
+}
+
+static void testSnrGain() {
+  const double levels[] = { 1500, 800, 400 };         // roughly 5, 10 and 16 dB SNR over the talkspurts
+  for (double level : levels) {
+    Result r = measure(mix(level, 8000 * 20));
+    printf("  SNR in %5.1f dB, out %5.1f dB (%+.1f), pauses %+5.1f dB, speech %+5.1f dB\n", r.snrIn, r.snrOut,
+           r.snrOut - r.snrIn, r.pauseDb, r.speechDb);
+    CHECK(r.snrOut - r.snrIn > 8);
+    CHECK(r.pauseDb < -12);
+    CHECK(r.pauseDb > -20);                          // the floor is -18 dB, no deeper
+    CHECK(r.speechDb > -3);
+  }
+}
+
+// Silence in, silence out: the fixed-point path must not add noise of its own
+static void testSilence() {
+  std::vector<int16_t> pcm(8000, 0);
+  NoiseSuppressor ns;
+  for (size_t i = 0; i + FRAME <= pcm.size(); i += FRAME) ns.process(&pcm[i], FRAME);
+  CHECK_EQ(*std::max_element(pcm.begin(), pcm.end()), 0);
+  CHECK_EQ(*std::min_element(pcm.begin(), pcm.end()), 0);
+}
+
+static void reportCost() {
+  std::vector<int16_t> pcm(8000 * 10);
+  signals::HvacNoise hvac(8000, 800);
+  for (int16_t& v : pcm) v = signals::toPcm(hvac.next());
+  NoiseSuppressor ns;
+  uint64_t total = 0, worst = 0;
+  size_t frames = 0;
+  for (size_t i = 0; i + FRAME <= pcm.size(); i += FRAME, ++frames) {
+    ns.process(&pcm[i], FRAME);
+    total += ns.lastFrameCycles();
+    worst = std::max<uint64_t>(worst, ns.lastFrameCycles());
+  }
+  printf("  20 ms frame: %.1f us average, %.1f us worst on this host\n", total / 1000.0 / frames, worst / 1000.0);
+}
+
+static int runRecording(const char* in, const char* out) {
+  std::vector<int16_t> pcm = wav::read(in);
+  size_t frames = pcm.size() / FRAME;
+  if (frames < 10) {
+    printf("test_noise_suppressor: %s is not an 8 kHz 16-bit mono WAV\n", in);
+    return 1;
+  }
+  std::vector<int16_t> res(pcm.begin(), pcm.begin() + frames * FRAME);
+  NoiseSuppressor ns;
+  for (size_t f = 0; f < frames; ++f) ns.process(&res[f * FRAME], FRAME);
+
+  // Rank frames by input level: the quietest tenth is mostly noise, the loudest tenth mostly speech
+  std::vector<std::pair<double, size_t>> level;
+  for (size_t f = 1; f + 1 < frames; ++f) level.push_back({ signals::rms(&pcm[f * FRAME], FRAME), f });
+  std::sort(level.begin(), level.end());
+  size_t tenth = std::max<size_t>(1, level.size() / 10);
+  double quietIn = 0, quietOut = 0, loudIn = 0, loudOut = 0;
+  for (size_t i = 0; i < tenth; ++i) {
+    size_t q = level[i].second * FRAME, l = level[level.size() - 1 - i].second * FRAME;
+    quietIn += pow(signals::rms(&pcm[q], FRAME), 2);
+    quietOut += pow(signals::rms(&res[q + DELAY], FRAME), 2);
+    loudIn += pow(signals::rms(&pcm[l], FRAME), 2);
+    loudOut += pow(signals::rms(&res[l + DELAY], FRAME), 2);
+  }
+  printf("  quietest 10%%: %+.1f dB, loudest 10%%: %+.1f dB\n", 10 * log10(quietOut / quietIn),
+         10 * log10(loudOut / loudIn));
+  if (out) wav::write(out, res);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) return runRecording(argv[1], argc > 2 ? argv[2] : nullptr);
+  testNoiseFloor();
+  testSnrGain();
+  testSilence();
+  reportCost();
+  return host::finish("test_noise_suppressor");
+}
@@ -0,0 +1,138 @@
+/*
+ * test_playout.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * RTPOutput on the host: the I2S configuration it starts with, and packets arriving on the RTP port coming out
+ * of the DAC one 20 ms block per update(), in order and at the 40 ms LAN depth; a codec change mid-call, and the
+ * speaker going quiet while the call does not receive.
+ */
+#include "HostTest.h"
+#include "RTPOutput.h"
+#include <vector>
+
+static const uint16_t RTP_PORT = 5004;
+
+static std::string datagram(uint16_t seq, uint8_t level, uint8_t payloadType = 0) {
+  std::string d(RTP_HEADER_SIZE + 160, (char)level);
+  const uint32_t ts = seq * 160u, ssrc = 0x0BADF00D;
+  const uint8_t hdr[12] = { 0x80, payloadType, (uint8_t)(seq >> 8), (uint8_t)seq,
+                            (uint8_t)(ts >> 24), (uint8_t)(ts >> 16), (uint8_t)(ts >> 8), (uint8_t)ts,
+                            (uint8_t)(ssrc >> 24), (uint8_t)(ssrc >> 16), (uint8_t)(ssrc >> 8), (uint8_t)ssrc };
+  memcpy(&d[0], hdr, sizeof(hdr));
+  return d;
+}
+
+static void testStream() {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+
+  std::vector<size_t> writes;
+  std::vector<int16_t> played;
+  host::i2s(1).write = [&](const uint8_t* data, size_t len) {
+    writes.push_back(len);
+    played.insert(played.end(), (const int16_t*)data, (const int16_t*)(data + len));
+  };
+
+  static RTPOutput out("", "");
+  CHECK(out.begin(RTP_PORT, 25, 26, 27));
+
+  // DMA buffer length is counted in frames: one 20 ms block of 8 kHz mono
+  const audio_tools::I2SConfig& cfg = host::i2s(1).config;
+  CHECK(host::i2s(1).started);
+  CHECK_EQ(cfg.port_no, audio_tools::I2S_NUM_1);
+  CHECK_EQ(cfg.sample_rate, 8000);
+  CHECK_EQ(cfg.channels, 1);
+  CHECK_EQ(cfg.bits_per_sample, 16);
+  CHECK_EQ(cfg.buffer_size, 160);
+  CHECK_EQ(cfg.buffer_size * 1000 / cfg.sample_rate, 20);
+
+  // One packet per 20 ms; µ-law 0xFF is silence, anything else is sound
+  int firstSound = -1;
+  for (uint16_t seq = 0; seq < 50; ++seq) {
+    host::deliver(RTP_PORT, datagram(seq, seq < 10 ? 0xFF : 0x80));
+    host::advanceMs(20);
+    out.update();
+    if (firstSound < 0) {
+      for (size_t i = played.size() - 160; i < played.size(); ++i) {
+        if (played[i] != 0) { firstSound = (int)writes.size() - 1; break; }
+      }
+    }
+  }
+  CHECK_EQ(writes.size(), 50);
+  for (size_t len : writes) CHECK_EQ(len, 160 * sizeof(int16_t));
+  // voice starts at packet 10 and plays 2 frames (40 ms) later; the resampler may shift it by a fraction of a block
+  CHECK(firstSound >= 11 && firstSound <= 13);
+  CHECK_EQ(out.jitterBuffer().targetFrames(), 2);
+  CHECK_EQ(out.jitterBuffer().lost(), 0);
+  CHECK_EQ(out.concealedFrames(), 0);
+}
+
+static std::vector<int16_t> played;
+
+static RTPOutput& start() {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  played.clear();
+  host::i2s(1).write = [](const uint8_t* data, size_t len) {
+    played.insert(played.end(), (const int16_t*)data, (const int16_t*)(data + len));
+  };
+  static RTPOutput* out = nullptr;
+  delete out;
+  out = new RTPOutput("", "");
+  return *out;
+}
+
+static int16_t loudest(size_t from) {
+  int16_t peak = 0;
+  for (size_t i = from; i < played.size(); ++i) peak = std::max<int16_t>(peak, (int16_t)abs(played[i]));
+  return peak;
+}
+
+// After a re-INVITE from PCMU to PCMA, packets still in flight in PCMU are concealed, not decoded as A-law
+static void testCodecChange() {
+  RTPOutput& out = start();
+  out.setCodec(8, G711::ALAW);
+  CHECK(out.begin(RTP_PORT, 25, 26, 27));
+  for (uint16_t seq = 0; seq < 40; ++seq) {
+    host::deliver(RTP_PORT, datagram(seq, seq < 10 || seq >= 20 ? 0xD5 : 0x80, seq < 10 || seq >= 20 ? 8 : 0));
+    host::advanceMs(20);
+    out.update();
+  }
+  CHECK_EQ(out.concealedFrames(), 10);
+  CHECK(loudest(0) < 100);                          // A-law 0xD5 and the concealment of it are both near silence
+}
+
+// Sendonly or inactive: nothing is decoded, the speaker is silent, and taking it back up primes the buffer again
+static void testNotReceiving() {
+  RTPOutput& out = start();
+  CHECK(out.begin(RTP_PORT, 25, 26, 27));
+  out.setReceiving(false);
+  for (uint16_t seq = 0; seq < 20; ++seq) {
+    host::deliver(RTP_PORT, datagram(seq, 0x80));
+    host::advanceMs(20);
+    out.update();
+  }
+  CHECK_EQ(played.size(), 20 * 160);
+  CHECK_EQ(loudest(0), 0);
+  CHECK_EQ(out.jitterBuffer().depthFrames(), 0);
+
+  out.setReceiving(true);
+  size_t resumed = played.size();
+  for (uint16_t seq = 20; seq < 40; ++seq) {
+    host::deliver(RTP_PORT, datagram(seq, 0x80));
+    host::advanceMs(20);
+    out.update();
+  }
+  CHECK(loudest(resumed) > 10000);
+  CHECK_EQ(out.concealedFrames(), 0);
+}
+
+int main() {
+  testStream();
+  testCodecChange();
+  testNotReceiving();
+  return host::finish("test_playout");
+}
@@ -0,0 +1,222 @@
+/*
+ * test_plc.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * PacketLossConcealer on the host. A synthetic voiced signal (glottal pulses through two formant resonators) is
+ * cut into 20 ms frames and run through loss patterns the way RTPOutput does it: good frames to goodFrame(),
+ * missing ones to conceal(). Checks the pitch estimate, the fade (full level for 10 ms, then 20% per 10 ms,
+ * silent after 60 ms), the joins at both ends of a loss, and that concealment beats silence on random and
+ * burst loss.
+ *
+ *   test_plc [speech.wav [concealed.wav]]
+ * runs the same loss patterns over a recording (8 kHz 16-bit mono WAV) and reports the numbers instead of
+ * checking them; the second file gets the 10% random loss result for listening.
+ */
+#include "HostTest.h"
+#include "Arduino.h"
+#include "PacketLossConcealer.h"
+#include "HostWav.h"
+#include <vector>
+
+static const size_t FRAME = 160;
+
+// Voiced speech model: pulse train at 'period' samples through resonators at 700 and 1220 Hz, with an optional
+// slow pitch and level contour so nothing is exactly periodic
+static std::vector<int16_t> voiced(size_t n, double period, bool vary) {
+  std::vector<int16_t> out(n);
+  double phase = 0, y1[2] = {0, 0}, y2[2] = {0, 0};
+  const double f[2] = { 700, 1220 }, bw = 90;
+  double a1[2], a2[2];
+  for (int k = 0; k < 2; ++k) {
+    double r = exp(-M_PI * bw / 8000.0);
+    a1[k] = 2 * r * cos(2 * M_PI * f[k] / 8000.0);
+    a2[k] = -r * r;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    double t = i / 8000.0;
+    double p = vary ? period * (1 + 0.06 * sin(2 * M_PI * 1.3 * t)) : period;
+    double level = vary ? 0.55 + 0.45 * sin(2 * M_PI * 2.1 * t) : 1.0;
+    phase += 1.0 / p;
+    double x = 0;
+    if (phase >= 1) {
+      phase -= 1;
+      x = 3000 * level;
+    }
+    double s = x;
+    for (int k = 0; k < 2; ++k) {
+      double y = s + a1[k] * y1[k] + a2[k] * y2[k];
+      y2[k] = y1[k];
+      y1[k] = y;
+      s = y * 0.25;
+    }
+    out[i] = (int16_t)constrain(s, -32767.0, 32767.0);
+  }
+  return out;
+}
+
+static double rms(const int16_t* p, size_t n) {
+  double e = 0;
+  for (size_t i = 0; i < n; ++i) e += (double)p[i] * p[i];
+  return sqrt(e / n);
+}
+
+// Plays 'in' frame by frame, concealing the frames marked lost; returns the output
+static std::vector<int16_t> play(const std::vector<int16_t>& in, const std::vector<bool>& lost, bool silence = false) {
+  PacketLossConcealer plc;
+  std::vector<int16_t> out(in.size());
+  for (size_t f = 0; f * FRAME + FRAME <= in.size(); ++f) {
+    int16_t* frame = &out[f * FRAME];
+    if (lost[f]) {
+      if (silence) memset(frame, 0, FRAME * sizeof(int16_t));
+      else plc.conceal(frame, FRAME);
+    } else {
+      memcpy(frame, &in[f * FRAME], FRAME * sizeof(int16_t));
+      plc.goodFrame(frame, FRAME);
+    }
+  }
+  return out;
+}
+
+// Signal to error ratio over the first 'span' samples of every loss, where substitution should follow the waveform
+static double lossSnr(const std::vector<int16_t>& ref, const std::vector<int16_t>& out, const std::vector<bool>& lost,
+                      size_t span) {
+  double s = 0, e = 0;
+  for (size_t f = 1; f < lost.size(); ++f) {
+    if (!lost[f] || lost[f - 1]) continue;
+    for (size_t i = f * FRAME; i < f * FRAME + span; ++i) {
+      double d = (double)out[i] - ref[i];
+      s += (double)ref[i] * ref[i];
+      e += d * d;
+    }
+  }
+  return 10 * log10((s + 1) / (e + 1));
+}
+
+// Level kept over the lost frames, relative to what was sent
+static double lostLevel(const std::vector<int16_t>& ref, const std::vector<int16_t>& out, const std::vector<bool>& lost) {
+  double r = 0, o = 0;
+  for (size_t f = 0; f < lost.size(); ++f) {
+    if (!lost[f]) continue;
+    r += rms(&ref[f * FRAME], FRAME);
+    o += rms(&out[f * FRAME], FRAME);
+  }
+  return o / (r + 1);
+}
+
+// Largest sample step where a loss starts or ends, relative to the largest step anywhere in the reference
+static double worstJoin(const std::vector<int16_t>& ref, const std::vector<int16_t>& out, const std::vector<bool>& lost) {
+  int refStep = 1, worst = 0;
+  for (size_t i = 1; i < ref.size(); ++i) refStep = std::max(refStep, abs(ref[i] - ref[i - 1]));
+  for (size_t f = 1; f < lost.size(); ++f) {
+    if (lost[f] == lost[f - 1]) continue;
+    size_t b = f * FRAME;
+    worst = std::max(worst, abs(out[b] - out[b - 1]));
+  }
+  return (double)worst / refStep;
+}
+
+static std::vector<bool> randomLoss(size_t frames, uint32_t percent) {
+  std::vector<bool> lost(frames, false);
+  for (size_t f = 5; f < frames; ++f) lost[f] = esp_random() % 100 < percent;
+  return lost;
+}
+
+static std::vector<bool> burstLoss(size_t frames, size_t every, size_t len) {
+  std::vector<bool> lost(frames, false);
+  for (size_t f = every; f < frames; f += every) {
+    for (size_t k = 0; k < len && f + k < frames; ++k) lost[f + k] = true;
+  }
+  return lost;
+}
+
+static void testPitchAndFade() {
+  // 64 samples = 125 Hz, exactly periodic so every repeated period matches the original
+  std::vector<int16_t> in = voiced(FRAME * 20, 64, false);
+  PacketLossConcealer plc;
+  int16_t frame[FRAME];
+  for (size_t f = 0; f < 10; ++f) {
+    memcpy(frame, &in[f * FRAME], sizeof(frame));
+    plc.goodFrame(frame, FRAME);
+  }
+  std::vector<int16_t> out(FRAME * 5);
+  for (size_t f = 0; f < 5; ++f) plc.conceal(&out[f * FRAME], FRAME);
+  CHECK_EQ(plc.pitch(), 64);
+  CHECK(plc.concealing());
+
+  // per 10 ms block: the mean of the linear ramp (1 for the first 10 ms, -20% per 10 ms after, 0 after 60 ms)
+  const double expect[10] = { 1.0, 0.9, 0.7, 0.5, 0.3, 0.1, 0, 0, 0, 0 };
+  for (size_t b = 0; b < 10; ++b) {
+    double ratio = rms(&out[b * 80], 80) / rms(&in[10 * FRAME + b * 80], 80);
+    CHECK_NEAR(ratio, expect[b], 0.05);
+  }
+  for (size_t i = 480; i < out.size(); ++i) CHECK_EQ(out[i], 0);
+
+  // the first good frame after a short loss is faded in from the concealment, without a step
+  memcpy(frame, &in[15 * FRAME], sizeof(frame));
+  plc.goodFrame(frame, FRAME);
+  CHECK(!plc.concealing());
+}
+
+static void testLossPatterns() {
+  std::vector<int16_t> in = voiced(8000 * 20, 62, true);
+  size_t frames = in.size() / FRAME;
+  struct { const char* name; std::vector<bool> lost; } cases[] = {
+    { "random 5%",   randomLoss(frames, 5) },
+    { "random 10%",  randomLoss(frames, 10) },
+    { "bursts of 2", burstLoss(frames, 25, 2) },
+    { "bursts of 4", burstLoss(frames, 25, 4) },
+  };
+  for (auto& c : cases) {
+    std::vector<int16_t> plc = play(in, c.lost), gap = play(in, c.lost, true);
+    double snr = lossSnr(in, plc, c.lost, 80), level = lostLevel(in, plc, c.lost);
+    double join = worstJoin(in, plc, c.lost), gapJoin = worstJoin(in, gap, c.lost);
+    printf("  %-12s first 10 ms SNR %5.1f dB, level kept %3.0f%%, worst join %.2f (silence %.2f)\n",
+           c.name, snr, 100 * level, join, gapJoin);
+    CHECK(snr >= 4);                  // silence scores 0 dB here
+    CHECK(level >= 0.4);
+    CHECK(join <= 1.1);
+  }
+}
+
+// Cost of one concealed frame, the worst case for the playout task
+static void reportCost() {
+  std::vector<int16_t> in = voiced(FRAME * 10, 62, true);
+  PacketLossConcealer plc;
+  int16_t frame[FRAME];
+  const int rounds = 20000;
+  uint64_t t0 = host::wallNs();
+  for (int r = 0; r < rounds; ++r) {
+    memcpy(frame, &in[(r % 10) * FRAME], sizeof(frame));
+    plc.goodFrame(frame, FRAME);
+    plc.conceal(frame, FRAME);
+    host::keep(frame);
+  }
+  printf("  good + concealed frame: %.1f us on this host\n", (host::wallNs() - t0) / 1000.0 / rounds);
+}
+
+static int runRecording(const char* in, const char* out) {
+  std::vector<int16_t> pcm = wav::read(in);
+  size_t frames = pcm.size() / FRAME;
+  if (frames < 10) {
+    printf("test_plc: %s is not an 8 kHz 16-bit mono WAV\n", in);
+    return 1;
+  }
+  const uint32_t percents[] = { 3, 5, 10, 20 };
+  for (uint32_t p : percents) {
+    std::vector<bool> lost = randomLoss(frames, p);
+    std::vector<int16_t> plc = play(pcm, lost);
+    printf("  random %2u%%: first 10 ms SNR %5.1f dB, level kept %3.0f%%, worst join %.2f\n", p,
+           lossSnr(pcm, plc, lost, 80), 100 * lostLevel(pcm, plc, lost), worstJoin(pcm, plc, lost));
+    if (out && p == 10) wav::write(out, plc);
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) return runRecording(argv[1], argc > 2 ? argv[2] : nullptr);
+  testPitchAndFade();
+  testLossPatterns();
+  reportCost();
+  return host::finish("test_plc");
+}
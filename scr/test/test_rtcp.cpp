@@ -0,0 +1,116 @@
+/*
+ * test_rtcp.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * RTCPSession on the host, fed by RTPOutput the way the sketch wires it: the jitter it reports is the one the
+ * jitter buffer measured, loss comes from the sequence numbers, and the RTT from the LSR/DLSR of a reply. Reports
+ * follow the far end when a re-INVITE moves its media.
+ */
+#include "HostTest.h"
+#include "RTPOutput.h"
+
+static const uint16_t RTP_PORT = 5004, RTCP_PORT = 5005;
+static const uint32_t LOCAL_SSRC = 0x01020304, REMOTE_SSRC = 0x0BADF00D;
+
+static std::string datagram(uint16_t seq) {
+  std::string d(RTP_HEADER_SIZE + 160, (char)0xFF);
+  const uint32_t ts = seq * 160u;
+  const uint8_t hdr[12] = { 0x80, 0, (uint8_t)(seq >> 8), (uint8_t)seq,
+                            (uint8_t)(ts >> 24), (uint8_t)(ts >> 16), (uint8_t)(ts >> 8), (uint8_t)ts,
+                            (uint8_t)(REMOTE_SSRC >> 24), (uint8_t)(REMOTE_SSRC >> 16),
+                            (uint8_t)(REMOTE_SSRC >> 8), (uint8_t)REMOTE_SSRC };
+  memcpy(&d[0], hdr, sizeof(hdr));
+  return d;
+}
+
+static uint32_t get32(const std::string& s, size_t at) {
+  const uint8_t* p = (const uint8_t*)s.data() + at;
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+// Sends reports until one comes out, returns it
+static std::string nextReport(RTCPSession& rtcp) {
+  for (int i = 0; i < 2000 && host::sent().empty(); ++i) {
+    host::advanceMs(10);
+    rtcp.update();
+  }
+  std::string r = host::sent().empty() ? std::string() : host::sent().back().data;
+  host::sent().clear();
+  return r;
+}
+
+int main() {
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+
+  static RTPOutput out("", "");
+  static RTCPSession rtcp;
+  CHECK(out.begin(RTP_PORT, 25, 26, 27));
+  CHECK(rtcp.begin(IPAddress(10, 0, 0, 33), RTCP_PORT, RTCP_PORT));
+  rtcp.setLocalSSRC(LOCAL_SSRC);
+  out.setRtcp(&rtcp);
+
+  // 300 packets on a jittery link, every 20th one lost
+  uint32_t late = 0;
+  for (uint16_t seq = 0; seq < 300; ++seq) {
+    uint32_t extra = esp_random() % 30;
+    host::advanceMs(20 + extra - late);
+    late = extra;
+    if (seq % 20 != 10) host::deliver(RTP_PORT, datagram(seq));
+    out.update();
+    if (seq % 50 == 0) rtcp.update();
+  }
+  rtcp.update();
+  host::sent().clear();                                    // reports sent during the call so far
+  CHECK(out.jitterBuffer().jitter() > 0);
+  CHECK_EQ(rtcp.jitter(), out.jitterBuffer().jitter());
+  CHECK_EQ(rtcp.jitterMs(), out.jitterBuffer().jitterMs());
+  CHECK_EQ(rtcp.eventsDropped(), 0);
+
+  // Receiver report: we have not sent anything, so RR with one block about the remote source
+  std::string rr = nextReport(rtcp);
+  CHECK(rr.size() >= 32);
+  CHECK_EQ((uint8_t)rr[0], 0x81);
+  CHECK_EQ((uint8_t)rr[1], 201);
+  CHECK_EQ(get32(rr, 8), REMOTE_SSRC);
+  CHECK_EQ(rtcp.cumulativeLost(), 15);
+  CHECK_EQ(get32(rr, 12) & 0xFFFFFF, 15);
+  CHECK_EQ(get32(rr, 16), 299);                            // extended highest sequence number
+  CHECK_EQ(get32(rr, 20), out.jitterBuffer().jitter());
+
+  // RTT: our SR goes out, the remote answers 100 ms later after holding it for 30 ms
+  rtcp.onRtpSent(12345, 160);
+  rtcp.update();
+  std::string sr = nextReport(rtcp);
+  CHECK_EQ((uint8_t)sr[1], 200);
+  uint32_t lsr = (get32(sr, 8) << 16) | (get32(sr, 12) >> 16);
+  host::advanceMs(100);
+  uint8_t reply[32] = { 0x81, 201, 0, 7 };
+  put32(reply + 4, REMOTE_SSRC);
+  put32(reply + 8, LOCAL_SSRC);
+  put32(reply + 12, 0x10000003);                           // 1/16 lost, 3 in total
+  put32(reply + 20, 40);                                   // jitter in timestamp units, 5 ms
+  put32(reply + 24, lsr);
+  put32(reply + 28, 30 * 65536 / 1000);
+  host::deliver(RTCP_PORT, reply, sizeof(reply));
+  rtcp.update();
+  CHECK_NEAR(rtcp.rttMs(), 70, 1);
+  CHECK_EQ(rtcp.remoteFractionLost(), 0x10);
+  CHECK_EQ(rtcp.remoteCumulativeLost(), 3);
+  CHECK_EQ(rtcp.remoteJitterMs(), 5);
+
+  // A re-INVITE moved the far end's media: reports follow it
+  rtcp.setRemote(IPAddress(10, 0, 0, 40), 17001);
+  host::sent().clear();
+  for (int i = 0; i < 2000 && host::sent().empty(); ++i) {
+    host::advanceMs(10);
+    rtcp.update();
+  }
+  CHECK(!host::sent().empty() && host::sent().back().address == "10.0.0.40" && host::sent().back().port == 17001);
+
+  return host::finish("test_rtcp");
+}
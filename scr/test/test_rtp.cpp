@@ -0,0 +1,265 @@
+/*
+ * test_rtp.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * RTPOverUDP and RTPPacketizer on the host: header layout, sequence and timestamp accounting per packet time,
+ * frame-exact packets and talkspurt markers around skipSamples() and a mid-call format change, the zero-copy path and
+ * the Stream fallback.
+ */
+#include "HostTest.h"
+#include "RTPOverUDP.h"
+#include "RTPPacketizer.h"
+
+static const uint16_t RTP_PORT = 5004;
+
+static RTPPacket sentPacket(size_t i) {
+  RTPPacket pkt = {};
+  const std::string& d = host::sent()[i].data;
+  CHECK(RTPOverUDP::parse((const uint8_t*)d.data(), d.size(), pkt));
+  return pkt;
+}
+
+static void testHeader() {
+  host::resetNet();
+  UDPStream udp("", "");
+  udp.begin(IPAddress(10, 0, 0, 33), RTP_PORT);
+  RTPOverUDP rtp(udp);
+  rtp.setSSRC(0x11223344);
+  rtp.setPayloadType(8);
+
+  memset(rtp.payloadBuffer(), 0xD5, 160);
+  CHECK_EQ(rtp.sendPacket(160, 160, true), RTP_HEADER_SIZE + 160);
+  memset(rtp.payloadBuffer(), 0x55, 160);
+  rtp.sendPacket(160, 160);
+  rtp.payloadBuffer()[0] = 60;
+  rtp.sendPacket(1, 0, false, 13);
+
+  CHECK_EQ(host::sent().size(), 3);
+  CHECK_EQ(host::sent()[0].port, RTP_PORT);
+  CHECK(host::sent()[0].address == "10.0.0.33");
+  const std::string& raw = host::sent()[0].data;
+  CHECK_EQ((uint8_t)raw[0], 0x80);                 // V=2, no padding, extension or CSRC
+  CHECK_EQ((uint8_t)raw[1], 0x80 | 8);             // marker, PCMA
+
+  RTPPacket a = sentPacket(0), b = sentPacket(1), cn = sentPacket(2);
+  CHECK_EQ(a.ssrc, 0x11223344);
+  CHECK(a.marker);
+  CHECK(!b.marker);
+  CHECK_EQ(b.payloadType, 8);
+  CHECK_EQ((uint16_t)(b.seq - a.seq), 1);
+  CHECK_EQ(b.timestamp - a.timestamp, 160);
+  CHECK_EQ(b.payload[0], 0x55);
+  CHECK_EQ(cn.payloadType, 13);                    // per packet override, the session type stays
+  CHECK_EQ(cn.payloadLen, 1);
+  CHECK_EQ(cn.timestamp, b.timestamp + 160);
+}
+
+// One packet per ptime, timestamps in samples whatever the packet time
+static void testPacketizer() {
+  const uint8_t ptimes[] = { 10, 20, 30, 40, 60 };
+  for (uint8_t ms : ptimes) {
+    host::resetNet();
+    UDPStream udp("", "");
+    udp.begin(IPAddress(10, 0, 0, 33), RTP_PORT);
+    RTPOverUDP rtp(udp);
+    RTPPacketizer packetizer(rtp);
+    CHECK(packetizer.setPtime(ms));
+    size_t frame = 8 * ms;
+
+    // 1 s of PCM in 20 ms blocks, which do not line up with 30 or 40 ms packets
+    int16_t pcm[160];
+    for (int block = 0; block < 50; ++block) {
+      for (int i = 0; i < 160; ++i) pcm[i] = (int16_t)(1000 * sin((block * 160 + i) * 0.05));
+      packetizer.writeSamples(pcm, 160);
+    }
+    CHECK_EQ(host::sent().size(), 8000 / frame);
+    for (size_t i = 0; i < host::sent().size(); ++i) {
+      RTPPacket pkt = sentPacket(i);
+      CHECK_EQ(pkt.payloadLen, frame);
+      CHECK_EQ(pkt.timestamp - sentPacket(0).timestamp, i * frame);
+      CHECK_EQ(pkt.marker, i == 0);
+    }
+  }
+
+  UDPStream udp("", "");
+  RTPOverUDP rtp(udp);
+  RTPPacketizer packetizer(rtp);
+  CHECK(!packetizer.setPtime(25));
+  CHECK_EQ(packetizer.ptime(), 20);
+}
+
+// DTX at 10, 30 and 60 ms: a talkspurt ending mid-frame is completed from the silence so every packet stays one
+// ptime, the skipped rest only moves the clock, and the first packet after it carries the marker
+static void testSkipSamples() {
+  const uint8_t ptimes[] = { 10, 30, 60 };
+  for (uint8_t ms : ptimes) {
+    host::resetNet();
+    UDPStream udp("", "");
+    udp.begin(IPAddress(10, 0, 0, 33), RTP_PORT);
+    RTPOverUDP rtp(udp);
+    RTPPacketizer packetizer(rtp);
+    CHECK(packetizer.setPtime(ms));
+    size_t frame = 8 * ms;
+
+    // 20 ms blocks: 13 voice (260 ms, a partial 30 and 60 ms frame), 12 silent, then 15 voice
+    int16_t pcm[160];
+    for (int i = 0; i < 160; ++i) pcm[i] = (int16_t)(1000 * sin(i * 0.05));
+    size_t talk1 = 0;
+    for (int block = 0; block < 40; ++block) {
+      bool silent = block >= 13 && block < 25;
+      if (silent) packetizer.skipSamples(pcm, 160);
+      else packetizer.writeSamples(pcm, 160);
+      if (block == 12) talk1 = host::sent().size();
+    }
+    size_t filled = (frame - (13 * 160) % frame) % frame;  // silence that completes the last voice frame
+    CHECK_EQ(host::sent().size(), (13 * 160 + filled) / frame + 15 * 160 / frame);
+    CHECK_EQ(filled, ms == 10 ? 0 : ms == 30 ? 80 : 320);
+    uint32_t ts0 = sentPacket(0).timestamp;
+    size_t resume = (13 * 160 + filled) / frame;           // first packet of the second talkspurt
+    CHECK(talk1 <= resume);
+    for (size_t i = 0; i < host::sent().size(); ++i) {
+      RTPPacket pkt = sentPacket(i);
+      CHECK_EQ(pkt.payloadLen, frame);
+      CHECK_EQ(pkt.marker, i == 0 || i == resume);
+      if (i > 0) CHECK_EQ((uint16_t)(pkt.seq - sentPacket(i - 1).seq), 1);
+      uint32_t at = i < resume ? i * frame : 25 * 160 + (i - resume) * frame;
+      CHECK_EQ(pkt.timestamp - ts0, at);
+    }
+  }
+}
+
+// A re-INVITE switching law or ptime mid-frame: the partial frame is not sent in a mix of formats, its time is
+// skipped, and the first packet in the new format starts a talkspurt; setting what is already set changes nothing
+static void testFormatChange() {
+  host::resetNet();
+  UDPStream udp("", "");
+  udp.begin(IPAddress(10, 0, 0, 33), RTP_PORT);
+  RTPOverUDP rtp(udp);
+  RTPPacketizer packetizer(rtp);
+  int16_t pcm[160];
+  for (int i = 0; i < 160; ++i) pcm[i] = (int16_t)(1000 * sin(i * 0.05));
+
+  packetizer.writeSamples(pcm, 160);
+  packetizer.writeSamples(pcm, 100);
+  CHECK(packetizer.setPtime(20));
+  packetizer.setLaw(G711::ULAW);
+  CHECK(!packetizer.frameBoundary());               // same format: the partial frame is kept
+  packetizer.setLaw(G711::ALAW);
+  CHECK(packetizer.frameBoundary());
+  packetizer.writeSamples(pcm, 160);
+  packetizer.writeSamples(pcm, 60);
+  CHECK(packetizer.setPtime(40));
+  CHECK(packetizer.frameBoundary());
+  packetizer.writeSamples(pcm, 160);
+  packetizer.writeSamples(pcm, 160);
+
+  CHECK_EQ(host::sent().size(), 3);
+  RTPPacket a = sentPacket(0), b = sentPacket(1), c = sentPacket(2);
+  CHECK(a.marker && b.marker && c.marker);
+  CHECK_EQ(b.timestamp - a.timestamp, 160 + 100);
+  CHECK_EQ(b.payload[0], G711::linearToAlaw(pcm[0]));
+  CHECK_EQ(c.timestamp - b.timestamp, 160 + 60);
+  CHECK_EQ(c.payloadLen, 320);
+  CHECK_EQ((uint16_t)(c.seq - a.seq), 2);
+}
+
+// reserve()/commit() write straight into the datagram buffer
+static void testZeroCopy() {
+  host::resetNet();
+  UDPStream udp("", "");
+  udp.begin(IPAddress(10, 0, 0, 33), RTP_PORT);
+  RTPOverUDP rtp(udp);
+  RTPPacketizer packetizer(rtp);
+
+  size_t room;
+  uint8_t* slot = packetizer.reserve(room);
+  CHECK(slot == rtp.payloadBuffer());
+  CHECK_EQ(room, 160);
+  memset(slot, 0x7F, 100);
+  packetizer.commit(100);
+  CHECK_EQ(host::sent().size(), 0);
+  slot = packetizer.reserve(room);
+  CHECK(slot == rtp.payloadBuffer() + 100);
+  CHECK_EQ(room, 60);
+  memset(slot, 0x7E, 60);
+  packetizer.commit(60);
+  CHECK_EQ(host::sent().size(), 1);
+  RTPPacket pkt = sentPacket(0);
+  CHECK_EQ(pkt.payload[99], 0x7F);
+  CHECK_EQ(pkt.payload[100], 0x7E);
+}
+
+// The Stream fallback splits large writes and counts one sample per G.711 byte
+static void testStreamWrite() {
+  host::resetNet();
+  UDPStream udp("", "");
+  udp.begin(IPAddress(10, 0, 0, 33), RTP_PORT);
+  RTPOverUDP rtp(udp);
+
+  uint8_t payload[800];
+  memset(payload, 0xFF, sizeof(payload));
+  CHECK_EQ(rtp.write(payload, 160), 160);
+  CHECK_EQ(rtp.write(payload, sizeof(payload)), sizeof(payload));
+  CHECK_EQ(host::sent().size(), 3);
+  RTPPacket a = sentPacket(0), b = sentPacket(1), c = sentPacket(2);
+  CHECK_EQ(b.timestamp - a.timestamp, 160);
+  CHECK_EQ(b.payloadLen, RTPOverUDP::maxPayload());
+  CHECK_EQ(c.timestamp - b.timestamp, RTPOverUDP::maxPayload());
+  CHECK_EQ(c.payloadLen, 800 - RTPOverUDP::maxPayload());
+}
+
+static std::string rtpDatagram(uint16_t seq, size_t payloadLen) {
+  std::string d(RTP_HEADER_SIZE + payloadLen, '\x55');
+  d[0] = (char)0x80;
+  d[1] = 0;
+  d[2] = (char)(seq >> 8);
+  d[3] = (char)seq;
+  return d;
+}
+
+// A datagram that is not RTP is dropped and counted, the good ones around it are still read
+static void testReceive() {
+  host::resetNet();
+  UDPStream udp("", "");
+  udp.begin(RTP_PORT);
+  RTPOverUDP rtp(udp);
+
+  host::deliver(RTP_PORT, rtpDatagram(1, 160));
+  host::deliver(RTP_PORT, std::string("\x80\x00\x00", 3));            // shorter than a header
+  host::deliver(RTP_PORT, std::string(172, '\x40'));                    // version 1
+  host::deliver(RTP_PORT, rtpDatagram(2, 160));
+  std::string padded = rtpDatagram(3, 8);
+  padded[0] |= 0x20;
+  padded.back() = 40;                                                    // more padding than the datagram holds
+  host::deliver(RTP_PORT, padded);
+
+  RTPPacket pkt;
+  uint16_t seqs[4];
+  int n = 0;
+  while (n < 4 && rtp.receive(pkt)) seqs[n++] = pkt.seq;
+  CHECK_EQ(n, 2);
+  CHECK_EQ(seqs[0], 1);
+  CHECK_EQ(seqs[1], 2);
+  CHECK_EQ(rtp.rejected(), 3);
+  CHECK(!rtp.receive(pkt));
+
+  // The Stream API skips them the same way
+  host::deliver(RTP_PORT, std::string(5, '\x80'));
+  host::deliver(RTP_PORT, rtpDatagram(4, 20));
+  uint8_t buf[64];
+  CHECK_EQ(rtp.available(), 20);
+  CHECK_EQ(rtp.readBytes(buf, sizeof(buf)), 20);
+  CHECK_EQ(rtp.rejected(), 4);
+}
+
+int main() {
+  testHeader();
+  testPacketizer();
+  testSkipSamples();
+  testFormatChange();
+  testZeroCopy();
+  testStreamWrite();
+  testReceive();
+  return host::finish("test_rtp");
+}
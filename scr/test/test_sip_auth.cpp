@@ -0,0 +1,317 @@
+/*
+ * test_sip_auth.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Digest challenges against ArduinoSIP on the UDP stub, for each method the phone sends. A challenged REGISTER or
+ * INVITE is sent again with credentials, and later requests carry them up front with the next nonce-count. A
+ * challenged BYE goes out again as a new request, with the next CSeq, a new branch and credentials. A challenged
+ * CANCEL keeps the INVITE's CSeq and branch, so it still matches the INVITE. Only the INVITE's challenge is ACKed.
+ * The response= values are recomputed here with MD5Builder, itself checked against the RFC 2617 and RFC 2069
+ * examples, for qop=auth and for the qop-less RFC 2069 form, in Authorization and Proxy-Authorization.
+ */
+#include "HostTest.h"
+#include "ArduinoSIP.h"
+#include "MD5Builder.h"
+#include <string>
+#include <vector>
+
+static const char    *SERVER      = "10.0.0.1";
+static const uint16_t SERVER_PORT = 5060;
+static const uint16_t LOCAL_PORT  = 5070;
+
+static const char *WWW_CHALLENGE   = "WWW-Authenticate: Digest realm=\"pbx\", nonce=\"n1\", qop=\"auth\"\r\n";
+static const char *PROXY_CHALLENGE = "Proxy-Authenticate: Digest realm=\"pbx\", nonce=\"n2\", qop=\"auth\"\r\n";
+
+static char outBuf[1500], inBuf[1500];
+static std::vector<std::string> wire;          // everything the client sent, oldest first
+
+static void pump(Sip &sip, uint32_t ms) {
+  for ( uint32_t t = 0; t < ms; t += 10 )
+  {
+    sip.Processing(inBuf, sizeof(inBuf));
+    for ( const HostDatagram &d : host::sent() )
+    {
+      CHECK(d.address == SERVER && d.port == SERVER_PORT);
+      wire.push_back(d.data);
+    }
+    host::sent().clear();
+    host::advanceMs(10);
+  }
+}
+
+static std::string method(const std::string &msg) { return msg.substr(0, msg.find(' ')); }
+
+static size_t count(const char *m) {
+  size_t n = 0;
+  for ( const std::string &s : wire ) n += method(s) == m;
+  return n;
+}
+
+static const std::string &last(const char *m) {
+  for ( size_t i = wire.size(); i-- > 0; )
+    if ( method(wire[i]) == m ) return wire[i];
+  static std::string none;
+  return none;
+}
+
+static std::string header(const std::string &msg, SipMessage::Header h) {
+  SipMessage m;
+  size_t len = 0;
+  const char *v = m.Parse(msg.data(), msg.size()) ? m.Value(h, len) : 0;
+  return v ? std::string(v, len) : std::string();
+}
+
+static std::string branch(const std::string &msg) {
+  SipMessage m;
+  char b[32] = { 0 };
+  m.Parse(msg.data(), msg.size());
+  m.Param(SipMessage::H_VIA, "branch", b, sizeof(b));
+  return b;
+}
+
+// The credentials line a request carries, empty if none
+static std::string credentials(const std::string &msg, const char *name) {
+  size_t at = msg.find(std::string("\r\n") + name + ": Digest ");
+  if ( at == std::string::npos ) return std::string();
+  at += 2;
+  return msg.substr(at, msg.find("\r\n", at) - at);
+}
+
+static std::string param(const std::string &line, const char *name) {
+  size_t at = line.find(std::string(" ") + name + "=");
+  if ( at == std::string::npos ) return std::string();
+  at += strlen(name) + 2;
+  if ( line[at] == '"' ) return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+  return line.substr(at, line.find(',', at) - at);
+}
+
+static void respond(const std::string &req, int code, const char *reason, const char *extra = "") {
+  std::string to = header(req, SipMessage::H_TO);
+  if ( code > 100 && to.find("tag=") == std::string::npos ) to += ";tag=srv77";
+  std::string r = "SIP/2.0 " + std::to_string(code) + " " + reason + "\r\n"
+                + "Via: " + header(req, SipMessage::H_VIA) + "\r\n"
+                + "From: " + header(req, SipMessage::H_FROM) + "\r\n"
+                + "To: " + to + "\r\n"
+                + "Call-ID: " + header(req, SipMessage::H_CALL_ID) + "\r\n"
+                + "CSeq: " + header(req, SipMessage::H_CSEQ) + "\r\n"
+                + extra + "Content-Length: 0\r\n\r\n";
+  host::deliver(LOCAL_PORT, r);
+}
+
+static Sip &start(const char *user = "alice", const char *password = "secret") {
+  host::reset();
+  host::resetNet();
+  wire.clear();
+  static Sip *sip = nullptr;
+  delete sip;
+  sip = new Sip(outBuf, sizeof(outBuf));
+  sip->Init(SERVER, SERVER_PORT, "10.0.0.2", LOCAL_PORT, user, password);
+  return *sip;
+}
+
+static std::string md5(const std::string &s) {
+  MD5Builder m;
+  m.begin();
+  m.add(s.c_str());
+  m.calculate();
+  char hex[33];
+  m.getChars(hex);
+  return hex;
+}
+
+// RFC 2617 3.2.2: MD5(HA1:nonce:nc:cnonce:qop:HA2), or without qop the RFC 2069 MD5(HA1:nonce:HA2)
+static std::string digest(const std::string &user, const std::string &realm, const std::string &password,
+                          const std::string &method, const std::string &uri, const std::string &nonce,
+                          const std::string &nc = "", const std::string &cnonce = "", const std::string &qop = "") {
+  std::string ha1 = md5(user + ":" + realm + ":" + password), ha2 = md5(method + ":" + uri);
+  if ( qop.empty() ) return md5(ha1 + ":" + nonce + ":" + ha2);
+  return md5(ha1 + ":" + nonce + ":" + nc + ":" + cnonce + ":" + qop + ":" + ha2);
+}
+
+// The response a server expects for these credentials, from what the request itself says
+static std::string expected(const std::string &req, const char *name, const char *user, const char *password) {
+  std::string auth = credentials(req, name);
+  return digest(user, param(auth, "realm"), password, method(req), param(auth, "uri"), param(auth, "nonce"),
+                param(auth, "nc"), param(auth, "cnonce"), param(auth, "qop"));
+}
+
+static Sip &dial() {
+  Sip &sip = start();
+  static const char sdp[] = "v=0\r\n";
+  CHECK(sip.Dial("100", "Test", sdp, sizeof(sdp) - 1));
+  pump(sip, 10);
+  CHECK_EQ(count("INVITE"), 1);
+  return sip;
+}
+
+// The reference itself, on the worked examples of RFC 2617 3.5 and RFC 2069 2.4 (the latter as corrected by its
+// erratum)
+static void testKnownAnswers() {
+  CHECK(md5("abc") == "900150983cd24fb0d6963f7d28e17f72");                       // RFC 1321 A.5
+  CHECK(digest("Mufasa", "testrealm@host.com", "Circle Of Life", "GET", "/dir/index.html",
+               "dcd98b7102dd2f0e8b11d0f600bfb0c093", "00000001", "0a4f113b", "auth")
+        == "6629fae49393a05397450978507c4ef1");
+  CHECK(digest("Mufasa", "testrealm@host.com", "CircleOfLife", "GET", "/dir/index.html",
+               "dcd98b7102dd2f0e8b11d0f600bfb0c093") == "1949323746fe6a43ef61f9606e7febea");
+}
+
+// The RFC 2617 challenge against a REGISTER: the response, the echoed opaque, and the next nonce-count's response
+static void testDigestQop() {
+  Sip &sip = start("Mufasa", "Circle Of Life");
+  CHECK(sip.Register());
+  pump(sip, 10);
+  respond(last("REGISTER"), 401, "Unauthorized",
+          "WWW-Authenticate: Digest realm=\"testrealm@host.com\", qop=\"auth,auth-int\", "
+          "nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\", opaque=\"5ccc069c403ebaf9f0171e9517f40e41\"\r\n");
+  pump(sip, 10);
+  std::string req = last("REGISTER");
+  std::string auth = credentials(req, "Authorization");
+  CHECK(param(auth, "username") == "Mufasa" && param(auth, "qop") == "auth" && param(auth, "nc") == "00000001");
+  CHECK(param(auth, "cnonce").size() == 8);
+  CHECK(param(auth, "opaque") == "5ccc069c403ebaf9f0171e9517f40e41");
+  CHECK(param(auth, "response") == expected(req, "Authorization", "Mufasa", "Circle Of Life"));
+  CHECK(param(auth, "response") == digest("Mufasa", "testrealm@host.com", "Circle Of Life", "REGISTER",
+                                          "sip:10.0.0.1", "dcd98b7102dd2f0e8b11d0f600bfb0c093", "00000001",
+                                          param(auth, "cnonce"), "auth"));
+  respond(req, 200, "OK");
+  pump(sip, 10);
+
+  CHECK(sip.Register());
+  pump(sip, 10);
+  req = last("REGISTER");
+  CHECK(param(credentials(req, "Authorization"), "nc") == "00000002");
+  CHECK(param(credentials(req, "Authorization"), "response")
+        == expected(req, "Authorization", "Mufasa", "Circle Of Life"));
+}
+
+// A 407 without qop: RFC 2069 form in Proxy-Authorization, no nc or cnonce
+static void testDigestNoQop() {
+  Sip &sip = start("Mufasa", "CircleOfLife");
+  static const char sdp[] = "v=0\r\n";
+  CHECK(sip.Dial("100", "Test", sdp, sizeof(sdp) - 1));
+  pump(sip, 10);
+  respond(last("INVITE"), 407, "Proxy Authentication Required",
+          "Proxy-Authenticate: Digest realm=\"testrealm@host.com\", nonce=\"dcd98b7102dd2f0e8b11d0f600bfb0c093\"\r\n");
+  pump(sip, 10);
+  CHECK_EQ(count("INVITE"), 2);
+  std::string req = last("INVITE");
+  std::string auth = credentials(req, "Proxy-Authorization");
+  CHECK(credentials(req, "Authorization").empty());
+  CHECK(param(auth, "qop").empty() && param(auth, "nc").empty() && param(auth, "cnonce").empty());
+  CHECK(param(auth, "response") == digest("Mufasa", "testrealm@host.com", "CircleOfLife", "INVITE",
+                                          "sip:100@10.0.0.1", "dcd98b7102dd2f0e8b11d0f600bfb0c093"));
+}
+
+// REGISTER: sent again with credentials, and the refresh carries them before any challenge
+static void testRegister() {
+  Sip &sip = start();
+  CHECK(sip.Register());
+  pump(sip, 10);
+  respond(last("REGISTER"), 401, "Unauthorized", WWW_CHALLENGE);
+  pump(sip, 10);
+  CHECK_EQ(count("REGISTER"), 2);
+  CHECK_EQ(count("ACK"), 0);
+  std::string auth = credentials(last("REGISTER"), "Authorization");
+  CHECK(param(auth, "nonce") == "n1" && param(auth, "uri") == "sip:10.0.0.1" && param(auth, "nc") == "00000001");
+  respond(last("REGISTER"), 200, "OK");
+  pump(sip, 10);
+
+  CHECK(sip.Register());
+  pump(sip, 10);
+  CHECK_EQ(count("REGISTER"), 3);
+  CHECK(param(credentials(last("REGISTER"), "Authorization"), "nc") == "00000002");
+}
+
+// INVITE: the transaction ACKs the 407, then the same call goes out again with credentials
+static void testInvite() {
+  Sip &sip = dial();
+  respond(last("INVITE"), 407, "Proxy Authentication Required", PROXY_CHALLENGE);
+  pump(sip, 10);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK_EQ(count("INVITE"), 2);
+  CHECK(header(last("INVITE"), SipMessage::H_CSEQ) == "2 INVITE");
+  CHECK(param(credentials(last("INVITE"), "Proxy-Authorization"), "uri") == "sip:100@10.0.0.1");
+  CHECK(param(credentials(last("INVITE"), "Proxy-Authorization"), "response")
+        == expected(last("INVITE"), "Proxy-Authorization", "alice", "secret"));
+}
+
+// BYE: a new request each time, with its own branch and the next CSeq; never ACKed, never a new call
+static void testBye() {
+  Sip &sip = dial();
+  std::string invite = last("INVITE");
+  respond(invite, 200, "OK");                      // no SDP we can use: ACK, then BYE
+  pump(sip, 10);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK_EQ(count("BYE"), 1);
+  std::string bye = last("BYE");
+  CHECK(branch(bye) != branch(invite) && !branch(bye).empty());
+  CHECK(header(bye, SipMessage::H_VIA).compare(0, 26, "SIP/2.0/UDP 10.0.0.2:5070;") == 0);
+  CHECK(header(bye, SipMessage::H_CSEQ) == "2 BYE");
+  CHECK(credentials(bye, "Authorization").empty());
+
+  respond(bye, 401, "Unauthorized", WWW_CHALLENGE);
+  pump(sip, 10);
+  CHECK_EQ(count("BYE"), 2);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK_EQ(count("INVITE"), 1);
+  std::string again = last("BYE");
+  CHECK(header(again, SipMessage::H_CSEQ) == "3 BYE");
+  CHECK(branch(again) != branch(bye));
+  CHECK(header(again, SipMessage::H_CALL_ID) == header(bye, SipMessage::H_CALL_ID));
+  CHECK(header(again, SipMessage::H_TO) == header(bye, SipMessage::H_TO));
+  std::string auth = credentials(again, "Authorization");
+  CHECK(param(auth, "nonce") == "n1" && param(auth, "uri") == "sip:100@10.0.0.1");
+  CHECK(param(auth, "response") == expected(again, "Authorization", "alice", "secret"));
+
+  // the same nonce refused again: the credentials are wrong, give up
+  respond(again, 401, "Unauthorized", WWW_CHALLENGE);
+  pump(sip, 10);
+  CHECK_EQ(count("BYE"), 2);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK_EQ(count("INVITE"), 1);
+}
+
+// CANCEL: resent on the INVITE's branch and CSeq, then the 487 still ends the INVITE with one ACK
+static void testCancel() {
+  Sip &sip = dial();
+  std::string invite = last("INVITE");
+  respond(invite, 180, "Ringing");
+  pump(sip, 180100);                               // Timer C
+  CHECK_EQ(count("CANCEL"), 1);
+  std::string cancel = last("CANCEL");
+  CHECK(credentials(cancel, "Proxy-Authorization").empty());
+
+  respond(cancel, 407, "Proxy Authentication Required", PROXY_CHALLENGE);
+  pump(sip, 10);
+  CHECK_EQ(count("CANCEL"), 2);
+  CHECK_EQ(count("ACK"), 0);
+  CHECK_EQ(count("INVITE"), 1);
+  std::string again = last("CANCEL");
+  CHECK(branch(again) == branch(invite));
+  CHECK(header(again, SipMessage::H_CSEQ) == "1 CANCEL");
+  std::string auth = credentials(again, "Proxy-Authorization");
+  CHECK(param(auth, "nonce") == "n2" && param(auth, "uri") == "sip:100@10.0.0.1");
+  CHECK(param(auth, "response") == expected(again, "Proxy-Authorization", "alice", "secret"));
+
+  // the resent CANCEL replaced the first one: no retransmissions of the refused copy
+  respond(again, 200, "OK");
+  pump(sip, 2000);
+  CHECK_EQ(count("CANCEL"), 2);
+  respond(invite, 487, "Request Terminated");
+  pump(sip, 10);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK(branch(last("ACK")) == branch(invite));
+  CHECK_EQ(count("INVITE"), 1);
+}
+
+int main() {
+  testKnownAnswers();
+  testDigestQop();
+  testDigestNoQop();
+  testRegister();
+  testInvite();
+  testBye();
+  testCancel();
+  return host::finish("test_sip_auth");
+}
@@ -0,0 +1,261 @@
+/*
+ * test_sip_dialog.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Incoming INVITEs against ArduinoSIP's auto-answer, on the UDP stub: the offer is answered with the negotiated
+ * codec and a To tag that retransmissions keep; re-INVITEs inside the dialog keep the To line and the o= session id,
+ * the o= version goes up only when the answer changes, and hold, resume, a new media address and a new codec or ptime
+ * show up in the session and its version; a re-INVITE we cannot take is refused without
+ * touching the running session. An INVITE without an offer gets ours in the 200, and the answer in the ACK either
+ * starts the call or ends it with a BYE.
+ */
+#include "HostTest.h"
+#include "ArduinoSIP.h"
+#include <string>
+#include <vector>
+
+static const char    *SERVER      = "10.0.0.1";
+static const uint16_t SERVER_PORT = 5060;
+static const uint16_t LOCAL_PORT  = 5070;
+
+static char outBuf[1500], inBuf[1500];
+static std::vector<std::string> wire;          // everything the phone sent, oldest first
+
+static void pump(Sip &sip) {
+  for ( int i = 0; i < 3; i++ )
+  {
+    sip.Processing(inBuf, sizeof(inBuf));
+    for ( const HostDatagram &d : host::sent() )
+    {
+      CHECK(d.address == SERVER && d.port == SERVER_PORT);
+      wire.push_back(d.data);
+    }
+    host::sent().clear();
+    host::advanceMs(10);
+  }
+}
+
+static std::string header(const std::string &msg, SipMessage::Header h) {
+  SipMessage m;
+  size_t len = 0;
+  const char *v = m.Parse(msg.data(), msg.size()) ? m.Value(h, len) : 0;
+  return v ? std::string(v, len) : std::string();
+}
+
+static std::string body(const std::string &msg) {
+  size_t at = msg.find("\r\n\r\n");
+  return at == std::string::npos ? std::string() : msg.substr(at + 4);
+}
+
+// The o= line's session id and version
+static std::pair<std::string, unsigned long> origin(const std::string &msg) {
+  std::string b = body(msg);
+  size_t at = b.find("o=- ");
+  if ( at == std::string::npos ) return { std::string(), 0 };
+  at += 4;
+  size_t space = b.find(' ', at);
+  return { b.substr(at, space - at), strtoul(b.c_str() + space + 1, nullptr, 10) };
+}
+
+static std::string sdp(const char *address, unsigned port, const char *formats, const char *attributes) {
+  return std::string("v=0\r\no=- 1 1 IN IP4 ") + address + "\r\ns=-\r\nc=IN IP4 " + address + "\r\nt=0 0\r\n"
+       + "m=audio " + std::to_string(port) + " RTP/AVP " + formats + "\r\n" + attributes;
+}
+
+static const char *PCMA_CN = "a=rtpmap:8 PCMA/8000\r\na=rtpmap:13 CN/8000\r\na=ptime:20\r\n";
+
+// A request from the PBX in the call it opens; toTag is empty until the phone has answered
+static void request(const char *method, int cseq, const char *branch, const std::string &toTag,
+                    const std::string &sdpBody = "") {
+  std::string r = std::string(method) + " sip:alice@10.0.0.2:5070 SIP/2.0\r\n"
+                + "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=" + branch + ";rport\r\n"
+                + "Max-Forwards: 70\r\n"
+                + "From: \"Bob\" <sip:bob@10.0.0.1>;tag=bob1\r\n"
+                + "To: <sip:alice@10.0.0.2:5070>" + (toTag.empty() ? "" : ";tag=" + toTag) + "\r\n"
+                + "Contact: <sip:bob@10.0.0.1:5060>\r\n"
+                + "Call-ID: call1@10.0.0.1\r\n"
+                + "CSeq: " + std::to_string(cseq) + " " + method + "\r\n"
+                + (sdpBody.empty() ? "" : "Content-Type: application/sdp\r\n")
+                + "Content-Length: " + std::to_string(sdpBody.size()) + "\r\n\r\n" + sdpBody;
+  host::deliver(LOCAL_PORT, r);
+}
+
+static std::string toTag(const std::string &response) {
+  std::string to = header(response, SipMessage::H_TO);
+  size_t at = to.find(";tag=");
+  return at == std::string::npos ? std::string() : to.substr(at + 5);
+}
+
+static Sip &start() {
+  host::reset();
+  host::resetNet();
+  wire.clear();
+  static Sip *sip = nullptr;
+  delete sip;
+  sip = new Sip(outBuf, sizeof(outBuf));
+  sip->Init(SERVER, SERVER_PORT, "10.0.0.2", LOCAL_PORT, "alice", "secret");
+  Sdp::Media local;
+  Sdp::Clear(local);
+  strcpy(local.address, "10.0.0.2");
+  local.port = 4000;
+  Sdp::Add(local, 0, Sdp::CODEC_PCMU);
+  Sdp::Add(local, 8, Sdp::CODEC_PCMA);
+  Sdp::Add(local, 13, Sdp::CODEC_CN);
+  local.ptime = 20;
+  sip->SetLocalMedia(local);
+  return *sip;
+}
+
+// A call with an offer: answered at once, and a retransmitted INVITE gets the same answer and tag
+static std::string answerCall(Sip &sip) {
+  request("INVITE", 1, "z9hG4bKa1", "", sdp("10.0.0.1", 17000, "8 13", PCMA_CN));
+  pump(sip);
+  CHECK_EQ(wire.size(), 1);
+  const std::string ok = wire.back();
+  CHECK(ok.compare(0, 15, "SIP/2.0 200 OK\r") == 0);
+  std::string tag = toTag(ok);
+  CHECK(!tag.empty());
+  CHECK(body(ok).find("m=audio 4000 RTP/AVP 8 13\r\n") != std::string::npos);
+  CHECK(sip.IsInCall());
+  const Sdp::Session &s = sip.GetMediaSession();
+  CHECK(s.valid && !strcmp(s.address, "10.0.0.1") && s.port == 17000 && s.codec == Sdp::CODEC_PCMA);
+  CHECK_EQ(s.direction, Sdp::SENDRECV);
+  CHECK_EQ(sip.GetMediaVersion(), 1);
+  CHECK(!origin(ok).first.empty());
+
+  request("INVITE", 1, "z9hG4bKa1", "", sdp("10.0.0.1", 17000, "8 13", PCMA_CN));
+  pump(sip);
+  CHECK_EQ(wire.size(), 2);
+  CHECK(toTag(wire.back()) == tag);
+  CHECK(origin(wire.back()) == origin(ok));
+  CHECK_EQ(sip.GetMediaVersion(), 1);
+  return tag;
+}
+
+static void testReInvite() {
+  Sip &sip = start();
+  std::string tag = answerCall(sip);
+  auto o = origin(wire.back());
+
+  // a session refresh: the same offer gets the same answer, and the o= version stays
+  request("INVITE", 2, "z9hG4bKa5", tag, sdp("10.0.0.1", 17000, "8 13", PCMA_CN));
+  pump(sip);
+  CHECK(origin(wire.back()) == o);
+
+  // hold: the PBX only sends, we answer recvonly inside the same dialog
+  request("INVITE", 3, "z9hG4bKa2", tag, sdp("10.0.0.1", 17000, "8 13", "a=rtpmap:8 PCMA/8000\r\na=sendonly\r\n"));
+  pump(sip);
+  CHECK(wire.back().compare(0, 15, "SIP/2.0 200 OK\r") == 0);
+  CHECK(header(wire.back(), SipMessage::H_TO) == "<sip:alice@10.0.0.2:5070>;tag=" + tag);
+  CHECK(body(wire.back()).find("a=recvonly\r\n") != std::string::npos);
+  CHECK_EQ(sip.GetMediaSession().direction, Sdp::RECVONLY);
+  CHECK_EQ(sip.GetMediaVersion(), 2);
+  CHECK(origin(wire.back()).first == o.first);
+  CHECK_EQ(origin(wire.back()).second, o.second + 1);
+
+  // resume on a media server elsewhere
+  request("INVITE", 4, "z9hG4bKa3", tag, sdp("10.0.0.9", 18000, "8 13", PCMA_CN));
+  pump(sip);
+  CHECK(toTag(wire.back()) == tag);
+  CHECK(origin(wire.back()).first == o.first);
+  CHECK_EQ(origin(wire.back()).second, o.second + 2);
+  const Sdp::Session &s = sip.GetMediaSession();
+  CHECK(!strcmp(s.address, "10.0.0.9") && s.port == 18000);
+  CHECK_EQ(s.direction, Sdp::SENDRECV);
+  CHECK_EQ(sip.GetMediaVersion(), 3);
+
+  // RFC 2543 hold, 0.0.0.0: nothing to send, and the address is not one to send to
+  request("INVITE", 5, "z9hG4bKa4", tag, sdp("0.0.0.0", 18000, "8 13", PCMA_CN));
+  pump(sip);
+  CHECK(!Sdp::Sends(sip.GetMediaSession().direction));
+  CHECK_EQ(sip.GetMediaVersion(), 4);
+  CHECK_EQ(origin(wire.back()).second, o.second + 3);
+  CHECK(sip.IsInCall());
+}
+
+// A re-INVITE that brings PCMU and asks for 40 ms: the answer switches to our cheaper codec and that ptime, and the
+// session the pipelines follow changes with it
+static void testCodecChange() {
+  Sip &sip = start();
+  std::string tag = answerCall(sip);
+  auto o = origin(wire.back());
+
+  request("INVITE", 2, "z9hG4bKa2", tag,
+          sdp("10.0.0.1", 17000, "8 0 13", "a=rtpmap:0 PCMU/8000\r\na=rtpmap:8 PCMA/8000\r\na=ptime:40\r\n"));
+  pump(sip);
+  const std::string &ok = wire.back();
+  CHECK(ok.compare(0, 15, "SIP/2.0 200 OK\r") == 0);
+  CHECK(body(ok).find("m=audio 4000 RTP/AVP 0 13\r\n") != std::string::npos);
+  CHECK(body(ok).find("a=ptime:40\r\n") != std::string::npos);
+  CHECK_EQ(origin(ok).second, o.second + 1);
+  const Sdp::Session &s = sip.GetMediaSession();
+  CHECK_EQ(s.codec, Sdp::CODEC_PCMU);
+  CHECK_EQ(s.payloadType, 0);
+  CHECK_EQ(s.ptime, 40);
+  CHECK_EQ(s.cnPayloadType, 13);
+  CHECK_EQ(sip.GetMediaVersion(), 2);
+}
+
+// A re-INVITE with nothing we can use is refused; the call goes on with the session it had
+static void testRejectedReInvite() {
+  Sip &sip = start();
+  std::string tag = answerCall(sip);
+  Sdp::Session before = sip.GetMediaSession();
+
+  request("INVITE", 2, "z9hG4bKa2", tag, sdp("10.0.0.9", 18000, "18", "a=rtpmap:18 G729/8000\r\n"));
+  pump(sip);
+  CHECK(wire.back().compare(0, 31, "SIP/2.0 488 Not Acceptable Here") == 0);
+  CHECK(toTag(wire.back()) == tag);
+  CHECK(memcmp(&before, &sip.GetMediaSession(), sizeof(before)) == 0);
+  CHECK_EQ(sip.GetMediaVersion(), 1);
+  CHECK(sip.IsInCall());
+}
+
+// No offer: ours goes in the 200, the call starts with the answer in the ACK
+static void testOfferless() {
+  Sip &sip = start();
+  request("INVITE", 1, "z9hG4bKb1", "");
+  pump(sip);
+  CHECK_EQ(wire.size(), 1);
+  CHECK(wire.back().compare(0, 15, "SIP/2.0 200 OK\r") == 0);
+  CHECK(body(wire.back()).find("m=audio 4000 RTP/AVP 0 8 13\r\n") != std::string::npos);
+  CHECK(!sip.IsInCall());
+  std::string tag = toTag(wire.back());
+
+  request("ACK", 1, "z9hG4bKb2", tag, sdp("10.0.0.1", 17000, "8", "a=rtpmap:8 PCMA/8000\r\n"));
+  pump(sip);
+  CHECK_EQ(wire.size(), 1);
+  CHECK(sip.IsInCall());
+  CHECK_EQ(sip.GetMediaSession().codec, Sdp::CODEC_PCMA);
+  CHECK_EQ(sip.GetMediaSession().port, 17000);
+  CHECK_EQ(sip.GetMediaVersion(), 1);
+}
+
+// No offer, and an answer we cannot use: the ACK completes the INVITE, then a BYE ends the dialog from our side
+static void testOfferlessBadAnswer() {
+  Sip &sip = start();
+  request("INVITE", 1, "z9hG4bKc1", "");
+  pump(sip);
+  std::string tag = toTag(wire.back());
+
+  request("ACK", 1, "z9hG4bKc2", tag, sdp("10.0.0.1", 17000, "18", "a=rtpmap:18 G729/8000\r\n"));
+  pump(sip);
+  CHECK(!sip.IsInCall());
+  CHECK_EQ(wire.size(), 2);
+  const std::string &bye = wire.back();
+  CHECK(bye.compare(0, 35, "BYE sip:bob@10.0.0.1:5060 SIP/2.0\r\n") == 0);
+  CHECK(header(bye, SipMessage::H_FROM) == "<sip:alice@10.0.0.2:5070>;tag=" + tag);
+  CHECK(header(bye, SipMessage::H_TO) == "\"Bob\" <sip:bob@10.0.0.1>;tag=bob1");
+  CHECK(header(bye, SipMessage::H_CALL_ID) == "call1@10.0.0.1");
+  CHECK_EQ(sip.GetMediaVersion(), 0);
+}
+
+int main() {
+  testReInvite();
+  testCodecChange();
+  testRejectedReInvite();
+  testOfferless();
+  testOfferlessBadAnswer();
+  return host::finish("test_sip_dialog");
+}
@@ -0,0 +1,253 @@
+/*
+ * test_sip_lossy.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * Registration and call setup over a link that loses 20% of the datagrams in each direction. The test stands
+ * between the client and a scripted server and drops datagrams itself, from a seeded generator, so every run is
+ * repeatable. The server behaves as an Asterisk-style registrar and UAS would: it challenges the first REGISTER and
+ * INVITE, answers retransmitted requests with its last response and retransmits INVITE final responses (Timer G,
+ * RFC 3261 17.2.1) until the ACK arrives. The client is driven as SimpleSIPClient drives it, re-registering and
+ * re-dialling when the transaction layer reports a timeout. Every run must register and set up the call.
+ */
+#include "HostTest.h"
+#include "ArduinoSIP.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+static const char    *SERVER      = "10.0.0.1";
+static const uint16_t SERVER_PORT = 5060;
+static const uint16_t LOCAL_PORT  = 5070;
+static const uint32_t T1 = 500, T2 = 4000;
+
+static char outBuf[1500], inBuf[1500];
+
+static std::string header(const SipMessage &m, SipMessage::Header h) {
+  size_t len = 0;
+  const char *v = m.Value(h, len);
+  return v ? std::string(v, len) : std::string();
+}
+
+class LossyLink {
+public:
+  LossyLink(double loss, uint32_t seed) : _loss(loss), _rng(seed) {}
+  bool drop() {
+    _rng = _rng * 1664525u + 1013904223u;
+    bool lost = (_rng >> 8) * (1.0 / (1 << 24)) < _loss;
+    datagrams++;
+    dropped += lost;
+    return lost;
+  }
+  uint32_t datagrams = 0, dropped = 0;
+
+private:
+  double   _loss;
+  uint32_t _rng;
+};
+
+class Server {
+public:
+  Server(LossyLink &link) : _link(link) {}
+
+  bool registered = false;
+  bool established = false;               // the ACK for our 200 OK arrived
+
+  void receive(const std::string &text, uint32_t now) {
+    SipMessage m;
+    CHECK(m.Parse(text.data(), text.size()));
+    std::string key = header(m, SipMessage::H_CALL_ID) + "/" + std::to_string(m.CSeqNumber());
+    switch ( m.GetMethod() )
+    {
+      case SipMessage::M_REGISTER:
+        if ( text.find("\r\nAuthorization: Digest") == std::string::npos )
+          send(response(m, 401, "Unauthorized", "WWW-Authenticate: Digest realm=\"pbx\", nonce=\"r1\", qop=\"auth\"\r\n"));
+        else
+        {
+          send(response(m, 200, "OK", "Expires: 3600\r\n"));
+          registered = true;
+        }
+        break;
+
+      case SipMessage::M_INVITE:
+      {
+        auto it = _finals.find(key);
+        if ( it != _finals.end() )                  // a retransmission: the last response again
+        {
+          send(it->second.text);
+          break;
+        }
+        Final f;
+        if ( text.find("\r\nProxy-Authorization: Digest") == std::string::npos )
+          f.text = response(m, 407, "Proxy Authentication Required",
+                            "Proxy-Authenticate: Digest realm=\"pbx\", nonce=\"i1\", qop=\"auth\"\r\n");
+        else
+        {
+          send(response(m, 100, "Trying"));
+          f.text = response(m, 200, "OK", "Contact: <sip:100@10.0.0.1:5060>\r\n", true);
+          f.answer = true;
+        }
+        f.interval = T1;
+        f.resendAt = now + T1;
+        f.giveUpAt = now + 64 * T1;
+        send(f.text);
+        _finals[key] = f;
+        break;
+      }
+
+      case SipMessage::M_ACK:
+      {
+        auto it = _finals.find(key);
+        if ( it != _finals.end() )
+        {
+          it->second.acked = true;
+          established |= it->second.answer;
+        }
+        break;
+      }
+
+      default:
+        break;
+    }
+  }
+
+  // Timer G: INVITE finals go out again, doubling up to T2, until ACKed or 64*T1 passed
+  void tick(uint32_t now) {
+    for ( auto &kv : _finals )
+    {
+      Final &f = kv.second;
+      if ( f.acked || now >= f.giveUpAt || now < f.resendAt ) continue;
+      send(f.text);
+      f.interval = std::min(f.interval * 2, T2);
+      f.resendAt = now + f.interval;
+    }
+  }
+
+private:
+  struct Final {
+    std::string text;
+    bool        answer = false, acked = false;
+    uint32_t    interval = 0, resendAt = 0, giveUpAt = 0;
+  };
+
+  LossyLink                   &_link;
+  std::map<std::string, Final> _finals;
+
+  void send(const std::string &text) {
+    if ( !_link.drop() ) host::deliver(LOCAL_PORT, text);
+  }
+
+  static std::string response(const SipMessage &req, int code, const char *reason, const char *extra = "",
+                              bool sdp = false) {
+    std::string to = header(req, SipMessage::H_TO);
+    if ( code > 100 && to.find("tag=") == std::string::npos ) to += ";tag=srv1";
+    std::string body = sdp ? "v=0\r\no=- 1 1 IN IP4 10.0.0.1\r\ns=-\r\nc=IN IP4 10.0.0.1\r\nt=0 0\r\n"
+                             "m=audio 17000 RTP/AVP 0\r\na=rtpmap:0 PCMU/8000\r\na=ptime:20\r\n" : "";
+    return "SIP/2.0 " + std::to_string(code) + " " + reason + "\r\n"
+         + "Via: " + header(req, SipMessage::H_VIA) + "\r\n"
+         + "From: " + header(req, SipMessage::H_FROM) + "\r\n"
+         + "To: " + to + "\r\n"
+         + "Call-ID: " + header(req, SipMessage::H_CALL_ID) + "\r\n"
+         + "CSeq: " + header(req, SipMessage::H_CSEQ) + "\r\n"
+         + extra
+         + (sdp ? "Content-Type: application/sdp\r\n" : "")
+         + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+};
+
+struct Result {
+  bool     registered, inCall;
+  uint32_t setupMs;
+  uint32_t retransmissions;
+  uint32_t datagrams, dropped;
+};
+
+// One call: REGISTER and INVITE at once, as the sketch does after Wi-Fi comes up, for at most two minutes
+static Result call(double loss, uint32_t seed) {
+  host::reset();
+  host::resetNet();
+  LossyLink link(loss, seed);
+  Server server(link);
+  static Sip *sip = nullptr;
+  delete sip;
+  sip = new Sip(outBuf, sizeof(outBuf));
+  sip->Init(SERVER, SERVER_PORT, "10.0.0.2", LOCAL_PORT, "1001", "secret");
+
+  Sdp::Media local;
+  Sdp::Clear(local);
+  strcpy(local.address, "10.0.0.2");
+  local.port = 4000;
+  Sdp::Add(local, 0, Sdp::CODEC_PCMU);
+  local.ptime = 20;
+  sip->SetLocalMedia(local);
+  static char sdp[320];
+  SipBuilder offer(sdp, sizeof(sdp));
+  CHECK(Sdp::Write(offer, local, "test"));
+
+  sip->Register();
+  sip->Dial("100", "Test", sdp, offer.Length());
+  uint32_t registerAt = 0;
+  Result r = {};
+  for ( uint32_t now = 0; now < 120000 && !(server.registered && server.established && sip->IsInCall()); now += 10 )
+  {
+    sip->Processing(inBuf, sizeof(inBuf));
+    for ( const HostDatagram &d : host::sent() )
+    {
+      CHECK(d.address == SERVER && d.port == SERVER_PORT);
+      if ( !link.drop() ) server.receive(d.data, now);
+    }
+    host::sent().clear();
+    server.tick(now);
+
+    if ( sip->PollRegisterTimeout() ) registerAt = now + 5000;
+    if ( registerAt && now >= registerAt )
+    {
+      sip->Register();
+      registerAt = 0;
+    }
+    if ( sip->PollDialTimeout() ) sip->Dial("100", "Test", sdp, offer.Length());
+    r.setupMs = now;
+    host::advanceMs(10);
+  }
+  r.registered = server.registered;
+  r.inCall = server.established && sip->IsInCall();
+  r.retransmissions = sip->Retransmissions();
+  r.datagrams = link.datagrams;
+  r.dropped = link.dropped;
+  return r;
+}
+
+static void testClean() {
+  Result r = call(0, 1);
+  CHECK(r.registered && r.inCall);
+  CHECK(r.setupMs <= 30);                           // a few Processing() passes, no timer involved
+  CHECK_EQ(r.retransmissions, 0);
+}
+
+static void testLossy(double loss, int runs) {
+  std::vector<uint32_t> setup;
+  int ok = 0;
+  uint64_t resent = 0, datagrams = 0, dropped = 0;
+  for ( int i = 0; i < runs; i++ )
+  {
+    Result r = call(loss, 1000 + i);
+    ok += r.registered && r.inCall;
+    resent += r.retransmissions;
+    datagrams += r.datagrams;
+    dropped += r.dropped;
+    setup.push_back(r.setupMs);
+  }
+  std::sort(setup.begin(), setup.end());
+  printf("  %2.0f%% loss (%u of %u datagrams dropped): %d/%d calls set up, setup p50 %.1f s, p99 %.1f s, "
+         "%.1f retransmissions per call\n", loss * 100, (unsigned)dropped, (unsigned)datagrams, ok, runs,
+         setup[runs / 2] / 1000.0, setup[runs * 99 / 100] / 1000.0, (double)resent / runs);
+  CHECK_EQ(ok, runs);
+  CHECK_NEAR((double)dropped / datagrams, loss, 0.02);
+}
+
+int main() {
+  testClean();
+  testLossy(0.2, 300);
+  return host::finish("test_sip_lossy");
+}
@@ -0,0 +1,252 @@
+/*
+ * test_sip_message.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * SipMessage on the host: start line classification, the header index with compact forms and any letter case,
+ * parameters (quoted strings included), URIs, CSeq and the body, over the corpus and over hand-made edge cases, and
+ * that malformed text is refused rather than half indexed.
+ */
+#include "HostTest.h"
+#include "SipMessage.h"
+#include "SipCorpus.h"
+#include <string.h>
+#include <string>
+
+static bool parse(SipMessage &m, const char *text) { return m.Parse(text, strlen(text)); }
+
+static std::string value(const SipMessage &m, SipMessage::Header h) {
+  size_t len = 0;
+  const char *v = m.Value(h, len);
+  return v ? std::string(v, len) : std::string("<none>");
+}
+
+static std::string param(const SipMessage &m, SipMessage::Header h, const char *name) {
+  char buf[64];
+  return m.Param(h, name, buf, sizeof(buf)) ? std::string(buf) : std::string("<none>");
+}
+
+static std::string uri(const SipMessage &m, SipMessage::Header h) {
+  char buf[64];
+  return m.Uri(h, buf, sizeof(buf)) ? std::string(buf) : std::string("<none>");
+}
+
+// Every corpus message parses; the handlers' lookups give what the text says
+static void testCorpus() {
+  SipMessage m;
+  for ( size_t i = 0; i < sipcorpus::COUNT; i++ )
+  {
+    CHECK(parse(m, sipcorpus::MESSAGES[i]));
+    CHECK(m.Has(SipMessage::H_VIA) && m.Has(SipMessage::H_CALL_ID) && m.Has(SipMessage::H_CSEQ));
+    CHECK(param(m, SipMessage::H_VIA, "branch").compare(0, 7, "z9hG4bK") == 0);
+  }
+
+  CHECK(parse(m, sipcorpus::MESSAGES[0]));
+  CHECK(!m.IsRequest());
+  CHECK_EQ(m.Status(), 401);
+  CHECK_EQ(m.CSeqNumber(), 1);
+  CHECK(m.CSeqMethod() == SipMessage::M_REGISTER);
+  CHECK(param(m, SipMessage::H_VIA, "branch") == "z9hG4bK0001234567");
+  CHECK(param(m, SipMessage::H_VIA, "rport") == "5060");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "realm") == "asterisk");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "nonce") == "1a2b3c4d");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "opaque") == "5e6f7a8b");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "qop") == "auth");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "algorithm") == "MD5");
+  CHECK(!m.Has(SipMessage::H_PROXY_AUTHENTICATE));
+
+  CHECK(parse(m, sipcorpus::MESSAGES[2]));
+  CHECK_EQ(m.Status(), 407);
+  CHECK(m.CSeqMethod() == SipMessage::M_INVITE);
+  CHECK(param(m, SipMessage::H_PROXY_AUTHENTICATE, "nonce") == "7c8d9e0f");
+  CHECK(uri(m, SipMessage::H_TO) == "sip:100@192.168.1.10");
+  CHECK(param(m, SipMessage::H_TO, "tag") == "as0b1c2d3e");
+  CHECK(uri(m, SipMessage::H_FROM) == "sip:1001@192.168.1.10");       // past the quoted display name
+  CHECK(param(m, SipMessage::H_FROM, "tag") == "0000333333");
+
+  CHECK(parse(m, sipcorpus::MESSAGES[4]));
+  CHECK_EQ(m.Status(), 200);
+  size_t len;
+  const char *body = m.Body(len);
+  CHECK(strncmp(body, "v=0\r\n", 5) == 0);
+  CHECK_EQ(len, strlen(body));
+  CHECK(value(m, SipMessage::H_CONTENT_TYPE) == "application/sdp");
+  CHECK_EQ(atoi(value(m, SipMessage::H_CONTENT_LENGTH).c_str()), len);
+
+  CHECK(parse(m, sipcorpus::MESSAGES[5]));
+  CHECK(m.IsRequest());
+  CHECK(m.GetMethod() == SipMessage::M_OPTIONS);
+  CHECK_EQ(m.Status(), 0);
+  CHECK_EQ(m.CSeqNumber(), 102);
+  CHECK(uri(m, SipMessage::H_TO) == "sip:1001@192.168.1.50:5060;transport=udp");
+  CHECK(param(m, SipMessage::H_TO, "tag") == "<none>");
+
+  CHECK(parse(m, sipcorpus::MESSAGES[6]));
+  CHECK(m.GetMethod() == SipMessage::M_INVITE);
+  CHECK(m.CSeqMethod() == SipMessage::M_INVITE);
+  m.Body(len);
+  CHECK_EQ(atoi(value(m, SipMessage::H_CONTENT_LENGTH).c_str()), len);
+
+  CHECK(parse(m, sipcorpus::MESSAGES[7]));
+  CHECK(m.GetMethod() == SipMessage::M_BYE);
+  CHECK(param(m, SipMessage::H_TO, "tag") == "4F2A9C1B");
+  m.Body(len);
+  CHECK_EQ(len, 0);
+}
+
+// Compact forms, any letter case, white space around the colon, LF-only line ends
+static void testHeaderForms() {
+  const char *text =
+    "SIP/2.0 180 Ringing\n"
+    "v: SIP/2.0/UDP 10.0.0.2:5070;branch=z9hG4bKabc\n"
+    "VIA: SIP/2.0/UDP 10.0.0.9:5060;branch=z9hG4bKproxy\n"
+    "f:<sip:a@x>;tag=1\n"
+    "t : <sip:b@x>;TAG=2\n"
+    "i:\tcall-1\n"
+    "cseq:   7   INVITE\n"
+    "m: <sip:b@10.0.0.1>\n"
+    "c: application/sdp\n"
+    "X-Unknown: ignored\n"
+    "expires: 60\n"
+    "l: 0\n"
+    "\n";
+  SipMessage m;
+  CHECK(parse(m, text));
+  CHECK_EQ(m.Status(), 180);
+  CHECK(param(m, SipMessage::H_VIA, "branch") == "z9hG4bKabc");       // the first Via is ours
+  CHECK(uri(m, SipMessage::H_FROM) == "sip:a@x");
+  CHECK(param(m, SipMessage::H_TO, "tag") == "2");                   // parameter names are case-insensitive
+  CHECK(value(m, SipMessage::H_CALL_ID) == "call-1");
+  CHECK_EQ(m.CSeqNumber(), 7);
+  CHECK(m.CSeqMethod() == SipMessage::M_INVITE);
+  CHECK(uri(m, SipMessage::H_CONTACT) == "sip:b@10.0.0.1");
+  CHECK(value(m, SipMessage::H_CONTENT_TYPE) == "application/sdp");
+  CHECK(value(m, SipMessage::H_EXPIRES) == "60");
+  CHECK(value(m, SipMessage::H_CONTENT_LENGTH) == "0");
+
+  size_t len;
+  const char *line = m.Line(SipMessage::H_TO, len);
+  CHECK(std::string(line, len) == "t : <sip:b@x>;TAG=2");              // copied into replies as received
+  CHECK(m.Line(SipMessage::H_WWW_AUTHENTICATE, len) == nullptr && len == 0);
+}
+
+// Quoted strings are skipped whole: a parameter inside a nonce is not a parameter
+static void testQuotedParams() {
+  const char *text =
+    "SIP/2.0 401 Unauthorized\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.2;branch=z9hG4bK1\r\n"
+    "CSeq: 1 REGISTER\r\n"
+    "WWW-Authenticate: Digest nonce=\"x, realm=fake; qop=none\", Realm=\"real\", qop=\"auth,auth-int\", stale=TRUE\r\n"
+    "\r\n";
+  SipMessage m;
+  CHECK(parse(m, text));
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "nonce") == "x, realm=fake; qop=none");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "realm") == "real");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "qop") == "auth,auth-int");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "stale") == "TRUE");
+  CHECK(param(m, SipMessage::H_WWW_AUTHENTICATE, "opaque") == "<none>");
+  char small[4];
+  CHECK(!m.Param(SipMessage::H_WWW_AUTHENTICATE, "realm", small, sizeof(small)));  // does not fit: refused, not cut
+}
+
+// addr-spec without brackets, and URIs that do not fit
+static void testUris() {
+  const char *text =
+    "BYE sip:1001@10.0.0.2 SIP/2.0\r\n"
+    "From: sip:100@10.0.0.1;tag=9\r\n"
+    "To: \"Me\" <sip:1001@10.0.0.2>\r\n"
+    "Contact: <>\r\n"
+    "CSeq: 3 BYE\r\n"
+    "\r\n";
+  SipMessage m;
+  CHECK(parse(m, text));
+  CHECK(m.GetMethod() == SipMessage::M_BYE);
+  CHECK(uri(m, SipMessage::H_FROM) == "sip:100@10.0.0.1");
+  CHECK(uri(m, SipMessage::H_TO) == "sip:1001@10.0.0.2");
+  CHECK(uri(m, SipMessage::H_CONTACT) == "<none>");                  // empty
+  CHECK(uri(m, SipMessage::H_VIA) == "<none>");                      // absent
+  char small[8];
+  CHECK(!m.Uri(SipMessage::H_TO, small, sizeof(small)));
+}
+
+static void testMethods() {
+  struct { const char *line; SipMessage::Method method; } cases[] = {
+    { "INVITE sip:a SIP/2.0\r\n\r\n",   SipMessage::M_INVITE },
+    { "ACK sip:a SIP/2.0\r\n\r\n",      SipMessage::M_ACK },
+    { "BYE sip:a SIP/2.0\r\n\r\n",      SipMessage::M_BYE },
+    { "CANCEL sip:a SIP/2.0\r\n\r\n",   SipMessage::M_CANCEL },
+    { "OPTIONS sip:a SIP/2.0\r\n\r\n",  SipMessage::M_OPTIONS },
+    { "REGISTER sip:a SIP/2.0\r\n\r\n", SipMessage::M_REGISTER },
+    { "INFO sip:a SIP/2.0\r\n\r\n",     SipMessage::M_INFO },
+    { "NOTIFY sip:a SIP/2.0\r\n\r\n",   SipMessage::M_NOTIFY },
+    { "MESSAGE sip:a SIP/2.0\r\n\r\n",  SipMessage::M_OTHER },
+    { "invite sip:a SIP/2.0\r\n\r\n",   SipMessage::M_OTHER },        // method names are case-sensitive
+  };
+  for ( auto &c : cases )
+  {
+    SipMessage m;
+    CHECK(parse(m, c.line));
+    CHECK(m.GetMethod() == c.method);
+    CHECK(m.IsRequest());
+  }
+}
+
+// Malformed text is refused and leaves nothing indexed
+static void testMalformed() {
+  const char *bad[] = {
+    "",
+    "SIP/2.0 200 OK",                              // no line end at all
+    "SIP/2.0 999 Nope\r\n\r\n",                    // status out of range
+    "SIP/2.0 0a0 OK\r\n\r\n",
+    " INVITE sip:a SIP/2.0\r\n\r\n",               // empty method
+    "INVITE\r\n\r\n",
+  };
+  for ( const char *text : bad )
+  {
+    SipMessage m;
+    CHECK(!parse(m, text));
+  }
+
+  std::string huge = "SIP/2.0 200 OK\r\nX: " + std::string(70000, 'a') + "\r\n\r\n";
+  SipMessage m;
+  CHECK(!m.Parse(huge.data(), huge.size()));
+  CHECK(!m.Has(SipMessage::H_VIA));
+
+  // A valid parse after a refused one starts from a clean index
+  CHECK(parse(m, sipcorpus::MESSAGES[3]));
+  CHECK(!parse(m, "garbage"));
+  CHECK_EQ(m.Status(), 0);
+  CHECK(!m.Has(SipMessage::H_VIA));
+  CHECK_EQ(m.CSeqNumber(), 0);
+}
+
+// No blank line: everything is headers and the body is empty; a second header of a kind does not replace the first
+static void testEdges() {
+  const char *text =
+    "SIP/2.0 200 OK\r\n"
+    "CSeq: 4 BYE\r\n"
+    "CSeq: 5 INVITE\r\n"
+    "Call-ID: last";
+  SipMessage m;
+  CHECK(parse(m, text));
+  CHECK_EQ(m.CSeqNumber(), 4);
+  CHECK(m.CSeqMethod() == SipMessage::M_BYE);
+  CHECK(value(m, SipMessage::H_CALL_ID) == "last");
+  size_t len;
+  m.Body(len);
+  CHECK_EQ(len, 0);
+
+  // The text is not copied: the index points into it
+  CHECK(m.Text() == text);
+}
+
+int main() {
+  testCorpus();
+  testHeaderForms();
+  testQuotedParams();
+  testUris();
+  testMethods();
+  testMalformed();
+  testEdges();
+  return host::finish("test_sip_message");
+}
@@ -0,0 +1,251 @@
+/*
+ * test_sip_transactions.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * ArduinoSIP client transactions (RFC 3261 17.1) against a scripted server on the UDP stub, on the simulated clock:
+ * Timer A/E retransmission and B/F timeouts, the ACK a non-2xx final response to INVITE gets from the transaction
+ * (once, and again for each duplicate), refused calls reported through PollDialFailure(), and Timer C, which cancels
+ * an INVITE that rings too long and still ACKs the 487 that ends it.
+ */
+#include "HostTest.h"
+#include "ArduinoSIP.h"
+#include <string>
+#include <vector>
+
+static const char    *SERVER     = "10.0.0.1";
+static const uint16_t SERVER_PORT = 5060;
+static const uint16_t LOCAL_PORT  = 5070;
+
+static char outBuf[1500], inBuf[1500];
+static std::vector<std::string> wire;          // everything the client sent, oldest first
+
+static void pump(Sip &sip, uint32_t ms) {
+  for ( uint32_t t = 0; t < ms; t += 10 )
+  {
+    sip.Processing(inBuf, sizeof(inBuf));
+    for ( const HostDatagram &d : host::sent() )
+    {
+      CHECK(d.address == SERVER && d.port == SERVER_PORT);
+      wire.push_back(d.data);
+    }
+    host::sent().clear();
+    host::advanceMs(10);
+  }
+}
+
+static std::string method(const std::string &msg) { return msg.substr(0, msg.find(' ')); }
+
+static size_t count(const char *m) {
+  size_t n = 0;
+  for ( const std::string &s : wire ) n += method(s) == m;
+  return n;
+}
+
+static const std::string &last(const char *m) {
+  for ( size_t i = wire.size(); i-- > 0; )
+    if ( method(wire[i]) == m ) return wire[i];
+  static std::string none;
+  return none;
+}
+
+static std::string header(const std::string &msg, SipMessage::Header h) {
+  SipMessage m;
+  size_t len = 0;
+  const char *v = m.Parse(msg.data(), msg.size()) ? m.Value(h, len) : 0;
+  return v ? std::string(v, len) : std::string();
+}
+
+static std::string branch(const std::string &msg) {
+  SipMessage m;
+  char b[32] = { 0 };
+  m.Parse(msg.data(), msg.size());
+  m.Param(SipMessage::H_VIA, "branch", b, sizeof(b));
+  return b;
+}
+
+// A response to 'req' as a server would send it; the To tag marks everything past 100 Trying
+static void respond(const std::string &req, int code, const char *reason, const char *extra = "") {
+  SipMessage m;
+  CHECK(m.Parse(req.data(), req.size()));
+  std::string to = header(req, SipMessage::H_TO);
+  if ( code > 100 && to.find("tag=") == std::string::npos ) to += ";tag=srv77";
+  std::string r = "SIP/2.0 " + std::to_string(code) + " " + reason + "\r\n"
+                + "Via: " + header(req, SipMessage::H_VIA) + "\r\n"
+                + "From: " + header(req, SipMessage::H_FROM) + "\r\n"
+                + "To: " + to + "\r\n"
+                + "Call-ID: " + header(req, SipMessage::H_CALL_ID) + "\r\n"
+                + "CSeq: " + header(req, SipMessage::H_CSEQ) + "\r\n"
+                + extra + "Content-Length: 0\r\n\r\n";
+  host::deliver(LOCAL_PORT, r);
+}
+
+static Sip &start() {
+  host::reset();
+  host::resetNet();
+  wire.clear();
+  static Sip *sip = nullptr;
+  delete sip;
+  sip = new Sip(outBuf, sizeof(outBuf));
+  sip->Init(SERVER, SERVER_PORT, "10.0.0.2", LOCAL_PORT, "alice", "secret");
+  return *sip;
+}
+
+static Sip &dial() {
+  Sip &sip = start();
+  static const char sdp[] = "v=0\r\n";
+  CHECK(sip.Dial("100", "Test", sdp, sizeof(sdp) - 1));
+  pump(sip, 10);
+  CHECK_EQ(count("INVITE"), 1);
+  return sip;
+}
+
+// Unanswered INVITE: Timer A doubles from T1 without a cap, Timer B gives up after 64*T1
+static void testInviteTimeout() {
+  Sip &sip = dial();
+  pump(sip, 31400);
+  CHECK_EQ(count("INVITE"), 6);                     // sent at 0, then 0.5, 1.5, 3.5, 7.5, 15.5 s
+  CHECK(!sip.PollDialTimeout());
+  pump(sip, 200);
+  CHECK_EQ(count("INVITE"), 7);                     // 31.5 s
+  pump(sip, 600);
+  CHECK(sip.PollDialTimeout());
+  CHECK(!sip.PollDialTimeout());
+  CHECK(!sip.IsBusy());
+  pump(sip, 60000);
+  CHECK_EQ(count("INVITE"), 7);
+}
+
+// Unanswered REGISTER: Timer E is capped at T2, Timer F reports it
+static void testRegisterTimeout() {
+  Sip &sip = start();
+  CHECK(sip.Register());
+  pump(sip, 32100);
+  CHECK_EQ(count("REGISTER"), 11);                  // 0, 0.5, 1.5, 3.5, then every 4 s up to 31.5 s
+  CHECK(sip.PollRegisterTimeout());
+  CHECK(!sip.PollDialTimeout());
+  CHECK_EQ(sip.Retransmissions(), 10);
+}
+
+// 486 to INVITE: the transaction ACKs it on entering Completed and each duplicate again, the call is reported
+// refused once, and no INVITE follows
+static void testRefused() {
+  Sip &sip = dial();
+  std::string invite = wire.back();
+  respond(invite, 100, "Trying");
+  respond(invite, 486, "Busy Here");
+  pump(sip, 20);
+  CHECK_EQ(count("ACK"), 1);
+  const std::string &ack = last("ACK");
+  CHECK(ack.compare(0, 24, "ACK sip:100@10.0.0.1 SIP") == 0);
+  CHECK(branch(ack) == branch(invite));             // 17.1.1.3: the ACK is part of the INVITE transaction
+  CHECK(header(ack, SipMessage::H_CSEQ) == "1 ACK");
+  CHECK(header(ack, SipMessage::H_TO).find("tag=srv77") != std::string::npos);
+  CHECK_EQ(sip.PollDialFailure(), 486);
+  CHECK_EQ(sip.PollDialFailure(), 0);
+  CHECK(!sip.IsBusy());
+
+  respond(invite, 486, "Busy Here");                // the ACK was lost
+  pump(sip, 20);
+  CHECK_EQ(count("ACK"), 2);
+  CHECK_EQ(sip.PollDialFailure(), 0);               // absorbed by the transaction
+  pump(sip, 40000);
+  CHECK_EQ(count("INVITE"), 1);
+  CHECK(!sip.PollDialTimeout());
+}
+
+// 401 to INVITE: one ACK from the transaction, then the INVITE again with credentials
+static void testChallenge() {
+  Sip &sip = dial();
+  std::string invite = wire.back();
+  respond(invite, 401, "Unauthorized", "WWW-Authenticate: Digest realm=\"pbx\", nonce=\"n1\", qop=\"auth\"\r\n");
+  pump(sip, 20);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK_EQ(count("INVITE"), 2);
+  CHECK(method(wire[wire.size() - 2]) == "ACK");    // the ACK goes out before the new INVITE
+  const std::string &again = last("INVITE");
+  CHECK(header(again, SipMessage::H_CSEQ) == "2 INVITE");
+  CHECK(again.find("Authorization: Digest username=\"alice\"") != std::string::npos);
+  CHECK(branch(again) != branch(invite));
+  CHECK_EQ(sip.PollDialFailure(), 0);
+  CHECK(sip.IsBusy());
+}
+
+// Ringing: no retransmission once a 1xx is heard; each 1xx restarts Timer C; on expiry the dial times out, a
+// CANCEL matching the INVITE goes out and the 487 that follows is still ACKed
+static void testTimerC() {
+  Sip &sip = dial();
+  std::string invite = wire.back();
+  respond(invite, 180, "Ringing");
+  pump(sip, 100000);
+  respond(invite, 180, "Ringing");
+  pump(sip, 179000);
+  CHECK_EQ(count("INVITE"), 1);
+  CHECK_EQ(count("CANCEL"), 0);
+  CHECK(!sip.PollDialTimeout());
+  pump(sip, 1100);
+
+  CHECK_EQ(count("CANCEL"), 1);
+  CHECK(sip.PollDialTimeout());
+  CHECK(!sip.IsBusy());
+  const std::string &cancel = last("CANCEL");
+  CHECK(cancel.compare(0, 27, "CANCEL sip:100@10.0.0.1 SIP") == 0);
+  CHECK(branch(cancel) == branch(invite));
+  CHECK(header(cancel, SipMessage::H_CSEQ) == "1 CANCEL");
+  CHECK(header(cancel, SipMessage::H_CALL_ID) == header(invite, SipMessage::H_CALL_ID));
+  CHECK(header(cancel, SipMessage::H_FROM) == header(invite, SipMessage::H_FROM));
+  CHECK(header(cancel, SipMessage::H_TO) == header(invite, SipMessage::H_TO));
+
+  respond(cancel, 200, "OK");
+  respond(invite, 487, "Request Terminated");
+  pump(sip, 20);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK(branch(last("ACK")) == branch(invite));
+  CHECK_EQ(sip.PollDialFailure(), 0);               // already reported as a timeout
+  pump(sip, 60000);
+  CHECK_EQ(count("CANCEL"), 1);
+  CHECK(!sip.PollDialTimeout());
+}
+
+// The CANCEL goes unanswered: it is retransmitted, the INVITE transaction is released after 64*T1 and nothing is
+// reported twice
+static void testTimerCNoFinal() {
+  Sip &sip = dial();
+  respond(wire.back(), 180, "Ringing");
+  pump(sip, 180100);
+  CHECK(sip.PollDialTimeout());
+  pump(sip, 40000);
+  CHECK_EQ(count("CANCEL"), 11);
+  CHECK(!sip.PollDialTimeout());
+  CHECK_EQ(count("INVITE"), 1);
+}
+
+// The callee answers as the CANCEL crosses it: the 2xx is confirmed and the call ended with BYE at once
+static void testTimerCAnswered() {
+  Sip &sip = dial();
+  std::string invite = wire.back();
+  respond(invite, 180, "Ringing");
+  pump(sip, 180100);
+  CHECK_EQ(count("CANCEL"), 1);
+  respond(invite, 200, "OK");
+  pump(sip, 20);
+  CHECK_EQ(count("ACK"), 1);
+  CHECK_EQ(count("BYE"), 1);
+  CHECK(!sip.IsInCall());
+  respond(invite, 200, "OK");                       // retransmitted until the ACK arrives
+  pump(sip, 20);
+  CHECK_EQ(count("ACK"), 2);
+  CHECK_EQ(count("BYE"), 1);
+  CHECK(!sip.IsInCall());
+}
+
+int main() {
+  testInviteTimeout();
+  testRegisterTimeout();
+  testRefused();
+  testChallenge();
+  testTimerC();
+  testTimerCNoFinal();
+  testTimerCAnswered();
+  return host::finish("test_sip_transactions");
+}
@@ -0,0 +1,186 @@
+/*
+ * test_spsc.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * SPSCQueue on the host: full/empty edges on one thread, then a producer and a consumer pthread hammering small
+ * rings with every access style (copying, zero copy, batches) for a few million items. Each item carries its
+ * sequence number and a payload derived from it, so a lost, repeated, reordered or torn item is caught. A side that
+ * finds the ring full or empty yields, so the test also makes progress on a single core. 'make tsan' runs it under
+ * ThreadSanitizer to have the memory ordering checked as well.
+ */
+#include "HostTest.h"
+#include "SPSCQueue.h"
+#include <pthread.h>
+#include <sched.h>
+
+static const uint32_t ITEMS = 2000000;
+
+// Big enough that a torn copy would show: every word is a function of the sequence number
+struct Item {
+  uint32_t seq;
+  uint32_t words[15];
+  void fill(uint32_t s) {
+    seq = s;
+    for (int i = 0; i < 15; ++i) words[i] = s * 2654435761u + i;
+  }
+  bool intact() const {
+    for (int i = 0; i < 15; ++i) if (words[i] != seq * 2654435761u + i) return false;
+    return true;
+  }
+};
+
+enum class Style { Copy, ZeroCopy, Batch };
+
+template <size_t N>
+struct Run {
+  SPSCQueue<Item, N> q;
+  Style              style;
+  uint32_t           received = 0, bad = 0, outOfOrder = 0, oversize = 0;
+};
+
+template <size_t N>
+static void* producer(void* arg) {
+  Run<N>& run = *(Run<N>*)arg;
+  uint32_t next = 0;
+  Item batch[5];
+  while (next < ITEMS) {
+    switch (run.style) {
+      case Style::Copy: {
+        Item it;
+        it.fill(next);
+        if (run.q.push(it)) next++;
+        else sched_yield();
+        break;
+      }
+      case Style::ZeroCopy: {
+        Item* slot = run.q.reserve();
+        if (!slot) {
+          sched_yield();
+          break;
+        }
+        slot->fill(next++);
+        run.q.commit();
+        break;
+      }
+      case Style::Batch: {
+        size_t n = 1 + next % 5;
+        if (n > ITEMS - next) n = ITEMS - next;
+        for (size_t i = 0; i < n; ++i) batch[i].fill(next + (uint32_t)i);
+        size_t pushed = run.q.push(batch, n);          // a partial push is resent from where it stopped
+        if (pushed == 0) sched_yield();
+        next += (uint32_t)pushed;
+        break;
+      }
+    }
+    if (run.q.size() > N) run.oversize++;
+  }
+  return nullptr;
+}
+
+template <size_t N>
+static void* consumer(void* arg) {
+  Run<N>& run = *(Run<N>*)arg;
+  Item batch[7];
+  auto check = [&](const Item& it) {
+    if (!it.intact()) run.bad++;
+    if (it.seq != run.received) run.outOfOrder++;
+    run.received++;
+  };
+  while (run.received < ITEMS) {
+    switch (run.style) {
+      case Style::Copy: {
+        Item it;
+        if (run.q.pop(it)) check(it);
+        else sched_yield();
+        break;
+      }
+      case Style::ZeroCopy: {
+        const Item* slot = run.q.front();
+        if (!slot) {
+          sched_yield();
+          break;
+        }
+        check(*slot);
+        run.q.release();
+        break;
+      }
+      case Style::Batch: {
+        size_t n = run.q.pop(batch, 1 + run.received % 7);
+        if (n == 0) sched_yield();
+        for (size_t i = 0; i < n; ++i) check(batch[i]);
+        break;
+      }
+    }
+    if (run.q.size() > N) run.oversize++;
+  }
+  return nullptr;
+}
+
+template <size_t N>
+static void stress(Style style, const char* name) {
+  static Run<N> run;
+  run.style = style;
+  run.received = run.bad = run.outOfOrder = run.oversize = 0;
+  pthread_t prod, cons;
+  uint64_t t0 = host::wallNs();
+  CHECK_EQ(pthread_create(&cons, nullptr, consumer<N>, &run), 0);
+  CHECK_EQ(pthread_create(&prod, nullptr, producer<N>, &run), 0);
+  pthread_join(prod, nullptr);
+  pthread_join(cons, nullptr);
+  double ms = (host::wallNs() - t0) / 1e6;
+  printf("  %-9s N=%-3zu %u items in %.0f ms\n", name, N, run.received, ms);
+  CHECK_EQ(run.received, ITEMS);
+  CHECK_EQ(run.bad, 0);
+  CHECK_EQ(run.outOfOrder, 0);
+  CHECK_EQ(run.oversize, 0);
+  CHECK(run.q.empty());
+}
+
+// One thread: the edges, where an off-by-one would hide under load
+static void testEdges() {
+  SPSCQueue<int, 4> q;
+  int v;
+  CHECK(q.empty());
+  CHECK(!q.pop(v));
+  CHECK(q.front() == nullptr);
+  for (int i = 0; i < 4; ++i) CHECK(q.push(i));
+  CHECK(!q.push(4));
+  CHECK(q.reserve() == nullptr);
+  CHECK_EQ(q.size(), 4);
+  CHECK(q.pop(v) && v == 0);
+  CHECK(q.push(4));
+
+  int out[8];
+  CHECK_EQ(q.pop(out, 8), 4);
+  CHECK(out[0] == 1 && out[3] == 4);
+  const int in[6] = { 10, 11, 12, 13, 14, 15 };
+  CHECK_EQ(q.push(in, 6), 4);                        // only what fits
+  CHECK_EQ(q.pop(out, 2), 2);
+  CHECK_EQ(q.push(in + 4, 2), 2);
+  CHECK_EQ(q.pop(out, 8), 4);
+  CHECK(out[0] == 12 && out[1] == 13 && out[2] == 14 && out[3] == 15);
+
+  // reserve() hands out the same slot until it is committed
+  int* a = q.reserve();
+  CHECK(a != nullptr && a == q.reserve());
+  *a = 42;
+  CHECK(q.empty());
+  q.commit();
+  const int* f = q.front();
+  CHECK(f && *f == 42);
+  CHECK(f == q.front());
+  q.release();
+  CHECK(q.empty());
+}
+
+int main() {
+  testEdges();
+  stress<2>(Style::Copy, "copy");
+  stress<16>(Style::Copy, "copy");
+  stress<4>(Style::ZeroCopy, "zero-copy");
+  stress<64>(Style::ZeroCopy, "zero-copy");
+  stress<8>(Style::Batch, "batch");
+  stress<32>(Style::Batch, "batch");
+  return host::finish("test_spsc");
+}
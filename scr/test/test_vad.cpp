@@ -0,0 +1,215 @@
+/*
+ * test_vad.cpp
+ * Licensed under the GNU General Public License v3.0
+ * (c) 2025 Hugo Schroeder
+
+ * VoiceActivityDetector and DTX on the host, over a conversation-like signal: phrases of 1-3 s separated by 0.5-2 s
+ * pauses, with ventilation noise underneath, and end to end through RTPInput also a two-way call taken in turns.
+ * Measures what DTX is for and what it must not cost: the packets saved, and speech frames that are not sent
+ * (clipping), both at the detector and end to end.
+ */
+#include "HostTest.h"
+#include "RTPInput.h"
+#include "Signals.h"
+#include <algorithm>
+#include <vector>
+
+static const size_t   FRAME    = 160;
+static const uint16_t RTP_PORT = 5004;
+static const double   PEAK     = 9000;
+
+struct Frame {
+  bool talking;               // the talker is in a phrase
+  bool voiced;                // and this frame carries speech, not a gap between syllables
+};
+
+struct Stats {
+  size_t frames = 0, talking = 0, voiced = 0, sent = 0, clipped = 0, onsets = 0, onsetFrames = 0, worstOnset = 0;
+  double activity() const { return (double)sent / frames; }
+  double clipping() const { return (double)clipped / voiced; }
+};
+
+// 8 kHz frames of the conversation, with the truth about each
+class Conversation {
+public:
+  Conversation(double noiseRms, uint32_t seed)
+    : _talker(8000, PEAK, true, seed), _hvac(8000, noiseRms, seed + 1), _audible(std::max(PEAK / 100, noiseRms)) {}
+
+  Frame next(int16_t* pcm) {
+    double e = 0;
+    for (size_t i = 0; i < FRAME; ++i) {
+      double s = _talker.next();
+      e += s * s;
+      pcm[i] = signals::toPcm(s + _hvac.next());
+    }
+    return { _talker.talking(), sqrt(e / FRAME) > _audible };
+  }
+
+private:
+  signals::Speech    _talker;
+  signals::HvacNoise _hvac;
+  double             _audible;         // speech within 40 dB of the peak and above the noise
+};
+
+// Runs the detector on 'seconds' of conversation; the first 2 s only train the noise floor
+static Stats detect(double noiseRms, int seconds, uint32_t seed) {
+  Conversation talk(noiseRms, seed);
+  VoiceActivityDetector vad;
+  Stats st;
+  int16_t pcm[FRAME];
+  bool wasTalking = false;
+  int  onset = -2;                  // -1 waiting for speech in a new phrase, then frames until it is sent
+  for (int f = 0; f < seconds * 50; ++f) {
+    Frame fr = talk.next(pcm);
+    bool active = vad.process(pcm, FRAME);
+    if (f < 100) {
+      wasTalking = fr.talking;
+      continue;
+    }
+    st.frames++;
+    st.talking += fr.talking;
+    st.voiced += fr.voiced;
+    st.sent += active;
+    if (fr.voiced && !active) st.clipped++;
+
+    // Onset: frames from the first audible one of a phrase until the detector lets speech through
+    if (fr.talking && !wasTalking) onset = -1;
+    if (onset == -1 && fr.voiced) onset = 0;
+    if (onset >= 0) {
+      if (active) {
+        st.onsets++;
+        st.onsetFrames += onset;
+        st.worstOnset = std::max(st.worstOnset, (size_t)onset);
+        onset = -2;
+      } else {
+        onset++;
+      }
+    }
+    wasTalking = fr.talking;
+  }
+  return st;
+}
+
+static void testDetector() {
+  const double levels[] = { 30, 150, 600 };            // quiet office, ventilation, loud fan; speech about 60 dB SPL
+  for (double level : levels) {
+    Stats st = detect(level, 120, 7);
+    printf("  noise %4.0f rms: talking %.0f%% of the time, sent %.0f%%, clipped %.2f%% of speech, "
+           "onsets %.2f frames late on average, %zu at worst\n", level, 100.0 * st.talking / st.frames,
+           100 * st.activity(), 100 * st.clipping(), (double)st.onsetFrames / st.onsets, st.worstOnset);
+    CHECK(st.clipping() < 0.01);
+    CHECK(st.onsets > 30);
+    CHECK(st.onsetFrames < st.onsets);                  // under one frame late on average
+    CHECK(st.worstOnset <= 5);
+    CHECK(st.activity() < (double)st.talking / st.frames + 0.1);       // pauses go quiet, bar the hangover
+  }
+}
+
+// Noise alone: after the floor settles nothing is speech
+static void testNoiseOnly() {
+  VoiceActivityDetector vad;
+  signals::HvacNoise hvac(8000, 300);
+  int16_t pcm[FRAME];
+  int active = 0;
+  for (int f = 0; f < 50 * 30; ++f) {
+    for (size_t i = 0; i < FRAME; ++i) pcm[i] = signals::toPcm(hvac.next());
+    if (vad.process(pcm, FRAME) && f >= 50) active++;
+  }
+  CHECK_EQ(active, 0);
+}
+
+// End to end: the mic sees a talker at 16 kHz over ventilation noise, the network sees voice, comfort noise and
+// nothing. Against one packet per block DTX can at best save the pauses less the hangover at the end of each phrase.
+struct Link {
+  size_t blocks = 0, pauses = 0, voiced = 0, clipped = 0, voice = 0, cn = 0, bytes = 0, spurts = 0;
+  double pauseShare() const   { return (double)pauses / blocks; }
+  double packetSaving() const { return 1.0 - (double)(voice + cn) / blocks; }
+  double byteSaving() const   { return 1.0 - (double)bytes / (blocks * (RTP_HEADER_SIZE + FRAME)); }
+  double clipping() const     { return (double)clipped / voiced; }
+};
+
+template <typename Talker>
+static Link send(Talker& talker, int seconds) {
+  signals::HvacNoise hvac(16000, 150, 8);
+  const double audible = std::max(PEAK / 100, 150.0);
+  bool talking = false;
+  double energy = 0;
+  host::reset();
+  host::resetNet();
+  host::resetI2S();
+  host::i2s(0).read = [&](uint8_t* data, size_t len) {
+    int32_t* raw = (int32_t*)data;
+    talking = false;
+    energy  = 0;
+    for (size_t i = 0; i < len / 4; ++i) {
+      double s = talker.next();
+      energy += s * s;
+      raw[i] = signals::toI2S(s + hvac.next());
+      talking |= talker.talking();
+    }
+    energy /= len / 4;
+    return len;
+  };
+
+  RTPInput in("", "");
+  CHECK(in.begin(IPAddress(10, 0, 0, 33), RTP_PORT, 1, 2, 3));
+  host::sent().clear();
+  Link link;
+  bool sending = false;
+  for (int b = 0; b < seconds * 50; ++b) {
+    size_t before = in.voiceBlocks();
+    in.update();
+    link.spurts += sending && in.voiceBlocks() == before;
+    sending = in.voiceBlocks() != before;
+    link.blocks++;
+    link.pauses += !talking;
+    if (b >= 100 && sqrt(energy) > audible) {           // the first 2 s train the noise floor
+      link.voiced++;
+      link.clipped += in.voiceBlocks() == before;
+    }
+    for (const HostDatagram& d : host::sent()) {
+      RTPPacket pkt = {};
+      CHECK(RTPOverUDP::parse((const uint8_t*)d.data.data(), d.data.size(), pkt));
+      if (pkt.payloadType == RTPPacketizer::CN_PAYLOAD_TYPE) link.cn++;
+      else link.voice++;
+      link.bytes += d.data.size();
+    }
+    host::sent().clear();
+  }
+  CHECK_EQ(in.voiceBlocks(), link.voice);
+  CHECK(link.cn <= link.spurts + (link.blocks - link.voice) / 25);   // one as each pause starts, then a couple a second
+  return link;
+}
+
+static void report(const char* name, const Link& link) {
+  printf("  RTPInput, %s: %.0f%% pauses, %zu voice and %zu comfort noise packets for %zu blocks, %.0f%% fewer "
+         "packets, %.0f%% fewer bytes, clipped %.2f%% of speech\n", name, 100 * link.pauseShare(), link.voice, link.cn,
+         link.blocks, 100 * link.packetSaving(), 100 * link.byteSaving(), 100 * link.clipping());
+}
+
+// One talker in phrases of 1-3 s with 0.5-2 s pauses: the 250 ms hangover takes about a fifth of each pause
+static void testPackets() {
+  signals::Speech talker(16000, PEAK, true, 7);
+  Link link = send(talker, 120);
+  report("2 min of phrases", link);
+  CHECK(link.packetSaving() > 0.7 * link.pauseShare());
+  CHECK(link.clipping() < 0.01);
+}
+
+// A two-way call: this side talks about 40% of the time, listens or sits idle for the rest
+static void testTurnTaking() {
+  signals::Turns talker(16000, PEAK, 7);
+  Link link = send(talker, 300);
+  report("5 min of turn taking", link);
+  CHECK(link.pauseShare() > 0.55 && link.pauseShare() < 0.65);
+  CHECK(link.packetSaving() > 0.5);
+  CHECK(link.clipping() < 0.01);
+}
+
+int main() {
+  testDetector();
+  testNoiseOnly();
+  testPackets();
+  testTurnTaking();
+  return host::finish("test_vad");
+}